@@ -0,0 +1,40 @@
+#ifndef BENCH_H
+#define BENCH_H 1
+
+// Host-side benchmarks for lyuba, see bench_lyuba.cpp for the scenario table
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+uint64_t bench_now_ns(void);
+// CPU timestamp counter where there is one (x86), otherwise 0
+uint64_t bench_cycles(void);
+// value of "--name N" from the command line, or def if absent
+long bench_opt_long(int argc, char **argv, const char *name, long def);
+// value of "--name S" from the command line, or def if absent
+const char *bench_opt_str(int argc, char **argv, const char *name, const char *def);
+
+// a realistic status JSON document, padded out by padding bytes of content
+std::string bench_make_status(unsigned long long id, size_t padding);
+// the same status framed as a Mastodon streaming API "update" event
+std::string bench_make_sse_update(unsigned long long id, size_t padding);
+// httpc_get_stats() totals and latency histograms, each line prefixed by name
+void bench_print_httpc_stats(const char *name);
+
+int bench_linebuffer(int argc, char **argv);
+int bench_json(int argc, char **argv);
+int bench_stream(int argc, char **argv);
+int bench_toot(int argc, char **argv);
+int bench_concurrent(int argc, char **argv);
+int bench_multistream(int argc, char **argv);
+int bench_resume(int argc, char **argv);
+int bench_reconnect(int argc, char **argv);
+int bench_ratelimit(int argc, char **argv);
+int bench_queue(int argc, char **argv);
+int bench_slots(int argc, char **argv);
+int bench_callbacks(int argc, char **argv);
+int bench_submit(int argc, char **argv);
+int bench_netdown(int argc, char **argv);
+
+#endif
@@ -0,0 +1,163 @@
+// Callback queue, a slow stream callback runs from lyuba_loop() and shouldn't hold up other requests on the
+// httpc task. Build with -DLYUBA_CALLBACK_QUEUE_SIZE=0 to compare against callbacks made on the httpc task.
+// Toots made meanwhile must get their results however full the stream keeps the queue.
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <Arduino.h>
+#include "bench.h"
+#include "lyuba.h"
+#include "mock_server.h"
+
+static std::atomic<long> delivered(0);
+static std::atomic<bool> streamFailed(false);
+static std::atomic<long> getsFailed(0);
+static std::atomic<long> tootsDone(0);
+static std::atomic<long> tootsOk(0);
+static std::mutex getsLock;
+static std::vector<uint64_t> getLatencies;
+static long slowUs;
+
+// runs from lyuba_loop(), or on the httpc task without the queue
+static void stream_cb(bool ok, const char *username, const char *content) {
+    if (!ok) {
+        streamFailed = true;
+        return;
+    }
+    usleep(slowUs);     // e.g. drawing it on a display
+    delivered++;
+}
+
+// runs from lyuba_loop()
+static void toot_cb(bool ok) {
+    tootsDone++;
+    tootsOk += ok ? 1 : 0;
+}
+
+// runs on the httpc task
+static httpc_err_t get_cb(httpc_err_t err, httpc_req_t *req, int status_code, const char *data, size_t len) {
+    uint64_t started = *(uint64_t *)req->userdata;
+
+    if (err != HTTPC_ERR_OK || status_code != 200) {
+        getsFailed++;
+    } else if (NULL != data) {
+        std::lock_guard<std::mutex> guard(getsLock);
+        getLatencies.push_back(bench_now_ns() - started);
+    }
+    return HTTPC_ERR_OK;
+}
+
+static double percentile_ms(std::vector<uint64_t> &v, double p) {
+    return v.empty() ? 0 : v[(size_t)(p * (v.size() - 1))] / 1e6;
+}
+
+int bench_callbacks(int argc, char **argv) {
+    mock_server_config_t cfg;
+    long every_ms = bench_opt_long(argc, argv, "--every", 20);
+    long timeout_s = bench_opt_long(argc, argv, "--timeout", 60);
+    const char *overflow = bench_opt_str(argc, argv, "--overflow", "drop");
+    long toots = bench_opt_long(argc, argv, "--toots", 10);
+    lyuba_callback_stats_t stats;
+    std::atomic<bool> stop(false);
+    std::vector<uint64_t> gets;
+    uint64_t start, deadline;
+    long issued = 0, tooted = 0;
+    char host[32];
+    lyuba_t *lyuba;
+    int lfd;
+    pid_t pid;
+
+    mock_server_config_init(&cfg);
+    cfg.rate = bench_opt_long(argc, argv, "--rate", 200);
+    cfg.count = bench_opt_long(argc, argv, "--count", 400);
+    cfg.padding = bench_opt_long(argc, argv, "--padding", 0);
+    slowUs = bench_opt_long(argc, argv, "--slow", 4000);
+    if (cfg.count <= 0 || every_ms <= 0 || slowUs < 0 || toots < 0 || (0 != strcmp(overflow, "wait") && 0 != strcmp(overflow, "drop"))) {
+        fprintf(stderr, "callbacks: --count and --every must be > 0, --slow and --toots >= 0, --overflow wait|drop\n");
+        return 1;
+    }
+
+    if ((lfd = mock_server_listen(0)) < 0) {
+        perror("callbacks setup");
+        return 1;
+    }
+    snprintf(host, sizeof(host), "127.0.0.1:%d", mock_server_port(lfd));
+    pid = mock_server_fork(lfd, &cfg);
+    close(lfd);
+
+    if (NULL == (lyuba = lyuba_init(host, NULL, NULL))) {
+        fprintf(stderr, "lyuba_init failed\n");
+        kill(pid, SIGTERM);
+        return 1;
+    }
+    lyuba->callsOverflow = 0 == strcmp(overflow, "drop") ? LYUBA_CALLBACK_DROP : LYUBA_CALLBACK_WAIT;
+    start = bench_now_ns();
+    lyuba_conn_t conn = lyuba_stream(lyuba, "Bearer mockaccesstoken", "public", stream_cb);
+
+    // small GETs on their own connection meanwhile, from another task
+    std::thread getter([&]() {
+        while (!stop) {
+            uint64_t now = bench_now_ns();
+            if (HTTPC_HANDLE_NONE == httpc_get(host, "/api/v1/timelines/public?limit=1", "Bearer mockaccesstoken", 4096, false, get_cb, &now, sizeof(now), false)) {
+                getsFailed++;
+            }
+            issued++;
+            delay(every_ms);
+        }
+    });
+
+    deadline = start + timeout_s * 1000000000ULL;
+    lyuba_callback_stats(lyuba, &stats);
+    while (delivered + (long)stats.dropped < cfg.count && !streamFailed && bench_now_ns() < deadline) {
+        // a toot every few statuses' worth of the stream, while it's flooding the queue
+        if (tooted < toots && delivered + (long)stats.dropped >= tooted * cfg.count / (toots + 1)) {
+            lyuba_toot(lyuba, "Bearer mockaccesstoken", "callbacks", toot_cb);
+            tooted++;
+        }
+        lyuba_loop(lyuba);
+        lyuba_callback_stats(lyuba, &stats);
+        delay(1);
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    while (tootsDone < tooted && bench_now_ns() < deadline) {
+        lyuba_loop(lyuba);
+        delay(1);
+    }
+    stop = true;
+    getter.join();
+    delay(every_ms);    // the last GET
+    lyuba_close(lyuba, conn);
+    lyuba_loop(lyuba);
+    lyuba_callback_stats(lyuba, &stats);
+    lyuba_term(lyuba);
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+
+    {
+        std::lock_guard<std::mutex> guard(getsLock);
+        gets = getLatencies;
+    }
+    std::sort(gets.begin(), gets.end());
+    printf("callbacks: %ld statuses at %ld/s, callback takes %.1f ms, %ld delivered in %.2f s%s\n",
+        cfg.count, cfg.rate, slowUs / 1000.0, delivered.load(), elapsed / 1e9, streamFailed ? " (stream failed)" : "");
+    printf("callbacks: %ld GETs every %ld ms alongside, %zu answered, %ld failed, latency p50 %.2f ms p99 %.2f ms max %.2f ms\n",
+        issued, every_ms, gets.size(), getsFailed.load(), percentile_ms(gets, 0.50), percentile_ms(gets, 0.99), percentile_ms(gets, 1.0));
+    printf("callbacks: %ld toots made meanwhile, %ld results delivered, %ld ok\n", tooted, tootsDone.load(), tootsOk.load());
+    if (stats.size > 0) {
+        printf("callbacks: queue %zu bytes, %s when full, high water %zu, %lu queued, %lu waits, %lu dropped\n",
+            stats.size, overflow, stats.highWater, stats.queued, stats.waits, stats.dropped);
+    } else {
+        printf("callbacks: built with LYUBA_CALLBACK_QUEUE_SIZE 0, callbacks made on the httpc task\n");
+    }
+    return (delivered + (long)stats.dropped == cfg.count && getsFailed == 0 && (long)gets.size() == issued && tootsDone == tooted) ? 0 : 1;
+}
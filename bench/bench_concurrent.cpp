@@ -0,0 +1,120 @@
+// Concurrency benchmark, many requests in flight through httpc alongside flooding streams
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include <Arduino.h>
+#include "bench.h"
+#include "httpc.h"
+#include "mock_server.h"
+
+static char host[32];
+static std::atomic<bool> running(false);
+static std::atomic<long> postsDone(0);
+static std::atomic<long> postsFailed(0);
+static std::atomic<long> linesSeen(0);
+static std::mutex latencyLock;
+static std::vector<uint64_t> latencies;
+
+static httpc_err_t post_cb(httpc_err_t err, httpc_req_t *req, int status_code, const char *data, size_t len);
+
+static bool post_start(void) {
+    uint64_t t0 = bench_now_ns();
+    return HTTPC_HANDLE_NONE != httpc_post(host, "/api/v1/statuses", "Bearer mockaccesstoken", "status=bench", 4096, false, post_cb, &t0, sizeof(t0));
+}
+
+// runs on the httpc task, keeps the number in flight constant by starting the next
+static httpc_err_t post_cb(httpc_err_t err, httpc_req_t *req, int status_code, const char *data, size_t len) {
+    uint64_t t0 = *(uint64_t *)req->userdata;
+    if (err != HTTPC_ERR_OK || status_code != 200) {
+        postsFailed++;
+    } else {
+        std::lock_guard<std::mutex> guard(latencyLock);
+        latencies.push_back(bench_now_ns() - t0);
+    }
+    postsDone++;
+    if (running && !post_start()) {
+        postsFailed++;
+    }
+    return HTTPC_ERR_OK;
+}
+
+static httpc_err_t stream_cb(httpc_err_t err, httpc_req_t *req, int status_code, const char *data, size_t len) {
+    if (err == HTTPC_ERR_OK && data != NULL && 0 == strncmp(data, "data:", 5)) {
+        linesSeen++;
+    }
+    return HTTPC_ERR_OK;
+}
+
+static double pct_ms(std::vector<uint64_t> &v, double p) {
+    if (v.empty()) {
+        return 0;
+    }
+    return v[(size_t)(p * (v.size() - 1))] / 1e6;
+}
+
+int bench_concurrent(int argc, char **argv) {
+    long inflight = bench_opt_long(argc, argv, "--inflight", 8);
+    long streams = bench_opt_long(argc, argv, "--streams", 1);
+    long seconds = bench_opt_long(argc, argv, "--seconds", 5);
+    std::vector<httpc_handle_t> streamReqs;
+    mock_server_config_t cfg;
+    uint64_t t0, t1;
+    int lfd;
+    pid_t pid;
+
+    mock_server_config_init(&cfg);
+    cfg.count = 0;  // streams flood until closed
+    cfg.padding = bench_opt_long(argc, argv, "--padding", 0);
+    if ((lfd = mock_server_listen(0)) < 0) {
+        perror("mock_server_listen");
+        return 1;
+    }
+    snprintf(host, sizeof(host), "127.0.0.1:%d", mock_server_port(lfd));
+    pid = mock_server_fork(lfd, &cfg);
+    close(lfd);
+
+    if (HTTPC_ERR_OK != httpc_init()) {
+        fprintf(stderr, "httpc_init failed\n");
+        kill(pid, SIGTERM);
+        return 1;
+    }
+    for (long i=0;i<streams;i++) {
+        streamReqs.push_back(httpc_get(host, "/api/v1/streaming/public", "Bearer mockaccesstoken", 16384, true, stream_cb, NULL, 0, true));
+    }
+    delay(100);     // let the streams get going
+
+    running = true;
+    t0 = bench_now_ns();
+    for (long i=0;i<inflight;i++) {
+        post_start();
+    }
+    delay(seconds * 1000);
+    running = false;
+    t1 = bench_now_ns();
+    long posts = postsDone.load();
+    long failed = postsFailed.load();   // before the server goes, taking in-flight requests with it
+    long lines = linesSeen.load();
+
+    for (size_t i=0;i<streamReqs.size();i++) {
+        httpc_close(streamReqs[i]);
+    }
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+
+    std::lock_guard<std::mutex> guard(latencyLock);
+    std::sort(latencies.begin(), latencies.end());
+    printf("concurrent: %ld posts in flight, %ld flooding streams, %ld s\n", inflight, streams, seconds);
+    printf("concurrent: %.0f posts/s, %ld failed, latency p50 %.2f ms p99 %.2f ms max %.2f ms\n",
+        posts / ((t1 - t0) / 1e9), failed, pct_ms(latencies, 0.5), pct_ms(latencies, 0.99), pct_ms(latencies, 1.0));
+    printf("concurrent: %.0f stream statuses/s alongside\n", lines / ((t1 - t0) / 1e9));
+    return posts > 0 && failed == 0 ? 0 : 1;
+}
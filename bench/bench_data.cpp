@@ -0,0 +1,60 @@
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#include "bench.h"
+
+// A status as delivered on /api/v1/streaming/public, with media, mentions,
+// tags, custom emoji and a preview card so the parser sees a realistic shape.
+// The id is patched by bench_make_status() so consecutive statuses differ.
+static const char *status_template =
+    "{\"id\":\"%s\",\"created_at\":\"2022-12-04T19:22:41.000Z\",\"in_reply_to_id\":null,"
+    "\"in_reply_to_account_id\":null,\"sensitive\":false,\"spoiler_text\":\"\",\"visibility\":\"public\","
+    "\"language\":\"en\",\"uri\":\"https://mastodon.example/users/sensorbot/statuses/%s\","
+    "\"url\":\"https://mastodon.example/@sensorbot/%s\",\"replies_count\":0,\"reblogs_count\":3,"
+    "\"favourites_count\":11,\"edited_at\":null,"
+    "\"content\":\"\\u003cp\\u003eLiving room is \\u003cstrong\\u003e21.5\\u00b0C\\u003c/strong\\u003e, "
+    "humidity 48%% \\ud83c\\udf21\\ufe0f \\u003cspan class=\\\"h-card\\\"\\u003e\\u003ca href=\\\"https://mastodon.example/@tobyjaffey\\\" "
+    "class=\\\"u-url mention\\\"\\u003e@\\u003cspan\\u003etobyjaffey\\u003c/span\\u003e\\u003c/a\\u003e\\u003c/span\\u003e "
+    "\\u003ca href=\\\"https://mastodon.example/tags/cheerlights\\\" class=\\\"mention hashtag\\\" rel=\\\"tag\\\"\\u003e#\\u003cspan\\u003echeerlights\\u003c/span\\u003e\\u003c/a\\u003e "
+    "\\\"quoted\\\" text with a backslash \\\\ and a tab\\t%s\\u003c/p\\u003e\","
+    "\"reblog\":null,\"application\":{\"name\":\"lyuba\",\"website\":\"http://github.com/ringtailsoftware/lyuba\"},"
+    "\"account\":{\"id\":\"109348567483019283\",\"username\":\"sensorbot\",\"acct\":\"sensorbot@mastodon.example\","
+    "\"display_name\":\"Sensor Bot :thermometer:\",\"locked\":false,\"bot\":true,\"discoverable\":true,\"group\":false,"
+    "\"created_at\":\"2022-11-13T00:00:00.000Z\",\"note\":\"\\u003cp\\u003eI post readings from an ESP32\\u003c/p\\u003e\","
+    "\"url\":\"https://mastodon.example/@sensorbot\",\"avatar\":\"https://files.mastodon.example/accounts/avatars/109/348/567/483/019/283/original/a1b2c3d4e5f60718.png\","
+    "\"avatar_static\":\"https://files.mastodon.example/accounts/avatars/109/348/567/483/019/283/original/a1b2c3d4e5f60718.png\","
+    "\"header\":\"https://mastodon.example/headers/original/missing.png\",\"header_static\":\"https://mastodon.example/headers/original/missing.png\","
+    "\"followers_count\":128,\"following_count\":3,\"statuses_count\":48211,\"last_status_at\":\"2022-12-04\","
+    "\"emojis\":[{\"shortcode\":\"thermometer\",\"url\":\"https://files.mastodon.example/custom_emojis/images/000/012/345/original/thermometer.png\","
+    "\"static_url\":\"https://files.mastodon.example/custom_emojis/images/000/012/345/static/thermometer.png\",\"visible_in_picker\":true}],"
+    "\"fields\":[{\"name\":\"Source\",\"value\":\"\\u003ca href=\\\"https://github.com/ringtailsoftware/lyuba\\\"\\u003egithub.com/ringtailsoftware/lyuba\\u003c/a\\u003e\",\"verified_at\":null}]},"
+    "\"media_attachments\":[{\"id\":\"109457081214960398\",\"type\":\"image\",\"url\":\"https://files.mastodon.example/media_attachments/files/109/457/081/214/960/398/original/0f1e2d3c4b5a6978.png\","
+    "\"preview_url\":\"https://files.mastodon.example/media_attachments/files/109/457/081/214/960/398/small/0f1e2d3c4b5a6978.png\","
+    "\"remote_url\":null,\"preview_remote_url\":null,\"text_url\":null,"
+    "\"meta\":{\"original\":{\"width\":640,\"height\":480,\"size\":\"640x480\",\"aspect\":1.3333333333333333},"
+    "\"small\":{\"width\":461,\"height\":346,\"size\":\"461x346\",\"aspect\":1.3323699421965318}},"
+    "\"description\":\"Graph of temperature over the last 24 hours\",\"blurhash\":\"UBL;mH~q%%M?bIUxuj[jt7xuayfQ~qxu%%Mt7\"}],"
+    "\"mentions\":[{\"id\":\"109303924478381957\",\"username\":\"tobyjaffey\",\"url\":\"https://mastodon.me.uk/@tobyjaffey\",\"acct\":\"tobyjaffey@mastodon.me.uk\"}],"
+    "\"tags\":[{\"name\":\"cheerlights\",\"url\":\"https://mastodon.example/tags/cheerlights\"}],"
+    "\"emojis\":[],\"card\":{\"url\":\"https://github.com/ringtailsoftware/lyuba\",\"title\":\"lyuba\",\"description\":\"Arduino library for Mastodon communications\","
+    "\"type\":\"link\",\"author_name\":\"\",\"author_url\":\"\",\"provider_name\":\"GitHub\",\"provider_url\":\"\",\"html\":\"\",\"width\":400,\"height\":200,"
+    "\"image\":null,\"embed_url\":\"\",\"blurhash\":null},\"poll\":null}";
+
+std::string bench_make_status(unsigned long long id, size_t padding) {
+    char idbuf[24];
+    std::string pad(padding, 'x');
+    std::string out;
+    int len;
+
+    snprintf(idbuf, sizeof(idbuf), "%llu", id);
+    len = snprintf(NULL, 0, status_template, idbuf, idbuf, idbuf, pad.c_str());
+    out.resize(len + 1);
+    snprintf(&out[0], len + 1, status_template, idbuf, idbuf, idbuf, pad.c_str());
+    out.resize(len);
+    return out;
+}
+
+std::string bench_make_sse_update(unsigned long long id, size_t padding) {
+    return "event: update\ndata: " + bench_make_status(id, padding) + "\n\n";
+}
@@ -0,0 +1,60 @@
+// bench_lyuba, host-side benchmarks for the lyuba library
+//
+//   bench_lyuba <scenario> [--option value ...]
+//
+// Run without arguments to list the scenarios. Build with the top level
+// CMakeLists.txt, then profile with perf or valgrind as usual.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "host_shim.h"
+
+typedef struct {
+    const char *name;
+    int (*fn)(int argc, char **argv);
+    const char *help;
+} bench_scenario_t;
+
+static const bench_scenario_t scenarios[] = {
+    {"linebuffer", bench_linebuffer, "feed SSE traffic through a linebuffer, copied and in place [--mb N] [--chunk N] [--padding N] [--replay FILE]"},
+    {"json", bench_json, "cJSON parse/lookup/delete, cJSON arena and jsonscan of a status [--iterations N] [--padding N]"},
+    {"stream", bench_stream, "lyuba_stream() against the mock server [--rate N] [--count N] [--padding N] [--heartbeat MS] [--replay FILE] [--events MASK] [--psram BYTES] [--internal BYTES] [--pipeline 0|1] [--decode-queue BYTES] [--overflow wait|drop] [--timeout S]"},
+    {"toot", bench_toot, "lyuba_toot() latency to the wire and to callback, idle wakeups [--count N] [--idle MS]"},
+    {"concurrent", bench_concurrent, "httpc posts kept in flight alongside flooding streams [--inflight N] [--streams N] [--seconds N] [--padding N]"},
+    {"multistream", bench_multistream, "N lyuba_stream() connections against one lyuba_stream_multi() websocket [--streams N] [--transport sse|ws|both] [--rate N] [--count N] [--padding N] [--timeout S]"},
+    {"resume", bench_resume, "lyuba_stream() ended repeatedly, statuses posted meanwhile are backfilled [--drops N] [--gap N] [--stall 0|1] [--heartbeat MS] [--count N] [--rate N] [--padding N] [--tag STREAM] [--timeout S]"},
+    {"reconnect", bench_reconnect, "lyuba_stream() whose first attempts are refused or dropped, or which goes silent, reconnects with backoff [--fail N] [--status N, 0 drops] [--retry-after S] [--transport sse|ws] [--count N] [--stall N] [--heartbeat MS] [--missed N] [--idle MS] [--timeout S]"},
+    {"ratelimit", bench_ratelimit, "lyuba_toot() offered faster than a small X-RateLimit- budget, counts 429s [--rate N] [--seconds N] [--limit N] [--window MS] [--timeout S]"},
+    {"queue", bench_queue, "lyuba_queue_toot() readings while the server is unreachable, with a restart, then drained [--readings N] [--every MS] [--offline MS] [--coalesce MS] [--interval MS] [--reboot 0|1] [--timeout S]"},
+    {"slots", bench_slots, "httpc requests one at a time counting heap allocations, then more at once than HTTPC_REQ_SLOTS [--count N] [--warmup N] [--extra N] [--timeout S]"},
+    {"callbacks", bench_callbacks, "lyuba_stream() with a slow callback, latency of GETs made alongside [--slow US] [--rate N] [--count N] [--padding N] [--every MS] [--overflow wait|drop] [--toots N] [--timeout S]"},
+    {"submit", bench_submit, "time spent in httpc_post() and httpc_is_open() from several threads alongside flooding streams [--threads N] [--inflight N] [--streams N] [--seconds N] [--padding N]"},
+    {"netdown", bench_netdown, "lyuba_stream() and lyuba_toot() while the WiFi drops and comes back [--outage MS] [--events 0|1] [--transport sse|ws] [--rate N] [--heartbeat MS] [--timeout S]"},
+};
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s <scenario> [options]\n\nscenarios:\n", prog);
+    for (size_t i=0;i<sizeof(scenarios)/sizeof(scenarios[0]);i++) {
+        fprintf(stderr, "  %-12s %s\n", scenarios[i].name, scenarios[i].help);
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (bench_opt_long(argc, argv, "--verbose", 0) == 0) {
+        host_serial_mute(true);
+    }
+    for (size_t i=0;i<sizeof(scenarios)/sizeof(scenarios[0]);i++) {
+        if (0 == strcmp(argv[1], scenarios[i].name)) {
+            return scenarios[i].fn(argc - 1, argv + 1);
+        }
+    }
+    usage(argv[0]);
+    return 1;
+}
@@ -0,0 +1,219 @@
+// Several streams at once, one SSE connection each with lyuba_stream() against all of them
+// over a single websocket with lyuba_stream_multi()
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <Arduino.h>
+#include "bench.h"
+#include "host_shim.h"
+#include "lyuba.h"
+#include "mock_server.h"
+
+static std::vector<uint64_t> latencies;
+static std::atomic<long> stamped(0);
+static std::atomic<long> perStream[LYUBA_MAX_STREAMS];
+static std::atomic<long> misrouted(0);
+static std::atomic<bool> streamFailed(false);
+
+static void record(const char *content) {
+    uint64_t now = bench_now_ns();
+    long n = stamped.load();
+
+    if (0 != strncmp(content, "ts:", 3) || n >= (long)latencies.size()) {
+        return;
+    }
+    latencies[n] = now - strtoull(content + 3, NULL, 10);
+    stamped = n + 1;
+}
+
+// runs from lyuba_loop()
+static void sse_cb(bool ok, const char *username, const char *content) {
+    if (!ok) {
+        streamFailed = true;
+        return;
+    }
+    record(content);
+}
+
+// runs from lyuba_loop()
+static void ws_cb(bool ok, int stream, const char *username, const char *content) {
+    if (!ok) {
+        streamFailed = true;
+        return;
+    }
+    if (stream < 0 || stream >= LYUBA_MAX_STREAMS) {
+        misrouted++;
+        return;
+    }
+    perStream[stream]++;
+    record(content);
+}
+
+// new connections and streaming requests the mock server has reported since last asked
+static void drain_reports(int fd, long *connections, long *requests) {
+    static std::string pending;
+    char buf[4096];
+    ssize_t n;
+    size_t eol;
+
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        pending.append(buf, n);
+    }
+    while (std::string::npos != (eol = pending.find('\n'))) {
+        std::string line = pending.substr(0, eol);
+        pending.erase(0, eol + 1);
+        if (0 == line.compare(0, 7, "ACCEPT ")) {
+            (*connections)++;
+        } else if (std::string::npos != line.find(" /api/v1/streaming")) {
+            (*requests)++;
+        }
+    }
+}
+
+static double pct_ms(std::vector<uint64_t> v, double p) {
+    if (v.empty()) {
+        return 0;
+    }
+    std::sort(v.begin(), v.end());
+    return v[(size_t)(p * (v.size() - 1))] / 1e6;
+}
+
+static void settle(lyuba_t *lyuba, long ms) {
+    uint64_t until = bench_now_ns() + ms * 1000000ULL;
+    while (bench_now_ns() < until) {
+        lyuba_loop(lyuba);
+        delay(1);
+    }
+}
+
+int bench_multistream(int argc, char **argv) {
+    mock_server_config_t cfg;
+    long nstreams = bench_opt_long(argc, argv, "--streams", 4);
+    long timeout_s = bench_opt_long(argc, argv, "--timeout", 30);
+    const char *transport = bench_opt_str(argc, argv, "--transport", "both");
+    std::vector<std::string> names;
+    std::vector<const char *> specs;
+    char host[32];
+    int lfd, pipefd[2];
+    lyuba_t *lyuba;
+    pid_t pid;
+    int rc = 0;
+
+    mock_server_config_init(&cfg);
+    cfg.rate = bench_opt_long(argc, argv, "--rate", 0);
+    cfg.count = bench_opt_long(argc, argv, "--count", 2000);
+    cfg.padding = bench_opt_long(argc, argv, "--padding", 0);
+    if (cfg.count <= 0 || nstreams < 1 || nstreams > LYUBA_MAX_STREAMS) {
+        fprintf(stderr, "multistream: --count must be > 0, --streams 1..%d\n", LYUBA_MAX_STREAMS);
+        return 1;
+    }
+    for (long i=0;i<nstreams;i++) {
+        names.push_back("hashtag?tag=bench" + std::to_string(i));
+    }
+    for (const std::string &name : names) {
+        specs.push_back(name.c_str());
+    }
+
+    if ((lfd = mock_server_listen(0)) < 0 || 0 != pipe(pipefd)) {
+        perror("multistream setup");
+        return 1;
+    }
+    snprintf(host, sizeof(host), "127.0.0.1:%d", mock_server_port(lfd));
+    cfg.report_fd = pipefd[1];
+    pid = mock_server_fork(lfd, &cfg);
+    close(pipefd[1]);
+    close(lfd);
+    fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
+
+    if (NULL == (lyuba = lyuba_init(host, NULL, NULL))) {
+        fprintf(stderr, "lyuba_init failed\n");
+        kill(pid, SIGTERM);
+        return 1;
+    }
+    // every status is counted, so wait for lyuba_loop() rather than drop any in the flood
+    lyuba->callsOverflow = LYUBA_CALLBACK_WAIT;
+
+    for (int ws=0;ws<2;ws++) {
+        host_heap_stats_t before, after;
+        std::vector<lyuba_conn_t> conns;
+        long connections = 0, requests = 0, total = nstreams * cfg.count;
+        uint64_t start, deadline;
+
+        if ((ws ? "sse" : "ws") == std::string(transport)) {
+            continue;
+        }
+        stamped = 0;
+        misrouted = 0;
+        streamFailed = false;
+        for (long i=0;i<nstreams;i++) {
+            perStream[i] = 0;
+        }
+        latencies.assign(total, 0);
+        drain_reports(pipefd[0], &connections, &requests);
+        connections = requests = 0;
+
+        host_heap_get_stats(&before);
+        host_heap_reset_peak();
+        start = bench_now_ns();
+        if (ws) {
+            conns.push_back(lyuba_stream_multi(lyuba, "Bearer mockaccesstoken", specs.data(), nstreams, LYUBA_EVENT_UPDATE, ws_cb, NULL));
+        } else {
+            for (long i=0;i<nstreams;i++) {
+                conns.push_back(lyuba_stream(lyuba, "Bearer mockaccesstoken", specs[i], sse_cb));
+            }
+        }
+        deadline = start + timeout_s * 1000000000ULL;
+        while (stamped < total && !streamFailed && bench_now_ns() < deadline) {
+            lyuba_loop(lyuba);
+            delay(1);
+        }
+        uint64_t elapsed = bench_now_ns() - start;
+        host_heap_get_stats(&after);
+        for (lyuba_conn_t conn : conns) {
+            if (conn != HTTPC_HANDLE_NONE) {
+                lyuba_close(lyuba, conn);
+            }
+        }
+        settle(lyuba, 200);
+        drain_reports(pipefd[0], &connections, &requests);
+
+        long n = stamped.load();
+        latencies.resize(n);
+        printf("multistream %s: %ld streams, %ld/%ld statuses delivered in %.2f s%s\n", ws ? "websocket" : "sse",
+            nstreams, n, total, elapsed / 1e9, streamFailed ? " (stream failed)" : "");
+        printf("multistream %s: %ld connections, %ld streaming requests, peak heap %zu bytes above baseline\n", ws ? "websocket" : "sse",
+            connections, requests, after.peak - before.in_use);
+        printf("multistream %s: latency p50 %.2f ms p99 %.2f ms\n", ws ? "websocket" : "sse",
+            pct_ms(latencies, 0.50), pct_ms(latencies, 0.99));
+        if (ws) {
+            std::string counts;
+            for (long i=0;i<nstreams;i++) {
+                counts += (i ? " " : "") + std::to_string(perStream[i].load());
+            }
+            printf("multistream websocket: per stream %s, %ld misrouted\n", counts.c_str(), misrouted.load());
+            for (long i=0;i<nstreams;i++) {
+                if (perStream[i] != cfg.count) {
+                    rc = 1;
+                }
+            }
+        }
+        if (n != total || misrouted > 0) {
+            rc = 1;
+        }
+    }
+
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    close(pipefd[0]);
+    return rc;
+}
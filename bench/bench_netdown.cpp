@@ -0,0 +1,183 @@
+// WiFi loss, a stream should be torn down as soon as the WiFi goes and be back as soon as there's an IP address
+// again, with the pooled connection made again ready for the next toot. --events 0 drops the WiFi without telling
+// httpc, leaving the stream to miss its heartbeats, for comparison.
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <atomic>
+
+#include <Arduino.h>
+#include "bench.h"
+#include "host_shim.h"
+#include "lyuba.h"
+#include "mock_server.h"
+
+static std::atomic<long> delivered(0);
+static std::atomic<int> tootsDone(0);
+static std::atomic<bool> tootOk(false);
+
+// runs from lyuba_loop()
+static void sse_cb(bool ok, const char *username, const char *content) {
+    if (ok) {
+        delivered++;
+    }
+}
+
+// runs from lyuba_loop()
+static void ws_cb(bool ok, int stream, const char *username, const char *content) {
+    sse_cb(ok, username, content);
+}
+
+static void toot_cb(bool ok) {
+    tootOk = ok;
+    tootsDone++;
+}
+
+// run lyuba_loop() until done() or the deadline, returns when it was done, 0 if it never was
+template <typename F> static uint64_t loop_until(lyuba_t *lyuba, uint64_t deadline, F done) {
+    while (!done()) {
+        if (bench_now_ns() > deadline) {
+            return 0;
+        }
+        lyuba_loop(lyuba);
+        delay(1);
+    }
+    return bench_now_ns();
+}
+
+// a toot and how long it took to be answered, 0 if it never was
+static uint64_t toot(lyuba_t *lyuba, uint64_t deadline, bool *ok) {
+    int before = tootsDone;
+    uint64_t start = bench_now_ns(), done;
+
+    lyuba_toot(lyuba, "Bearer mockaccesstoken", "netdown", toot_cb);
+    done = loop_until(lyuba, deadline, [&]() { return tootsDone > before; });
+    *ok = done > 0 && tootOk;
+    return done > 0 ? done - start : 0;
+}
+
+int bench_netdown(int argc, char **argv) {
+    mock_server_config_t cfg;
+    long outage_ms = bench_opt_long(argc, argv, "--outage", 2000);
+    long timeout_s = bench_opt_long(argc, argv, "--timeout", 60);
+    bool events = 0 != bench_opt_long(argc, argv, "--events", 1);
+    const char *transport = bench_opt_str(argc, argv, "--transport", "sse");
+    bool ws = 0 == strcmp(transport, "ws");
+    const char *tag = "public";
+    httpc_reconnect_stats_t before, after;
+    httpc_stats_t totals;
+    lyuba_config_t lcfg;
+    uint64_t deadline, downAt, upAt, noticed, tootDown, recovered, tootUp;
+    bool okBefore, okDown = false, okUp;
+    char host[32];
+    lyuba_t *lyuba;
+    lyuba_conn_t conn;
+    int lfd;
+    pid_t pid;
+
+    mock_server_config_init(&cfg);
+    lyuba_config_default(&lcfg);
+    cfg.rate = bench_opt_long(argc, argv, "--rate", 100);
+    cfg.count = 0;
+    cfg.heartbeat_ms = bench_opt_long(argc, argv, "--heartbeat", HTTPC_HEARTBEAT_MS);
+    lcfg.streams.heartbeatMs = cfg.heartbeat_ms;
+    if (cfg.rate <= 0 || outage_ms <= 0 || cfg.heartbeat_ms <= 0 || (!ws && 0 != strcmp(transport, "sse"))) {
+        fprintf(stderr, "netdown: --rate, --outage and --heartbeat must be > 0, --transport sse|ws\n");
+        return 1;
+    }
+
+    if ((lfd = mock_server_listen(0)) < 0) {
+        perror("netdown setup");
+        return 1;
+    }
+    snprintf(host, sizeof(host), "127.0.0.1:%d", mock_server_port(lfd));
+    pid = mock_server_fork(lfd, &cfg);
+    close(lfd);
+
+    if (NULL == (lyuba = lyuba_init_config(host, NULL, NULL, &lcfg))) {
+        fprintf(stderr, "lyuba_init failed\n");
+        kill(pid, SIGTERM);
+        return 1;
+    }
+    deadline = bench_now_ns() + timeout_s * 1000000000ULL;
+    if (ws) {
+        conn = lyuba_stream_multi(lyuba, "Bearer mockaccesstoken", &tag, 1, LYUBA_EVENT_UPDATE, ws_cb, NULL);
+    } else {
+        conn = lyuba_stream(lyuba, "Bearer mockaccesstoken", tag, sse_cb);
+    }
+    loop_until(lyuba, deadline, [&]() { return delivered >= 10; });
+    toot(lyuba, deadline, &okBefore);    // leaves a connection in the pool
+
+    // the WiFi goes, a toot made meanwhile should fail rather than hang
+    memset(&before, 0x00, sizeof(before));
+    lyuba_stream_stats(lyuba, conn, &before);
+    int tootsBefore = tootsDone;
+    noticed = tootDown = 0;
+    downAt = bench_now_ns();
+    host_net_down(events);
+    lyuba_toot(lyuba, "Bearer mockaccesstoken", "netdown", toot_cb);
+    loop_until(lyuba, downAt + outage_ms * 1000000ULL, [&]() {
+        memset(&after, 0x00, sizeof(after));
+        lyuba_stream_stats(lyuba, conn, &after);
+        if (0 == noticed && after.reconnects > before.reconnects) {
+            noticed = bench_now_ns();
+        }
+        if (0 == tootDown && tootsDone > tootsBefore) {
+            tootDown = bench_now_ns();
+            okDown = tootOk;
+        }
+        return false;
+    });
+
+    // and comes back
+    long deliveredDown = delivered;
+    upAt = bench_now_ns();
+    host_net_up(events);
+    recovered = loop_until(lyuba, deadline, [&]() { return delivered > deliveredDown; });
+    if (0 == tootDown) {
+        // without events it went on a pooled connection that went quiet, and waits for its first byte timeout
+        tootDown = loop_until(lyuba, deadline, [&]() { return tootsDone > tootsBefore; });
+        okDown = tootOk;
+    }
+    tootUp = toot(lyuba, deadline, &okUp);
+
+    lyuba_stream_stats(lyuba, conn, &after);
+    lyuba_close(lyuba, conn);
+    loop_until(lyuba, bench_now_ns() + 100000000ULL, [&]() { return false; });
+    lyuba_term(lyuba);
+    httpc_get_stats(&totals);
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+
+    printf("netdown %s: %ld statuses/s, heartbeat %ld ms, WiFi down for %ld ms %s events\n",
+        ws ? "websocket" : "sse", cfg.rate, cfg.heartbeat_ms, outage_ms, events ? "with" : "without");
+    if (noticed > 0) {
+        printf("netdown %s: stream torn down %.2f ms after the WiFi went\n", ws ? "websocket" : "sse", (noticed - downAt) / 1e6);
+    } else {
+        printf("netdown %s: stream not torn down while the WiFi was down\n", ws ? "websocket" : "sse");
+    }
+    if (tootDown > 0) {
+        printf("netdown %s: toot while down %s in %.1f ms\n", ws ? "websocket" : "sse", okDown ? "succeeded" : "failed", (tootDown - downAt) / 1e6);
+    } else {
+        printf("netdown %s: toot while down not answered\n", ws ? "websocket" : "sse");
+    }
+    if (recovered > 0) {
+        printf("netdown %s: statuses again %.2f ms after the WiFi came back\n", ws ? "websocket" : "sse", (recovered - upAt) / 1e6);
+    } else {
+        printf("netdown %s: no statuses after the WiFi came back\n", ws ? "websocket" : "sse");
+    }
+    printf("netdown %s: toot after %s in %.1f ms, %lu pooled connections made again\n",
+        ws ? "websocket" : "sse", okUp ? "ok" : "failed", tootUp / 1e6, totals.preconnects);
+    printf("netdown %s: stream reconnects %lu failures %lu retries %u, httpc %lu WiFi losses %lu timeouts %lu stalls\n",
+        ws ? "websocket" : "sse", after.reconnects, after.failures, after.retries, totals.linkLosses, totals.timeouts, totals.stalls);
+
+    bool ok = okBefore && tootDown > 0 && !okDown && okUp && recovered > 0;
+    if (events) {
+        ok = ok && noticed > 0 && totals.linkLosses == 1 && (HTTPC_POOL_SIZE == 0 || totals.preconnects == 1);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,233 @@
+// Parse path microbenchmarks, no network involved
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#include "bench.h"
+#include "cJSON.h"
+#include "host_shim.h"
+#include "jsonscan.h"
+#include "linebuffer.h"
+
+static size_t lines_seen;
+static size_t bytes_seen;
+
+static int count_line_cb(linebuffer_t *lb, const char *line, size_t len, void *userdata) {
+    if (NULL == line) {
+        return 0;
+    }
+    lines_seen++;
+    bytes_seen += len;
+    return 0;
+}
+
+// push total bytes of stream through a linebuffer in chunk sized reads, each either landing in a receive
+// buffer and copied in with linebuffer_write(), or landing in the linebuffer's free space
+static void linebuffer_run(const std::string &stream, size_t total, size_t chunk, bool inplace) {
+    static char rx[65536];
+    linebuffer_t lb;
+    uint64_t t0, t1, c0, c1;
+    size_t done = 0;
+
+    if (0 != linebuffer_init(&lb, 16384, count_line_cb)) {
+        fprintf(stderr, "linebuffer_init failed\n");
+        return;
+    }
+    lines_seen = 0;
+    bytes_seen = 0;
+    t0 = bench_now_ns();
+    c0 = bench_cycles();
+    while (done < total) {
+        for (size_t off=0; off<stream.size(); off+=chunk) {
+            size_t n = stream.size() - off < chunk ? stream.size() - off : chunk;
+            int err;
+            if (inplace) {
+                size_t space;
+                char *p = linebuffer_get_space(&lb, &space);
+                if (n > space) {
+                    n = space;
+                }
+                memcpy(p, stream.data() + off, n);
+                err = linebuffer_commit(&lb, n);
+            } else {
+                memcpy(rx, stream.data() + off, n);
+                err = linebuffer_write(&lb, rx, n);
+            }
+            if (0 != err) {
+                fprintf(stderr, "linebuffer overflow\n");
+            }
+            off -= chunk - n;   // a short read carries on from where it stopped
+        }
+        done += stream.size();
+    }
+    c1 = bench_cycles();
+    t1 = bench_now_ns();
+    linebuffer_term(&lb);
+
+    printf("linebuffer: %-8s %zu bytes in %5zu byte reads, %zu lines (%zu bytes kept), %.1f MB/s, %.0f lines/s",
+        inplace ? "in place" : "copied", done, chunk, lines_seen, bytes_seen, (done / 1048576.0) / ((t1 - t0) / 1e9), lines_seen / ((t1 - t0) / 1e9));
+    if (c1 > c0) {
+        printf(", %.2f bytes/cycle", done / (double)(c1 - c0));
+    }
+    printf("\n");
+}
+
+int bench_linebuffer(int argc, char **argv) {
+    size_t mb = bench_opt_long(argc, argv, "--mb", 64);
+    long chunk = bench_opt_long(argc, argv, "--chunk", 0);
+    size_t padding = bench_opt_long(argc, argv, "--padding", 0);
+    const char *replay = bench_opt_str(argc, argv, "--replay", NULL);
+    // a TLS record's worth at most, the httpc receive buffer, a TCP segment
+    static const size_t chunks[] = {64, 512, 1024, 1460};
+    std::string stream;
+
+    if (replay != NULL) {
+        std::string capture;
+        char buf[65536];
+        size_t n;
+        FILE *fp = fopen(replay, "rb");
+        if (NULL == fp) {
+            fprintf(stderr, "linebuffer: can't open %s\n", replay);
+            return 1;
+        }
+        while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+            capture.append(buf, n);
+        }
+        fclose(fp);
+        if (capture.empty()) {
+            fprintf(stderr, "linebuffer: %s is empty\n", replay);
+            return 1;
+        }
+        while (stream.size() < 4*1024*1024) {
+            stream += capture;
+        }
+    } else {
+        // a few MB of distinct events, replayed until the target volume is reached
+        for (unsigned long long id=1; stream.size() < 4*1024*1024; id++) {
+            stream += bench_make_sse_update(109457081214960000ULL + id, padding);
+            stream += ":thump\n";
+        }
+    }
+
+    if (chunk > 0) {
+        linebuffer_run(stream, mb * 1024 * 1024, chunk, false);
+        linebuffer_run(stream, mb * 1024 * 1024, chunk, true);
+    } else {
+        for (size_t i=0;i<sizeof(chunks)/sizeof(chunks[0]);i++) {
+            linebuffer_run(stream, mb * 1024 * 1024, chunks[i], false);
+            linebuffer_run(stream, mb * 1024 * 1024, chunks[i], true);
+        }
+    }
+    return 0;
+}
+
+int bench_json(int argc, char **argv) {
+    long iterations = bench_opt_long(argc, argv, "--iterations", 100000);
+    size_t padding = bench_opt_long(argc, argv, "--padding", 0);
+    std::string status = bench_make_status(109457081214960398ULL, padding);
+    std::string content(status.size(), '\0');
+    char username[64];
+    host_heap_stats_t h0, h1;
+    size_t found = 0;
+    uint64_t t0, t1;
+
+    host_heap_get_stats(&h0);
+    t0 = bench_now_ns();
+    for (long i=0;i<iterations;i++) {
+        cJSON *json, *content, *account, *username;
+        if (NULL == (json = cJSON_Parse(status.c_str()))) {
+            fprintf(stderr, "cJSON_Parse failed\n");
+            return 1;
+        }
+        if (NULL != (content = cJSON_GetObjectItem(json, "content")) &&
+            NULL != (account = cJSON_GetObjectItem(json, "account")) &&
+            NULL != (username = cJSON_GetObjectItem(account, "username"))) {
+            found++;
+        }
+        cJSON_Delete(json);
+    }
+    t1 = bench_now_ns();
+    host_heap_get_stats(&h1);
+
+    printf("json: cJSON, %ld statuses of %zu bytes, %zu matched, %.0f statuses/s, %.1f MB/s, %.1f allocations/status\n",
+        iterations, status.size(), found, iterations / ((t1 - t0) / 1e9),
+        (iterations * (double)status.size() / 1048576.0) / ((t1 - t0) / 1e9), (h1.allocs - h0.allocs) / (double)iterations);
+
+    // the same, parsed into a reused arena
+    std::string block(65536, '\0');
+    cJSON_Arena arena;
+    cJSON_ArenaInit(&arena, &block[0], block.size());
+    found = 0;
+    host_heap_get_stats(&h0);
+    t0 = bench_now_ns();
+    for (long i=0;i<iterations;i++) {
+        cJSON *json, *content, *account, *username;
+        if (NULL == (json = cJSON_ParseWithArena(status.c_str(), &arena))) {
+            fprintf(stderr, "cJSON_ParseWithArena failed\n");
+            return 1;
+        }
+        if (NULL != (content = cJSON_GetObjectItem(json, "content")) &&
+            NULL != (account = cJSON_GetObjectItem(json, "account")) &&
+            NULL != (username = cJSON_GetObjectItem(account, "username"))) {
+            found++;
+        }
+        cJSON_ArenaReset(&arena);
+    }
+    t1 = bench_now_ns();
+    host_heap_get_stats(&h1);
+
+    printf("json: cJSON arena, %ld statuses of %zu bytes, %zu matched, %.0f statuses/s, %.1f MB/s, %.1f allocations/status, %zu arena bytes\n",
+        iterations, status.size(), found, iterations / ((t1 - t0) / 1e9),
+        (iterations * (double)status.size() / 1048576.0) / ((t1 - t0) / 1e9), (h1.allocs - h0.allocs) / (double)iterations, arena.peak);
+
+    found = 0;
+    host_heap_get_stats(&h0);
+    t0 = bench_now_ns();
+    for (long i=0;i<iterations;i++) {
+        jsonscan_field_t fields[] = {
+            {"content", &content[0], content.size()},
+            {"account.username", username, sizeof(username)},
+        };
+        if (0 != jsonscan_extract(status.data(), status.size(), fields, 2)) {
+            fprintf(stderr, "jsonscan_extract failed\n");
+            return 1;
+        }
+        if (fields[0].found && fields[1].found) {
+            found++;
+        }
+    }
+    t1 = bench_now_ns();
+    host_heap_get_stats(&h1);
+
+    printf("json: jsonscan, %ld statuses of %zu bytes, %zu matched, %.0f statuses/s, %.1f MB/s, %.1f allocations/status\n",
+        iterations, status.size(), found, iterations / ((t1 - t0) / 1e9),
+        (iterations * (double)status.size() / 1048576.0) / ((t1 - t0) / 1e9), (h1.allocs - h0.allocs) / (double)iterations);
+
+    // in situ, the status is copied in first each time as the scan destroys it, as a line would arrive in the linebuffer
+    std::string line(status.size() + 1, '\0');
+    found = 0;
+    host_heap_get_stats(&h0);
+    t0 = bench_now_ns();
+    for (long i=0;i<iterations;i++) {
+        jsonscan_field_t fields[] = {
+            {"content"},
+            {"account.username"},
+        };
+        memcpy(&line[0], status.data(), status.size());
+        if (0 != jsonscan_extract_insitu(&line[0], status.size(), fields, 2)) {
+            fprintf(stderr, "jsonscan_extract_insitu failed\n");
+            return 1;
+        }
+        if (fields[0].found && fields[1].found) {
+            found++;
+        }
+    }
+    t1 = bench_now_ns();
+    host_heap_get_stats(&h1);
+
+    printf("json: jsonscan in situ (with copy in), %ld statuses of %zu bytes, %zu matched, %.0f statuses/s, %.1f MB/s, %.1f allocations/status\n",
+        iterations, status.size(), found, iterations / ((t1 - t0) / 1e9),
+        (iterations * (double)status.size() / 1048576.0) / ((t1 - t0) / 1e9), (h1.allocs - h0.allocs) / (double)iterations);
+    return 0;
+}
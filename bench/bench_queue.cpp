@@ -0,0 +1,173 @@
+// Toot queue, sensor readings queued with lyuba_queue_toot() while the server is unreachable should all be
+// posted once it's back, coalesced into a few statuses, and survive a restart in between
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+
+#include <Arduino.h>
+#include "bench.h"
+#include "host_shim.h"
+#include "lyuba.h"
+#include "mock_server.h"
+
+static std::atomic<long> postedOk(0);
+static std::atomic<long> postedFailed(0);
+
+// runs from lyuba_loop()
+static void toot_cb(bool ok) {
+    if (ok) {
+        postedOk++;
+    } else {
+        postedFailed++;
+    }
+}
+
+// statuses posted, their total body bytes and new connections the mock server has reported since last asked
+static void drain_reports(int fd, long *posts, long *bytes, long *connections) {
+    static std::string pending;
+    char buf[4096];
+    ssize_t n;
+    size_t eol;
+
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        pending.append(buf, n);
+    }
+    while (std::string::npos != (eol = pending.find('\n'))) {
+        std::string line = pending.substr(0, eol);
+        char method[16], path[200];
+        unsigned long long ns;
+        long len;
+        pending.erase(0, eol + 1);
+        if (0 == line.compare(0, 7, "ACCEPT ")) {
+            (*connections)++;
+        } else if (4 == sscanf(line.c_str(), "%15s %199s %llu %ld", method, path, &ns, &len) && 0 == strcmp(path, "/api/v1/statuses")) {
+            (*posts)++;
+            *bytes += len;
+        }
+    }
+}
+
+static lyuba_t *start(const char *host, long interval_ms, long coalesce_ms) {
+    lyuba_t *lyuba = lyuba_init(host, NULL, NULL);
+    if (NULL != lyuba) {
+        lyuba_queue_start(lyuba, "Bearer mockaccesstoken", interval_ms, coalesce_ms, true, toot_cb);
+    }
+    return lyuba;
+}
+
+int bench_queue(int argc, char **argv) {
+    mock_server_config_t cfg;
+    long readings = bench_opt_long(argc, argv, "--readings", 60);
+    long every_ms = bench_opt_long(argc, argv, "--every", 100);
+    long offline_ms = bench_opt_long(argc, argv, "--offline", 3000);
+    long coalesce_ms = bench_opt_long(argc, argv, "--coalesce", 1000);
+    long interval_ms = bench_opt_long(argc, argv, "--interval", 200);
+    bool reboot = 0 != bench_opt_long(argc, argv, "--reboot", 1);
+    long timeout_s = bench_opt_long(argc, argv, "--timeout", 60);
+    long posts = 0, bytes = 0, connections = 0, queued = 0, refused = 0, restored = 0;
+    uint64_t begin, online = 0, drained = 0, deadline;
+    char host[32], reading[64];
+    int lfd, port, pipefd[2];
+    size_t readingLen, nvsBytes;
+    unsigned long nvsWrites;
+    lyuba_t *lyuba;
+    pid_t pid = -1;
+
+    if (readings <= 0 || every_ms < 0 || offline_ms < 0) {
+        fprintf(stderr, "queue: --readings must be > 0, --every and --offline >= 0\n");
+        return 1;
+    }
+    // a free port with nothing listening on it yet, connections are refused until the server comes up
+    if ((lfd = mock_server_listen(0)) < 0 || 0 != pipe(pipefd)) {
+        perror("queue setup");
+        return 1;
+    }
+    port = mock_server_port(lfd);
+    close(lfd);
+    snprintf(host, sizeof(host), "127.0.0.1:%d", port);
+    fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
+    mock_server_config_init(&cfg);
+    cfg.report_fd = pipefd[1];
+
+    if (NULL == (lyuba = start(host, interval_ms, coalesce_ms))) {
+        fprintf(stderr, "lyuba_init failed\n");
+        return 1;
+    }
+    readingLen = snprintf(reading, sizeof(reading), "reading %06ld value %04ld", 0L, 0L);
+
+    begin = bench_now_ns();
+    deadline = begin + timeout_s * 1000000000ULL;
+    while (bench_now_ns() < deadline) {
+        uint64_t now = bench_now_ns();
+        long due = every_ms == 0 ? readings : std::min(readings, (long)((now - begin) / (every_ms * 1000000ULL)) + 1);
+        while (queued < due) {
+            snprintf(reading, sizeof(reading), "reading %06ld value %04ld", queued, random() % 4096);
+            if (!lyuba_queue_toot(lyuba, reading)) {
+                refused++;
+            }
+            queued++;
+        }
+        if (reboot && now - begin >= offline_ms * 500000ULL && !lyuba->queueSending) {
+            // restart halfway through the outage, the queue should come back from flash
+            reboot = false;
+            lyuba_term(lyuba);
+            if (NULL == (lyuba = start(host, interval_ms, coalesce_ms))) {
+                fprintf(stderr, "lyuba_init failed\n");
+                return 1;
+            }
+            restored = (long)lyuba_queue_pending(lyuba);
+        }
+        if (pid < 0 && now - begin >= offline_ms * 1000000ULL) {
+            if ((lfd = mock_server_listen(port)) < 0) {
+                perror("queue listen");
+                return 1;
+            }
+            pid = mock_server_fork(lfd, &cfg);
+            close(lfd);
+            online = bench_now_ns();
+        }
+        if (pid >= 0 && queued == readings && lyuba_queue_pending(lyuba) == 0 && !lyuba->queueSending) {
+            drained = bench_now_ns();
+            break;
+        }
+        lyuba_loop(lyuba);
+        delay(1);
+    }
+    for (uint64_t until = bench_now_ns() + 100000000ULL; bench_now_ns() < until; ) {
+        lyuba_loop(lyuba);  // let the last response's connection report
+        delay(1);
+    }
+    lyuba_term(lyuba);
+    host_nvs_get_writes(&nvsWrites, &nvsBytes);
+    if (pid >= 0) {
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+    }
+    close(pipefd[1]);
+    drain_reports(pipefd[0], &posts, &bytes, &connections);
+    close(pipefd[0]);
+
+    // each status is "status=" and its readings one per line
+    long delivered = posts > 0 ? (bytes - 6 * posts) / (long)(readingLen + 1) : 0;
+    bool exact = posts > 0 && (bytes - 6 * posts) % (long)(readingLen + 1) == 0;
+    printf("queue: %ld readings every %ld ms, server unreachable for the first %ld ms%s, coalesce %ld ms, interval %ld ms\n",
+        readings, every_ms, offline_ms, restored > 0 ? ", restarted halfway" : "", coalesce_ms, interval_ms);
+    printf("queue: %ld bytes restored from flash after the restart, %ld readings refused (queue full)\n", restored, refused);
+    printf("queue: %lu flash writes of %zu bytes in all, written after changes waited %d ms\n", nvsWrites, nvsBytes, LYUBA_QUEUE_SAVE_MS);
+    printf("queue: %ld statuses posted carrying %ld readings%s, %ld connections, %ld callbacks ok %ld failed\n",
+        posts, delivered, exact ? "" : " (inexact)", connections, postedOk.load(), postedFailed.load());
+    if (drained > 0) {
+        printf("queue: drained %.2f s after the server came back\n", (drained - online) / 1e9);
+    } else {
+        printf("queue: not drained in %ld s\n", timeout_s);
+    }
+    return (drained > 0 && exact && delivered == readings - refused && postedFailed == 0) ? 0 : 1;
+}
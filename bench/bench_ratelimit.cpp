@@ -0,0 +1,105 @@
+// Rate limited posting, lyuba_toot() offered faster than the account's X-RateLimit- budget
+// should be paced to it rather than run into 429s
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include <Arduino.h>
+#include "bench.h"
+#include "lyuba.h"
+#include "mock_server.h"
+
+static std::atomic<long> tootsOk(0);
+static std::atomic<long> tootsFailed(0);
+static std::mutex doneLock;
+static std::vector<uint64_t> doneNs;
+
+// runs from lyuba_loop()
+static void toot_cb(bool ok) {
+    std::lock_guard<std::mutex> guard(doneLock);
+    doneNs.push_back(bench_now_ns());
+    if (ok) {
+        tootsOk++;
+    } else {
+        tootsFailed++;     // the mock only refuses with 429
+    }
+}
+
+int bench_ratelimit(int argc, char **argv) {
+    mock_server_config_t cfg;
+    long rate = bench_opt_long(argc, argv, "--rate", 6);
+    long seconds = bench_opt_long(argc, argv, "--seconds", 10);
+    long timeout_s = bench_opt_long(argc, argv, "--timeout", 60);
+    std::vector<uint64_t> sentNs;
+    uint64_t start, deadline;
+    char host[32];
+    int lfd;
+    lyuba_t *lyuba;
+    pid_t pid;
+
+    mock_server_config_init(&cfg);
+    cfg.post_limit = bench_opt_long(argc, argv, "--limit", 20);
+    cfg.post_window_ms = bench_opt_long(argc, argv, "--window", 5000);
+    if (rate <= 0 || seconds <= 0 || cfg.post_limit <= 0 || cfg.post_window_ms <= 0) {
+        fprintf(stderr, "ratelimit: --rate, --seconds, --limit and --window must be > 0\n");
+        return 1;
+    }
+
+    if ((lfd = mock_server_listen(0)) < 0) {
+        perror("ratelimit setup");
+        return 1;
+    }
+    snprintf(host, sizeof(host), "127.0.0.1:%d", mock_server_port(lfd));
+    pid = mock_server_fork(lfd, &cfg);
+    close(lfd);
+
+    if (NULL == (lyuba = lyuba_init(host, NULL, NULL))) {
+        fprintf(stderr, "lyuba_init failed\n");
+        kill(pid, SIGTERM);
+        return 1;
+    }
+
+    // toots offered at a steady rate for a while, then wait for the last of them
+    long total = rate * seconds;
+    start = bench_now_ns();
+    deadline = start + timeout_s * 1000000000ULL;
+    while (bench_now_ns() < deadline) {
+        long due = std::min(total, (long)((bench_now_ns() - start) * rate / 1000000000ULL) + 1);
+        while ((long)sentNs.size() < due) {
+            sentNs.push_back(bench_now_ns());
+            lyuba_toot(lyuba, "Bearer mockaccesstoken", "rate limited", toot_cb);
+        }
+        if (tootsOk + tootsFailed >= total) {
+            break;
+        }
+        lyuba_loop(lyuba);
+        delay(1);
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    lyuba_term(lyuba);
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+
+    double budget = (double)cfg.post_limit * 1000 / cfg.post_window_ms;
+    std::vector<uint64_t> done;
+    {
+        std::lock_guard<std::mutex> guard(doneLock);
+        done = doneNs;
+    }
+    printf("ratelimit: %ld toots offered at %ld/s against %ld per %ld ms (%.1f/s), done in %.2f s\n",
+        total, rate, cfg.post_limit, cfg.post_window_ms, budget, elapsed / 1e9);
+    printf("ratelimit: %ld posted, %ld refused with 429, %ld unfinished\n",
+        tootsOk.load(), tootsFailed.load(), total - tootsOk - tootsFailed);
+    if (done.size() > 1) {
+        printf("ratelimit: %.2f toots/s completed\n", (done.size() - 1) / ((done.back() - done.front()) / 1e9));
+    }
+    return (tootsOk == total && tootsFailed == 0) ? 0 : 1;
+}
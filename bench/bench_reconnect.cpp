@@ -0,0 +1,202 @@
+// Reconnect backoff, a stream whose first few attempts are refused or dropped should come back
+// after growing, jittered delays, and one refused for good should say so once. With --stall the
+// stream goes silent instead, and should be given up on once it has missed its heartbeats.
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <Arduino.h>
+#include "bench.h"
+#include "host_shim.h"
+#include "lyuba.h"
+#include "mock_server.h"
+
+static std::atomic<long> delivered(0);
+static std::atomic<long> refusals(0);
+
+// runs from lyuba_loop()
+static void sse_cb(bool ok, const char *username, const char *content) {
+    if (!ok) {
+        refusals++;
+        return;
+    }
+    delivered++;
+}
+
+// runs from lyuba_loop()
+static void ws_cb(bool ok, int stream, const char *username, const char *content) {
+    sse_cb(ok, username, content);
+}
+
+// times of the streaming requests the mock server has reported since last asked, and of a stall
+static void drain_reports(int fd, std::vector<uint64_t> *attempts, uint64_t *stalledAt) {
+    static std::string pending;
+    char buf[4096];
+    ssize_t n;
+    size_t eol, sp;
+
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        pending.append(buf, n);
+    }
+    while (std::string::npos != (eol = pending.find('\n'))) {
+        std::string line = pending.substr(0, eol);
+        pending.erase(0, eol + 1);
+        if (std::string::npos != line.find(" /api/v1/streaming") && std::string::npos != (sp = line.rfind(' '))) {
+            attempts->push_back(strtoull(line.c_str() + sp + 1, NULL, 10));
+        } else if (0 == line.compare(0, 8, "STALL - ")) {
+            *stalledAt = strtoull(line.c_str() + 8, NULL, 10);
+        }
+    }
+}
+
+static void settle(lyuba_t *lyuba, long ms) {
+    uint64_t until = bench_now_ns() + ms * 1000000ULL;
+    while (bench_now_ns() < until) {
+        lyuba_loop(lyuba);
+        delay(1);
+    }
+}
+
+int bench_reconnect(int argc, char **argv) {
+    mock_server_config_t cfg;
+    long timeout_s = bench_opt_long(argc, argv, "--timeout", 60);
+    const char *transport = bench_opt_str(argc, argv, "--transport", "sse");
+    bool ws = 0 == strcmp(transport, "ws");
+    const char *tag = "hashtag?tag=bench";
+    std::vector<uint64_t> attempts;
+    uint64_t stalledAt = 0;
+    httpc_reconnect_stats_t stats;
+    httpc_stats_t totals;
+    lyuba_config_t lcfg;
+    bool permanent;
+    uint64_t start, deadline;
+    char host[32];
+    int lfd, pipefd[2];
+    lyuba_t *lyuba;
+    lyuba_conn_t conn;
+    pid_t pid;
+    int rc = 0;
+
+    mock_server_config_init(&cfg);
+    lyuba_config_default(&lcfg);
+    cfg.stall_after = bench_opt_long(argc, argv, "--stall", 0);
+    cfg.heartbeat_ms = bench_opt_long(argc, argv, "--heartbeat", cfg.stall_after > 0 ? 1000 : 0);
+    if (cfg.heartbeat_ms > 0) {
+        lcfg.streams.heartbeatMs = cfg.heartbeat_ms;
+    }
+    lcfg.streams.stallHeartbeats = bench_opt_long(argc, argv, "--missed", HTTPC_STALL_HEARTBEATS);
+    lcfg.streams.idleMs = bench_opt_long(argc, argv, "--idle", HTTPC_IDLE_TIMEOUT_MS);
+    cfg.fail_first = bench_opt_long(argc, argv, "--fail", cfg.stall_after > 0 ? 0 : 3);
+    cfg.fail_status = (int)bench_opt_long(argc, argv, "--status", 503);
+    cfg.retry_after_s = bench_opt_long(argc, argv, "--retry-after", 0);
+    cfg.count = bench_opt_long(argc, argv, "--count", 50);
+    cfg.rate = 0;
+    if (cfg.count <= 0 || cfg.fail_first < 0 || cfg.stall_after < 0 || cfg.stall_after >= cfg.count || (!ws && 0 != strcmp(transport, "sse"))) {
+        fprintf(stderr, "reconnect: --count must be > 0, --fail >= 0, --stall 0 to count-1, --transport sse|ws\n");
+        return 1;
+    }
+    // refusals that aren't worth retrying end the stream at the first one
+    permanent = cfg.fail_first > 0 && cfg.fail_status != 0 && cfg.fail_status != 200 && !httpc_status_retryable(cfg.fail_status);
+
+    if ((lfd = mock_server_listen(0)) < 0 || 0 != pipe(pipefd)) {
+        perror("reconnect setup");
+        return 1;
+    }
+    snprintf(host, sizeof(host), "127.0.0.1:%d", mock_server_port(lfd));
+    cfg.report_fd = pipefd[1];
+    pid = mock_server_fork(lfd, &cfg);
+    close(pipefd[1]);
+    close(lfd);
+    fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
+
+    if (NULL == (lyuba = lyuba_init_config(host, NULL, NULL, &lcfg))) {
+        fprintf(stderr, "lyuba_init failed\n");
+        kill(pid, SIGTERM);
+        return 1;
+    }
+    // the statuses come in a flood, wait for lyuba_loop() rather than drop any and end up backfilling them
+    lyuba->callsOverflow = LYUBA_CALLBACK_WAIT;
+    start = bench_now_ns();
+    if (ws) {
+        conn = lyuba_stream_multi(lyuba, "Bearer mockaccesstoken", &tag, 1, LYUBA_EVENT_UPDATE, ws_cb, NULL);
+    } else {
+        conn = lyuba_stream(lyuba, "Bearer mockaccesstoken", tag, sse_cb);
+    }
+
+    deadline = start + timeout_s * 1000000000ULL;
+    while (delivered < cfg.count && refusals == 0 && bench_now_ns() < deadline) {
+        lyuba_loop(lyuba);
+        delay(1);
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    if (refusals > 0) {
+        settle(lyuba, 1000);    // it shouldn't try again
+    }
+    memset(&stats, 0x00, sizeof(stats));
+    if (HTTPC_ERR_OK != lyuba_stream_stats(lyuba, conn, &stats)) {
+        printf("reconnect: stream already closed\n");
+    }
+    lyuba_close(lyuba, conn);
+    settle(lyuba, 100);
+    lyuba_term(lyuba);
+    httpc_get_stats(&totals);
+    drain_reports(pipefd[0], &attempts, &stalledAt);
+
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    close(pipefd[0]);
+
+    printf("reconnect %s: first %ld attempts get %d, %ld/%ld statuses delivered in %.2f s, %ld refusals reported\n",
+        ws ? "websocket" : "sse", cfg.fail_first, cfg.fail_status, delivered.load(), cfg.count, elapsed / 1e9, refusals.load());
+    std::string gaps;
+    for (size_t i=1;i<attempts.size();i++) {
+        char ms[32];
+        snprintf(ms, sizeof(ms), "%s%.0f", i > 1 ? " " : "", (attempts[i] - attempts[i - 1]) / 1e6);
+        gaps += ms;
+    }
+    printf("reconnect %s: %zu attempts, ms between them: %s\n", ws ? "websocket" : "sse", attempts.size(), gaps.empty() ? "-" : gaps.c_str());
+    printf("reconnect %s: stats reconnects %lu failures %lu retries %u backoff %u ms next %u ms last status %d\n",
+        ws ? "websocket" : "sse", stats.reconnects, stats.failures, stats.retries, (unsigned)stats.backoffMs,
+        (unsigned)stats.nextRetryMs, stats.lastStatus);
+
+    if (cfg.stall_after > 0) {
+        printf("reconnect %s: stalled after %ld statuses, heartbeat %ld ms, %u missed allowed, idle timeout %u ms\n",
+            ws ? "websocket" : "sse", cfg.stall_after, cfg.heartbeat_ms, lcfg.streams.stallHeartbeats, (unsigned)lcfg.streams.idleMs);
+        if (stalledAt > 0 && attempts.size() > (size_t)cfg.fail_first + 1) {
+            printf("reconnect %s: reconnected %.2f s after the stream went silent, httpc %lu timeouts %lu stalls\n",
+                ws ? "websocket" : "sse", (attempts[cfg.fail_first + 1] - stalledAt) / 1e9, totals.timeouts, totals.stalls);
+        } else {
+            printf("reconnect %s: no reconnect after the stream went silent\n", ws ? "websocket" : "sse");
+        }
+    }
+
+    if (cfg.stall_after > 0) {
+        rc = (delivered >= cfg.count && refusals == 0 && stalledAt > 0 && (long)attempts.size() == cfg.fail_first + 2 && totals.timeouts == 1) ? 0 : 1;
+    } else if (permanent) {
+        rc = (refusals == 1 && attempts.size() == 1 && delivered == 0) ? 0 : 1;
+    } else {
+        rc = (delivered == cfg.count && refusals == 0 && (long)attempts.size() == cfg.fail_first + 1) ? 0 : 1;
+        for (size_t i=1;i<attempts.size();i++) {
+            // each wait is at least half its doubling cap, and at least any Retry-After
+            uint64_t cap = (uint64_t)HTTPC_BACKOFF_MIN_MS << (i - 1);
+            uint64_t floor = cap > HTTPC_BACKOFF_MAX_MS ? HTTPC_BACKOFF_MAX_MS / 2 : cap / 2;
+            if (cfg.retry_after_s * 1000 > (long)floor) {
+                floor = cfg.retry_after_s * 1000;
+            }
+            if ((attempts[i] - attempts[i - 1]) / 1000000 < floor) {
+                printf("reconnect: attempt %zu came after %.0f ms, expected at least %llu ms\n", i + 1,
+                    (attempts[i] - attempts[i - 1]) / 1e6, (unsigned long long)floor);
+                rc = 1;
+            }
+        }
+    }
+    return rc;
+}
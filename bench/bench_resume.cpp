@@ -0,0 +1,161 @@
+// Stream resume, statuses posted while lyuba_stream() reconnects should still arrive, once each, whether the
+// stream ended or stalled (--stall 1) and was given up on
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <atomic>
+#include <iterator>
+#include <mutex>
+#include <set>
+#include <string>
+
+#include <Arduino.h>
+#include "bench.h"
+#include "host_shim.h"
+#include "lyuba.h"
+#include "mock_server.h"
+
+static std::mutex idsLock;
+static std::set<unsigned long long> ids;
+static std::atomic<long> duplicates(0);
+static std::atomic<long> delivered(0);
+static std::atomic<bool> streamFailed(false);
+
+// runs from lyuba_loop()
+static void stream_cb(bool ok, const char *username, const char *content) {
+    const char *id;
+
+    if (!ok) {
+        streamFailed = true;
+        return;
+    }
+    if (NULL == (id = strstr(content, "id:"))) {
+        return;
+    }
+    std::lock_guard<std::mutex> guard(idsLock);
+    if (!ids.insert(strtoull(id + 3, NULL, 10)).second) {
+        duplicates++;
+    }
+    delivered++;
+}
+
+// streaming connections and timeline requests the mock server has reported since last asked
+static void drain_reports(int fd, long *streams, long *timelines) {
+    static std::string pending;
+    char buf[4096];
+    ssize_t n;
+    size_t eol;
+
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        pending.append(buf, n);
+    }
+    while (std::string::npos != (eol = pending.find('\n'))) {
+        std::string line = pending.substr(0, eol);
+        pending.erase(0, eol + 1);
+        if (std::string::npos != line.find(" /api/v1/streaming/")) {
+            (*streams)++;
+        } else if (std::string::npos != line.find(" /api/v1/timelines/")) {
+            (*timelines)++;
+        }
+    }
+}
+
+int bench_resume(int argc, char **argv) {
+    mock_server_config_t cfg;
+    lyuba_config_t lcfg;
+    long drops = bench_opt_long(argc, argv, "--drops", 3);
+    long timeout_s = bench_opt_long(argc, argv, "--timeout", 60);
+    const char *tag = bench_opt_str(argc, argv, "--tag", "hashtag?tag=bench");
+    long streams = 0, timelines = 0, target, missing;
+    unsigned long long lo = 0, hi = 0;
+    uint64_t start, deadline;
+    char host[32];
+    int lfd, pipefd[2];
+    lyuba_t *lyuba;
+    pid_t pid;
+
+    mock_server_config_init(&cfg);
+    lyuba_config_default(&lcfg);
+    cfg.rate = bench_opt_long(argc, argv, "--rate", 2000);
+    cfg.count = bench_opt_long(argc, argv, "--count", 200);
+    cfg.gap = bench_opt_long(argc, argv, "--gap", 20);
+    cfg.padding = bench_opt_long(argc, argv, "--padding", 0);
+    cfg.stall_end = 0 != bench_opt_long(argc, argv, "--stall", 0);
+    if (cfg.stall_end) {
+        // a stall is noticed after stallHeartbeats missed heartbeats, keep that short
+        lcfg.streams.heartbeatMs = bench_opt_long(argc, argv, "--heartbeat", 250);
+    }
+    if (cfg.count <= 0 || drops < 0 || cfg.gap < 0) {
+        fprintf(stderr, "resume: --count must be > 0, --drops and --gap >= 0\n");
+        return 1;
+    }
+    // every status posted up to the last reconnect
+    target = (drops + 1) * cfg.count + drops * cfg.gap + cfg.gap / 2;
+
+    if ((lfd = mock_server_listen(0)) < 0 || 0 != pipe(pipefd)) {
+        perror("resume setup");
+        return 1;
+    }
+    snprintf(host, sizeof(host), "127.0.0.1:%d", mock_server_port(lfd));
+    cfg.report_fd = pipefd[1];
+    pid = mock_server_fork(lfd, &cfg);
+    close(pipefd[1]);
+    close(lfd);
+    fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
+
+    if (NULL == (lyuba = lyuba_init_config(host, NULL, NULL, &lcfg))) {
+        fprintf(stderr, "lyuba_init failed\n");
+        kill(pid, SIGTERM);
+        return 1;
+    }
+    // every status is counted, so wait for lyuba_loop() rather than drop any
+    lyuba->callsOverflow = LYUBA_CALLBACK_WAIT;
+    start = bench_now_ns();
+    lyuba_conn_t conn = lyuba_stream(lyuba, "Bearer mockaccesstoken", tag, stream_cb);
+
+    deadline = start + timeout_s * 1000000000ULL;
+    while (!streamFailed && bench_now_ns() < deadline) {
+        drain_reports(pipefd[0], &streams, &timelines);
+        if (streams > drops + 1) {
+            break;  // reconnected after the last drop
+        }
+        lyuba_loop(lyuba);
+        delay(1);
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    // the stream carries on, give whatever was missed up to now time to be fetched (after a stall that's done
+    // once it's back)
+    for (uint64_t until = bench_now_ns() + 100000000ULL; !streamFailed && bench_now_ns() < until; ) {
+        lyuba_loop(lyuba);
+        delay(1);
+    }
+    lyuba_close(lyuba, conn);
+    {
+        std::lock_guard<std::mutex> guard(idsLock);
+        if (!ids.empty()) {
+            lo = *ids.begin();
+            hi = *ids.rbegin();
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(idsLock);
+        long have = ids.empty() ? 0 : (long)std::distance(ids.begin(), ids.upper_bound(hi));
+        missing = ids.empty() ? target : (long)(hi - lo + 1) - have;
+    }
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    close(pipefd[0]);
+
+    printf("resume: %s, %ld %s with %ld statuses posted during each, %.2f s%s\n", tag, drops, cfg.stall_end ? "stalls" : "drops",
+        cfg.gap, elapsed / 1e9, streamFailed ? " (stream failed)" : "");
+    printf("resume: %ld delivered, %ld distinct (%ld posted by the last reconnect), %ld missing, %ld duplicates\n",
+        delivered.load(), hi >= lo && !ids.empty() ? (long)(hi - lo + 1) - missing : 0, target, missing, duplicates.load());
+    printf("resume: %ld streaming connections, %ld timeline requests\n", streams, timelines);
+    return (missing == 0 && duplicates == 0 && (long)(hi - lo + 1) >= target) ? 0 : 1;
+}
@@ -0,0 +1,136 @@
+// Request slots, with HTTPC_REQ_SLOTS set requests should be made and finished without touching the heap,
+// and more at once than there are slots should be refused cleanly rather than allocated
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <atomic>
+#include <vector>
+
+#include <Arduino.h>
+#include "bench.h"
+#include "host_shim.h"
+#include "httpc.h"
+#include "mock_server.h"
+
+static std::atomic<long> done(0);
+static std::atomic<long> failed(0);
+
+// runs on the httpc task
+static httpc_err_t get_cb(httpc_err_t err, httpc_req_t *req, int status_code, const char *data, size_t len) {
+    if (err != HTTPC_ERR_OK || status_code != 200) {
+        failed++;
+    }
+    done++;
+    return HTTPC_ERR_OK;
+}
+
+static bool get_start(const char *host) {
+    uint64_t t0 = bench_now_ns();
+    return HTTPC_HANDLE_NONE != httpc_get(host, "/api/v1/timelines/public?limit=2", "Bearer mockaccesstoken", 4096, false, get_cb, &t0, sizeof(t0), false);
+}
+
+// wait for n requests to call back, then for their slots to be given back
+static bool wait_done(long n, long timeout_s) {
+    uint64_t deadline = bench_now_ns() + timeout_s * 1000000000ULL;
+    httpc_slot_stats_t stats;
+
+    while (done < n) {
+        if (bench_now_ns() > deadline) {
+            return false;
+        }
+        delay(1);
+    }
+    do {
+        delay(1);
+        httpc_get_slot_stats(&stats);
+    } while (stats.slotsInUse > 0 && bench_now_ns() < deadline);
+    return true;
+}
+
+int bench_slots(int argc, char **argv) {
+    long count = bench_opt_long(argc, argv, "--count", 200);
+    long warmup = bench_opt_long(argc, argv, "--warmup", 10);
+    long extra = bench_opt_long(argc, argv, "--extra", 4);
+    long timeout_s = bench_opt_long(argc, argv, "--timeout", 30);
+    mock_server_config_t cfg;
+    host_heap_stats_t before, after;
+    httpc_slot_stats_t stats;
+    long refused = 0, burst = 0;
+    char host[32];
+    int lfd, rc = 0;
+    pid_t pid;
+
+    if (count <= 0 || warmup < 0 || extra < 0) {
+        fprintf(stderr, "slots: --count must be > 0, --warmup and --extra >= 0\n");
+        return 1;
+    }
+    mock_server_config_init(&cfg);
+    if ((lfd = mock_server_listen(0)) < 0) {
+        perror("slots setup");
+        return 1;
+    }
+    snprintf(host, sizeof(host), "127.0.0.1:%d", mock_server_port(lfd));
+    pid = mock_server_fork(lfd, &cfg);
+    close(lfd);
+
+    if (HTTPC_ERR_OK != httpc_init()) {
+        fprintf(stderr, "httpc_init failed\n");
+        kill(pid, SIGTERM);
+        return 1;
+    }
+
+    // one at a time, the first few make the pooled connection, after that nothing new should be needed
+    for (long i=0;i<warmup + count;i++) {
+        if (i == warmup) {
+            host_heap_get_stats(&before);
+        }
+        if (!get_start(host) || !wait_done(i + 1, timeout_s)) {
+            rc = 1;
+            break;
+        }
+    }
+    host_heap_get_stats(&after);
+    long allocs = after.allocs - before.allocs;
+
+    // then more at once than there are slots
+    httpc_get_slot_stats(&stats);
+    if (rc == 0 && stats.slots > 0) {
+        long base = done.load();
+        unsigned long exhausted = stats.exhausted;
+        for (long i=0;i<stats.slots + extra;i++) {
+            if (get_start(host)) {
+                burst++;
+            } else {
+                refused++;
+            }
+        }
+        if (!wait_done(base + burst, timeout_s)) {
+            rc = 1;
+        }
+        httpc_get_slot_stats(&stats);
+        if (stats.exhausted - exhausted != (unsigned long)refused) {
+            rc = 1;
+        }
+    }
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+
+    printf("slots: %ld requests one at a time after %ld to warm up, %ld failed\n", count, warmup, failed.load());
+    printf("slots: %ld heap allocations, %.2f per request\n", allocs, (double)allocs / count);
+    if (stats.slots > 0) {
+        printf("slots: %d slots and %zu bytes of blocks reserved, peak %d slots %d blocks in use, %lu requests refused\n",
+            stats.slots, stats.blockBytes, stats.slotsPeak, stats.blocksPeak, stats.exhausted);
+        printf("slots: %ld at once, %ld made and %ld refused, %d slots still in use\n",
+            stats.slots + extra, burst, refused, stats.slotsInUse);
+        if (allocs != 0 || stats.slotsInUse != 0 || stats.blocksInUse != 0) {
+            rc = 1;
+        }
+    } else {
+        printf("slots: built without HTTPC_REQ_SLOTS, requests come from the heap\n");
+    }
+    return (rc == 0 && failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,155 @@
+// End-to-end streaming benchmark, lyuba_stream() against the mock server
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include <Arduino.h>
+#include "bench.h"
+#include "host_shim.h"
+#include "lyuba.h"
+#include "mock_server.h"
+
+static std::vector<uint64_t> latencies;
+static std::atomic<long> stamped(0);
+static std::atomic<long> unstamped(0);
+static std::atomic<bool> streamFailed(false);
+static uint64_t firstNs, lastNs;
+
+// runs from lyuba_loop()
+static void stream_cb(bool ok, const char *username, const char *content) {
+    uint64_t now = bench_now_ns();
+    long n;
+
+    if (!ok) {
+        streamFailed = true;
+        return;
+    }
+    if (0 != strncmp(content, "ts:", 3)) {
+        unstamped++;    // not a replayed "update", e.g. a status.update when subscribed to them
+        return;
+    }
+    n = stamped.load();
+    if (n >= (long)latencies.size()) {
+        return;     // the stream resumed after its end before the caller noticed
+    }
+    latencies[n] = now - strtoull(content + 3, NULL, 10);
+    if (n == 0) {
+        firstNs = now;
+    }
+    lastNs = now;
+    stamped = n + 1;
+}
+
+// runs from lyuba_loop(), for subscribed events other than statuses
+static void event_cb(bool ok, const char *event, const char *data, size_t len) {
+    if (!ok) {
+        streamFailed = true;
+        return;
+    }
+    unstamped++;
+}
+
+static double percentile_ms(std::vector<uint64_t> &v, double p) {
+    if (v.empty()) {
+        return 0;
+    }
+    size_t i = (size_t)(p * (v.size() - 1));
+    return v[i] / 1e6;
+}
+
+int bench_stream(int argc, char **argv) {
+    mock_server_config_t cfg;
+    host_heap_stats_t before, after;
+    char host[32];
+    long timeout_s = bench_opt_long(argc, argv, "--timeout", 30);
+    long psram = bench_opt_long(argc, argv, "--psram", 0);
+    long internal = bench_opt_long(argc, argv, "--internal", 200000);  // about what an ESP32 has free with WiFi up
+    bool pipelined = 0 != bench_opt_long(argc, argv, "--pipeline", 0);
+    long decodeQueue = bench_opt_long(argc, argv, "--decode-queue", LYUBA_DECODE_QUEUE_SIZE);
+    // a flood outruns the callbacks, waiting measures every status going through rather than backfills of dropped ones
+    const char *overflow = bench_opt_str(argc, argv, "--overflow", "wait");
+    lyuba_callback_stats_t decodeStats;
+    lyuba_config_t lcfg;
+    uint64_t deadline;
+    lyuba_t *lyuba;
+    int lfd, port;
+    pid_t pid;
+
+    mock_server_config_init(&cfg);
+    cfg.rate = bench_opt_long(argc, argv, "--rate", 0);
+    cfg.count = bench_opt_long(argc, argv, "--count", 5000);
+    cfg.padding = bench_opt_long(argc, argv, "--padding", 0);
+    cfg.heartbeat_ms = bench_opt_long(argc, argv, "--heartbeat", 0);
+    cfg.replay_path = bench_opt_str(argc, argv, "--replay", NULL);
+    unsigned events = bench_opt_long(argc, argv, "--events", LYUBA_EVENT_UPDATE);
+    if (cfg.count <= 0 || psram < 0 || decodeQueue <= 0 || (0 != strcmp(overflow, "wait") && 0 != strcmp(overflow, "drop"))) {
+        fprintf(stderr, "stream: --count and --decode-queue must be > 0, --psram >= 0, --overflow wait|drop\n");
+        return 1;
+    }
+    latencies.assign(cfg.count, 0);
+
+    if ((lfd = mock_server_listen(0)) < 0) {
+        perror("mock_server_listen");
+        return 1;
+    }
+    port = mock_server_port(lfd);
+    pid = mock_server_fork(lfd, &cfg);
+    close(lfd);
+
+    host_heap_set_psram(psram);
+    host_heap_get_stats(&before);
+    host_heap_reset_peak();
+
+    snprintf(host, sizeof(host), "127.0.0.1:%d", port);
+    // pipelined, the httpc task frames on one core and the decode task parses on the other
+    lyuba_config_default(&lcfg);
+    lcfg.pipelined = pipelined;
+    lcfg.net.core = 0;
+    lcfg.decode.core = 1;
+    lcfg.decodeQueueSize = decodeQueue;
+    if (NULL == (lyuba = lyuba_init_config(host, NULL, NULL, &lcfg))) {
+        fprintf(stderr, "lyuba_init failed\n");
+        kill(pid, SIGTERM);
+        return 1;
+    }
+    lyuba->callsOverflow = 0 == strcmp(overflow, "drop") ? LYUBA_CALLBACK_DROP : LYUBA_CALLBACK_WAIT;
+    lyuba_stream_events(lyuba, "Bearer mockaccesstoken", "public", events, stream_cb, event_cb);
+
+    deadline = bench_now_ns() + timeout_s * 1000000000ULL;
+    while (stamped < cfg.count && !streamFailed && bench_now_ns() < deadline) {
+        lyuba_loop(lyuba);
+        delay(1);
+    }
+    host_heap_get_stats(&after);
+    lyuba_decode_stats(lyuba, &decodeStats);
+
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+
+    long n = stamped.load();
+    latencies.resize(n < cfg.count ? n : cfg.count);
+    std::sort(latencies.begin(), latencies.end());
+
+    printf("stream: offered %s, padding %zu, %ld/%ld statuses delivered%s\n",
+        cfg.rate > 0 ? (std::to_string(cfg.rate) + "/s").c_str() : "flood", cfg.padding, n, cfg.count,
+        streamFailed ? " (stream failed)" : "");
+    printf("stream: %.0f statuses/s, latency p50 %.2f ms p99 %.2f ms max %.2f ms\n",
+        n > 1 ? (n - 1) / ((lastNs - firstNs) / 1e9) : 0.0,
+        percentile_ms(latencies, 0.50), percentile_ms(latencies, 0.99), percentile_ms(latencies, 1.0));
+    printf("stream: peak heap %zu bytes above baseline, %zu in PSRAM, %lu allocations, %ld other callbacks\n",
+        after.peak - before.in_use, after.psram_peak - before.psram_in_use, after.allocs - before.allocs, unstamped.load());
+    if (pipelined) {
+        printf("stream: pipelined, decode queue %zu bytes, %s when full, high water %zu, %lu queued, %lu waits, %lu dropped or decoded on the httpc task\n",
+            decodeStats.size, overflow, decodeStats.highWater, decodeStats.queued, decodeStats.waits, decodeStats.dropped);
+    }
+    printf("stream: internal heap headroom %ld of %ld bytes, with %ld bytes of PSRAM\n",
+        internal - (long)(after.peak - before.in_use), internal, psram);
+    return n == cfg.count ? 0 : 1;
+}
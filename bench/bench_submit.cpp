@@ -0,0 +1,157 @@
+// Submission, tasks making requests and asking after them shouldn't wait on the httpc task while it's busy
+// with flooding streams, times spent inside httpc_post() and httpc_is_open() from several threads at once
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <Arduino.h>
+#include "bench.h"
+#include "httpc.h"
+#include "mock_server.h"
+
+static char host[32];
+static std::atomic<long> postsDone(0);
+static std::atomic<long> postsFailed(0);
+static std::atomic<long> linesSeen(0);
+static std::atomic<long> *outstanding;     // per submitting thread
+
+// runs on the httpc task
+static httpc_err_t post_cb(httpc_err_t err, httpc_req_t *req, int status_code, const char *data, size_t len) {
+    long thread = *(long *)req->userdata;
+    if (err != HTTPC_ERR_OK || status_code != 200) {
+        postsFailed++;
+    }
+    postsDone++;
+    outstanding[thread]--;
+    return HTTPC_ERR_OK;
+}
+
+static httpc_err_t stream_cb(httpc_err_t err, httpc_req_t *req, int status_code, const char *data, size_t len) {
+    if (err == HTTPC_ERR_OK && data != NULL && 0 == strncmp(data, "data:", 5)) {
+        linesSeen++;
+    }
+    return HTTPC_ERR_OK;
+}
+
+static double pct_us(std::vector<uint64_t> &v, double p) {
+    return v.empty() ? 0 : v[(size_t)(p * (v.size() - 1))] / 1e3;
+}
+
+int bench_submit(int argc, char **argv) {
+    long threads = bench_opt_long(argc, argv, "--threads", 4);
+    long inflight = bench_opt_long(argc, argv, "--inflight", 4);
+    long streams = bench_opt_long(argc, argv, "--streams", 2);
+    long seconds = bench_opt_long(argc, argv, "--seconds", 5);
+    std::vector<httpc_handle_t> streamReqs;
+    std::vector<std::thread> workers;
+    std::vector<uint64_t> submits, lookups;
+    std::atomic<bool> running(true);
+    std::atomic<long> refused(0);
+    std::mutex timesLock;
+    mock_server_config_t cfg;
+    uint64_t t0, t1;
+    int lfd;
+    pid_t pid;
+
+    if (threads <= 0 || inflight <= 0 || streams < 0 || seconds <= 0) {
+        fprintf(stderr, "submit: --threads, --inflight and --seconds must be > 0, --streams >= 0\n");
+        return 1;
+    }
+    mock_server_config_init(&cfg);
+    cfg.count = 0;  // streams flood until closed
+    cfg.padding = bench_opt_long(argc, argv, "--padding", 0);
+    if ((lfd = mock_server_listen(0)) < 0) {
+        perror("submit setup");
+        return 1;
+    }
+    snprintf(host, sizeof(host), "127.0.0.1:%d", mock_server_port(lfd));
+    pid = mock_server_fork(lfd, &cfg);
+    close(lfd);
+
+    if (HTTPC_ERR_OK != httpc_init()) {
+        fprintf(stderr, "httpc_init failed\n");
+        kill(pid, SIGTERM);
+        return 1;
+    }
+    for (long i=0;i<streams;i++) {
+        streamReqs.push_back(httpc_get(host, "/api/v1/streaming/public", "Bearer mockaccesstoken", 16384, true, stream_cb, NULL, 0, true));
+    }
+    delay(100);     // let the streams get going
+
+    outstanding = new std::atomic<long>[threads];
+    t0 = bench_now_ns();
+    for (long t=0;t<threads;t++) {
+        outstanding[t] = 0;
+        workers.push_back(std::thread([&, t]() {
+            std::vector<uint64_t> mySubmits, myLookups;
+            unsigned long n = 0;
+
+            while (running) {
+                if (outstanding[t] >= inflight) {
+                    // meanwhile ask after a stream, as a display task might
+                    if (!streamReqs.empty()) {
+                        uint64_t before = bench_now_ns();
+                        httpc_is_open(streamReqs[n++ % streamReqs.size()]);
+                        myLookups.push_back(bench_now_ns() - before);
+                    }
+                    usleep(200);
+                    continue;
+                }
+                outstanding[t]++;
+                uint64_t before = bench_now_ns();
+                httpc_handle_t h = httpc_post(host, "/api/v1/statuses", "Bearer mockaccesstoken", "status=bench", 4096, false, post_cb, (void *)&t, sizeof(t));
+                mySubmits.push_back(bench_now_ns() - before);
+                if (HTTPC_HANDLE_NONE == h) {
+                    outstanding[t]--;
+                    refused++;
+                    usleep(200);    // out of handles, wait for some to come back
+                }
+            }
+            std::lock_guard<std::mutex> guard(timesLock);
+            submits.insert(submits.end(), mySubmits.begin(), mySubmits.end());
+            lookups.insert(lookups.end(), myLookups.begin(), myLookups.end());
+        }));
+    }
+    delay(seconds * 1000);
+    running = false;
+    for (size_t i=0;i<workers.size();i++) {
+        workers[i].join();
+    }
+    t1 = bench_now_ns();
+    long posts = postsDone.load();
+    long failed = postsFailed.load();   // before the server goes, taking in-flight requests with it
+    long lines = linesSeen.load();
+
+    for (size_t i=0;i<streamReqs.size();i++) {
+        httpc_close(streamReqs[i]);
+    }
+    // posts still in flight call back into outstanding
+    for (long t=0;t<threads;t++) {
+        for (uint64_t until = bench_now_ns() + 5000000000ULL; outstanding[t] > 0 && bench_now_ns() < until; ) {
+            delay(1);
+        }
+    }
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+
+    std::sort(submits.begin(), submits.end());
+    std::sort(lookups.begin(), lookups.end());
+    printf("submit: %ld threads each keeping %ld posts in flight, %ld flooding streams, %ld s\n", threads, inflight, streams, seconds);
+    printf("submit: %zu httpc_post() calls, %ld refused, took p50 %.1f us p99 %.1f us max %.1f us\n",
+        submits.size(), refused.load(), pct_us(submits, 0.5), pct_us(submits, 0.99), pct_us(submits, 1.0));
+    printf("submit: %zu httpc_is_open() calls, took p50 %.1f us p99 %.1f us max %.1f us\n",
+        lookups.size(), pct_us(lookups, 0.5), pct_us(lookups, 0.99), pct_us(lookups, 1.0));
+    printf("submit: %.0f posts/s answered, %ld failed, %.0f stream statuses/s alongside\n",
+        posts / ((t1 - t0) / 1e9), failed, lines / ((t1 - t0) / 1e9));
+    delete[] outstanding;
+    return posts > 0 && failed == 0 ? 0 : 1;
+}
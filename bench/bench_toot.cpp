@@ -0,0 +1,127 @@
+// Request latency benchmark, lyuba_toot() against the mock server
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include <Arduino.h>
+#include "bench.h"
+#include "lyuba.h"
+#include "mock_server.h"
+
+static std::atomic<int> tootsDone(0);
+static std::atomic<int> tootsFailed(0);
+static std::atomic<uint64_t> tootDoneNs(0);
+static long connections;
+
+static void toot_cb(bool ok) {
+    tootDoneNs = bench_now_ns();
+    if (!ok) {
+        tootsFailed++;
+    }
+    tootsDone++;
+}
+
+// next "METHOD PATH NS" report from the mock server for path
+static uint64_t read_report(FILE *fp, const char *path) {
+    char line[256], method[16], reqPath[200];
+    unsigned long long ns;
+    while (NULL != fgets(line, sizeof(line), fp)) {
+        if (3 != sscanf(line, "%15s %199s %llu", method, reqPath, &ns)) {
+            continue;
+        }
+        if (0 == strcmp(method, "ACCEPT")) {
+            connections++;
+        } else if (0 == strcmp(reqPath, path)) {
+            return ns;
+        }
+    }
+    return 0;
+}
+
+static double pct_ms(std::vector<uint64_t> v, double p) {
+    if (v.empty()) {
+        return 0;
+    }
+    std::sort(v.begin(), v.end());
+    return v[(size_t)(p * (v.size() - 1))] / 1e6;
+}
+
+// wakeups and CPU of the library's tasks while the caller sleeps
+static void idle_report(long idle_ms, const char *what) {
+    struct rusage r0, r1;
+    long switches;
+    double cpu;
+
+    getrusage(RUSAGE_SELF, &r0);
+    delay(idle_ms);
+    getrusage(RUSAGE_SELF, &r1);
+    switches = (r1.ru_nvcsw + r1.ru_nivcsw) - (r0.ru_nvcsw + r0.ru_nivcsw);
+    cpu = (r1.ru_utime.tv_sec - r0.ru_utime.tv_sec + r1.ru_stime.tv_sec - r0.ru_stime.tv_sec) * 1e3 +
+        (r1.ru_utime.tv_usec - r0.ru_utime.tv_usec + r1.ru_stime.tv_usec - r0.ru_stime.tv_usec) / 1e3;
+    printf("toot: %s, %.1f wakeups/s, %.3f ms CPU/s\n", what, switches * 1000.0 / idle_ms, cpu * 1000.0 / idle_ms);
+}
+
+int bench_toot(int argc, char **argv) {
+    long count = bench_opt_long(argc, argv, "--count", 200);
+    long idle_ms = bench_opt_long(argc, argv, "--idle", 2000);
+    mock_server_config_t cfg;
+    httpc_tls_stats_t tls;
+    std::vector<uint64_t> wire, done;
+    char host[32];
+    int lfd, pipefd[2];
+    lyuba_t *lyuba;
+    FILE *reports;
+    pid_t pid;
+
+    mock_server_config_init(&cfg);
+    if ((lfd = mock_server_listen(0)) < 0 || 0 != pipe(pipefd)) {
+        perror("toot setup");
+        return 1;
+    }
+    snprintf(host, sizeof(host), "127.0.0.1:%d", mock_server_port(lfd));
+    cfg.report_fd = pipefd[1];
+    pid = mock_server_fork(lfd, &cfg);
+    close(pipefd[1]);
+    close(lfd);
+    reports = fdopen(pipefd[0], "r");
+
+    if (NULL == (lyuba = lyuba_init(host, NULL, NULL))) {
+        fprintf(stderr, "lyuba_init failed\n");
+        kill(pid, SIGTERM);
+        return 1;
+    }
+    idle_report(idle_ms, "idle, no requests");
+
+    for (long i=0;i<count;i++) {
+        int before = tootsDone;
+        uint64_t t0 = bench_now_ns();
+        lyuba_toot(lyuba, "Bearer mockaccesstoken", "bench", toot_cb);
+        uint64_t fb = read_report(reports, "/api/v1/statuses");
+        while (tootsDone == before) {
+            lyuba_loop(lyuba);
+            delay(1);
+        }
+        wire.push_back(fb - t0);
+        done.push_back(tootDoneNs - t0);
+    }
+
+    httpc_get_tls_stats(&tls);
+    printf("toot: %ld toots, %d failed, %ld connections opened\n", count, tootsFailed.load(), connections);
+    printf("toot: TLS handshakes %lu full, %lu resumed\n", tls.fullHandshakes, tls.resumedHandshakes);
+    printf("toot: lyuba_toot() to first byte on the wire p50 %.2f ms p99 %.2f ms\n", pct_ms(wire, 0.5), pct_ms(wire, 0.99));
+    printf("toot: lyuba_toot() to callback p50 %.2f ms p99 %.2f ms\n", pct_ms(done, 0.5), pct_ms(done, 0.99));
+    bench_print_httpc_stats("toot");
+
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    fclose(reports);
+    return tootsFailed == 0 ? 0 : 1;
+}
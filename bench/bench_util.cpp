@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+#include "httpc.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+uint64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t bench_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+const char *bench_opt_str(int argc, char **argv, const char *name, const char *def) {
+    for (int i=0;i<argc-1;i++) {
+        if (0 == strcmp(argv[i], name)) {
+            return argv[i+1];
+        }
+    }
+    return def;
+}
+
+long bench_opt_long(int argc, char **argv, const char *name, long def) {
+    const char *s = bench_opt_str(argc, argv, name, NULL);
+    return s != NULL ? strtol(s, NULL, 0) : def;
+}
+
+void bench_print_httpc_stats(const char *name) {
+    static const char *phases[HTTPC_PHASES] = {"dns", "connect", "tls", "first byte", "complete"};
+    httpc_stats_t stats;
+
+    httpc_get_stats(&stats);
+    printf("%s: httpc %lu requests %lu responses %lu failures (%lu timeouts %lu stalls) %lu reconnects, %llu bytes in %llu out, buffer high water %zu\n",
+        name, stats.requests, stats.responses, stats.failures, stats.timeouts, stats.stalls, stats.reconnects, stats.bytesIn, stats.bytesOut, stats.bufHighWater);
+    printf("%s: httpc %lu WiFi losses, %lu pooled connections made again\n", name, stats.linkLosses, stats.preconnects);
+    printf("%s: httpc %lu allocations %lu frees, internal heap free %zu min %zu, PSRAM free %zu\n",
+        name, stats.allocs, stats.frees, stats.heapFree, stats.heapMinFree, stats.psramFree);
+    printf("%s: httpc %-10s", name, "ms");
+    for (int b=0;b<HTTPC_HIST_BUCKETS;b++) {
+        char bound[16];
+        snprintf(bound, sizeof(bound), b < HTTPC_HIST_BUCKETS - 1 ? "<%lu" : "more", 1UL << (2 * b));
+        printf(" %7s", bound);
+    }
+    printf("\n");
+    for (int p=0;p<HTTPC_PHASES;p++) {
+        printf("%s: httpc %-10s", name, phases[p]);
+        for (int b=0;b<HTTPC_HIST_BUCKETS;b++) {
+            printf(" %7lu", stats.hist[p][b]);
+        }
+        printf("\n");
+    }
+}
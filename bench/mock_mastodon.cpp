@@ -0,0 +1,29 @@
+// mock_mastodon, standalone loopback Mastodon server for manual testing
+//
+//   mock_mastodon [--port N] [--rate N] [--count N] [--padding N] [--heartbeat MS] [--replay FILE]
+
+#include <stdio.h>
+
+#include "bench.h"
+#include "mock_server.h"
+
+int main(int argc, char **argv) {
+    mock_server_config_t cfg;
+    int lfd;
+
+    mock_server_config_init(&cfg);
+    cfg.rate = bench_opt_long(argc, argv, "--rate", 10);
+    cfg.count = bench_opt_long(argc, argv, "--count", 0);
+    cfg.padding = bench_opt_long(argc, argv, "--padding", 0);
+    cfg.heartbeat_ms = bench_opt_long(argc, argv, "--heartbeat", 15000);
+    cfg.replay_path = bench_opt_str(argc, argv, "--replay", NULL);
+
+    if ((lfd = mock_server_listen(bench_opt_long(argc, argv, "--port", 8080))) < 0) {
+        perror("mock_server_listen");
+        return 1;
+    }
+    printf("mock_mastodon listening on 127.0.0.1:%d\n", mock_server_port(lfd));
+    fflush(stdout);
+    mock_server_run(lfd, &cfg);
+    return 0;
+}
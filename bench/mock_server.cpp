@@ -0,0 +1,721 @@
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "mock_server.h"
+#include "mbedtls/base64.h"
+#include "mbedtls/sha1.h"
+
+#define MAX_REQUEST_HEADERS 16384
+#define STREAMING_PREFIX "/api/v1/streaming/"
+#define STREAMING_WS "/api/v1/streaming"
+#define TIMELINES_PREFIX "/api/v1/timelines/"
+#define FIRST_STATUS_ID 109457081214960000ULL
+
+typedef struct {
+    std::string text;   // SSE block as sent, including its terminating newlines
+    bool isStatus;      // "update" event, paced and counted
+} mock_event_t;
+
+typedef struct {
+    std::string method;
+    std::string path;
+    std::string body;
+    bool close;
+    std::string wsKey;      // Sec-WebSocket-Key of a websocket upgrade, "" if not one
+    uint64_t firstByteNs;   // arrival of the first byte of the request
+} mock_request_t;
+
+typedef struct {
+    int fd;
+    const mock_server_config_t *cfg;
+} mock_conn_t;
+
+static std::vector<mock_event_t> events;
+// synthesised statuses are numbered in the order they're posted, across every stream, so timelines can serve them
+static std::atomic<unsigned long long> nextStatusId(FIRST_STATUS_ID);
+static std::atomic<long> streamsEnded(0);
+static std::atomic<long> streamRequests(0);
+static std::atomic<bool> streamStalled(false);
+// posts counted against cfg->post_limit, one account shared by every connection
+static std::mutex postLock;
+static uint64_t postWindowStart;    // CLOCK_REALTIME ns
+static long postsInWindow;
+
+void mock_server_config_init(mock_server_config_t *cfg) {
+    memset(cfg, 0x00, sizeof(mock_server_config_t));
+    cfg->count = 1000;
+    cfg->report_fd = -1;
+}
+
+int mock_server_listen(int port) {
+    struct sockaddr_in addr;
+    int fd, one = 1;
+
+    if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    memset(&addr, 0x00, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (0 != bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || 0 != listen(fd, 64)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int mock_server_port(int listen_fd) {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    if (0 != getsockname(listen_fd, (struct sockaddr *)&addr, &len)) {
+        return -1;
+    }
+    return ntohs(addr.sin_port);
+}
+
+// split a capture into SSE blocks, comments (heartbeats) stand alone
+static bool load_capture(const char *path) {
+    FILE *fp;
+    char line[65536];
+    mock_event_t ev;
+
+    if (NULL == (fp = fopen(path, "r"))) {
+        fprintf(stderr, "mock_server: can't open %s\n", path);
+        return false;
+    }
+    ev.isStatus = false;
+    while (NULL != fgets(line, sizeof(line), fp)) {
+        if (line[0] == ':' && ev.text.empty()) {
+            if (0 == strncmp(line, ":thump", 6)) {
+                mock_event_t hb = {line, false};
+                events.push_back(hb);
+            }
+            continue;
+        }
+        ev.text += line;
+        if (0 == strncmp(line, "event: update", 13)) {
+            ev.isStatus = true;
+        }
+        if (line[0] == '\n' || (line[0] == '\r' && line[1] == '\n')) {
+            events.push_back(ev);
+            ev.text.clear();
+            ev.isStatus = false;
+        }
+    }
+    fclose(fp);
+    return !events.empty();
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void sleep_until_ns(uint64_t t) {
+    struct timespec ts;
+    ts.tv_sec = t / 1000000000ULL;
+    ts.tv_nsec = t % 1000000000ULL;
+    while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)) {
+    }
+}
+
+static bool send_all(int fd, const char *p, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool send_chunk(int fd, const std::string &data) {
+    char hdr[16];
+    snprintf(hdr, sizeof(hdr), "%zx\r\n", data.size());
+    std::string chunk = hdr + data + "\r\n";
+    return send_all(fd, chunk.data(), chunk.size());
+}
+
+// extra is any further header lines, each ending in CRLF
+static bool send_response_headers(int fd, int status, const char *reason, const char *contentType, const char *extra, const std::string &body, bool close) {
+    char hdr[1024];
+    snprintf(hdr, sizeof(hdr), "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n%s%s\r\n",
+        status, reason, contentType, body.size(), extra, close ? "Connection: close\r\n" : "");
+    return send_all(fd, hdr, strlen(hdr)) && send_all(fd, body.data(), body.size());
+}
+
+static bool send_response(int fd, int status, const char *reason, const char *contentType, const std::string &body, bool close) {
+    return send_response_headers(fd, status, reason, contentType, "", body, close);
+}
+
+// a post to /api/v1/statuses, rate limited as Mastodon does when cfg->post_limit is set
+static bool serve_post_status(int fd, const mock_server_config_t *cfg, unsigned long long id, bool close) {
+    char body[128], extra[384], date[64], reset[64];
+    struct timespec ts;
+    struct tm tm;
+    uint64_t now, resetNs;
+    bool allowed;
+    long remaining;
+
+    snprintf(body, sizeof(body), "{\"id\":\"%llu\",\"visibility\":\"public\",\"content\":\"\"}", id);
+    if (cfg->post_limit <= 0 || cfg->post_window_ms <= 0) {
+        return send_response(fd, 200, "OK", "application/json", body, close);
+    }
+    clock_gettime(CLOCK_REALTIME, &ts);
+    now = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    {
+        std::lock_guard<std::mutex> guard(postLock);
+        uint64_t window = (uint64_t)cfg->post_window_ms * 1000000ULL;
+        if (postWindowStart == 0) {
+            postWindowStart = now;
+        }
+        if (now - postWindowStart >= window) {
+            postWindowStart += (now - postWindowStart) / window * window;
+            postsInWindow = 0;
+        }
+        allowed = postsInWindow < cfg->post_limit;
+        if (allowed) {
+            postsInWindow++;
+        }
+        remaining = cfg->post_limit - postsInWindow;
+        resetNs = postWindowStart + window;
+    }
+    time_t secs = (time_t)(now / 1000000000ULL);
+    gmtime_r(&secs, &tm);
+    strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    secs = (time_t)(resetNs / 1000000000ULL);
+    gmtime_r(&secs, &tm);
+    strftime(reset, sizeof(reset), "%Y-%m-%dT%H:%M:%S", &tm);
+    snprintf(extra, sizeof(extra), "Date: %s\r\nX-RateLimit-Limit: %ld\r\nX-RateLimit-Remaining: %ld\r\nX-RateLimit-Reset: %s.%06luZ\r\n",
+        date, cfg->post_limit, remaining, reset, (unsigned long)(resetNs % 1000000000ULL / 1000));
+    if (!allowed) {
+        snprintf(extra + strlen(extra), sizeof(extra) - strlen(extra), "Retry-After: %lu\r\n",
+            (unsigned long)((resetNs - now + 999999999ULL) / 1000000000ULL));
+        return send_response_headers(fd, 429, "Too Many Requests", "application/json", extra, "{\"error\":\"Too many requests\"}", close);
+    }
+    return send_response_headers(fd, 200, "OK", "application/json", extra, body, close);
+}
+
+// the first cfg->fail_first streaming requests get cfg->fail_status instead, true if this one did
+static bool refuse_stream(int fd, const mock_server_config_t *cfg) {
+    char hdr[256];
+
+    if (streamRequests++ >= cfg->fail_first) {
+        return false;
+    }
+    if (cfg->fail_status > 0) {
+        snprintf(hdr, sizeof(hdr), "HTTP/1.1 %d Refused\r\nContent-Type: application/json\r\nContent-Length: 2\r\n"
+            "Connection: close\r\n", cfg->fail_status);
+        if (cfg->retry_after_s > 0) {
+            snprintf(hdr + strlen(hdr), sizeof(hdr) - strlen(hdr), "Retry-After: %ld\r\n", cfg->retry_after_s);
+        }
+        strcat(hdr, "\r\n{}");
+        send_all(fd, hdr, strlen(hdr));
+    }
+    return true;
+}
+
+// hold a stream silent until the client leaves
+static void hold_silent(int fd, const mock_server_config_t *cfg) {
+    char buf[4096];
+
+    if (cfg->report_fd >= 0) {
+        char report[64];
+        int len = snprintf(report, sizeof(report), "STALL - %llu\n", (unsigned long long)now_ns());
+        if (write(cfg->report_fd, report, len) < 0) {
+            perror("mock_server report");
+        }
+    }
+    while (recv(fd, buf, sizeof(buf), 0) > 0) {
+    }
+}
+
+// true once sent statuses have gone down the stream that's to stall, it has then been held silent until the client left
+static bool stall_stream(int fd, const mock_server_config_t *cfg, long sent) {
+    if (cfg->stall_after <= 0 || sent != cfg->stall_after || streamStalled.exchange(true)) {
+        return false;
+    }
+    hold_silent(fd, cfg);
+    return true;
+}
+
+static bool read_request(int fd, std::string &pending, mock_request_t *req) {
+    size_t hdrEnd, pos;
+    long contentLength = 0;
+    char buf[4096];
+
+    req->firstByteNs = now_ns();
+    while (std::string::npos == (hdrEnd = pending.find("\r\n\r\n"))) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0 || pending.size() > MAX_REQUEST_HEADERS) {
+            return false;
+        }
+        if (pending.empty()) {
+            req->firstByteNs = now_ns();
+        }
+        pending.append(buf, n);
+    }
+
+    std::string head = pending.substr(0, hdrEnd + 2);
+    pending.erase(0, hdrEnd + 4);
+
+    pos = head.find(' ');
+    req->method = head.substr(0, pos);
+    req->path = head.substr(pos + 1, head.find(' ', pos + 1) - pos - 1);
+    req->close = false;
+    req->wsKey.clear();
+    for (pos = head.find("\r\n"); pos != std::string::npos && pos + 2 < head.size(); pos = head.find("\r\n", pos + 2)) {
+        const char *line = head.c_str() + pos + 2;
+        if (0 == strncasecmp(line, "Content-Length:", 15)) {
+            contentLength = atol(line + 15);
+        } else if (0 == strncasecmp(line, "Connection:", 11) && NULL != strcasestr(line, "close")) {
+            req->close = true;
+        } else if (0 == strncasecmp(line, "Sec-WebSocket-Key:", 18)) {
+            const char *v = line + 18;
+            while (*v == ' ') {
+                v++;
+            }
+            req->wsKey.assign(v, strcspn(v, "\r"));
+        }
+    }
+
+    while ((long)pending.size() < contentLength) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            return false;
+        }
+        pending.append(buf, n);
+    }
+    req->body = pending.substr(0, contentLength);
+    pending.erase(0, contentLength);
+    return true;
+}
+
+// insert the send time at the start of a status' content
+static std::string stamp(const std::string &text) {
+    static const char *key = "\"content\":\"";
+    char ts[64];
+    size_t pos = text.find(key);
+    unsigned long long id = 0;
+    size_t idPos = text.find("\"id\":\"");
+    if (pos == std::string::npos) {
+        return text;
+    }
+    if (idPos != std::string::npos) {
+        id = strtoull(text.c_str() + idPos + 6, NULL, 10);
+    }
+    snprintf(ts, sizeof(ts), "ts:%019llu id:%llu ", (unsigned long long)now_ns(), id);
+    std::string out = text;
+    out.insert(pos + strlen(key), ts);
+    return out;
+}
+
+// the next SSE block to send, from the capture or synthesised
+static std::string next_event(const mock_server_config_t *cfg, size_t *ev, bool *isStatus) {
+    if (cfg->replay_path != NULL) {
+        std::string text = events[*ev].text;
+        *isStatus = events[*ev].isStatus;
+        *ev = (*ev + 1) % events.size();
+        return text;
+    }
+    *isStatus = true;
+    return bench_make_sse_update(nextStatusId++, cfg->padding);
+}
+
+static void serve_stream(int fd, const mock_server_config_t *cfg) {
+    static const char *hdr = "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nTransfer-Encoding: chunked\r\nCache-Control: no-store\r\n\r\n";
+    uint64_t start, next, interval, lastHeartbeat;
+    long sent = 0;
+    size_t ev = 0;
+
+    if (!send_all(fd, hdr, strlen(hdr))) {
+        return;
+    }
+    if (streamsEnded > 0) {
+        nextStatusId += cfg->gap - cfg->gap / 2;   // posted while the client was reconnecting
+    }
+    interval = cfg->rate > 0 ? 1000000000ULL / cfg->rate : 0;
+    start = lastHeartbeat = now_ns();
+    while (cfg->count == 0 || sent < cfg->count) {
+        bool isStatus;
+        std::string text = next_event(cfg, &ev, &isStatus);
+
+        if (isStatus) {
+            next = start + sent * interval;
+            // keep heartbeats flowing while waiting for the next slot
+            while (cfg->heartbeat_ms > 0 && next > lastHeartbeat + cfg->heartbeat_ms * 1000000ULL) {
+                lastHeartbeat += cfg->heartbeat_ms * 1000000ULL;
+                sleep_until_ns(lastHeartbeat);
+                if (!send_chunk(fd, ":thump\n")) {
+                    return;
+                }
+            }
+            if (interval > 0) {
+                sleep_until_ns(next);
+            }
+            text = stamp(text);
+            sent++;
+        }
+        if (!send_chunk(fd, text) || (isStatus && stall_stream(fd, cfg, sent))) {
+            return;
+        }
+    }
+    nextStatusId += cfg->gap / 2;  // posted before the client could reconnect
+    streamsEnded++;
+    if (cfg->stall_end) {
+        hold_silent(fd, cfg);
+        return;
+    }
+    send_all(fd, "0\r\n\r\n", 5);
+}
+
+// value of name in the query of path, "" if absent
+static std::string query_param(const std::string &path, const char *name) {
+    size_t q = path.find('?');
+    std::string key = std::string(name) + "=";
+    while (q != std::string::npos) {
+        if (0 == path.compare(q + 1, key.size(), key)) {
+            size_t end = path.find('&', q + 1);
+            return path.substr(q + 1 + key.size(), end == std::string::npos ? std::string::npos : end - q - 1 - key.size());
+        }
+        q = path.find('&', q + 1);
+    }
+    return "";
+}
+
+// any timeline, all of them hold every synthesised status posted so far, newest first
+static bool serve_timeline(int fd, const mock_server_config_t *cfg, const std::string &path, bool close) {
+    unsigned long long newest = nextStatusId - 1, first, last;
+    std::string minId = query_param(path, "min_id"), sinceId = query_param(path, "since_id");
+    long limit = strtol(query_param(path, "limit").c_str(), NULL, 10);
+    std::string body = "[";
+
+    if (limit <= 0 || limit > 40) {
+        limit = limit <= 0 ? 20 : 40;
+    }
+    if (!minId.empty()) {
+        // the page straight after min_id
+        first = strtoull(minId.c_str(), NULL, 10) + 1;
+        last = std::min(first + limit - 1, newest);
+    } else {
+        // the newest page, after since_id if given
+        last = newest;
+        first = last >= FIRST_STATUS_ID + limit ? last - limit + 1 : FIRST_STATUS_ID;
+        if (!sinceId.empty()) {
+            first = std::max(first, strtoull(sinceId.c_str(), NULL, 10) + 1);
+        }
+    }
+    for (unsigned long long id = last; id >= first && id >= FIRST_STATUS_ID && id <= newest; id--) {
+        body += (body.size() > 1 ? "," : "") + stamp(bench_make_status(id, cfg->padding));
+    }
+    body += "]";
+    return send_response(fd, 200, "OK", "application/json", body, close);
+}
+
+static bool ws_send_frame(int fd, unsigned char opcode, const std::string &payload) {
+    std::string frame;
+    frame += (char)(0x80 | opcode);
+    if (payload.size() < 126) {
+        frame += (char)payload.size();
+    } else if (payload.size() < 65536) {
+        frame += (char)126;
+        frame += (char)(payload.size() >> 8);
+        frame += (char)(payload.size() & 0xFF);
+    } else {
+        frame += (char)127;
+        for (int i=7;i>=0;i--) {
+            frame += (char)((uint64_t)payload.size() >> (i * 8));
+        }
+    }
+    frame += payload;
+    return send_all(fd, frame.data(), frame.size());
+}
+
+// a JSON string value's text, from the first "key":"..." in msg
+static std::string json_string_field(const std::string &msg, const char *key) {
+    std::string k = std::string("\"") + key + "\":\"";
+    size_t pos = msg.find(k), end;
+    if (pos == std::string::npos || std::string::npos == (end = msg.find('"', pos + k.size()))) {
+        return "";
+    }
+    return msg.substr(pos + k.size(), end - pos - k.size());
+}
+
+static std::string json_escape(const std::string &text) {
+    std::string out;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c == '\n') {
+            out += "\\n";
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+// read whatever client frames have arrived, subscriptions are added to subs, returns false once the client has gone
+static bool ws_read_frames(int fd, std::string &in, std::vector<std::string> &subs, int timeout_ms) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    char buf[4096];
+
+    if (poll(&pfd, 1, timeout_ms) > 0) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            return false;
+        }
+        in.append(buf, n);
+    }
+    for (;;) {
+        const unsigned char *p = (const unsigned char *)in.data();
+        size_t hdr = 2, len;
+        if (in.size() < 2) {
+            return true;
+        }
+        len = p[1] & 0x7F;
+        if (len == 126) {
+            hdr += 2;
+        } else if (len == 127) {
+            return false;   // nothing lyuba sends is that big
+        }
+        hdr += 4;   // client frames are masked
+        if (in.size() < hdr) {
+            return true;
+        }
+        if (len == 126) {
+            len = (size_t)p[2] << 8 | p[3];
+        }
+        if (in.size() < hdr + len) {
+            return true;
+        }
+        std::string payload = in.substr(hdr, len);
+        for (size_t i=0;i<len;i++) {
+            payload[i] ^= p[hdr - 4 + (i & 3)];
+        }
+        unsigned char opcode = p[0] & 0x0F;
+        in.erase(0, hdr + len);
+        if (opcode == 0x1 && json_string_field(payload, "type") == "subscribe") {
+            // as the streaming server names it in messages, e.g. ["hashtag","cheerlights"]
+            std::string name = "[\"" + json_string_field(payload, "stream") + "\"";
+            std::string param = json_string_field(payload, "tag");
+            if (param.empty()) {
+                param = json_string_field(payload, "list");
+            }
+            if (!param.empty()) {
+                name += ",\"" + param + "\"";
+            }
+            subs.push_back(name + "]");
+        } else if (opcode == 0x9) {
+            ws_send_frame(fd, 0xA, payload);
+        } else if (opcode == 0x8) {
+            ws_send_frame(fd, 0x8, payload.substr(0, 2));
+            return false;
+        }
+    }
+}
+
+// the streaming API's websocket, every subscribed stream gets its own count of events, interleaved
+static void serve_ws(int fd, const mock_server_config_t *cfg, const std::string &key, std::string &pending) {
+    unsigned char digest[20];
+    unsigned char accept[32];
+    size_t acceptLen;
+    char hdr[256];
+    std::string keyGuid = key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    std::vector<std::string> subs;
+    std::vector<long> sent;
+    uint64_t start = 0, interval = 0;
+    long total = 0;
+    size_t ev = 0, next = 0;
+
+    mbedtls_sha1((const unsigned char *)keyGuid.data(), keyGuid.size(), digest);
+    mbedtls_base64_encode(accept, sizeof(accept), &acceptLen, digest, sizeof(digest));
+    snprintf(hdr, sizeof(hdr), "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: %s\r\n\r\n", accept);
+    if (!send_all(fd, hdr, strlen(hdr))) {
+        return;
+    }
+    for (;;) {
+        bool isStatus;
+        if (!ws_read_frames(fd, pending, subs, subs.empty() ? 100 : 0)) {
+            return;
+        }
+        if (subs.empty()) {
+            continue;
+        }
+        if (sent.size() != subs.size()) {
+            sent.resize(subs.size(), 0);
+            start = now_ns() - total * interval;
+            interval = cfg->rate > 0 ? 1000000000ULL / (cfg->rate * subs.size()) : 0;
+        }
+        // next stream still owed events
+        size_t i;
+        for (i=0;i<subs.size();i++) {
+            size_t s = (next + i) % subs.size();
+            if (cfg->count == 0 || sent[s] < cfg->count) {
+                next = s;
+                break;
+            }
+        }
+        if (i == subs.size()) {
+            ws_send_frame(fd, 0x8, std::string("\x03\xe8", 2));    // 1000, normal closure
+            while (ws_read_frames(fd, pending, subs, 1000)) {
+            }
+            return;
+        }
+        uint64_t now = now_ns(), due = start + total * interval;
+        if (now < due) {
+            // answer pings while waiting
+            if (!ws_read_frames(fd, pending, subs, (int)((due - now) / 1000000) + 1)) {
+                return;
+            }
+            continue;
+        }
+        std::string text = next_event(cfg, &ev, &isStatus);
+        if (isStatus) {
+            text = stamp(text);
+            sent[next]++;
+            total++;
+        }
+        // SSE block to {"stream":[...],"event":"...","payload":"..."}
+        std::string event = "message", data;
+        for (size_t pos = 0; pos < text.size(); ) {
+            size_t eol = text.find('\n', pos);
+            std::string line = text.substr(pos, eol == std::string::npos ? std::string::npos : eol - pos);
+            if (0 == line.compare(0, 7, "event: ")) {
+                event = line.substr(7);
+            } else if (0 == line.compare(0, 6, "data: ")) {
+                data += (data.empty() ? "" : "\n") + line.substr(6);
+            }
+            pos = eol == std::string::npos ? text.size() : eol + 1;
+        }
+        if (data.empty()) {
+            continue;   // a heartbeat
+        }
+        std::string msg = "{\"stream\":" + subs[next] + ",\"event\":\"" + event + "\",\"payload\":\"" + json_escape(data) + "\"}";
+        if (!ws_send_frame(fd, 0x1, msg) || (isStatus && stall_stream(fd, cfg, total))) {
+            return;
+        }
+        if (isStatus) {
+            next = (next + 1) % subs.size();
+        }
+    }
+}
+
+static void *conn_thread(void *arg) {
+    mock_conn_t *conn = (mock_conn_t *)arg;
+    std::string pending;
+    mock_request_t req;
+    unsigned long long statusId = 109457081214970000ULL;
+    bool ok = true;
+
+    while (ok && read_request(conn->fd, pending, &req)) {
+        if (conn->cfg->report_fd >= 0) {
+            char report[256];
+            int len = req.body.empty() ?
+                snprintf(report, sizeof(report), "%s %s %llu\n", req.method.c_str(), req.path.c_str(), (unsigned long long)req.firstByteNs) :
+                snprintf(report, sizeof(report), "%s %s %llu %zu\n", req.method.c_str(), req.path.c_str(), (unsigned long long)req.firstByteNs, req.body.size());
+            if (len > 0 && len < (int)sizeof(report) && write(conn->cfg->report_fd, report, len) < 0) {
+                perror("mock_server report");
+            }
+        }
+        if (req.method == "GET" && !req.wsKey.empty() && 0 == req.path.compare(0, strlen(STREAMING_WS), STREAMING_WS)) {
+            if (!refuse_stream(conn->fd, conn->cfg)) {
+                serve_ws(conn->fd, conn->cfg, req.wsKey, pending);
+            }
+            break;
+        } else if (req.method == "GET" && 0 == req.path.compare(0, strlen(STREAMING_PREFIX), STREAMING_PREFIX)) {
+            if (!refuse_stream(conn->fd, conn->cfg)) {
+                serve_stream(conn->fd, conn->cfg);
+            }
+            break;
+        } else if (req.method == "GET" && 0 == req.path.compare(0, strlen(TIMELINES_PREFIX), TIMELINES_PREFIX)) {
+            ok = serve_timeline(conn->fd, conn->cfg, req.path, req.close);
+        } else if (req.method == "POST" && req.path == "/api/v1/statuses") {
+            ok = serve_post_status(conn->fd, conn->cfg, statusId++, req.close);
+        } else if (req.method == "POST" && req.path == "/api/v1/apps") {
+            ok = send_response(conn->fd, 200, "OK", "application/json",
+                "{\"id\":\"1\",\"name\":\"lyuba\",\"client_id\":\"mockclientid\",\"client_secret\":\"mockclientsecret\"}", req.close);
+        } else if (req.method == "POST" && req.path == "/oauth/token") {
+            ok = send_response(conn->fd, 200, "OK", "application/json",
+                "{\"access_token\":\"mockaccesstoken\",\"token_type\":\"Bearer\",\"scope\":\"write read follow\",\"created_at\":1670000000}", req.close);
+        } else {
+            ok = send_response(conn->fd, 404, "Not Found", "application/json", "{\"error\":\"Record not found\"}", req.close);
+        }
+        if (req.close) {
+            break;
+        }
+    }
+    close(conn->fd);
+    delete conn;
+    return NULL;
+}
+
+void mock_server_run(int listen_fd, const mock_server_config_t *cfg) {
+    signal(SIGPIPE, SIG_IGN);
+    if (cfg->replay_path != NULL && !load_capture(cfg->replay_path)) {
+        exit(1);
+    }
+    for (;;) {
+        pthread_t thread;
+        int one = 1;
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (cfg->report_fd >= 0) {
+            char report[64];
+            int len = snprintf(report, sizeof(report), "ACCEPT - %llu\n", (unsigned long long)now_ns());
+            if (write(cfg->report_fd, report, len) < 0) {
+                perror("mock_server report");
+            }
+        }
+        mock_conn_t *conn = new mock_conn_t;
+        conn->fd = fd;
+        conn->cfg = cfg;
+        if (0 != pthread_create(&thread, NULL, conn_thread, conn)) {
+            close(fd);
+            delete conn;
+            continue;
+        }
+        pthread_detach(thread);
+    }
+}
+
+pid_t mock_server_fork(int listen_fd, const mock_server_config_t *cfg) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        mock_server_run(listen_fd, cfg);
+        _exit(0);
+    }
+    return pid;
+}
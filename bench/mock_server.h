@@ -0,0 +1,46 @@
+#ifndef MOCK_SERVER_H
+#define MOCK_SERVER_H 1
+
+// Loopback mock of the Mastodon endpoints lyuba uses, plain HTTP/1.1 with
+// keep-alive. Streaming requests replay SSE traffic, either a capture file
+// or synthesised statuses, at a configurable rate, and the same traffic
+// is served over the streaming websocket to each stream subscribed there.
+// Each replayed status has its send time (CLOCK_MONOTONIC ns) and id
+// stamped at the start of its content as "ts:<ns> id:<id> " so the client
+// can measure delivery latency and spot repeats.
+
+#include <stddef.h>
+#include <sys/types.h>
+
+typedef struct {
+    const char *replay_path;    // SSE capture to replay, NULL to synthesise statuses
+    long rate;                  // statuses per second per stream, 0 for as fast as possible
+    long count;                 // statuses per stream before it is ended, 0 for endless
+    size_t padding;             // extra content bytes in synthesised statuses
+    long heartbeat_ms;          // interval between ":thump" comments, 0 for none
+    long gap;                   // statuses posted unseen each time a stream ends, half before the client reconnects
+                                // and half while it does. Timelines serve them (and every other synthesised status).
+    bool stall_end;             // rather than end each SSE stream, go silent as for stall_after until the client gives up
+    long fail_first;            // streaming requests (SSE or websocket) refused before any is served
+    int fail_status;            // how they're refused, e.g. 503, 429 or 401, 0 to close the connection unanswered
+    long retry_after_s;         // Retry-After sent with a refusal, 0 for none
+    long stall_after;           // statuses sent down the first stream (SSE or websocket) before it goes silent, no
+                                // heartbeats or pongs either, with the connection left open until the client gives up
+                                // on it. 0 never. "STALL - ns" is reported when it does.
+    long post_limit;            // statuses that may be posted per window, with X-RateLimit- headers, 0 for no limit.
+                                // Once it's used up posts get 429 until the window resets.
+    long post_window_ms;        // length of that window, windows are back to back from the first post
+    int report_fd;              // if >= 0, "METHOD PATH first-byte-ns" is written here for each request, followed
+                                // by the body's length if it has one, and "ACCEPT - ns" for each connection
+} mock_server_config_t;
+
+void mock_server_config_init(mock_server_config_t *cfg);
+// bind a listening socket on 127.0.0.1, port 0 picks a free port
+int mock_server_listen(int port);
+int mock_server_port(int listen_fd);
+// serve forever on listen_fd
+void mock_server_run(int listen_fd, const mock_server_config_t *cfg);
+// serve from a child process, returns its pid (kill it when done)
+pid_t mock_server_fork(int listen_fd, const mock_server_config_t *cfg);
+
+#endif
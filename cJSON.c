@@ -188,23 +188,28 @@ static cJSON *cJSON_New_Item(const internal_hooks *const hooks)
 	return node;
 }
 
-/* Delete a cJSON structure. */
-CJSON_PUBLIC(void) cJSON_Delete(cJSON * item){
+/* Delete a cJSON structure made with the given hooks. */
+static void delete_with_hooks(cJSON * item, const internal_hooks *const hooks){
 	cJSON *next = NULL;
 
 	while (item != NULL) {
 		next = item->next;
 		if (!(item->type & cJSON_IsReference) && (item->child != NULL))
-			cJSON_Delete(item->child);
+			delete_with_hooks(item->child, hooks);
 		if (!(item->type & cJSON_IsReference) && (item->valuestring != NULL))
-			global_hooks.deallocate(item->valuestring);
+			hooks->deallocate(item->valuestring);
 		if (!(item->type & cJSON_StringIsConst) && (item->string != NULL))
-			global_hooks.deallocate(item->string);
-		global_hooks.deallocate(item);
+			hooks->deallocate(item->string);
+		hooks->deallocate(item);
 		item = next;
 	}
 }
 
+/* Delete a cJSON structure. */
+CJSON_PUBLIC(void) cJSON_Delete(cJSON * item){
+	delete_with_hooks(item, &global_hooks);
+}
+
 /* get the decimal point character of the current locale */
 static unsigned char get_decimal_point(void)
 {
@@ -823,7 +828,7 @@ static parse_buffer *skip_utf8_bom(parse_buffer *const buffer)
 }
 
 /* Parse an object - create a new root, and populate. */
-CJSON_PUBLIC(cJSON *) cJSON_ParseWithOpts(const char *value, const char **return_parse_end, cJSON_bool require_null_terminated){
+static cJSON *parse_with_hooks(const char *value, const char **return_parse_end, cJSON_bool require_null_terminated, const internal_hooks *const hooks){
 	parse_buffer buffer = { 0, 0, 0, 0, { 0, 0, 0 } };
 	cJSON *item = NULL;
 
@@ -837,9 +842,9 @@ CJSON_PUBLIC(cJSON *) cJSON_ParseWithOpts(const char *value, const char **return
 	buffer.content = (const unsigned char *)value;
 	buffer.length = strlen((const char *)value) + sizeof("");
 	buffer.offset = 0;
-	buffer.hooks = global_hooks;
+	buffer.hooks = *hooks;
 
-	item = cJSON_New_Item(&global_hooks);
+	item = cJSON_New_Item(hooks);
 	if (item == NULL) /* memory fail */
 		goto fail;
 
@@ -860,7 +865,7 @@ CJSON_PUBLIC(cJSON *) cJSON_ParseWithOpts(const char *value, const char **return
 
 fail:
 	if (item != NULL)
-		cJSON_Delete(item);
+		delete_with_hooks(item, hooks);
 
 	if (value != NULL) {
 		error local_error;
@@ -881,11 +886,63 @@ fail:
 	return NULL;
 }
 
+CJSON_PUBLIC(cJSON *) cJSON_ParseWithOpts(const char *value, const char **return_parse_end, cJSON_bool require_null_terminated){
+	return parse_with_hooks(value, return_parse_end, require_null_terminated, &global_hooks);
+}
+
 /* Default options for cJSON_Parse */
 CJSON_PUBLIC(cJSON *) cJSON_Parse(const char *value){
 	return cJSON_ParseWithOpts(value, 0, 0);
 }
 
+/* The arena being parsed into by this thread. The hooks have no context argument, so it's passed this way. */
+#if defined(_MSC_VER)
+static __declspec(thread) cJSON_Arena *current_arena = NULL;
+#else
+static __thread cJSON_Arena *current_arena = NULL;
+#endif
+
+#define CJSON_ARENA_ALIGN sizeof(double)
+
+static void *arena_allocate(size_t size)
+{
+	cJSON_Arena *arena = current_arena;
+	size_t start = (arena->used + (CJSON_ARENA_ALIGN - 1)) & ~(CJSON_ARENA_ALIGN - 1);
+	if ((start > arena->size) || (size > arena->size - start))
+		return NULL;
+	arena->used = start + size;
+	if (arena->used > arena->peak)
+		arena->peak = arena->used;
+	return arena->block + start;
+}
+
+static void arena_deallocate(void *pointer)
+{
+	/* reclaimed all at once by cJSON_ArenaReset */
+	(void)pointer;
+}
+
+static const internal_hooks arena_hooks = { arena_allocate, arena_deallocate, NULL };
+
+CJSON_PUBLIC(void) cJSON_ArenaInit(cJSON_Arena *arena, void *block, size_t size){
+	arena->block = (unsigned char *)block;
+	arena->size = size;
+	arena->used = 0;
+	arena->peak = 0;
+}
+
+CJSON_PUBLIC(void) cJSON_ArenaReset(cJSON_Arena *arena){
+	arena->used = 0;
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_ParseWithArena(const char *value, cJSON_Arena *arena){
+	cJSON *item;
+	current_arena = arena;
+	item = parse_with_hooks(value, 0, 0, &arena_hooks);
+	current_arena = NULL;
+	return item;
+}
+
 #define cjson_min(a, b) ((a < b) ? a : b)
 
 static unsigned char *print(const cJSON *const item, cJSON_bool format, const internal_hooks *const hooks)
@@ -1160,7 +1217,7 @@ success:
 
 fail:
 	if (head != NULL)
-		cJSON_Delete(head);
+		delete_with_hooks(head, &input_buffer->hooks);
 
 	return false;
 }
@@ -1293,7 +1350,7 @@ success:
 
 fail:
 	if (head != NULL)
-		cJSON_Delete(head);
+		delete_with_hooks(head, &input_buffer->hooks);
 
 	return false;
 }
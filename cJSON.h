@@ -142,6 +142,22 @@ CJSON_PUBLIC(cJSON *) cJSON_Parse(const char *value);
 /* If you supply a ptr in return_parse_end and parsing fails, then return_parse_end will contain a pointer to the error so will match cJSON_GetErrorPtr(). */
 CJSON_PUBLIC(cJSON *) cJSON_ParseWithOpts(const char *value, const char **return_parse_end, cJSON_bool require_null_terminated);
 
+
+/* A bump allocator over a caller supplied block. A tree parsed into it needs no cJSON_Delete, and must not be
+ * given one, it's all released at once by cJSON_ArenaReset. The tree must not be modified. */
+typedef struct cJSON_Arena
+{
+    unsigned char *block;
+    size_t size;
+    size_t used;
+    size_t peak;    /* high water mark of used, for sizing the block */
+} cJSON_Arena;
+
+CJSON_PUBLIC(void) cJSON_ArenaInit(cJSON_Arena *arena, void *block, size_t size);
+CJSON_PUBLIC(void) cJSON_ArenaReset(cJSON_Arena *arena);
+/* As cJSON_Parse, allocating from the arena. Returns NULL if the JSON is bad or the arena is too small. */
+CJSON_PUBLIC(cJSON *) cJSON_ParseWithArena(const char *value, cJSON_Arena *arena);
+
 /* Render a cJSON entity to text for transfer/storage. */
 CJSON_PUBLIC(char *) cJSON_Print(const cJSON *item);
 /* Render a cJSON entity to text for transfer/storage without any formatting. */
@@ -0,0 +1,37 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H 1
+
+// Host (POSIX) stand-in for the Arduino-ESP32 core, just the parts lyuba uses.
+// Serial output goes to stderr, see host_shim.h to silence it.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_err.h"
+
+class HardwareSerial {
+public:
+    void begin(unsigned long baud);
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+    size_t print(const char *s);
+    size_t print(long n);
+    size_t println(const char *s = "");
+    size_t println(long n);
+};
+
+extern HardwareSerial Serial;
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(uint32_t ms);
+// hardware RNG on the ESP32 (declared via esp_system.h there)
+uint32_t esp_random(void);
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef HOST_PREFERENCES_H
+#define HOST_PREFERENCES_H 1
+
+// Host stand-in for the Arduino-ESP32 Preferences (NVS) library. Values are
+// held in RAM for the life of the process. Keys are limited to 15 characters
+// as on the device.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+class Preferences {
+public:
+    Preferences();
+    bool begin(const char *name, bool readOnly = false, const char *partition_label = NULL);
+    void end(void);
+    bool clear(void);
+    bool remove(const char *key);
+    bool isKey(const char *key);
+    size_t putUInt(const char *key, uint32_t value);
+    uint32_t getUInt(const char *key, uint32_t defaultValue = 0);
+    size_t putString(const char *key, const char *value);
+    size_t getString(const char *key, char *value, size_t maxLen);
+    size_t putBytes(const char *key, const void *value, size_t len);
+    size_t getBytesLength(const char *key);
+    size_t getBytes(const char *key, void *buf, size_t maxLen);
+private:
+    char _namespace[16];
+    bool _started;
+    bool _readOnly;
+};
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef HOST_WIRE_H
+#define HOST_WIRE_H 1
+
+// Included by the library sources for historical reasons, nothing is needed from it on the host
+
+#endif
@@ -0,0 +1,76 @@
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "host_shim.h"
+
+HardwareSerial Serial;
+
+static bool serialMuted = false;
+
+void host_serial_mute(bool mute) {
+    serialMuted = mute;
+}
+
+void HardwareSerial::begin(unsigned long baud) {
+    (void)baud;
+}
+
+size_t HardwareSerial::printf(const char *format, ...) {
+    va_list ap;
+    int n;
+
+    if (serialMuted) {
+        return 0;
+    }
+    va_start(ap, format);
+    n = vfprintf(stderr, format, ap);
+    va_end(ap);
+    return n < 0 ? 0 : (size_t)n;
+}
+
+size_t HardwareSerial::print(const char *s) {
+    return printf("%s", s);
+}
+
+size_t HardwareSerial::print(long n) {
+    return printf("%ld", n);
+}
+
+size_t HardwareSerial::println(const char *s) {
+    return printf("%s\r\n", s);
+}
+
+size_t HardwareSerial::println(long n) {
+    return printf("%ld\r\n", n);
+}
+
+static uint64_t monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+static uint64_t boot_us = monotonic_us();
+
+unsigned long millis(void) {
+    return (unsigned long)((monotonic_us() - boot_us) / 1000ULL);
+}
+
+unsigned long micros(void) {
+    return (unsigned long)(monotonic_us() - boot_us);
+}
+
+void delay(uint32_t ms) {
+    usleep((useconds_t)ms * 1000);
+}
+
+uint32_t esp_random(void) {
+    static bool seeded = false;
+    if (!seeded) {
+        srandom((unsigned)monotonic_us());
+        seeded = true;
+    }
+    return ((uint32_t)random() << 16) ^ (uint32_t)random();
+}
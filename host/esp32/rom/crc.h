@@ -0,0 +1,9 @@
+#ifndef HOST_ESP32_ROM_CRC_H
+#define HOST_ESP32_ROM_CRC_H 1
+
+#include <stdint.h>
+
+// Same semantics as the ESP32 ROM routine (CRC-32/ISO-HDLC, crc is inverted on entry and exit)
+uint32_t crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len);
+
+#endif
@@ -0,0 +1,88 @@
+#include <pthread.h>
+#include <string.h>
+
+#include "esp_event.h"
+#include "esp_netif_types.h"
+#include "esp_wifi_types.h"
+
+#define HOST_EVENT_HANDLERS 8
+
+ESP_EVENT_DEFINE_BASE(WIFI_EVENT);
+ESP_EVENT_DEFINE_BASE(IP_EVENT);
+
+typedef struct {
+    esp_event_base_t base;      // NULL if the slot is free
+    int32_t id;
+    esp_event_handler_t handler;
+    void *arg;
+} host_event_handler_t;
+
+static pthread_mutex_t handlersLock = PTHREAD_MUTEX_INITIALIZER;
+static host_event_handler_t handlers[HOST_EVENT_HANDLERS];
+static bool loopCreated = false;
+
+esp_err_t esp_event_loop_create_default(void) {
+    esp_err_t err = ESP_OK;
+
+    pthread_mutex_lock(&handlersLock);
+    if (loopCreated) {
+        err = ESP_ERR_INVALID_STATE;
+    }
+    loopCreated = true;
+    pthread_mutex_unlock(&handlersLock);
+    return err;
+}
+
+esp_err_t esp_event_handler_register(esp_event_base_t event_base, int32_t event_id, esp_event_handler_t event_handler, void *event_handler_arg) {
+    esp_err_t err = ESP_ERR_NO_MEM;
+
+    if (NULL == event_base || NULL == event_handler) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&handlersLock);
+    if (!loopCreated) {
+        err = ESP_ERR_INVALID_STATE;
+    } else {
+        for (int i=0;i<HOST_EVENT_HANDLERS;i++) {
+            if (NULL == handlers[i].base) {
+                handlers[i].base = event_base;
+                handlers[i].id = event_id;
+                handlers[i].handler = event_handler;
+                handlers[i].arg = event_handler_arg;
+                err = ESP_OK;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&handlersLock);
+    return err;
+}
+
+esp_err_t esp_event_handler_unregister(esp_event_base_t event_base, int32_t event_id, esp_event_handler_t event_handler) {
+    pthread_mutex_lock(&handlersLock);
+    for (int i=0;i<HOST_EVENT_HANDLERS;i++) {
+        if (handlers[i].base == event_base && handlers[i].id == event_id && handlers[i].handler == event_handler) {
+            memset(&handlers[i], 0x00, sizeof(host_event_handler_t));
+        }
+    }
+    pthread_mutex_unlock(&handlersLock);
+    return ESP_OK;
+}
+
+esp_err_t esp_event_post(esp_event_base_t event_base, int32_t event_id, const void *event_data, size_t event_data_size, TickType_t ticks_to_wait) {
+    (void)event_data_size;
+    (void)ticks_to_wait;
+    // one event at a time, handlers are called in the order they were registered
+    pthread_mutex_lock(&handlersLock);
+    if (!loopCreated) {
+        pthread_mutex_unlock(&handlersLock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (int i=0;i<HOST_EVENT_HANDLERS;i++) {
+        if (handlers[i].base == event_base && (handlers[i].id == ESP_EVENT_ANY_ID || handlers[i].id == event_id)) {
+            handlers[i].handler(handlers[i].arg, event_base, event_id, (void *)event_data);
+        }
+    }
+    pthread_mutex_unlock(&handlersLock);
+    return ESP_OK;
+}
@@ -0,0 +1,15 @@
+#ifndef HOST_ESP_NETIF_TYPES_H
+#define HOST_ESP_NETIF_TYPES_H 1
+
+// the IP events the host shim posts, numbered as in ESP-IDF
+
+#include "esp_event.h"
+
+ESP_EVENT_DECLARE_BASE(IP_EVENT);
+
+typedef enum {
+    IP_EVENT_STA_GOT_IP = 0,
+    IP_EVENT_STA_LOST_IP,
+} ip_event_t;
+
+#endif
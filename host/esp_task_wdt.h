@@ -0,0 +1,15 @@
+#ifndef HOST_ESP_TASK_WDT_H
+#define HOST_ESP_TASK_WDT_H 1
+
+// There is no task watchdog on the host, these are no-ops
+
+#include <stdbool.h>
+#include "esp_err.h"
+#include "freertos/task.h"
+
+static inline esp_err_t esp_task_wdt_init(uint32_t timeout, bool panic) { (void)timeout; (void)panic; return ESP_OK; }
+static inline esp_err_t esp_task_wdt_add(TaskHandle_t handle) { (void)handle; return ESP_OK; }
+static inline esp_err_t esp_task_wdt_delete(TaskHandle_t handle) { (void)handle; return ESP_OK; }
+static inline esp_err_t esp_task_wdt_reset(void) { return ESP_OK; }
+
+#endif
@@ -0,0 +1,338 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "Arduino.h"
+#include "esp_event.h"
+#include "esp_netif_types.h"
+#include "esp_tls.h"
+#include "esp_wifi_types.h"
+#include "host_shim.h"
+
+typedef enum {
+    HOST_TLS_INIT,
+    HOST_TLS_CONNECTING,
+    HOST_TLS_CONNECTED,
+    HOST_TLS_FAIL
+} host_tls_state_t;
+
+struct esp_tls_client_session {
+    unsigned long id;
+};
+
+struct esp_tls {
+    int sockfd;
+    host_tls_state_t state;
+    bool non_block;
+    int timeout_ms;
+    unsigned long connect_start_ms;
+    esp_tls_last_error_t error;
+    unsigned long session_id;
+    bool cut;           // the network went since it was made, set under connsLock
+    struct esp_tls *prev;   // every connection, for host_net_down()
+    struct esp_tls *next;
+};
+
+static unsigned long next_session_id = 1;
+
+// While the network is down new connections fail and those made before it went are cut, they stay open but
+// nothing arrives on them. A cut connection's socket is swapped for one end of a socket pair nobody writes to by
+// whichever task uses it next, so its fd number is only changed by its owner.
+static pthread_mutex_t connsLock = PTHREAD_MUTEX_INITIALIZER;
+static esp_tls_t *conns = NULL;
+static bool netDown = false;
+static int deadFds[2] = {-1, -1};
+
+static bool tls_net_down(void) {
+    return __atomic_load_n(&netDown, __ATOMIC_ACQUIRE);
+}
+
+// true if the network has gone since tls was made, its socket goes quiet
+static bool tls_cut(esp_tls_t *tls) {
+    if (!__atomic_load_n(&tls->cut, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    if (tls->sockfd >= 0 && tls->sockfd != deadFds[0]) {
+        dup2(deadFds[0], tls->sockfd);  // closes the real socket
+    }
+    return true;
+}
+
+void host_net_down(bool events) {
+    pthread_mutex_lock(&connsLock);
+    if (deadFds[0] < 0 && 0 != socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, deadFds)) {
+        Serial.printf("host_net_down socketpair failed\r\n");
+    }
+    __atomic_store_n(&netDown, true, __ATOMIC_RELEASE);
+    for (esp_tls_t *tls = conns;tls != NULL;tls = tls->next) {
+        __atomic_store_n(&tls->cut, true, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&connsLock);
+    if (events) {
+        // the IP address is only given up some time later, if the WiFi doesn't come back first
+        esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, NULL, 0, portMAX_DELAY);
+    }
+}
+
+void host_net_up(bool events) {
+    __atomic_store_n(&netDown, false, __ATOMIC_RELEASE);
+    if (events) {
+        esp_event_post(IP_EVENT, IP_EVENT_STA_GOT_IP, NULL, 0, portMAX_DELAY);
+    }
+}
+
+esp_tls_t *esp_tls_init(void) {
+    esp_tls_t *tls;
+    if (NULL == (tls = (esp_tls_t *)calloc(1, sizeof(esp_tls_t)))) {
+        return NULL;
+    }
+    tls->sockfd = -1;
+    tls->state = HOST_TLS_INIT;
+    pthread_mutex_lock(&connsLock);
+    tls->next = conns;
+    if (NULL != conns) {
+        conns->prev = tls;
+    }
+    conns = tls;
+    pthread_mutex_unlock(&connsLock);
+    return tls;
+}
+
+static int tls_fail(esp_tls_t *tls, esp_err_t err, int code) {
+    tls->error.last_error = err;
+    tls->error.esp_tls_error_code = code;
+    tls->state = HOST_TLS_FAIL;
+    if (tls->sockfd >= 0) {
+        close(tls->sockfd);
+        tls->sockfd = -1;
+    }
+    return -1;
+}
+
+static int tls_start_connect(const char *hostname, int hostlen, int port, const esp_tls_cfg_t *cfg, esp_tls_t *tls) {
+    struct addrinfo hints, *res;
+    char host[256];
+    char service[8];
+    int fd;
+
+    if (hostlen <= 0 || hostlen >= (int)sizeof(host) || tls_net_down()) {
+        return tls_fail(tls, ESP_ERR_ESP_TLS_CANNOT_RESOLVE_HOSTNAME, 0);
+    }
+    memcpy(host, hostname, hostlen);
+    host[hostlen] = '\0';
+    snprintf(service, sizeof(service), "%d", port);
+
+    memset(&hints, 0x00, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (0 != getaddrinfo(host, service, &hints, &res)) {
+        return tls_fail(tls, ESP_ERR_ESP_TLS_CANNOT_RESOLVE_HOSTNAME, 0);
+    }
+
+    if ((fd = socket(res->ai_family, res->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, res->ai_protocol)) < 0) {
+        freeaddrinfo(res);
+        return tls_fail(tls, ESP_ERR_ESP_TLS_CANNOT_CREATE_SOCKET, errno);
+    }
+    tls->sockfd = fd;
+    tls->non_block = cfg != NULL ? cfg->non_block : false;
+    tls->timeout_ms = cfg != NULL ? cfg->timeout_ms : 0;
+    tls->connect_start_ms = millis();
+    // a resumed session keeps its id, as with a real TLS server accepting it
+    tls->session_id = (cfg != NULL && cfg->client_session != NULL) ? cfg->client_session->id : __atomic_fetch_add(&next_session_id, 1, __ATOMIC_RELAXED);
+
+    if (0 != connect(fd, res->ai_addr, res->ai_addrlen) && errno != EINPROGRESS) {
+        freeaddrinfo(res);
+        return tls_fail(tls, ESP_ERR_ESP_TLS_FAILED_CONNECT_TO_HOST, errno);
+    }
+    freeaddrinfo(res);
+    tls->state = HOST_TLS_CONNECTING;
+    return 0;
+}
+
+// poll an in-progress connect, waiting at most wait_ms
+static int tls_check_connect(esp_tls_t *tls, int wait_ms) {
+    struct pollfd pfd;
+    int soerr = 0;
+    socklen_t len = sizeof(soerr);
+
+    pfd.fd = tls->sockfd;
+    pfd.events = POLLOUT;
+    pfd.revents = 0;
+    if (tls_cut(tls) || poll(&pfd, 1, wait_ms) <= 0) {
+        if (tls->timeout_ms > 0 && millis() - tls->connect_start_ms > (unsigned long)tls->timeout_ms) {
+            return tls_fail(tls, ESP_ERR_ESP_TLS_CONNECTION_TIMEOUT, 0);
+        }
+        return 0;
+    }
+    if (0 != getsockopt(tls->sockfd, SOL_SOCKET, SO_ERROR, &soerr, &len) || soerr != 0) {
+        return tls_fail(tls, ESP_ERR_ESP_TLS_FAILED_CONNECT_TO_HOST, soerr);
+    }
+    if (!tls->non_block) {
+        fcntl(tls->sockfd, F_SETFL, fcntl(tls->sockfd, F_GETFL) & ~O_NONBLOCK);
+        if (tls->timeout_ms > 0) {
+            struct timeval tv;
+            tv.tv_sec = tls->timeout_ms / 1000;
+            tv.tv_usec = (tls->timeout_ms % 1000) * 1000;
+            setsockopt(tls->sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        }
+    }
+    tls->state = HOST_TLS_CONNECTED;
+    return 1;
+}
+
+int esp_tls_conn_new_async(const char *hostname, int hostlen, int port, const esp_tls_cfg_t *cfg, esp_tls_t *tls) {
+    if (NULL == tls) {
+        return -1;
+    }
+    switch(tls->state) {
+        case HOST_TLS_INIT:
+            if (0 != tls_start_connect(hostname, hostlen, port, cfg, tls)) {
+                return -1;
+            }
+            return tls_check_connect(tls, 0);
+        case HOST_TLS_CONNECTING:
+            return tls_check_connect(tls, 0);
+        case HOST_TLS_CONNECTED:
+            return 1;
+        case HOST_TLS_FAIL:
+        default:
+            return -1;
+    }
+}
+
+int esp_tls_conn_new_sync(const char *hostname, int hostlen, int port, const esp_tls_cfg_t *cfg, esp_tls_t *tls) {
+    int rc;
+    while (0 == (rc = esp_tls_conn_new_async(hostname, hostlen, port, cfg, tls))) {
+        tls_check_connect(tls, 10);
+    }
+    return rc;
+}
+
+ssize_t esp_tls_conn_write(esp_tls_t *tls, const void *data, size_t datalen) {
+    ssize_t n;
+    if (NULL == tls || tls->state != HOST_TLS_CONNECTED) {
+        return -1;
+    }
+    tls_cut(tls);
+    if ((n = send(tls->sockfd, data, datalen, MSG_NOSIGNAL)) < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return ESP_TLS_ERR_SSL_WANT_WRITE;
+        }
+        tls->error.esp_tls_error_code = errno;
+        return -1;
+    }
+    return n;
+}
+
+ssize_t esp_tls_conn_read(esp_tls_t *tls, void *data, size_t datalen) {
+    ssize_t n;
+    if (NULL == tls || tls->state != HOST_TLS_CONNECTED) {
+        return -1;
+    }
+    tls_cut(tls);
+    if ((n = recv(tls->sockfd, data, datalen, 0)) < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return ESP_TLS_ERR_SSL_WANT_READ;
+        }
+        tls->error.esp_tls_error_code = errno;
+        return -1;
+    }
+    return n;
+}
+
+int esp_tls_conn_destroy(esp_tls_t *tls) {
+    if (NULL != tls) {
+        pthread_mutex_lock(&connsLock);
+        if (NULL != tls->prev) {
+            tls->prev->next = tls->next;
+        } else {
+            conns = tls->next;
+        }
+        if (NULL != tls->next) {
+            tls->next->prev = tls->prev;
+        }
+        pthread_mutex_unlock(&connsLock);
+        if (tls->sockfd >= 0) {
+            close(tls->sockfd);
+        }
+        free(tls);
+    }
+    return 0;
+}
+
+esp_err_t esp_tls_get_conn_sockfd(esp_tls_t *tls, int *sockfd) {
+    if (NULL == tls || NULL == sockfd) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *sockfd = tls->sockfd;
+    return ESP_OK;
+}
+
+esp_err_t esp_tls_get_conn_state(esp_tls_t *tls, esp_tls_conn_state_t *conn_state) {
+    if (NULL == tls || NULL == conn_state) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    switch(tls->state) {
+        case HOST_TLS_INIT:
+            *conn_state = ESP_TLS_INIT;
+            break;
+        case HOST_TLS_CONNECTING:
+            *conn_state = ESP_TLS_CONNECTING;
+            break;
+        case HOST_TLS_CONNECTED:
+            *conn_state = ESP_TLS_DONE;
+            break;
+        case HOST_TLS_FAIL:
+        default:
+            *conn_state = ESP_TLS_FAIL;
+            break;
+    }
+    return ESP_OK;
+}
+
+esp_tls_client_session_t *esp_tls_get_client_session(esp_tls_t *tls) {
+    esp_tls_client_session_t *session;
+    if (NULL == tls || tls->state != HOST_TLS_CONNECTED) {
+        return NULL;
+    }
+    if (NULL == (session = (esp_tls_client_session_t *)malloc(sizeof(esp_tls_client_session_t)))) {
+        return NULL;
+    }
+    session->id = tls->session_id;
+    return session;
+}
+
+void esp_tls_free_client_session(esp_tls_client_session_t *client_session) {
+    free(client_session);
+}
+
+esp_err_t esp_tls_get_error_handle(esp_tls_t *tls, esp_tls_error_handle_t *error_handle) {
+    if (NULL == tls || NULL == error_handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *error_handle = &tls->error;
+    return ESP_OK;
+}
+
+esp_err_t esp_tls_get_and_clear_last_error(esp_tls_error_handle_t h, int *esp_tls_code, int *esp_tls_flags) {
+    esp_err_t last_err;
+    if (NULL == h) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    last_err = h->last_error;
+    if (NULL != esp_tls_code) {
+        *esp_tls_code = h->esp_tls_error_code;
+    }
+    if (NULL != esp_tls_flags) {
+        *esp_tls_flags = h->esp_tls_flags;
+    }
+    memset(h, 0x00, sizeof(esp_tls_last_error_t));
+    return last_err;
+}
@@ -0,0 +1,71 @@
+#ifndef HOST_ESP_TLS_H
+#define HOST_ESP_TLS_H 1
+
+// Host (POSIX) stand-in for ESP-TLS. Connections are plain TCP, there is no
+// TLS on the host, so point lyuba at a plaintext server (see bench/).
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include "esp_err.h"
+
+#define ESP_ERR_ESP_TLS_CANNOT_RESOLVE_HOSTNAME (ESP_ERR_ESP_TLS_BASE + 0x01)
+#define ESP_ERR_ESP_TLS_CANNOT_CREATE_SOCKET (ESP_ERR_ESP_TLS_BASE + 0x02)
+#define ESP_ERR_ESP_TLS_FAILED_CONNECT_TO_HOST (ESP_ERR_ESP_TLS_BASE + 0x04)
+#define ESP_ERR_ESP_TLS_SOCKET_SETOPT_FAILED (ESP_ERR_ESP_TLS_BASE + 0x05)
+#define ESP_ERR_ESP_TLS_CONNECTION_TIMEOUT (ESP_ERR_ESP_TLS_BASE + 0x06)
+#define ESP_ERR_ESP_TLS_TCP_CLOSED_FIN (ESP_ERR_ESP_TLS_BASE + 0x0E)
+
+#define ESP_TLS_ERR_SSL_WANT_READ -0x6900
+#define ESP_TLS_ERR_SSL_WANT_WRITE -0x6880
+
+typedef struct esp_tls_last_error {
+    esp_err_t last_error;
+    int esp_tls_error_code;
+    int esp_tls_flags;
+} esp_tls_last_error_t;
+
+typedef esp_tls_last_error_t *esp_tls_error_handle_t;
+
+// there is no TLS on the host, a session is only an opaque token to hand back on reconnect
+typedef struct esp_tls_client_session esp_tls_client_session_t;
+
+typedef struct esp_tls_cfg {
+    const char **alpn_protos;
+    const unsigned char *cacert_buf;
+    unsigned int cacert_bytes;
+    bool non_block;
+    int timeout_ms;
+    const char *common_name;
+    bool skip_common_name;
+    esp_err_t (*crt_bundle_attach)(void *conf);
+    esp_tls_client_session_t *client_session;
+} esp_tls_cfg_t;
+
+typedef struct esp_tls esp_tls_t;
+
+typedef enum esp_tls_conn_state {
+    ESP_TLS_INIT = 0,
+    ESP_TLS_CONNECTING,
+    ESP_TLS_HANDSHAKE,  // never seen on the host, connections go straight to done
+    ESP_TLS_FAIL,
+    ESP_TLS_DONE,
+} esp_tls_conn_state_t;
+
+esp_tls_t *esp_tls_init(void);
+// returns -1 on failure, 0 while the connection is in progress and 1 once established
+int esp_tls_conn_new_async(const char *hostname, int hostlen, int port, const esp_tls_cfg_t *cfg, esp_tls_t *tls);
+int esp_tls_conn_new_sync(const char *hostname, int hostlen, int port, const esp_tls_cfg_t *cfg, esp_tls_t *tls);
+// returns bytes transferred, 0 on orderly close, ESP_TLS_ERR_SSL_WANT_READ/WRITE if it would block, other negative on error
+ssize_t esp_tls_conn_write(esp_tls_t *tls, const void *data, size_t datalen);
+ssize_t esp_tls_conn_read(esp_tls_t *tls, void *data, size_t datalen);
+int esp_tls_conn_destroy(esp_tls_t *tls);
+esp_err_t esp_tls_get_conn_sockfd(esp_tls_t *tls, int *sockfd);
+esp_err_t esp_tls_get_conn_state(esp_tls_t *tls, esp_tls_conn_state_t *conn_state);
+esp_err_t esp_tls_get_error_handle(esp_tls_t *tls, esp_tls_error_handle_t *error_handle);
+// the session negotiated on an established connection, to be offered in esp_tls_cfg_t next time
+esp_tls_client_session_t *esp_tls_get_client_session(esp_tls_t *tls);
+void esp_tls_free_client_session(esp_tls_client_session_t *client_session);
+esp_err_t esp_tls_get_and_clear_last_error(esp_tls_error_handle_t h, int *esp_tls_code, int *esp_tls_flags);
+
+#endif
@@ -0,0 +1,173 @@
+#include <pthread.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "Arduino.h"
+
+struct host_task_s {
+    pthread_t thread;
+    TaskFunction_t fn;
+    void *param;
+    char name[16];
+};
+
+struct host_semaphore_s {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    unsigned int count;
+};
+
+static __thread TaskHandle_t current_task = NULL;
+
+// absolute CLOCK_MONOTONIC deadline for waits measured in ticks
+static void deadline_from_ticks(struct timespec *ts, TickType_t ticks) {
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += ticks / 1000;
+    ts->tv_nsec += (long)(ticks % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+static void *task_trampoline(void *arg) {
+    TaskHandle_t task = (TaskHandle_t)arg;
+    current_task = task;
+    task->fn(task->param);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t pvTaskCode, const char *pcName, uint32_t usStackDepth, void *pvParameters, UBaseType_t uxPriority, TaskHandle_t *pxCreatedTask) {
+    return xTaskCreatePinnedToCore(pvTaskCode, pcName, usStackDepth, pvParameters, uxPriority, pxCreatedTask, tskNO_AFFINITY);
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pvTaskCode, const char *pcName, uint32_t usStackDepth, void *pvParameters, UBaseType_t uxPriority, TaskHandle_t *pxCreatedTask, BaseType_t xCoreID) {
+    TaskHandle_t task;
+    pthread_attr_t attr;
+    (void)uxPriority;
+
+    if (NULL == (task = (TaskHandle_t)calloc(1, sizeof(struct host_task_s)))) {
+        return pdFAIL;
+    }
+    task->fn = pvTaskCode;
+    task->param = pvParameters;
+    strncpy(task->name, pcName != NULL ? pcName : "", sizeof(task->name) - 1);
+
+    // FreeRTOS stack depth is in bytes on ESP32, glibc needs more headroom than the device
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, usStackDepth < 65536 ? 65536 : usStackDepth);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (xCoreID != tskNO_AFFINITY) {
+        // the core onto one of the host's CPUs
+        cpu_set_t cpus;
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        CPU_ZERO(&cpus);
+        CPU_SET(ncpu > 0 ? xCoreID % ncpu : 0, &cpus);
+        pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+    }
+    if (0 != pthread_create(&task->thread, &attr, task_trampoline, task)) {
+        pthread_attr_destroy(&attr);
+        free(task);
+        return pdFAIL;
+    }
+    pthread_attr_destroy(&attr);
+    if (NULL != pxCreatedTask) {
+        *pxCreatedTask = task;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t xTask) {
+    if (NULL == xTask || xTask == current_task) {
+        pthread_exit(NULL);
+    }
+    // deleting another task is not supported on the host
+}
+
+void vTaskDelay(TickType_t xTicksToDelay) {
+    usleep((useconds_t)xTicksToDelay * 1000 * portTICK_PERIOD_MS);
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)(millis() / portTICK_PERIOD_MS);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return current_task;
+}
+
+static SemaphoreHandle_t semaphore_create(unsigned int initial) {
+    SemaphoreHandle_t sem;
+    pthread_condattr_t cattr;
+
+    if (NULL == (sem = (SemaphoreHandle_t)malloc(sizeof(struct host_semaphore_s)))) {
+        return NULL;
+    }
+    pthread_mutex_init(&sem->mutex, NULL);
+    pthread_condattr_init(&cattr);
+    pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&sem->cond, &cattr);
+    pthread_condattr_destroy(&cattr);
+    sem->count = initial;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    return semaphore_create(1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return semaphore_create(0);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t xSemaphore, TickType_t xTicksToWait) {
+    struct timespec deadline;
+    BaseType_t rc = pdTRUE;
+
+    if (xTicksToWait != portMAX_DELAY) {
+        deadline_from_ticks(&deadline, xTicksToWait);
+    }
+    pthread_mutex_lock(&xSemaphore->mutex);
+    while (xSemaphore->count == 0) {
+        if (xTicksToWait == portMAX_DELAY) {
+            pthread_cond_wait(&xSemaphore->cond, &xSemaphore->mutex);
+        } else if (ETIMEDOUT == pthread_cond_timedwait(&xSemaphore->cond, &xSemaphore->mutex, &deadline)) {
+            if (xSemaphore->count == 0) {
+                rc = pdFALSE;
+                break;
+            }
+        }
+    }
+    if (rc == pdTRUE) {
+        xSemaphore->count--;
+    }
+    pthread_mutex_unlock(&xSemaphore->mutex);
+    return rc;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t xSemaphore) {
+    BaseType_t rc = pdFALSE;
+
+    pthread_mutex_lock(&xSemaphore->mutex);
+    if (xSemaphore->count == 0) {
+        xSemaphore->count = 1;
+        pthread_cond_signal(&xSemaphore->cond);
+        rc = pdTRUE;
+    }
+    pthread_mutex_unlock(&xSemaphore->mutex);
+    return rc;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t xSemaphore) {
+    if (NULL != xSemaphore) {
+        pthread_cond_destroy(&xSemaphore->cond);
+        pthread_mutex_destroy(&xSemaphore->mutex);
+        free(xSemaphore);
+    }
+}
@@ -0,0 +1,184 @@
+// Heap accounting for the host build. The link wraps malloc and friends
+// (see CMakeLists.txt) so allocations made by lyuba and the benchmarks are
+// counted, allocations made inside libc/libstdc++ are not. heap_caps_malloc()
+// with MALLOC_CAP_SPIRAM is counted against a simulated PSRAM instead.
+
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <unordered_set>
+
+#include "esp_heap_caps.h"
+#include "host_shim.h"
+
+extern "C" {
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+}
+
+static std::atomic<size_t> heap_in_use(0);
+static std::atomic<size_t> heap_peak(0);
+static std::atomic<size_t> heap_max(0);     // peak since start, not reset
+static size_t internal_size = 320 * 1024;
+static std::atomic<unsigned long> heap_allocs(0);
+static std::atomic<unsigned long> heap_frees(0);
+static std::atomic<size_t> psram_in_use(0);
+static std::atomic<size_t> psram_peak(0);
+static std::atomic<size_t> psram_max(0);
+static size_t psram_size = 0;
+static std::mutex psram_lock;
+static std::unordered_set<void *> psram_blocks;    // allocated by libstdc++, so not counted itself
+
+static void raise_peak(std::atomic<size_t> *peak, size_t now) {
+    size_t was = peak->load();
+    while (now > was && !peak->compare_exchange_weak(was, now)) {
+    }
+}
+
+static void account_alloc(void *p) {
+    if (NULL == p) {
+        return;
+    }
+    heap_allocs++;
+    size_t now = heap_in_use += malloc_usable_size(p);
+    raise_peak(&heap_peak, now);
+    raise_peak(&heap_max, now);
+}
+
+static void account_free(void *p) {
+    if (NULL == p) {
+        return;
+    }
+    heap_frees++;
+    {
+        std::lock_guard<std::mutex> guard(psram_lock);
+        if (!psram_blocks.empty() && 1 == psram_blocks.erase(p)) {
+            psram_in_use -= malloc_usable_size(p);
+            return;
+        }
+    }
+    heap_in_use -= malloc_usable_size(p);
+}
+
+extern "C" {
+
+void *__wrap_malloc(size_t size) {
+    void *p = __real_malloc(size);
+    account_alloc(p);
+    return p;
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size) {
+    void *p = __real_calloc(nmemb, size);
+    account_alloc(p);
+    return p;
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    void *p;
+    size_t old = ptr != NULL ? malloc_usable_size(ptr) : 0;
+    if (NULL == (p = __real_realloc(ptr, size))) {
+        return NULL;
+    }
+    if (NULL == ptr) {
+        account_alloc(p);
+    } else {
+        heap_in_use -= old;
+        heap_frees++;
+        account_alloc(p);
+    }
+    return p;
+}
+
+void __wrap_free(void *ptr) {
+    account_free(ptr);
+    __real_free(ptr);
+}
+
+char *__wrap_strdup(const char *s) {
+    size_t len = strlen(s) + 1;
+    char *p = (char *)__wrap_malloc(len);
+    if (NULL != p) {
+        memcpy(p, s, len);
+    }
+    return p;
+}
+
+char *__wrap_strndup(const char *s, size_t n) {
+    size_t len = strnlen(s, n);
+    char *p = (char *)__wrap_malloc(len + 1);
+    if (NULL != p) {
+        memcpy(p, s, len);
+        p[len] = '\0';
+    }
+    return p;
+}
+
+}
+
+void *heap_caps_malloc(size_t size, uint32_t caps) {
+    void *p;
+
+    if (0 == (caps & MALLOC_CAP_SPIRAM)) {
+        return __wrap_malloc(size);
+    }
+    std::lock_guard<std::mutex> guard(psram_lock);
+    if (psram_in_use > psram_size || size > psram_size - psram_in_use || NULL == (p = __real_malloc(size))) {
+        return NULL;
+    }
+    if (malloc_usable_size(p) > psram_size - psram_in_use) {
+        __real_free(p);
+        return NULL;
+    }
+    psram_blocks.insert(p);
+    heap_allocs++;
+    size_t now = psram_in_use += malloc_usable_size(p);
+    raise_peak(&psram_peak, now);
+    raise_peak(&psram_max, now);
+    return p;
+}
+
+void heap_caps_free(void *ptr) {
+    __wrap_free(ptr);
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+    if (caps & MALLOC_CAP_SPIRAM) {
+        return psram_in_use < psram_size ? psram_size - psram_in_use : 0;
+    }
+    return heap_in_use < internal_size ? internal_size - heap_in_use : 0;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps) {
+    if (caps & MALLOC_CAP_SPIRAM) {
+        return psram_max < psram_size ? psram_size - psram_max : 0;
+    }
+    return heap_max < internal_size ? internal_size - heap_max : 0;
+}
+
+void host_heap_set_internal(size_t bytes) {
+    internal_size = bytes;
+}
+
+void host_heap_set_psram(size_t bytes) {
+    std::lock_guard<std::mutex> guard(psram_lock);
+    psram_size = bytes;
+}
+
+void host_heap_get_stats(host_heap_stats_t *stats) {
+    stats->in_use = heap_in_use.load();
+    stats->peak = heap_peak.load();
+    stats->allocs = heap_allocs.load();
+    stats->frees = heap_frees.load();
+    stats->psram_in_use = psram_in_use.load();
+    stats->psram_peak = psram_peak.load();
+}
+
+void host_heap_reset_peak(void) {
+    heap_peak = heap_in_use.load();
+    psram_peak = psram_in_use.load();
+}
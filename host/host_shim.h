@@ -0,0 +1,39 @@
+#ifndef HOST_SHIM_H
+#define HOST_SHIM_H 1
+
+// Controls for the host shim which have no equivalent on the device,
+// for use by host-side benchmarks
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// stop Serial output reaching stderr
+void host_serial_mute(bool mute);
+
+typedef struct {
+    size_t in_use;          // bytes currently allocated through malloc(), internal RAM
+    size_t peak;            // high water mark of in_use since start or host_heap_reset_peak()
+    unsigned long allocs;   // number of allocations, from either heap
+    unsigned long frees;    // number of frees
+    size_t psram_in_use;    // bytes currently allocated with heap_caps_malloc(MALLOC_CAP_SPIRAM)
+    size_t psram_peak;
+} host_heap_stats_t;
+
+void host_heap_get_stats(host_heap_stats_t *stats);
+void host_heap_reset_peak(void);
+// size of the simulated PSRAM, 0 (the default) for a board without, see esp_heap_caps.h
+void host_heap_set_psram(size_t bytes);
+// internal RAM as heap_caps_get_free_size() sees it, 320KB by default as on an ESP32
+void host_heap_set_internal(size_t bytes);
+
+// Simulate the WiFi going and coming back. While it's down new connections fail, as DNS would without an IP
+// address, and those made before it went stay open but go quiet. With events, WIFI_EVENT_STA_DISCONNECTED is
+// posted on the way down and IP_EVENT_STA_GOT_IP on the way up as the WiFi driver would, without them requests
+// have to find out for themselves.
+void host_net_down(bool events);
+void host_net_up(bool events);
+
+// puts and removes made through Preferences since start, and the bytes put, what wears the flash on the device
+void host_nvs_get_writes(unsigned long *writes, size_t *bytes);
+
+#endif
@@ -0,0 +1,91 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "mbedtls/sha1.h"
+#include "mbedtls/base64.h"
+
+static uint32_t rol(uint32_t v, int n) {
+    return (v << n) | (v >> (32 - n));
+}
+
+static void sha1_block(uint32_t h[5], const unsigned char *p) {
+    uint32_t w[80], a, b, c, d, e;
+    for (int i=0;i<16;i++) {
+        w[i] = (uint32_t)p[i*4] << 24 | (uint32_t)p[i*4+1] << 16 | (uint32_t)p[i*4+2] << 8 | p[i*4+3];
+    }
+    for (int i=16;i<80;i++) {
+        w[i] = rol(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+    }
+    a = h[0]; b = h[1]; c = h[2]; d = h[3]; e = h[4];
+    for (int i=0;i<80;i++) {
+        uint32_t f, k, t;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        t = rol(a, 5) + f + e + k + w[i];
+        e = d; d = c; c = rol(b, 30); b = a; a = t;
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+}
+
+int mbedtls_sha1(const unsigned char *input, size_t ilen, unsigned char output[20]) {
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    unsigned char tail[128];
+    size_t full = ilen & ~(size_t)63, rest = ilen - full, tailLen;
+    uint64_t bits = (uint64_t)ilen * 8;
+
+    for (size_t i=0;i<full;i+=64) {
+        sha1_block(h, input + i);
+    }
+    memset(tail, 0x00, sizeof(tail));
+    memcpy(tail, input + full, rest);
+    tail[rest] = 0x80;
+    tailLen = rest < 56 ? 64 : 128;
+    for (int i=0;i<8;i++) {
+        tail[tailLen - 1 - i] = (unsigned char)(bits >> (i * 8));
+    }
+    for (size_t i=0;i<tailLen;i+=64) {
+        sha1_block(h, tail + i);
+    }
+    for (int i=0;i<20;i++) {
+        output[i] = (unsigned char)(h[i / 4] >> (24 - (i % 4) * 8));
+    }
+    return 0;
+}
+
+int mbedtls_base64_encode(unsigned char *dst, size_t dlen, size_t *olen, const unsigned char *src, size_t slen) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t need = ((slen + 2) / 3) * 4;
+    unsigned char *out = dst;
+
+    if (dlen < need + 1) {
+        *olen = need + 1;
+        return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+    }
+    for (size_t i=0;i<slen;i+=3) {
+        uint32_t v = (uint32_t)src[i] << 16;
+        if (i + 1 < slen) {
+            v |= (uint32_t)src[i+1] << 8;
+        }
+        if (i + 2 < slen) {
+            v |= src[i+2];
+        }
+        *out++ = alphabet[(v >> 18) & 0x3F];
+        *out++ = alphabet[(v >> 12) & 0x3F];
+        *out++ = i + 1 < slen ? alphabet[(v >> 6) & 0x3F] : '=';
+        *out++ = i + 2 < slen ? alphabet[v & 0x3F] : '=';
+    }
+    *out = '\0';
+    *olen = need;
+    return 0;
+}
@@ -0,0 +1,9 @@
+#ifndef HOST_MBEDTLS_SHA1_H
+#define HOST_MBEDTLS_SHA1_H 1
+
+#include <stddef.h>
+
+// Same as the mbedtls 3 one-shot routine, returns 0
+int mbedtls_sha1(const unsigned char *input, size_t ilen, unsigned char output[20]);
+
+#endif
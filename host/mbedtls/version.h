@@ -0,0 +1,7 @@
+#ifndef HOST_MBEDTLS_VERSION_H
+#define HOST_MBEDTLS_VERSION_H 1
+
+// the host stand-ins follow the mbedtls 3 API
+#define MBEDTLS_VERSION_NUMBER 0x03000000
+
+#endif
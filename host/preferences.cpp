@@ -0,0 +1,145 @@
+#include <pthread.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Preferences.h"
+#include "host_shim.h"
+
+#define NVS_KEY_NAME_MAX_SIZE 16    // including terminator, as on the device
+
+typedef std::map<std::string, std::vector<uint8_t> > nvs_namespace_t;
+
+static std::map<std::string, nvs_namespace_t> nvs;
+static pthread_mutex_t nvs_mutex = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long nvs_writes;
+static size_t nvs_bytes;
+
+static bool key_ok(const char *key) {
+    return key != NULL && strlen(key) < NVS_KEY_NAME_MAX_SIZE;
+}
+
+Preferences::Preferences() : _started(false), _readOnly(false) {
+    _namespace[0] = '\0';
+}
+
+bool Preferences::begin(const char *name, bool readOnly, const char *partition_label) {
+    (void)partition_label;
+    if (_started || !key_ok(name)) {
+        return false;
+    }
+    strcpy(_namespace, name);
+    _readOnly = readOnly;
+    _started = true;
+    return true;
+}
+
+void Preferences::end(void) {
+    _started = false;
+}
+
+bool Preferences::clear(void) {
+    if (!_started || _readOnly) {
+        return false;
+    }
+    pthread_mutex_lock(&nvs_mutex);
+    nvs[_namespace].clear();
+    pthread_mutex_unlock(&nvs_mutex);
+    return true;
+}
+
+bool Preferences::remove(const char *key) {
+    bool found;
+    if (!_started || _readOnly || !key_ok(key)) {
+        return false;
+    }
+    pthread_mutex_lock(&nvs_mutex);
+    found = nvs[_namespace].erase(key) > 0;
+    nvs_writes += found ? 1 : 0;
+    pthread_mutex_unlock(&nvs_mutex);
+    return found;
+}
+
+bool Preferences::isKey(const char *key) {
+    bool found;
+    if (!_started || !key_ok(key)) {
+        return false;
+    }
+    pthread_mutex_lock(&nvs_mutex);
+    found = nvs[_namespace].count(key) > 0;
+    pthread_mutex_unlock(&nvs_mutex);
+    return found;
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t len) {
+    if (!_started || _readOnly || !key_ok(key) || (value == NULL && len > 0)) {
+        return 0;
+    }
+    pthread_mutex_lock(&nvs_mutex);
+    nvs[_namespace][key].assign((const uint8_t *)value, (const uint8_t *)value + len);
+    nvs_writes++;
+    nvs_bytes += len;
+    pthread_mutex_unlock(&nvs_mutex);
+    return len;
+}
+
+size_t Preferences::getBytesLength(const char *key) {
+    size_t len = 0;
+    if (!_started || !key_ok(key)) {
+        return 0;
+    }
+    pthread_mutex_lock(&nvs_mutex);
+    nvs_namespace_t::iterator it = nvs[_namespace].find(key);
+    if (it != nvs[_namespace].end()) {
+        len = it->second.size();
+    }
+    pthread_mutex_unlock(&nvs_mutex);
+    return len;
+}
+
+size_t Preferences::getBytes(const char *key, void *buf, size_t maxLen) {
+    size_t len = 0;
+    if (!_started || !key_ok(key) || buf == NULL) {
+        return 0;
+    }
+    pthread_mutex_lock(&nvs_mutex);
+    nvs_namespace_t::iterator it = nvs[_namespace].find(key);
+    if (it != nvs[_namespace].end() && it->second.size() <= maxLen) {
+        len = it->second.size();
+        memcpy(buf, it->second.data(), len);
+    }
+    pthread_mutex_unlock(&nvs_mutex);
+    return len;
+}
+
+size_t Preferences::putUInt(const char *key, uint32_t value) {
+    return putBytes(key, &value, sizeof(value));
+}
+
+uint32_t Preferences::getUInt(const char *key, uint32_t defaultValue) {
+    uint32_t value;
+    if (sizeof(value) != getBytes(key, &value, sizeof(value))) {
+        return defaultValue;
+    }
+    return value;
+}
+
+// strings are stored with their terminator and the returned length includes it, as nvs_get_str() does
+size_t Preferences::putString(const char *key, const char *value) {
+    if (value == NULL) {
+        return 0;
+    }
+    return putBytes(key, value, strlen(value) + 1) > 0 ? strlen(value) : 0;
+}
+
+size_t Preferences::getString(const char *key, char *value, size_t maxLen) {
+    return getBytes(key, value, maxLen);
+}
+
+void host_nvs_get_writes(unsigned long *writes, size_t *bytes) {
+    pthread_mutex_lock(&nvs_mutex);
+    *writes = nvs_writes;
+    *bytes = nvs_bytes;
+    pthread_mutex_unlock(&nvs_mutex);
+}
@@ -1,256 +1,2204 @@
 #include <Wire.h>
 #include <Arduino.h>
+#include <sys/select.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 #include "ctype.h"
-#include "cJSON.h"
 #include "linebuffer.h"
-#include "esp_http_client.h"
 #include "esp_tls.h"
 #if CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
 #include "esp_crt_bundle.h"
 #endif
+#include "esp_vfs_eventfd.h"
+#include "esp_heap_caps.h"
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS && CONFIG_ESP_TLS_USING_MBEDTLS
+#include "mbedtls/ssl.h"
+#endif
+#include "mbedtls/version.h"
+#include "mbedtls/sha1.h"
+#include "mbedtls/base64.h"
+#if MBEDTLS_VERSION_NUMBER < 0x03000000 && !defined(MBEDTLS_PRIVATE)
+#define MBEDTLS_PRIVATE(member) member  // mbedTLS 3 hides the session fields compared below, 2.x has them public
+#endif
 
-#include "linebuffer.h"
 #include "httpc.h"
 #include "esp_task_wdt.h"
+#if HTTPC_LINK_EVENTS
+#include "esp_event.h"
+#include "esp_netif_types.h"
+#include "esp_wifi_types.h"
+#endif
 
 //#define HTTPC_DEBUG 1
-#define HTTPC_TASK_PRIORITY tskIDLE_PRIORITY
-#define HTTPC_TASK_STACK_SIZE 4096
 
-#define LOCK_WAIT_TICKS 10000
+#define HTTPC_RX_BUF_SIZE 1024      // shared by all requests, only the httpc task reads
+#define HTTPC_CONNECT_POLL_MS 10    // a TLS handshake in progress may want to read or write, so it's polled
+#define HTTPC_STEP_READS 8          // reads per request per pass, so a flooding stream can't starve the others
+
+#define HTTPC_WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"   // RFC 6455
+#define HTTPC_WS_KEY_HEADER "Sec-WebSocket-Key: "
+#define HTTPC_WS_FIN 0x80
+#define HTTPC_WS_MASKED 0x80
+#define HTTPC_WS_CONTINUATION 0x0
+#define HTTPC_WS_TEXT 0x1
+#define HTTPC_WS_BINARY 0x2
+#define HTTPC_WS_CLOSE 0x8
+#define HTTPC_WS_PING 0x9
+#define HTTPC_WS_PONG 0xA
+
+// handle table slot word, the slot's generation in the top 16 bits (as in its handles), then how many tasks are
+// looking at the request, then commands for the httpc task
+#define HTTPC_H_CLOSE   0x0001  // closed, by httpc_close() or the request ending
+#define HTTPC_H_RESUME  0x0002  // httpc_resume() called
+#define HTTPC_H_QUEUED  0x0004  // on the command list
+#define HTTPC_H_DEADLINES 0x0008    // httpc_set_deadlines() called, in deadlinesNext
+#define HTTPC_H_REF     0x0010
+#define HTTPC_H_REFS    0xfff0
+#define HTTPC_H_GEN     0xffff0000U
+#define HTTPC_H_INDEX   0xffffU
+
+#if HTTPC_MAX_HANDLES < 1 || HTTPC_MAX_HANDLES > 65535
+#error "HTTPC_MAX_HANDLES must be 1 to 65535"
+#endif
+
+typedef struct {
+    httpc_req_t *req;   // NULL while the slot is free
+    uint32_t word;
+    uint32_t nextFree;  // index + 1 of the next free slot, or slot with commands waiting, 0 ends the list
+    uint32_t nextCmd;
+} httpc_handle_slot_t;
 
 static TaskHandle_t httpc_task_handle;
+static bool pinnedDead;     // a closed request was left for httpc_unpin()
+static httpc_task_config_t taskConfig = {HTTPC_TASK_PRIORITY, HTTPC_TASK_STACK_SIZE, HTTPC_TASK_CORE};
 
 static bool inited = false;
-static httpc_req_t *reqs_ll_head = NULL; // linked list of requests, head
+static httpc_req_t *reqs_ll_head = NULL; // linked list of requests, head, only touched by the httpc task
+static httpc_req_t *submitted = NULL;    // made on other tasks since the httpc task last looked, newest first
+
+// Handles, made on any task and freed by the httpc task, with commands from any task for the httpc task. The free
+// list is popped by many tasks, so its top carries a count of pops against ABA. Only the httpc task takes the
+// command list, all of it at once, so a plain index is enough there.
+static httpc_handle_slot_t handles[HTTPC_MAX_HANDLES];
+static uint32_t freeHandles;    // count << 16 | index + 1 of the first free slot
+static uint32_t commands;       // index + 1 of the latest slot given commands
+
+// Timer wheel of request deadlines, only touched by the httpc task. A request has at most one timer, at its next
+// deadline, in the slot of the wheel tick that falls in. Reads and writes push deadlines back without moving the
+// timer, it's set again for whatever is next when it fires. A timer more than a turn of the wheel away goes back in
+// the same slot each time the wheel passes it until it's due.
+#define HTTPC_WHEEL_TICKS (pdMS_TO_TICKS(HTTPC_WHEEL_TICK_MS) > 0 ? pdMS_TO_TICKS(HTTPC_WHEEL_TICK_MS) : 1)
+static httpc_req_t *wheel[HTTPC_WHEEL_SLOTS];
+static unsigned wheelSlot;      // slot of the tick starting at wheelAt
+static TickType_t wheelAt;
+static TickType_t wheelDue;     // no timer fires before this
+static int wheelTimers;
+
+// what's due next for a request
+typedef enum {
+    HTTPC_DUE_NONE,
+    HTTPC_DUE_PING,     // a quiet websocket, make sure it's still there
+    HTTPC_DUE_FAIL      // past a deadline
+} httpc_due_t;
+
+// The WiFi as the event loop task last told of it, and how many times it's gone and come back. The httpc task
+// catches up with the counts at the top of each pass.
+static bool linkUp = true;      // until told otherwise
+static uint32_t linkDowns;
+static uint32_t linkUps;
+static uint32_t linkDownsSeen;  // only touched by the httpc task
+static uint32_t linkUpsSeen;
+
+static SemaphoreHandle_t statsSemaphore = NULL;
+static SemaphoreHandle_t wsSemaphore = NULL;
+static int wakeFd = -1;     // eventfd, written to wake the httpc task out of select()
+static char rxBuf[HTTPC_RX_BUF_SIZE];
+
+// idle keep-alive connections, only touched by the httpc task
+typedef struct {
+    esp_tls_t *tls;     // NULL if the slot is free
+    char host[HTTPC_MAX_HOST_LEN];
+    int port;
+    TickType_t idleSince;   // or since connecting began
+    bool connecting;    // made again after the WiFi came back, the handshake isn't done yet
+    bool sessionOffered;    // while connecting, a cached TLS session was offered
+    bool lost;          // free, its connection went with the WiFi, make it again when it's back
+} httpc_pool_conn_t;
+
+#if HTTPC_POOL_SIZE > 0
+static httpc_pool_conn_t pool[HTTPC_POOL_SIZE];
+#endif
+
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS && HTTPC_TLS_SESSION_CACHE_SIZE > 0
+#define HTTPC_TLS_RESUME 1
+// last TLS session negotiated with each host, only touched by the httpc task
+typedef struct {
+    esp_tls_client_session_t *session;  // NULL if the slot is free
+    char host[HTTPC_MAX_HOST_LEN];
+    int port;
+    TickType_t lastUsed;
+} httpc_tls_session_t;
+
+static httpc_tls_session_t tlsSessions[HTTPC_TLS_SESSION_CACHE_SIZE];
+#endif
+static httpc_tls_stats_t tlsStats;    // guarded by the stats lock
+
+#if HTTPC_RATELIMIT_HOSTS > 0
+// X-RateLimit- budget last reported by each host, only touched by the httpc task
+typedef struct {
+    char host[HTTPC_MAX_HOST_LEN];  // "" if the slot is free
+    int port;
+    long limit;
+    long remaining;         // as last reported
+    long inflight;          // paced requests waiting, sent or being answered, the budget will pay for them too
+    TickType_t resetAt;
+    TickType_t window;      // longest time to a reset seen, taken as the limit's period
+    TickType_t nextAt;      // earliest start for the next paced request
+    TickType_t lastUsed;
+} httpc_ratelimit_t;
+
+static httpc_ratelimit_t rateLimits[HTTPC_RATELIMIT_HOSTS];
+#endif
+
+#if HTTPC_REQ_SLOTS > 0
+// request slots and buffer blocks, free ones are chained through their first word. Requests are made on
+// any task and disposed of on the httpc task, so they have their own lock.
+typedef struct {
+    size_t size;
+    int count;
+} httpc_block_class_t;
+
+static const httpc_block_class_t blockClasses[] = { HTTPC_BLOCK_CLASSES };
+#define HTTPC_BLOCK_CLASS_COUNT (sizeof(blockClasses) / sizeof(blockClasses[0]))
+
+static httpc_req_t reqSlots[HTTPC_REQ_SLOTS];
+static httpc_req_t *freeSlots = NULL;
+static char *blockBase[HTTPC_BLOCK_CLASS_COUNT];    // each class's blocks back to back, reserved by httpc_init()
+static void *freeBlocks[HTTPC_BLOCK_CLASS_COUNT];
+static SemaphoreHandle_t slotSemaphore = NULL;
+#endif
+static httpc_slot_stats_t slotStats;
+static httpc_stats_t httpcStats;    // guarded by the stats lock, allocs and frees are atomic
+
+// The stats lock guards counters and the reconnect stats, the websocket lock each websocket's send queue. Neither
+// is held for more than a copy or a non-blocking write, so other tasks never wait on the network.
+static void lock_stats(void) {
+    xSemaphoreTake(statsSemaphore, portMAX_DELAY);
+}
+
+static void unlock_stats(void) {
+    xSemaphoreGive(statsSemaphore);
+}
+
+static void lock_ws(void) {
+    xSemaphoreTake(wsSemaphore, portMAX_DELAY);
+}
+
+static void unlock_ws(void) {
+    xSemaphoreGive(wsSemaphore);
+}
+
+// make the httpc task look at the request list again
+static void httpc_wake(void) {
+    uint64_t one = 1;
+    if (wakeFd >= 0 && write(wakeFd, &one, sizeof(one)) != sizeof(one)) {
+        Serial.printf("httpc_wake failed\r\n");
+    }
+}
+
+#if HTTPC_LINK_EVENTS
+// on the event loop task, the WiFi dropping is told of at once, losing the IP address only some time after
+static void httpc_link_event(void *arg, esp_event_base_t base, int32_t id, void *data) {
+    if (base == IP_EVENT && id == IP_EVENT_STA_GOT_IP) {
+        __atomic_store_n(&linkUp, true, __ATOMIC_SEQ_CST);
+        __atomic_fetch_add(&linkUps, 1, __ATOMIC_SEQ_CST);
+    } else if (__atomic_exchange_n(&linkUp, false, __ATOMIC_SEQ_CST)) {
+        __atomic_fetch_add(&linkDowns, 1, __ATOMIC_SEQ_CST);
+    }
+    httpc_wake();
+}
+#endif
+
+static void httpc_handles_init(void) {
+    for (int i=0;i<HTTPC_MAX_HANDLES;i++) {
+        handles[i].req = NULL;
+        handles[i].word = 1U << 16;     // no handle is 0
+        handles[i].nextFree = i + 1 < HTTPC_MAX_HANDLES ? i + 2 : 0;
+    }
+    freeHandles = 1;
+    commands = 0;
+}
+
+// a handle for req, on any task
+static httpc_handle_t httpc_handle_alloc(httpc_req_t *req) {
+    uint32_t top = __atomic_load_n(&freeHandles, __ATOMIC_ACQUIRE);
+    httpc_handle_slot_t *hs;
+    uint32_t next;
+
+    do {
+        if (0 == (top & HTTPC_H_INDEX)) {
+            return HTTPC_HANDLE_NONE;
+        }
+        hs = &handles[(top & HTTPC_H_INDEX) - 1];
+        next = ((top & HTTPC_H_GEN) + 0x10000) | __atomic_load_n(&hs->nextFree, __ATOMIC_RELAXED);
+    } while (!__atomic_compare_exchange_n(&freeHandles, &top, next, true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+    __atomic_store_n(&hs->req, req, __ATOMIC_RELEASE);
+    return (__atomic_load_n(&hs->word, __ATOMIC_ACQUIRE) & HTTPC_H_GEN) | (uint32_t)(hs - handles);
+}
+
+// on the httpc task, give back the handle of a dead request so it can be disposed of, false if it's still held
+static bool httpc_handle_free(httpc_req_t *req) {
+    httpc_handle_slot_t *hs = &handles[req->handle & HTTPC_H_INDEX];
+    uint32_t word = __atomic_load_n(&hs->word, __ATOMIC_ACQUIRE);
+    uint32_t gen, top;
+
+    do {
+        if (0 != (word & HTTPC_H_REFS)) {
+            return false;
+        }
+        gen = (word & HTTPC_H_GEN) + 0x10000;
+        if (0 == gen) {
+            gen = 0x10000;
+        }
+        // it stays on the command list if it's there, the httpc task finds it free
+    } while (!__atomic_compare_exchange_n(&hs->word, &word, gen | (word & HTTPC_H_QUEUED), true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+    __atomic_store_n(&hs->req, (httpc_req_t *)NULL, __ATOMIC_RELEASE);
+    top = __atomic_load_n(&freeHandles, __ATOMIC_ACQUIRE);
+    do {
+        __atomic_store_n(&hs->nextFree, top & HTTPC_H_INDEX, __ATOMIC_RELAXED);
+    } while (!__atomic_compare_exchange_n(&freeHandles, &top, ((top & HTTPC_H_GEN) + 0x10000) | ((req->handle & HTTPC_H_INDEX) + 1), true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+    return true;
+}
+
+// the request behind h, held so it isn't disposed of until httpc_unpin(), NULL if it has gone
+static httpc_req_t *httpc_handle_acquire(httpc_handle_t h) {
+    httpc_handle_slot_t *hs;
+    uint32_t word;
+
+    if ((h & HTTPC_H_INDEX) >= HTTPC_MAX_HANDLES) {
+        return NULL;
+    }
+    hs = &handles[h & HTTPC_H_INDEX];
+    word = __atomic_load_n(&hs->word, __ATOMIC_ACQUIRE);
+    do {
+        if ((word & HTTPC_H_GEN) != (h & HTTPC_H_GEN)) {
+            return NULL;
+        }
+    } while (!__atomic_compare_exchange_n(&hs->word, &word, word + HTTPC_H_REF, true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+    return __atomic_load_n(&hs->req, __ATOMIC_ACQUIRE);
+}
+
+// give h commands for the httpc task, false if it has gone
+static bool httpc_handle_command(httpc_handle_t h, uint32_t cmd) {
+    httpc_handle_slot_t *hs;
+    uint32_t word, top;
+
+    if ((h & HTTPC_H_INDEX) >= HTTPC_MAX_HANDLES) {
+        return false;
+    }
+    hs = &handles[h & HTTPC_H_INDEX];
+    word = __atomic_load_n(&hs->word, __ATOMIC_ACQUIRE);
+    do {
+        if ((word & HTTPC_H_GEN) != (h & HTTPC_H_GEN)) {
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&hs->word, &word, word | cmd | HTTPC_H_QUEUED, true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+    if (0 == (word & HTTPC_H_QUEUED)) {
+        top = __atomic_load_n(&commands, __ATOMIC_ACQUIRE);
+        do {
+            __atomic_store_n(&hs->nextCmd, top, __ATOMIC_RELAXED);
+        } while (!__atomic_compare_exchange_n(&commands, &top, (h & HTTPC_H_INDEX) + 1, true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+    }
+    httpc_wake();
+    return true;
+}
+
+static bool httpc_on_task(void) {
+    TaskHandle_t task = __atomic_load_n(&httpc_task_handle, __ATOMIC_ACQUIRE);
+    return NULL != task && xTaskGetCurrentTaskHandle() == task;
+}
+
+// count buffers of size back to back, in PSRAM where there is some if they're large, see HTTPC_PSRAM_MIN_LEN
+static void *httpc_malloc(size_t size, int count) {
+    void *p = NULL;
+
+#if HTTPC_PSRAM_MIN_LEN > 0
+    if (size >= HTTPC_PSRAM_MIN_LEN) {
+        p = heap_caps_malloc(size * count, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    }
+#endif
+    return NULL != p ? p : malloc(size * count);
+}
+
+#if HTTPC_REQ_SLOTS > 0
+// only held to pop or push a free list, like the stats lock
+static void lock_slots(void) {
+    xSemaphoreTake(slotSemaphore, portMAX_DELAY);
+}
+
+static void unlock_slots(void) {
+    xSemaphoreGive(slotSemaphore);
+}
+
+// block sizes rounded up to keep every block pointer aligned
+static size_t httpc_block_size(size_t i) {
+    return (blockClasses[i].size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+}
+
+static httpc_err_t httpc_slots_init(void) {
+    for (int i=0;i<HTTPC_REQ_SLOTS;i++) {
+        reqSlots[i].next = freeSlots;
+        freeSlots = &reqSlots[i];
+    }
+    for (size_t i=0;i<HTTPC_BLOCK_CLASS_COUNT;i++) {
+        size_t size = httpc_block_size(i);
+        if (NULL == (blockBase[i] = (char *)httpc_malloc(size, blockClasses[i].count))) {
+            Serial.printf("httpc out of mem reserving %d blocks of %u\r\n", blockClasses[i].count, (unsigned)size);
+            return HTTPC_ERR_FAIL;
+        }
+        for (int j=blockClasses[i].count-1;j>=0;j--) {
+            *(void **)(blockBase[i] + j * size) = freeBlocks[i];
+            freeBlocks[i] = blockBase[i] + j * size;
+        }
+        slotStats.blockBytes += size * blockClasses[i].count;
+    }
+    slotStats.slots = HTTPC_REQ_SLOTS;
+    if (NULL == (slotSemaphore = xSemaphoreCreateMutex())) {
+        return HTTPC_ERR_FAIL;
+    }
+    return HTTPC_ERR_OK;
+}
+#endif
+
+// a request's buffers, from the smallest free block that fits with HTTPC_REQ_SLOTS, otherwise the heap
+static void *httpc_alloc(size_t size) {
+#if HTTPC_REQ_SLOTS > 0
+    void *p = NULL;
+
+    lock_slots();
+    for (size_t i=0;i<HTTPC_BLOCK_CLASS_COUNT && NULL == p;i++) {
+        if (size <= blockClasses[i].size && NULL != freeBlocks[i]) {
+            p = freeBlocks[i];
+            freeBlocks[i] = *(void **)p;
+            if (++slotStats.blocksInUse > slotStats.blocksPeak) {
+                slotStats.blocksPeak = slotStats.blocksInUse;
+            }
+        }
+    }
+    if (NULL == p) {
+        slotStats.exhausted++;
+    }
+    unlock_slots();
+    if (NULL == p) {
+        Serial.printf("httpc no free block for %u bytes, see HTTPC_BLOCK_CLASSES\r\n", (unsigned)size);
+        return NULL;
+    }
+#else
+    void *p = httpc_malloc(size, 1);
+#endif
+    if (NULL != p) {
+        __atomic_fetch_add(&httpcStats.allocs, 1, __ATOMIC_RELAXED);
+    }
+    return p;
+}
+
+static void httpc_free(void *p) {
+    __atomic_fetch_add(&httpcStats.frees, 1, __ATOMIC_RELAXED);
+#if HTTPC_REQ_SLOTS > 0
+    lock_slots();
+    for (size_t i=0;i<HTTPC_BLOCK_CLASS_COUNT;i++) {
+        if ((char *)p >= blockBase[i] && (char *)p < blockBase[i] + httpc_block_size(i) * blockClasses[i].count) {
+            *(void **)p = freeBlocks[i];
+            freeBlocks[i] = p;
+            slotStats.blocksInUse--;
+            break;
+        }
+    }
+    unlock_slots();
+#else
+    free(p);
+#endif
+}
+
+static httpc_req_t *httpc_req_alloc(void) {
+#if HTTPC_REQ_SLOTS > 0
+    httpc_req_t *req;
+
+    lock_slots();
+    if (NULL != (req = freeSlots)) {
+        freeSlots = req->next;
+        if (++slotStats.slotsInUse > slotStats.slotsPeak) {
+            slotStats.slotsPeak = slotStats.slotsInUse;
+        }
+    } else {
+        slotStats.exhausted++;
+    }
+    unlock_slots();
+    if (NULL == req) {
+        Serial.printf("httpc no free request slot, all %d in use\r\n", HTTPC_REQ_SLOTS);
+        return NULL;
+    }
+#else
+    httpc_req_t *req = (httpc_req_t *)malloc(sizeof(httpc_req_t));
+#endif
+    if (NULL != req) {
+        __atomic_fetch_add(&httpcStats.allocs, 1, __ATOMIC_RELAXED);
+    }
+    return req;
+}
+
+static void httpc_req_free(httpc_req_t *req) {
+    __atomic_fetch_add(&httpcStats.frees, 1, __ATOMIC_RELAXED);
+#if HTTPC_REQ_SLOTS > 0
+    lock_slots();
+    req->next = freeSlots;
+    freeSlots = req;
+    slotStats.slotsInUse--;
+    unlock_slots();
+#else
+    free(req);
+#endif
+}
+
+void httpc_get_slot_stats(httpc_slot_stats_t *stats) {
+#if HTTPC_REQ_SLOTS > 0
+    if (NULL != slotSemaphore) {
+        lock_slots();
+        *stats = slotStats;
+        unlock_slots();
+        return;
+    }
+#endif
+    *stats = slotStats;
+}
+
+// bucket of the latency histogram for a phase taking us
+static int httpc_hist_bucket(uint32_t us) {
+    int b = 0;
+    for (uint32_t bound=1000;b<HTTPC_HIST_BUCKETS-1 && us >= bound;bound*=4) {
+        b++;
+    }
+    return b;
+}
+
+// the phase being timed for req has ended, the next starts now
+static void httpc_stats_phase(httpc_req_t *req, httpc_phase_t phase) {
+    uint32_t now = micros();
+    lock_stats();
+    req->stats.phaseUs[phase] = now - req->phaseUs;
+    httpcStats.hist[phase][httpc_hist_bucket(now - req->phaseUs)]++;
+    unlock_stats();
+    req->phaseUs = now;
+}
+
+// bytes moved and buffer used by req since last time, with the stats lock held
+static void httpc_stats_fold(httpc_req_t *req) {
+    req->stats.bytesIn += req->rxCount;
+    req->stats.bytesOut += req->txCount;
+    httpcStats.bytesIn += req->rxCount;
+    httpcStats.bytesOut += req->txCount;
+    req->rxCount = 0;
+    req->txCount = 0;
+    if (req->bufUsed > req->stats.bufHighWater) {
+        req->stats.bufHighWater = req->bufUsed;
+    }
+    if (req->bufUsed > httpcStats.bufHighWater) {
+        httpcStats.bufHighWater = req->bufUsed;
+    }
+}
+
+void httpc_get_stats(httpc_stats_t *stats) {
+    lock_stats();
+    *stats = httpcStats;
+    unlock_stats();
+    stats->allocs = __atomic_load_n(&httpcStats.allocs, __ATOMIC_RELAXED);
+    stats->frees = __atomic_load_n(&httpcStats.frees, __ATOMIC_RELAXED);
+    stats->heapFree = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    stats->heapMinFree = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
+    stats->psramFree = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+}
+
+void httpc_loop_internal(void);
+httpc_err_t httpc_init_internal(void);
+
+static void httpc_task_function(void * pvParameter) {
+    __atomic_store_n(&httpc_task_handle, xTaskGetCurrentTaskHandle(), __ATOMIC_RELEASE);  // it may not be set yet
+    esp_task_wdt_init(60, false);
+    while(1) {
+        esp_task_wdt_reset();
+        httpc_loop_internal();
+    }
+}
+
+void httpc_task_config_default(httpc_task_config_t *cfg) {
+    cfg->priority = HTTPC_TASK_PRIORITY;
+    cfg->stackSize = HTTPC_TASK_STACK_SIZE;
+    cfg->core = HTTPC_TASK_CORE;
+}
+
+void httpc_set_task_config(const httpc_task_config_t *cfg) {
+    taskConfig = *cfg;
+}
+
+httpc_err_t httpc_init(void) {
+    if (HTTPC_ERR_OK != httpc_init_internal()) {    // before the task starts, so requests can be queued straight away
+        return HTTPC_ERR_FAIL;
+    }
+    TaskHandle_t task;
+    if (NULL != __atomic_load_n(&httpc_task_handle, __ATOMIC_ACQUIRE)) {
+        return HTTPC_ERR_OK;    // already running, e.g. a second lyuba_init()
+    }
+    if (pdPASS != xTaskCreatePinnedToCore(httpc_task_function, "httpc", taskConfig.stackSize, NULL, taskConfig.priority, &task, taskConfig.core)) {
+        return HTTPC_ERR_FAIL;
+    }
+    __atomic_store_n(&httpc_task_handle, task, __ATOMIC_RELEASE);
+    return HTTPC_ERR_OK;
+}
+
+void httpc_loop(void) {
+    // FIXME
+}
+
+
+static void httpc_ll_push(httpc_req_t *req) {
+#ifdef HTTPC_DEBUG
+    Serial.printf("httpc_ll_push %p\r\n", req);
+#endif
+    // add to front of list
+    if (NULL == reqs_ll_head) {
+        reqs_ll_head = req;
+        req->prev = NULL;
+        req->next = NULL;
+    } else {
+        reqs_ll_head->prev = req;
+        req->prev = NULL;
+        req->next = reqs_ll_head;
+        reqs_ll_head = req;
+    }
+}
+
+static void httpc_ll_remove(httpc_req_t *req) {
+#ifdef HTTPC_DEBUG
+    Serial.printf("httpc_ll_remove %p\r\n", req);
+#endif
+    if (NULL == req->prev) {    // first item in list
+        reqs_ll_head = req->next;
+        if (NULL != req->next) {
+            req->next->prev = NULL;
+        }
+    } else if (NULL == req->next) {    // last item in list
+        req->prev->next = NULL;
+    } else {    // mid-list
+        req->prev->next = req->next;
+        req->next->prev = req->prev;
+    }
+}
+
+httpc_err_t httpc_init_internal(void) {
+    if (inited) {
+        return HTTPC_ERR_OK;
+    }
+    esp_vfs_eventfd_config_t eventfdConfig = ESP_VFS_EVENTD_CONFIG_DEFAULT();
+    esp_vfs_eventfd_register(&eventfdConfig);
+    if ((wakeFd = eventfd(0, 0)) < 0) {
+        Serial.printf("httpc eventfd failed\r\n");
+        return HTTPC_ERR_FAIL;
+    }
+#if HTTPC_REQ_SLOTS > 0
+    if (HTTPC_ERR_OK != httpc_slots_init()) {
+        return HTTPC_ERR_FAIL;
+    }
+#endif
+    if (NULL == (statsSemaphore = xSemaphoreCreateMutex()) || NULL == (wsSemaphore = xSemaphoreCreateMutex())) {
+        return HTTPC_ERR_FAIL;
+    }
+    httpc_handles_init();
+    reqs_ll_head = NULL;
+    submitted = NULL;
+#if HTTPC_LINK_EVENTS
+    // the WiFi library makes the default loop too, whichever gets there first
+    esp_err_t err = esp_event_loop_create_default();
+    if ((ESP_OK != err && ESP_ERR_INVALID_STATE != err) ||
+        ESP_OK != esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, httpc_link_event, NULL) ||
+        ESP_OK != esp_event_handler_register(IP_EVENT, IP_EVENT_STA_LOST_IP, httpc_link_event, NULL) ||
+        ESP_OK != esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, httpc_link_event, NULL)) {
+        Serial.printf("httpc can't follow the WiFi, requests are left to their deadlines\r\n");
+    }
+#endif
+    inited = true;
+    return HTTPC_ERR_OK;
+}
+
+static void httpc_transport_close(httpc_req_t *req) {
+    if (NULL != req->tls) {
+        esp_tls_conn_destroy(req->tls);
+        req->tls = NULL;
+    }
+}
+
+static void httpc_pool_discard(httpc_pool_conn_t *pc) {
+#ifdef HTTPC_DEBUG
+    Serial.printf("httpc_pool_discard %s:%d\r\n", pc->host, pc->port);
+#endif
+    esp_tls_conn_destroy(pc->tls);
+    pc->tls = NULL;
+    pc->connecting = false;
+}
 
-static SemaphoreHandle_t userSemaphore = NULL;
+// take an idle connection to the request's host:port, if there is one, *connecting if it's still being made
+static esp_tls_t *httpc_pool_take(httpc_req_t *req, bool *connecting) {
+#if HTTPC_POOL_SIZE > 0
+    for (int i=0;i<HTTPC_POOL_SIZE;i++) {
+        if (NULL != pool[i].tls && pool[i].port == req->port && 0 == strcmp(pool[i].host, req->host)) {
+            esp_tls_t *tls = pool[i].tls;
+            *connecting = pool[i].connecting;
+            pool[i].tls = NULL;
+            return tls;
+        }
+    }
+#endif
+    return NULL;
+}
+
+// finished with the connection, keep it for the next request to the same host if the server allows
+static void httpc_transport_release(httpc_req_t *req) {
+#if HTTPC_POOL_SIZE > 0
+    httpc_pool_conn_t *slot = NULL;
+    TickType_t now = xTaskGetTickCount();
+    if (NULL != req->tls && req->keepAlive) {
+        for (int i=0;i<HTTPC_POOL_SIZE;i++) {
+            if (NULL == pool[i].tls) {
+                slot = &pool[i];
+                break;
+            }
+            if (NULL == slot || now - pool[i].idleSince > now - slot->idleSince) {
+                slot = &pool[i];    // evict the longest idle
+            }
+        }
+        if (NULL != slot->tls) {
+            httpc_pool_discard(slot);
+        }
+#ifdef HTTPC_DEBUG
+        Serial.printf("httpc_transport_release %s:%d to pool\r\n", req->host, req->port);
+#endif
+        slot->tls = req->tls;
+        strcpy(slot->host, req->host);
+        slot->port = req->port;
+        slot->idleSince = now;
+        slot->connecting = false;
+        slot->lost = false;
+        req->tls = NULL;
+    }
+#endif
+    httpc_transport_close(req);
+}
+
+static void httpc_dispose(httpc_req_t *req) {
+#ifdef HTTPC_DEBUG
+    Serial.printf("httpc_dispose %p\r\n", req);
+#endif
+    if (NULL != req) {
+        httpc_transport_close(req);
+        if (NULL != req->httpBuf) {
+            httpc_free(req->httpBuf);
+        }
+        if (NULL != req->lb) {
+            httpc_free(req->lb->linebuf);
+        }
+        if (NULL != req->txBuf) {
+            httpc_free(req->txBuf);
+        }
+        if (NULL != req->wsTx) {
+            httpc_free(req->wsTx);
+        }
+        if (NULL != req->userdata) {
+            httpc_free(req->userdata);
+        }
+        httpc_req_free(req);
+    }
+}
 
-static void lock_ll(void) {
-    if (xSemaphoreTake(userSemaphore, (TickType_t)LOCK_WAIT_TICKS) != pdTRUE ) {
-        Serial.printf("*** LOCK FAILED, FIXME\r\n");    // shouldn't happen
+// true once ticks have reached at, allowing for wrap
+static bool httpc_ticks_due(TickType_t at, TickType_t now) {
+    return (TickType_t)(now - at) < portMAX_DELAY / 2;
+}
+
+static void httpc_timer_cancel(httpc_req_t *req) {
+    if (!req->timerSet) {
+        return;
+    }
+    *req->timerPrev = req->timerNext;
+    if (NULL != req->timerNext) {
+        req->timerNext->timerPrev = req->timerPrev;
+    }
+    req->timerSet = false;
+    wheelTimers--;
+}
+
+static void httpc_timer_set(httpc_req_t *req, TickType_t at) {
+    TickType_t ahead = 0;
+    unsigned slot;
+
+    httpc_timer_cancel(req);
+    if (0 == wheelTimers) {
+        wheelAt = xTaskGetTickCount();  // the wheel stands still while it's empty
+    }
+    if (!httpc_ticks_due(at, wheelAt)) {
+        ahead = at - wheelAt;
+    }
+    slot = (wheelSlot + ahead / HTTPC_WHEEL_TICKS) % HTTPC_WHEEL_SLOTS;
+    req->timerAt = at;
+    req->timerPrev = &wheel[slot];
+    req->timerNext = wheel[slot];
+    if (NULL != wheel[slot]) {
+        wheel[slot]->timerPrev = &req->timerNext;
+    }
+    wheel[slot] = req;
+    req->timerSet = true;
+    if (0 == wheelTimers++ || !httpc_ticks_due(wheelDue, at)) {
+        wheelDue = at;
+    }
+}
+
+// earlier of what's due at *at and d at t
+static void httpc_due_sooner(httpc_due_t *due, TickType_t *at, const char **why, httpc_due_t d, TickType_t t, const char *w) {
+    if (*due == HTTPC_DUE_NONE || !httpc_ticks_due(*at, t)) {
+        *due = d;
+        *at = t;
+        *why = w;
+    }
+}
+
+// The next deadline of req in the state it's in, and why it would fail. Connecting, waiting for the first byte and
+// idling run from lastActivity, which is when the attempt started, the request went out or the last read or write.
+static httpc_due_t httpc_req_due(httpc_req_t *req, TickType_t *at, const char **why) {
+    httpc_deadlines_t *d = &req->deadlines;
+    httpc_due_t due = HTTPC_DUE_NONE;
+    uint32_t quietMs = d->idleMs;
+
+    if (!req->autoResume && d->totalMs > 0 && (req->state == HTTPC_REQ_STATE_RUNNABLE || req->state == HTTPC_REQ_STATE_BACKOFF)) {
+        httpc_due_sooner(&due, at, why, HTTPC_DUE_FAIL, req->madeAt + pdMS_TO_TICKS(d->totalMs), "total timeout");
+    }
+    if (req->state != HTTPC_REQ_STATE_RUNNABLE) {
+        return due;
+    }
+    if (req->ioState == HTTPC_IO_CONNECTING) {
+        if (d->connectMs > 0) {
+            httpc_due_sooner(&due, at, why, HTTPC_DUE_FAIL, req->lastActivity + pdMS_TO_TICKS(d->connectMs), "connect timeout");
+        }
+        return due;
+    }
+    if (req->ioState == HTTPC_IO_RECV_HEADERS && !req->gotStatusLine && req->hdrLineLen == 0 && d->firstByteMs > 0) {
+        httpc_due_sooner(&due, at, why, HTTPC_DUE_FAIL, req->lastActivity + pdMS_TO_TICKS(d->firstByteMs), "first byte timeout");
+        return due;
+    }
+    if (req->ioState == HTTPC_IO_RECV_BODY && req->autoResume && d->heartbeatMs > 0 && d->stallHeartbeats > 0) {
+        uint32_t stallMs = d->heartbeatMs * d->stallHeartbeats;
+        httpc_due_sooner(&due, at, why, HTTPC_DUE_FAIL, req->lastActivity + pdMS_TO_TICKS(stallMs), "stalled");
+        if (quietMs == 0 || stallMs < quietMs) {
+            quietMs = stallMs;
+        }
+    }
+    if (d->idleMs > 0) {
+        httpc_due_sooner(&due, at, why, HTTPC_DUE_FAIL, req->lastActivity + pdMS_TO_TICKS(d->idleMs), "idle timeout");
+    }
+    if (req->wsOpen && !req->wsPingSent && quietMs > 0) {
+        // a pong is a read, so one ping well before the deadline keeps a healthy but quiet websocket from failing
+        httpc_due_sooner(&due, at, why, HTTPC_DUE_PING, req->lastActivity + pdMS_TO_TICKS(quietMs / 2), NULL);
+    }
+    return due;
+}
+
+// after req has changed state, set its timer if its next deadline comes sooner
+static void httpc_timer_update(httpc_req_t *req) {
+    const char *why;
+    TickType_t at;
+
+    if (HTTPC_DUE_NONE != httpc_req_due(req, &at, &why) && (!req->timerSet || !httpc_ticks_due(req->timerAt, at))) {
+        httpc_timer_set(req, at);
+    }
+}
+
+// on the httpc task, stop req, its transport is closed and it's disposed of on the next pass
+static void httpc_req_close(httpc_req_t *req) {
+    if (req->state == HTTPC_REQ_STATE_RUNNABLE || req->state == HTTPC_REQ_STATE_HELD || req->state == HTTPC_REQ_STATE_BACKOFF) {
+        req->state = HTTPC_REQ_STATE_CLOSEABLE;
+    }
+    __atomic_fetch_or(&handles[req->handle & HTTPC_H_INDEX].word, HTTPC_H_CLOSE, __ATOMIC_ACQ_REL);
+    lock_stats();
+    req->retryWaiting = false;
+    unlock_stats();
+}
+
+// on the httpc task, reconnect a held stream, once any backoff is over
+static bool httpc_req_resume(httpc_req_t *req) {
+    TickType_t now = xTaskGetTickCount();
+
+    if (req->state != HTTPC_REQ_STATE_HELD) {
+        return false;
+    }
+    lock_stats();
+    if (httpc_ticks_due(req->retryAt, now)) {
+        req->state = HTTPC_REQ_STATE_RUNNABLE;
+        req->lastActivity = now;    // the connect timeout runs from now
+        req->retryWaiting = false;
+    } else {
+        req->state = HTTPC_REQ_STATE_BACKOFF;
+    }
+    unlock_stats();
+    httpc_timer_update(req);
+    return true;
+}
+
+httpc_err_t httpc_close(httpc_handle_t h) {
+#ifdef HTTPC_DEBUG
+    Serial.printf("httpc_close %08x\r\n", (unsigned)h);
+#endif
+    if (httpc_on_task()) {
+        // from a callback, nothing more for it from here on
+        httpc_req_t *req = httpc_lookup(h);
+        if (NULL != req) {
+            httpc_req_close(req);
+        }
+    } else {
+        // safe after the request has gone, the handle no longer matches
+        httpc_handle_command(h, HTTPC_H_CLOSE);
+    }
+    return HTTPC_ERR_OK;
+}
+
+httpc_handle_t httpc_handle(httpc_req_t *req) {
+    return req->handle;
+}
+
+httpc_req_t *httpc_lookup(httpc_handle_t h) {
+    httpc_handle_slot_t *hs;
+
+    if ((h & HTTPC_H_INDEX) >= HTTPC_MAX_HANDLES) {
+        return NULL;
+    }
+    hs = &handles[h & HTTPC_H_INDEX];
+    if ((__atomic_load_n(&hs->word, __ATOMIC_ACQUIRE) & HTTPC_H_GEN) != (h & HTTPC_H_GEN)) {
+        return NULL;
+    }
+    return __atomic_load_n(&hs->req, __ATOMIC_ACQUIRE);
+}
+
+void httpc_pin(httpc_req_t *req) {
+    __atomic_fetch_add(&handles[req->handle & HTTPC_H_INDEX].word, HTTPC_H_REF, __ATOMIC_ACQ_REL);
+}
+
+void httpc_unpin(httpc_req_t *req) {
+    uint32_t word = __atomic_sub_fetch(&handles[req->handle & HTTPC_H_INDEX].word, HTTPC_H_REF, __ATOMIC_SEQ_CST);
+    if (0 == (word & HTTPC_H_REFS) && __atomic_load_n(&pinnedDead, __ATOMIC_SEQ_CST)) {
+        httpc_wake();
+    }
+}
+
+// a fresh Sec-WebSocket-Key in the request, and the accept value to expect for it
+static void httpc_ws_new_key(httpc_req_t *req) {
+    unsigned char nonce[16];
+    unsigned char digest[20];
+    char keyGuid[24 + sizeof(HTTPC_WS_GUID)];
+    size_t olen;
+
+    for (int i=0;i<(int)sizeof(nonce);i+=4) {
+        uint32_t r = esp_random();
+        memcpy(nonce + i, &r, 4);
+    }
+    mbedtls_base64_encode((unsigned char *)keyGuid, sizeof(keyGuid), &olen, nonce, sizeof(nonce));
+    memcpy(req->txBuf + req->wsKeyOff, keyGuid, 24);
+    strcpy(keyGuid + 24, HTTPC_WS_GUID);
+#if MBEDTLS_VERSION_NUMBER >= 0x03000000
+    mbedtls_sha1((const unsigned char *)keyGuid, strlen(keyGuid), digest);
+#else
+    mbedtls_sha1_ret((const unsigned char *)keyGuid, strlen(keyGuid), digest);
+#endif
+    mbedtls_base64_encode((unsigned char *)req->wsAccept, sizeof(req->wsAccept), &olen, digest, sizeof(digest));
+}
+
+// (re)start a request from the top, on a fresh connection
+static void httpc_req_start(httpc_req_t *req) {
+    httpc_transport_close(req);
+    req->ioState = HTTPC_IO_CONNECTING;
+    req->txOff = 0;
+    req->statusCode = -1;
+    req->retryAfterMs = 0;
+    req->rlLimit = -1;
+    req->rlRemaining = -1;
+    req->rlResetIn = -1;
+    req->rlReset = -1;
+    req->date = -1;
+    req->gotStatusLine = false;
+    req->hdrLineLen = 0;
+    req->chunked = false;
+    req->haveContentLength = false;
+    req->keepAlive = false;
+    req->reused = false;
+    req->sessionOffered = false;
+    req->httpBufLen = 0;
+    req->tlsState = -1;     // timing starts with the first connect step
+    if (NULL != req->lb) {
+        linebuffer_reset(req->lb);
+    }
+    if (req->ws) {
+        httpc_ws_new_key(req);
+        req->wsUpgraded = false;
+        req->wsAccepted = false;
+        req->wsInMessage = false;
+        req->wsPingSent = false;
+        lock_ws();
+        req->wsOpen = false;
+        req->wsTxLen = 0;   // anything unsent was for the old connection
+        unlock_ws();
+    }
+    req->lastActivity = xTaskGetTickCount();
+}
+
+// restart an endless request, straight away if its connection had been up a while and ended cleanly,
+// otherwise after a backoff doubling with each attempt, half of it random so clients dropped together
+// don't all come back together. held leaves it waiting for httpc_resume() as well.
+static void httpc_req_retry(httpc_req_t *req, bool failed, bool held) {
+    TickType_t now = xTaskGetTickCount();
+    unsigned retries = req->retries;
+    int status = req->statusCode;
+    uint32_t ms = 0;
+
+    if (!failed && req->gotStatusLine && now - req->connectedAt >= pdMS_TO_TICKS(HTTPC_BACKOFF_STABLE_MS)) {
+        retries = 0;
+    } else {
+        uint32_t cap = HTTPC_BACKOFF_MAX_MS;
+        if (retries < 16 && ((uint32_t)HTTPC_BACKOFF_MIN_MS << retries) < cap) {
+            cap = (uint32_t)HTTPC_BACKOFF_MIN_MS << retries;
+        }
+        ms = cap / 2 + esp_random() % (cap / 2 + 1);
+        retries++;
+    }
+    if (req->retryAfterMs > ms) {
+        ms = req->retryAfterMs;
+    }
+#ifdef HTTPC_DEBUG
+    Serial.printf("httpc req=%p reconnect in %u ms (status %d, retry %u)\r\n", req, (unsigned)ms, status, retries);
+#endif
+    httpc_req_start(req);
+    lock_stats();
+    httpcStats.reconnects++;
+    req->retries = retries;
+    if (failed) {
+        req->failures++;
+    }
+    req->reconnects++;
+    req->backoffMs = ms;
+    req->lastStatus = status;
+    if (req->state == HTTPC_REQ_STATE_RUNNABLE) {   // not closed from its callback
+        req->retryAt = now + pdMS_TO_TICKS(ms);
+        if (held) {
+            req->state = HTTPC_REQ_STATE_HELD;
+            req->retryWaiting = true;
+        } else if (ms > 0) {
+            req->state = HTTPC_REQ_STATE_BACKOFF;
+            req->retryWaiting = true;
+        }
+    }
+    unlock_stats();
+}
+
+bool httpc_status_retryable(int status_code) {
+    return status_code == 429 || (status_code >= 500 && status_code <= 599);
+}
+
+#if HTTPC_RATELIMIT_HOSTS > 0
+static httpc_ratelimit_t *httpc_ratelimit_find(httpc_req_t *req, bool create) {
+    httpc_ratelimit_t *rl = NULL;
+
+    for (int i=0;i<HTTPC_RATELIMIT_HOSTS;i++) {
+        if (rateLimits[i].port == req->port && 0 == strcmp(rateLimits[i].host, req->host)) {
+            return &rateLimits[i];
+        }
+    }
+    if (!create) {
+        return NULL;
+    }
+    // a free slot, else the least recently used
+    for (int i=0;i<HTTPC_RATELIMIT_HOSTS;i++) {
+        if (NULL == rl || rateLimits[i].host[0] == '\0' ||
+            (rl->host[0] != '\0' && rateLimits[i].lastUsed - rl->lastUsed > portMAX_DELAY / 2)) {
+            rl = &rateLimits[i];
+        }
+    }
+    memset(rl, 0x00, sizeof(httpc_ratelimit_t));
+    strcpy(rl->host, req->host);
+    rl->port = req->port;
+    return rl;
+}
+
+// when a POST may start, spread over the budget left before the reset. Once that's spent it waits for the reset,
+// then goes at the limit's average rate until a response reports the new budget. Only called on the httpc task, which owns the table.
+static TickType_t httpc_ratelimit_slot(httpc_req_t *req, TickType_t now) {
+    httpc_ratelimit_t *rl = httpc_ratelimit_find(req, false);
+    TickType_t t = now;
+    TickType_t interval;
+
+    if (NULL == rl || rl->limit <= 0) {
+        return now;     // nothing known yet, its response will tell
+    }
+    rl->inflight++;
+    rl->lastUsed = now;
+    req->rlInflight = true;
+    if (httpc_ticks_due(rl->resetAt + rl->window, now)) {
+        rl->nextAt = now;   // a whole period has gone by since the budget was reported
+        return now;
+    }
+    if (!httpc_ticks_due(rl->nextAt, now)) {
+        t = rl->nextAt;
+    }
+    if (!httpc_ticks_due(rl->resetAt, t) && rl->remaining - (rl->inflight - 1) > 0) {
+        interval = (rl->resetAt - t) / (rl->remaining - (rl->inflight - 1));
+    } else {
+        if (!httpc_ticks_due(rl->resetAt, t)) {
+            t = rl->resetAt;
+        }
+        interval = rl->window / rl->limit;
+    }
+    rl->nextAt = t + interval;
+    return t;
+}
+
+// the request no longer needs the budget, only called on the httpc task
+static httpc_ratelimit_t *httpc_ratelimit_release(httpc_req_t *req) {
+    httpc_ratelimit_t *rl = httpc_ratelimit_find(req, false);
+
+    if (req->rlInflight && NULL != rl && rl->inflight > 0) {
+        rl->inflight--;
+    }
+    req->rlInflight = false;
+    return rl;
+}
+
+// take the budget a response reported
+static void httpc_ratelimit_update(httpc_req_t *req) {
+    TickType_t now = xTaskGetTickCount();
+    long resetIn = req->rlResetIn;
+    httpc_ratelimit_t *rl;
+
+    if (resetIn < 0 && req->rlReset >= 0 && req->date >= 0) {
+        resetIn = req->rlReset > req->date ? (long)(req->rlReset - req->date) : 0;
+    }
+    if (resetIn > 86400) {
+        resetIn = 86400;
+    }
+    rl = httpc_ratelimit_release(req);
+    if (req->rlLimit > 0 && req->rlRemaining >= 0 && resetIn >= 0) {
+        TickType_t untilReset = (TickType_t)resetIn * configTICK_RATE_HZ;
+        if (NULL == rl) {
+            rl = httpc_ratelimit_find(req, true);
+        }
+        rl->limit = req->rlLimit;
+        rl->remaining = req->rlRemaining;
+        rl->resetAt = now + untilReset;
+        if (untilReset > rl->window) {
+            rl->window = untilReset;
+        }
+        rl->lastUsed = now;
+    }
+    if (req->statusCode == 429 && NULL != rl) {
+        // over budget anyway (other clients on the same account), nothing more until the reset
+        rl->remaining = 0;
+        if (req->retryAfterMs > 0 && !httpc_ticks_due(now + pdMS_TO_TICKS(req->retryAfterMs), rl->resetAt)) {
+            rl->resetAt = now + pdMS_TO_TICKS(req->retryAfterMs);
+        }
+    }
+}
+#endif
+
+static void httpc_req_fail(httpc_req_t *req, const char *why) {
+    Serial.printf("httpc req=%p failed: %s\r\n", req, why);
+    httpc_transport_close(req);
+    lock_stats();
+    httpcStats.failures++;
+    unlock_stats();
+    if (req->state == HTTPC_REQ_STATE_RUNNABLE) {
+        if (req->autoResume) {
+            // a transport error, the server may well be back later
+            req->dataCb(HTTPC_ERR_FAIL, req, req->statusCode, NULL, 0);
+            httpc_req_retry(req, true, false);
+        } else {
+            httpc_req_close(req);
+            req->dataCb(HTTPC_ERR_FAIL, req, req->statusCode, NULL, 0);
+        }
+    }
+}
+
+static void httpc_req_finish(httpc_req_t *req) {
+    httpc_err_t ret = HTTPC_ERR_OK;
+#ifdef HTTPC_DEBUG
+    Serial.printf("** httpc_req_finish req=%p status=%d\r\n", req, req->statusCode);
+#endif
+    lock_stats();
+    httpcStats.responses++;
+    if (!req->autoResume) {
+        uint32_t us = micros() - req->startUs;
+        req->stats.phaseUs[HTTPC_PHASE_COMPLETE] = us;
+        httpcStats.hist[HTTPC_PHASE_COMPLETE][httpc_hist_bucket(us)]++;
+    }
+    unlock_stats();
+#if HTTPC_RATELIMIT_HOSTS > 0
+    if (req->paced) {
+        httpc_ratelimit_update(req);
+    }
+#endif
+    if (req->httpBufMaxLen == 0 || req->lb != NULL || req->ws) {
+        ret = req->dataCb(HTTPC_ERR_OK, req, req->statusCode, NULL, 0);
+    } else {
+        // null terminate buffer
+        req->httpBuf[req->httpBufLen] = '\0';
+        req->dataCb(HTTPC_ERR_OK, req, req->statusCode, req->httpBuf, req->httpBufLen);
+    }
+    if (req->state == HTTPC_REQ_STATE_RUNNABLE) {    // once by user closed, don't reopen
+        if (!req->autoResume) {
+            httpc_req_close(req);
+        } else if (req->statusCode == (req->ws ? 101 : 200)) {
+            httpc_req_retry(req, false, ret == HTTPC_ERR_HOLD);
+        } else if (httpc_status_retryable(req->statusCode)) {
+            httpc_req_retry(req, true, false);
+        } else {
+            httpc_req_close(req);   // don't keep retrying if we get a 401!
+        }
+    }
+}
+
+// body bytes, after any chunked encoding is removed
+static void httpc_req_body(httpc_req_t *req, const char *data, size_t len) {
+#ifdef HTTPC_DEBUG
+    Serial.printf("httpc_req_body, len=%d\r\n", (int)len);
+#endif
+    if (req->httpBufMaxLen == 0) {
+        // pass buffer straight to cb
+        req->dataCb(HTTPC_ERR_OK, req, req->statusCode, data, len);
+    } else {
+        if (req->lb != NULL) {  // linebuffered
+            if (0 != linebuffer_write(req->lb, data, len)) {
+                req->dataCb(HTTPC_ERR_FAIL, req, req->statusCode, NULL, 0);
+            }
+        } else { // accumulate for big final send
+            if ((req->httpBufMaxLen-1) - req->httpBufLen >= len) {
+                memcpy(req->httpBuf + req->httpBufLen, data, len);
+                req->httpBufLen += len;
+                if (req->httpBufLen > req->bufUsed) {
+                    req->bufUsed = req->httpBufLen;
+                }
+            } else {
+                Serial.printf("** httpBuf too small (%d)\r\n", (int)req->httpBufMaxLen);
+                req->dataCb(HTTPC_ERR_FAIL, req, req->statusCode, NULL, 0);
+            }
+        }
+    }
+}
+
+// days from 1970-01-01 to a date in the proleptic Gregorian calendar
+static long httpc_days_from_civil(int y, int m, int d) {
+    y -= m <= 2;
+    long era = (y >= 0 ? y : y - 399) / 400;
+    long yoe = y - era * 400;
+    long doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    return era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+}
+
+// seconds since the epoch of an ISO 8601 UTC time ("2026-10-17T12:00:00.123456Z", rounded up to the second)
+// or an HTTP date ("Sat, 17 Oct 2026 12:00:00 GMT"), -1 if it's neither
+static long long httpc_parse_time(const char *s) {
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    int y, mo, d, h, mi, sec, n = 0;
+    char mon[4];
+    const char *m;
+    bool frac = false;
+
+    if (6 == sscanf(s, "%d-%d-%dT%d:%d:%d%n", &y, &mo, &d, &h, &mi, &sec, &n)) {
+        if (s[n] == '.') {
+            for (const char *p = s + n + 1; *p >= '0' && *p <= '9'; p++) {
+                frac |= (*p != '0');
+            }
+        }
+    } else if (6 == sscanf(s, "%*[^,], %d %3s %d %d:%d:%d", &d, mon, &y, &h, &mi, &sec) && strlen(mon) == 3 &&
+        NULL != (m = strstr(months, mon)) && (m - months) % 3 == 0) {
+        mo = (int)(m - months) / 3 + 1;
+    } else {
+        return -1;
+    }
+    if (mo < 1 || mo > 12 || d < 1 || d > 31) {
+        return -1;
+    }
+    return (long long)httpc_days_from_civil(y, mo, d) * 86400 + h * 3600 + mi * 60 + sec + (frac ? 1 : 0);
+}
+
+// a complete response header line, returns false if the response is unusable
+static bool httpc_req_header(httpc_req_t *req, char *line) {
+    char *value;
+
+    if (!req->gotStatusLine) {
+        int major, minor;
+        if (3 != sscanf(line, "HTTP/%d.%d %d", &major, &minor, &req->statusCode)) {
+            return false;
+        }
+        req->keepAlive = (major == 1 && minor >= 1);
+        req->gotStatusLine = true;
+        req->connectedAt = xTaskGetTickCount();
+        return true;
+    }
+#ifdef HTTPC_DEBUG
+    Serial.printf("header '%s'\r\n", line);
+#endif
+    if (NULL == (value = strchr(line, ':'))) {
+        return true;    // ignore malformed
+    }
+    *value++ = '\0';
+    while (*value == ' ' || *value == '\t') {
+        value++;
+    }
+    if (0 == strcasecmp(line, "Content-Length")) {
+        req->haveContentLength = true;
+        req->bodyRemaining = strtoul(value, NULL, 10);
+    } else if (0 == strcasecmp(line, "Transfer-Encoding")) {
+        req->chunked = (NULL != strstr(value, "chunked"));
+    } else if (req->ws && 0 == strcasecmp(line, "Upgrade")) {
+        req->wsUpgraded = (NULL != strcasestr(value, "websocket"));
+    } else if (req->ws && 0 == strcasecmp(line, "Sec-WebSocket-Accept")) {
+        req->wsAccepted = (0 == strcmp(value, req->wsAccept));
+    } else if (req->paced && 0 == strcasecmp(line, "X-RateLimit-Limit")) {
+        req->rlLimit = strtol(value, NULL, 10);
+    } else if (req->paced && 0 == strcasecmp(line, "X-RateLimit-Remaining")) {
+        req->rlRemaining = strtol(value, NULL, 10);
+    } else if (req->paced && 0 == strcasecmp(line, "X-RateLimit-Reset")) {
+        if (NULL == strchr(value, '-')) {   // seconds to go, or since the epoch
+            long long reset = strtoll(value, NULL, 10);
+            if (reset < 1000000000LL) {
+                req->rlResetIn = (long)reset;
+            } else {
+                req->rlReset = reset;
+            }
+        } else {
+            req->rlReset = httpc_parse_time(value);
+        }
+    } else if (req->paced && 0 == strcasecmp(line, "Date")) {
+        req->date = httpc_parse_time(value);
+    } else if (0 == strcasecmp(line, "Retry-After")) {
+        if (*value >= '0' && *value <= '9') {   // an HTTP date isn't worth parsing here, the backoff stands
+            unsigned long s = strtoul(value, NULL, 10);
+            req->retryAfterMs = s > 3600 ? 3600000 : s * 1000;
+        }
+    } else if (0 == strcasecmp(line, "Connection")) {
+        if (NULL != strcasestr(value, "close")) {
+            req->keepAlive = false;
+        } else if (NULL != strcasestr(value, "keep-alive")) {
+            req->keepAlive = true;
+        }
+    }
+    return true;
+}
+
+// append a frame to the websocket's send queue, masked as client frames must be, the websocket lock must be held
+static bool httpc_ws_queue(httpc_req_t *req, unsigned char opcode, const char *data, size_t len) {
+    unsigned char *f;
+    uint32_t mask = esp_random();
+    size_t hdrLen = len < 126 ? 6 : 8;
+
+    if (!req->wsOpen || NULL == req->wsTx || len > 0xFFFF || HTTPC_WS_TX_SIZE - req->wsTxLen < hdrLen + len) {
+        return false;
+    }
+    f = (unsigned char *)req->wsTx + req->wsTxLen;
+    *f++ = HTTPC_WS_FIN | opcode;
+    if (len < 126) {
+        *f++ = HTTPC_WS_MASKED | len;
+    } else {
+        *f++ = HTTPC_WS_MASKED | 126;
+        *f++ = len >> 8;
+        *f++ = len & 0xFF;
+    }
+    memcpy(f, &mask, 4);
+    for (size_t i=0;i<len;i++) {
+        f[4 + i] = data[i] ^ f[i & 3];
+    }
+    req->wsTxLen += hdrLen + len;
+    return true;
+}
+
+// write out queued frames, returns false if the connection failed
+static bool httpc_ws_flush(httpc_req_t *req) {
+    bool ok = true;
+    lock_ws();
+    while (req->wsTxLen > 0) {
+        ssize_t n = esp_tls_conn_write(req->tls, req->wsTx, req->wsTxLen);
+        if (n == ESP_TLS_ERR_SSL_WANT_WRITE || n == ESP_TLS_ERR_SSL_WANT_READ) {
+            break;
+        }
+        if (n <= 0) {
+            ok = false;
+            break;
+        }
+        memmove(req->wsTx, req->wsTx + n, req->wsTxLen - n);
+        req->wsTxLen -= n;
+        req->txCount += n;
+    }
+    unlock_ws();
+    return ok;
+}
+
+static size_t httpc_ws_header_len(httpc_req_t *req) {
+    size_t len = 2;
+    if (req->wsHdrLen >= 2) {
+        unsigned char len7 = req->wsHdr[1] & 0x7F;
+        len += (len7 == 126 ? 2 : (len7 == 127 ? 8 : 0)) + ((req->wsHdr[1] & HTTPC_WS_MASKED) ? 4 : 0);
+    }
+    return len;
+}
+
+// a frame header has been read, returns false if it breaks the protocol
+static bool httpc_ws_frame_start(httpc_req_t *req) {
+    unsigned char len7 = req->wsHdr[1] & 0x7F;
+    uint64_t len = len7;
+    bool control;
+
+    req->wsFin = (req->wsHdr[0] & HTTPC_WS_FIN) != 0;
+    req->wsOpcode = req->wsHdr[0] & 0x0F;
+    control = (req->wsOpcode & 0x8) != 0;
+    if ((req->wsHdr[0] & 0x70) != 0 || (req->wsHdr[1] & HTTPC_WS_MASKED) != 0) {
+        return false;   // no extensions were negotiated, and servers don't mask
+    }
+    if (len7 >= 126) {
+        len = 0;
+        for (int i=0;i<(len7 == 126 ? 2 : 8);i++) {
+            len = (len << 8) | req->wsHdr[2 + i];
+        }
+    }
+    if (control) {
+        if (!req->wsFin || len > sizeof(req->wsCtrl) ||
+            (req->wsOpcode != HTTPC_WS_CLOSE && req->wsOpcode != HTTPC_WS_PING && req->wsOpcode != HTTPC_WS_PONG)) {
+            return false;
+        }
+        req->wsCtrlLen = 0;
+    } else if (req->wsOpcode == HTTPC_WS_CONTINUATION) {
+        if (!req->wsInMessage) {
+            return false;
+        }
+    } else if (req->wsOpcode == HTTPC_WS_TEXT || req->wsOpcode == HTTPC_WS_BINARY) {
+        if (req->wsInMessage) {
+            return false;
+        }
+        req->wsInMessage = true;
+        req->wsDropping = false;
+        req->httpBufLen = 0;
+    } else {
+        return false;
+    }
+    if (len > (size_t)-1 / 2) {
+        return false;
+    }
+    req->bodyRemaining = (size_t)len;
+    req->wsHdrLen = 0;
+    req->bodyState = HTTPC_BODY_WS_PAYLOAD;
+    return true;
+}
+
+static void httpc_ws_payload(httpc_req_t *req, const char *data, size_t len) {
+    if (req->wsOpcode & 0x8) {
+        memcpy(req->wsCtrl + req->wsCtrlLen, data, len);
+        req->wsCtrlLen += len;
+    } else if (!req->wsDropping) {
+        if ((req->httpBufMaxLen - 1) - req->httpBufLen >= len) {
+            memcpy(req->httpBuf + req->httpBufLen, data, len);
+            req->httpBufLen += len;
+            if (req->httpBufLen > req->bufUsed) {
+                req->bufUsed = req->httpBufLen;
+            }
+        } else {
+            req->wsDropping = true;
+        }
+    }
+}
+
+// the frame's payload has all been read
+static void httpc_ws_frame_end(httpc_req_t *req) {
+    req->bodyState = HTTPC_BODY_WS_HEADER;
+    switch(req->wsOpcode) {
+        case HTTPC_WS_PING:
+        case HTTPC_WS_CLOSE:
+            // answer a ping with a pong, and echo a close (its status code only), the server then ends the connection
+            lock_ws();
+            httpc_ws_queue(req, req->wsOpcode == HTTPC_WS_PING ? HTTPC_WS_PONG : HTTPC_WS_CLOSE,
+                req->wsCtrl, req->wsOpcode == HTTPC_WS_PING ? req->wsCtrlLen : (req->wsCtrlLen < 2 ? req->wsCtrlLen : 2));
+            unlock_ws();
+            break;
+        case HTTPC_WS_PONG:
+            break;
+        default:
+            if (!req->wsFin) {
+                break;
+            }
+            req->wsInMessage = false;
+            if (req->wsDropping) {
+                Serial.printf("** websocket message too big for httpBuf (%d)\r\n", (int)req->httpBufMaxLen);
+                req->dataCb(HTTPC_ERR_FAIL, req, req->statusCode, NULL, 0);
+            } else {
+                req->httpBuf[req->httpBufLen] = '\0';
+                req->dataCb(HTTPC_ERR_OK, req, req->statusCode, req->httpBuf, req->httpBufLen);
+            }
+            break;
+    }
+}
+
+typedef enum {
+    HTTPC_PARSE_MORE,
+    HTTPC_PARSE_DONE,
+    HTTPC_PARSE_ERROR
+} httpc_parse_t;
+
+// end of the response, anything left over means the connection is out of step so can't be reused
+static httpc_parse_t httpc_req_parse_done(httpc_req_t *req, size_t n) {
+    if (n > 0) {
+        req->keepAlive = false;
+    }
+    return HTTPC_PARSE_DONE;
+}
+
+// feed received bytes through the response parser
+static httpc_parse_t httpc_req_parse(httpc_req_t *req, char *p, size_t n) {
+    while (n > 0 && req->state == HTTPC_REQ_STATE_RUNNABLE) {
+        if (req->ioState == HTTPC_IO_RECV_HEADERS) {
+            char c = *p++;
+            n--;
+            if (c == '\r') {
+                continue;
+            }
+            if (c != '\n') {
+                if (req->hdrLineLen < sizeof(req->hdrLine) - 1) {
+                    req->hdrLine[req->hdrLineLen++] = c;
+                }
+                continue;
+            }
+            req->hdrLine[req->hdrLineLen] = '\0';
+            if (req->hdrLineLen == 0 && req->gotStatusLine) {    // end of headers
+                req->ioState = HTTPC_IO_RECV_BODY;
+                if (req->statusCode == 204 || req->statusCode == 304) {
+                    return httpc_req_parse_done(req, n);
+                } else if (req->ws && req->statusCode == 101) {
+                    if (!req->wsUpgraded || !req->wsAccepted) {
+                        return HTTPC_PARSE_ERROR;
+                    }
+                    req->bodyState = HTTPC_BODY_WS_HEADER;
+                    req->wsHdrLen = 0;
+                    lock_ws();
+                    req->wsOpen = true;
+                    unlock_ws();
+                    req->keepAlive = false;
+                    req->dataCb(HTTPC_ERR_OPEN, req, req->statusCode, NULL, 0);
+                } else if (req->chunked) {
+                    req->bodyState = HTTPC_BODY_CHUNK_SIZE;
+                    req->bodyRemaining = 0;
+                } else if (req->haveContentLength) {
+                    req->bodyState = HTTPC_BODY_LENGTH;
+                    if (req->bodyRemaining == 0) {
+                        return httpc_req_parse_done(req, n);
+                    }
+                } else {
+                    req->bodyState = HTTPC_BODY_UNTIL_CLOSE;
+                    req->keepAlive = false;
+                }
+            } else if (!httpc_req_header(req, req->hdrLine)) {
+                return HTTPC_PARSE_ERROR;
+            }
+            req->hdrLineLen = 0;
+            continue;
+        }
+
+        switch(req->bodyState) {
+            case HTTPC_BODY_LENGTH:
+            case HTTPC_BODY_CHUNK_DATA: {
+                size_t take = n < req->bodyRemaining ? n : req->bodyRemaining;
+                httpc_req_body(req, p, take);
+                p += take;
+                n -= take;
+                req->bodyRemaining -= take;
+                if (req->bodyRemaining == 0) {
+                    if (req->bodyState == HTTPC_BODY_LENGTH) {
+                        return httpc_req_parse_done(req, n);
+                    }
+                    req->bodyState = HTTPC_BODY_CHUNK_CRLF;
+                }
+                break;
+            }
+            case HTTPC_BODY_UNTIL_CLOSE:
+                httpc_req_body(req, p, n);
+                n = 0;
+                break;
+            case HTTPC_BODY_CHUNK_SIZE:
+            case HTTPC_BODY_CHUNK_EXT: {
+                char c = *p++;
+                n--;
+                if (c == '\n') {
+                    if (req->bodyRemaining == 0) {
+                        req->bodyState = HTTPC_BODY_TRAILER;
+                        req->trailerLineEmpty = true;
+                    } else {
+                        req->bodyState = HTTPC_BODY_CHUNK_DATA;
+                    }
+                } else if (req->bodyState == HTTPC_BODY_CHUNK_SIZE && isxdigit((unsigned char)c)) {
+                    req->bodyRemaining = (req->bodyRemaining << 4) | (isdigit((unsigned char)c) ? c - '0' : (tolower((unsigned char)c) - 'a' + 10));
+                } else if (c != '\r') {
+                    req->bodyState = HTTPC_BODY_CHUNK_EXT;  // skip chunk extensions
+                }
+                break;
+            }
+            case HTTPC_BODY_CHUNK_CRLF: {
+                char c = *p++;
+                n--;
+                if (c == '\n') {
+                    req->bodyState = HTTPC_BODY_CHUNK_SIZE;
+                    req->bodyRemaining = 0;
+                }
+                break;
+            }
+            case HTTPC_BODY_TRAILER: {
+                char c = *p++;
+                n--;
+                if (c == '\n') {
+                    if (req->trailerLineEmpty) {
+                        return httpc_req_parse_done(req, n);
+                    }
+                    req->trailerLineEmpty = true;
+                } else if (c != '\r') {
+                    req->trailerLineEmpty = false;
+                }
+                break;
+            }
+            case HTTPC_BODY_WS_HEADER: {
+                req->wsHdr[req->wsHdrLen++] = *p++;
+                n--;
+                if (req->wsHdrLen == httpc_ws_header_len(req)) {
+                    if (!httpc_ws_frame_start(req)) {
+                        return HTTPC_PARSE_ERROR;
+                    }
+                    if (req->bodyRemaining == 0) {
+                        httpc_ws_frame_end(req);
+                    }
+                }
+                break;
+            }
+            case HTTPC_BODY_WS_PAYLOAD: {
+                size_t take = n < req->bodyRemaining ? n : req->bodyRemaining;
+                httpc_ws_payload(req, p, take);
+                p += take;
+                n -= take;
+                req->bodyRemaining -= take;
+                if (req->bodyRemaining == 0) {
+                    httpc_ws_frame_end(req);
+                }
+                break;
+            }
+        }
+    }
+    return HTTPC_PARSE_MORE;
+}
+
+#ifdef HTTPC_TLS_RESUME
+static httpc_tls_session_t *httpc_tls_session_find(const char *host, int port) {
+    for (int i=0;i<HTTPC_TLS_SESSION_CACHE_SIZE;i++) {
+        if (NULL != tlsSessions[i].session && tlsSessions[i].port == port && 0 == strcmp(tlsSessions[i].host, host)) {
+            return &tlsSessions[i];
+        }
+    }
+    return NULL;
+}
+
+// true if the handshake just done resumed the cached session rather than negotiating a new one
+static bool httpc_tls_session_resumed(esp_tls_t *tls, esp_tls_client_session_t *cached) {
+#if CONFIG_ESP_TLS_USING_MBEDTLS
+    // a server resuming a session (by id or ticket) echoes the session id the client offered
+    mbedtls_ssl_context *ssl = (mbedtls_ssl_context *)esp_tls_get_ssl_context(tls);
+    const mbedtls_ssl_session *session = NULL != ssl ? ssl->MBEDTLS_PRIVATE(session) : NULL;
+    return NULL != session && session->MBEDTLS_PRIVATE(id_len) > 0 &&
+        session->MBEDTLS_PRIVATE(id_len) == cached->saved_session.MBEDTLS_PRIVATE(id_len) &&
+        0 == memcmp(session->MBEDTLS_PRIVATE(id), cached->saved_session.MBEDTLS_PRIVATE(id), session->MBEDTLS_PRIVATE(id_len));
+#else
+    return true;    // host, there's no server side to refuse it
+#endif
+}
+#endif
+
+// settings for connecting to host:port, offering its cached TLS session if any, returns true if one was
+static bool httpc_tls_config(esp_tls_cfg_t *cfg, const char *host, int port) {
+    memset(cfg, 0x00, sizeof(esp_tls_cfg_t));
+    cfg->non_block = true;
+    cfg->timeout_ms = HTTP_TIMEOUT_MS;
+#if CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
+    cfg->crt_bundle_attach = esp_crt_bundle_attach;
+#endif
+#ifdef HTTPC_TLS_RESUME
+    httpc_tls_session_t *ts = httpc_tls_session_find(host, port);
+    cfg->client_session = NULL != ts ? ts->session : NULL;
+    return NULL != ts;
+#else
+    return false;
+#endif
+}
+
+// handshake complete, count it and remember the session for next time
+static void httpc_tls_session_update(const char *host, int port, esp_tls_t *tls, bool offered) {
+#ifdef HTTPC_TLS_RESUME
+    httpc_tls_session_t *ts = httpc_tls_session_find(host, port);
+    esp_tls_client_session_t *session;
+    TickType_t now = xTaskGetTickCount();
+
+    bool resumed = offered && NULL != ts && httpc_tls_session_resumed(tls, ts->session);
+
+    lock_stats();
+    if (resumed) {
+        tlsStats.resumedHandshakes++;
+    } else {
+        tlsStats.fullHandshakes++;
+    }
+    unlock_stats();
+    if (NULL == (session = esp_tls_get_client_session(tls))) {
+        return;
+    }
+    if (NULL == ts) {
+        for (int i=0;i<HTTPC_TLS_SESSION_CACHE_SIZE;i++) {
+            if (NULL == tlsSessions[i].session) {
+                ts = &tlsSessions[i];
+                break;
+            }
+            if (NULL == ts || now - tlsSessions[i].lastUsed > now - ts->lastUsed) {
+                ts = &tlsSessions[i];   // evict the least recently used
+            }
+        }
+        strcpy(ts->host, host);
+        ts->port = port;
+    }
+    if (NULL != ts->session) {
+        esp_tls_free_client_session(ts->session);
+    }
+    ts->session = session;
+    ts->lastUsed = now;
+#else
+    lock_stats();
+    tlsStats.fullHandshakes++;
+    unlock_stats();
+#endif
+}
+
+// the handshake failed, don't offer the same session again in case it was the cause
+static void httpc_tls_session_forget(const char *host, int port, bool offered) {
+#ifdef HTTPC_TLS_RESUME
+    httpc_tls_session_t *ts;
+    if (offered && NULL != (ts = httpc_tls_session_find(host, port))) {
+        esp_tls_free_client_session(ts->session);
+        ts->session = NULL;
+    }
+#endif
+}
+
+void httpc_get_tls_stats(httpc_tls_stats_t *stats) {
+    lock_stats();
+    *stats = tlsStats;
+    unlock_stats();
+}
+
+// a pooled connection the server closed while it sat idle, try again on another
+static bool httpc_req_stale(httpc_req_t *req) {
+    if (!req->reused || req->gotStatusLine || req->hdrLineLen > 0) {
+        return false;
+    }
+#ifdef HTTPC_DEBUG
+    Serial.printf("req %p pooled connection was stale, reconnecting\r\n", req);
+#endif
+    httpc_req_start(req);
+    return true;
+}
+
+#if HTTPC_POOL_SIZE > 0
+// carry on making a pooled connection, true once it's made and idle
+static bool httpc_pool_connect(httpc_pool_conn_t *pc, TickType_t now) {
+    esp_tls_cfg_t cfg;
+    int rc;
+
+    pc->sessionOffered = httpc_tls_config(&cfg, pc->host, pc->port);
+    rc = esp_tls_conn_new_async(pc->host, strlen(pc->host), pc->port, &cfg, pc->tls);
+    if (rc < 0 || (rc == 0 && HTTPC_CONNECT_TIMEOUT_MS > 0 && now - pc->idleSince >= pdMS_TO_TICKS(HTTPC_CONNECT_TIMEOUT_MS))) {
+        httpc_tls_session_forget(pc->host, pc->port, pc->sessionOffered);
+        httpc_pool_discard(pc);
+        return false;
+    }
+    if (rc == 0) {
+        return false;
+    }
+#ifdef HTTPC_DEBUG
+    Serial.printf("httpc_pool_connect %s:%d connected\r\n", pc->host, pc->port);
+#endif
+    httpc_tls_session_update(pc->host, pc->port, pc->tls, pc->sessionOffered);
+    pc->connecting = false;
+    pc->idleSince = now;
+    return true;
+}
+#endif
+
+// Close expired pooled connections and watch the rest, an idle connection becoming readable means the server
+// closed it. Those still being made are polled, as a request's would be.
+static void httpc_pool_watch(fd_set *readfds, int *maxfd, TickType_t now, TickType_t *waitTicks, bool *polling) {
+#if HTTPC_POOL_SIZE > 0
+    for (int i=0;i<HTTPC_POOL_SIZE;i++) {
+        TickType_t idle, timeout = pdMS_TO_TICKS(HTTPC_POOL_IDLE_MS);
+        int fd;
+        if (NULL == pool[i].tls) {
+            continue;
+        }
+        if (pool[i].connecting && !httpc_pool_connect(&pool[i], now)) {
+            if (NULL != pool[i].tls && ESP_OK == esp_tls_get_conn_sockfd(pool[i].tls, &fd) && fd >= 0) {
+                FD_SET(fd, readfds);
+                if (fd > *maxfd) {
+                    *maxfd = fd;
+                }
+            }
+            *polling |= NULL != pool[i].tls;
+            continue;
+        }
+        idle = now - pool[i].idleSince;
+        if (idle >= timeout || ESP_OK != esp_tls_get_conn_sockfd(pool[i].tls, &fd) || fd < 0) {
+            httpc_pool_discard(&pool[i]);
+            continue;
+        }
+        if (timeout - idle < *waitTicks) {
+            *waitTicks = timeout - idle;
+        }
+        FD_SET(fd, readfds);
+        if (fd > *maxfd) {
+            *maxfd = fd;
+        }
+    }
+#endif
+}
+
+static void httpc_pool_check(fd_set *readfds) {
+#if HTTPC_POOL_SIZE > 0
+    for (int i=0;i<HTTPC_POOL_SIZE;i++) {
+        char c;
+        int fd;
+        if (NULL == pool[i].tls || pool[i].connecting || ESP_OK != esp_tls_get_conn_sockfd(pool[i].tls, &fd) || fd < 0 || !FD_ISSET(fd, readfds)) {
+            continue;
+        }
+        // a partial TLS record wants more, anything else (close, alert, unsolicited data) ends the connection
+        if (ESP_TLS_ERR_SSL_WANT_READ != esp_tls_conn_read(pool[i].tls, &c, 1)) {
+            httpc_pool_discard(&pool[i]);
+        }
+    }
+#endif
+}
+
+// time the phases of a connect by the states ESP-TLS passes through
+static void httpc_stats_connecting(httpc_req_t *req) {
+    esp_tls_conn_state_t state;
+
+    if (ESP_OK != esp_tls_get_conn_state(req->tls, &state)) {
+        return;
+    }
+    if (req->tlsState == ESP_TLS_INIT && state != ESP_TLS_INIT) {
+        httpc_stats_phase(req, HTTPC_PHASE_DNS);
+    }
+    if ((req->tlsState == ESP_TLS_INIT || req->tlsState == ESP_TLS_CONNECTING) && (state == ESP_TLS_HANDSHAKE || state == ESP_TLS_DONE)) {
+        httpc_stats_phase(req, HTTPC_PHASE_CONNECT);
+    }
+    if (req->tlsState == ESP_TLS_HANDSHAKE && state == ESP_TLS_DONE) {
+        httpc_stats_phase(req, HTTPC_PHASE_TLS);
+    }
+    req->tlsState = state;
+}
+
+// drive a RUNNABLE request as far as it will go without blocking, or until it has had its share of reads,
+// returns true in that case as there may be more waiting (possibly already decrypted, so not visible to select)
+static bool httpc_req_step(httpc_req_t *req) {
+    int reads = 0;
+    while (req->state == HTTPC_REQ_STATE_RUNNABLE) {
+        switch(req->ioState) {
+            case HTTPC_IO_CONNECTING: {
+                esp_tls_cfg_t cfg;
+                bool connecting;
+                int rc;
+                if (req->tlsState < 0) {
+                    req->startUs = req->phaseUs = micros();
+                    req->tlsState = ESP_TLS_INIT;
+                    lock_stats();
+                    memset(req->stats.phaseUs, 0x00, sizeof(req->stats.phaseUs));
+                    unlock_stats();
+                }
+                if (NULL == req->tls && NULL != (req->tls = httpc_pool_take(req, &connecting)) && !connecting) {
+#ifdef HTTPC_DEBUG
+                    Serial.printf("req %p reusing connection\r\n", req);
+#endif
+                    req->reused = true;
+                    req->ioState = HTTPC_IO_SENDING;
+                    req->lastActivity = xTaskGetTickCount();
+                    break;
+                }
+                // a connection the pool was still making is carried on with
+                if (NULL == req->tls && NULL == (req->tls = esp_tls_init())) {
+                    httpc_req_fail(req, "out of mem tls");
+                    return false;
+                }
+                req->sessionOffered = httpc_tls_config(&cfg, req->host, req->port);
+                rc = esp_tls_conn_new_async(req->host, strlen(req->host), req->port, &cfg, req->tls);
+                if (rc < 0) {
+                    httpc_tls_session_forget(req->host, req->port, req->sessionOffered);
+                    httpc_req_fail(req, "connect");
+                    return false;
+                }
+                httpc_stats_connecting(req);
+                if (rc == 0) {
+                    return false;     // in progress
+                }
+#ifdef HTTPC_DEBUG
+                Serial.printf("req %p connected\r\n", req);
+#endif
+                httpc_tls_session_update(req->host, req->port, req->tls, req->sessionOffered);
+                req->ioState = HTTPC_IO_SENDING;
+                req->lastActivity = xTaskGetTickCount();
+                break;
+            }
+            case HTTPC_IO_SENDING: {
+                ssize_t n = esp_tls_conn_write(req->tls, req->txBuf + req->txOff, req->txLen - req->txOff);
+                if (n == ESP_TLS_ERR_SSL_WANT_WRITE || n == ESP_TLS_ERR_SSL_WANT_READ) {
+                    return false;
+                }
+                if (n <= 0) {
+                    if (!httpc_req_stale(req)) {
+                        httpc_req_fail(req, "write");
+                        return false;
+                    }
+                    break;
+                }
+                req->txOff += n;
+                req->txCount += n;
+                req->lastActivity = xTaskGetTickCount();
+                if (req->txOff == req->txLen) {
+                    req->ioState = HTTPC_IO_RECV_HEADERS;
+                    req->phaseUs = micros();
+                }
+                break;
+            }
+            case HTTPC_IO_RECV_HEADERS:
+            case HTTPC_IO_RECV_BODY: {
+                if (req->ws && !httpc_ws_flush(req)) {
+                    httpc_req_fail(req, "websocket write");
+                    return false;
+                }
+                if (reads++ == HTTPC_STEP_READS) {
+                    return true;
+                }
+                // a linebuffered request reads straight into its linebuffer, so body bytes are framed where they land
+                // (no more than rxBuf holds at a time, keeping HTTPC_STEP_READS a fair share)
+                char *rx = rxBuf;
+                size_t rxLen = sizeof(rxBuf);
+                if (req->lb != NULL) {
+                    size_t space;
+                    rx = linebuffer_get_space(req->lb, &space);
+                    rxLen = space < rxLen ? space : rxLen;
+                }
+                ssize_t n = esp_tls_conn_read(req->tls, rx, rxLen);
+                if (n == ESP_TLS_ERR_SSL_WANT_READ || n == ESP_TLS_ERR_SSL_WANT_WRITE) {
+                    return false;
+                }
+                if (n <= 0) {
+                    // connection ended, which completes a body read until close and ends a stream
+                    if (req->ioState == HTTPC_IO_RECV_BODY) {
+                        httpc_transport_close(req);
+                        httpc_req_finish(req);
+                    } else if (httpc_req_stale(req)) {
+                        break;
+                    } else {
+                        httpc_req_fail(req, "closed before response");
+                    }
+                    return false;
+                }
+                req->lastActivity = xTaskGetTickCount();
+                req->wsPingSent = false;
+                req->rxCount += n;
+                if (req->ioState == HTTPC_IO_RECV_HEADERS && !req->gotStatusLine && req->hdrLineLen == 0) {
+                    httpc_stats_phase(req, HTTPC_PHASE_FIRST_BYTE);
+                }
+                if (req->lb != NULL && req->lb->tail - req->lb->mark + n > req->bufUsed) {
+                    req->bufUsed = req->lb->tail - req->lb->mark + n;
+                }
+                switch(httpc_req_parse(req, rx, n)) {
+                    case HTTPC_PARSE_MORE:
+                        break;
+                    case HTTPC_PARSE_DONE:
+                        httpc_transport_release(req);
+                        httpc_req_finish(req);
+                        return false;
+                    case HTTPC_PARSE_ERROR:
+                        httpc_req_fail(req, "bad response");
+                        return false;
+                }
+                break;
+            }
+        }
     }
+    return false;
 }
 
-static void unlock_ll(void) {
-    xSemaphoreGive(userSemaphore);
-}
-
-void httpc_loop_internal(void);
-httpc_err_t httpc_init_internal(void);
+// take on the requests made since the last pass, oldest first
+static void httpc_admit(void) {
+    httpc_req_t *req = __atomic_exchange_n(&submitted, (httpc_req_t *)NULL, __ATOMIC_ACQUIRE);
+    httpc_req_t *oldest = NULL, *next;
 
-static void httpc_task_function(void * pvParameter) {
-    esp_task_wdt_init(60, false);
-    httpc_init_internal();
-    while(1) {
-        esp_task_wdt_reset();
-        httpc_loop_internal();
-        vTaskDelay(50);
-//        Serial.printf("*");
+    while (NULL != req) {
+        next = req->submitNext;
+        req->submitNext = oldest;
+        oldest = req;
+        req = next;
+    }
+    for (req = oldest;req != NULL;req = next) {
+        next = req->submitNext;
+#if HTTPC_RATELIMIT_HOSTS > 0
+        if (req->paced && req->state == HTTPC_REQ_STATE_RUNNABLE) {
+            TickType_t now = xTaskGetTickCount();
+            lock_stats();
+            req->retryAt = httpc_ratelimit_slot(req, now);
+            if (!httpc_ticks_due(req->retryAt, now)) {
+                req->state = HTTPC_REQ_STATE_BACKOFF;
+                req->retryWaiting = true;
+            }
+            unlock_stats();
+        }
+#endif
+        httpc_ll_push(req);
+        httpc_timer_update(req);
     }
 }
 
-httpc_err_t httpc_init(void) {
-    if (pdPASS != xTaskCreate(httpc_task_function, "httpc", HTTPC_TASK_STACK_SIZE, NULL, HTTPC_TASK_PRIORITY, &httpc_task_handle)) {
-        return HTTPC_ERR_FAIL;
-    } else {
-        return HTTPC_ERR_OK;
+// carry out httpc_close(), httpc_resume() and httpc_set_deadlines() made on other tasks
+static void httpc_commands(void) {
+    uint32_t next = __atomic_exchange_n(&commands, 0, __ATOMIC_ACQUIRE);
+
+    while (0 != next) {
+        httpc_handle_slot_t *hs = &handles[next - 1];
+        httpc_req_t *req;
+        uint32_t word;
+        next = __atomic_load_n(&hs->nextCmd, __ATOMIC_RELAXED);    // before it can be queued again
+        word = __atomic_fetch_and(&hs->word, ~(uint32_t)(HTTPC_H_QUEUED | HTTPC_H_RESUME | HTTPC_H_DEADLINES), __ATOMIC_ACQ_REL);
+        if (NULL == (req = __atomic_load_n(&hs->req, __ATOMIC_ACQUIRE))) {
+            continue;   // disposed of since
+        }
+        if (0 != (word & HTTPC_H_CLOSE)) {
+            httpc_req_close(req);
+            continue;
+        }
+        if (0 != (word & HTTPC_H_DEADLINES)) {
+            lock_stats();
+            req->deadlines = req->deadlinesNext;
+            unlock_stats();
+            httpc_timer_update(req);
+        }
+        if (0 != (word & HTTPC_H_RESUME)) {
+            httpc_req_resume(req);
+        }
     }
 }
 
-void httpc_loop(void) {
-    // FIXME
+static bool httpc_link_up(void) {
+    return __atomic_load_n(&linkUp, __ATOMIC_SEQ_CST);
 }
 
-
-static void httpc_ll_push(httpc_req_t *req) {
+// the WiFi has gone, nothing more will arrive on connections made over it
+static void httpc_link_lost(void) {
 #ifdef HTTPC_DEBUG
-    Serial.printf("httpc_ll_push %p\r\n", req);
+    Serial.printf("httpc WiFi lost\r\n");
 #endif
-    // add to front of list
-    if (NULL == reqs_ll_head) {
-        reqs_ll_head = req;
-        req->prev = NULL;
-        req->next = NULL;
-    } else {
-        reqs_ll_head->prev = req;
-        req->prev = NULL;
-        req->next = reqs_ll_head;
-        reqs_ll_head = req;
+    lock_stats();
+    httpcStats.linkLosses++;
+    unlock_stats();
+    for (httpc_req_t *req = reqs_ll_head;req != NULL;req = req->next) {
+        if (req->state == HTTPC_REQ_STATE_RUNNABLE) {
+            httpc_req_fail(req, "WiFi lost");   // a stream backs off, and waits for the WiFi after that
+        }
+    }
+#if HTTPC_POOL_SIZE > 0
+    for (int i=0;i<HTTPC_POOL_SIZE;i++) {
+        if (NULL != pool[i].tls) {
+            httpc_pool_discard(&pool[i]);
+            pool[i].lost = true;
+        }
     }
+#endif
 }
 
-static void httpc_ll_remove(httpc_req_t *req) {
+// the WiFi is back with an IP address. Streams that lost their connection reconnect now rather than at the end of
+// their backoff, those told to wait by the server (429, 5xx) still wait, and the pool's connections are made again.
+static void httpc_link_found(void) {
+    TickType_t now = xTaskGetTickCount();
+
 #ifdef HTTPC_DEBUG
-    Serial.printf("httpc_ll_remove %p\r\n", req);
+    Serial.printf("httpc WiFi back\r\n");
 #endif
-    if (NULL == req->prev) {    // first item in list
-        reqs_ll_head = req->next;
-    } else if (NULL == req->next) {    // last item in list
-        req->prev->next = NULL;
-    } else {    // mid-list
-        req->prev->next = req->next;
-        req->next->prev = req->prev;
+    for (httpc_req_t *req = reqs_ll_head;req != NULL;req = req->next) {
+        if (req->state == HTTPC_REQ_STATE_BACKOFF && req->autoResume && !httpc_status_retryable(req->lastStatus)) {
+            lock_stats();
+            req->state = HTTPC_REQ_STATE_RUNNABLE;
+            req->retryWaiting = false;
+            req->retries = 0;   // the failures were the WiFi's
+            unlock_stats();
+            req->lastActivity = now;    // the connect timeout runs from now
+            httpc_timer_update(req);
+        }
+    }
+#if HTTPC_POOL_SIZE > 0
+    for (int i=0;i<HTTPC_POOL_SIZE;i++) {
+        if (!pool[i].lost || NULL != pool[i].tls) {
+            continue;
+        }
+        pool[i].lost = false;
+        if (NULL == (pool[i].tls = esp_tls_init())) {
+            continue;
+        }
+        pool[i].connecting = true;
+        pool[i].idleSince = now;
+        lock_stats();
+        httpcStats.preconnects++;
+        unlock_stats();
+        httpc_pool_connect(&pool[i], now);
     }
+#endif
 }
 
-httpc_err_t httpc_init_internal(void) {
-    if (inited) {
-        return HTTPC_ERR_OK;
+// catch up with the WiFi going and coming back since the last pass
+static void httpc_link(void) {
+    uint32_t downs = __atomic_load_n(&linkDowns, __ATOMIC_SEQ_CST);
+    uint32_t ups = __atomic_load_n(&linkUps, __ATOMIC_SEQ_CST);
+
+    if (downs == linkDownsSeen && ups == linkUpsSeen) {
+        return;
+    }
+    if (downs != linkDownsSeen) {
+        httpc_link_lost();
+    }
+    linkDownsSeen = downs;
+    linkUpsSeen = ups;
+    // it may have come back between the counts being read, the next pass sees that again
+    if (httpc_link_up()) {
+        httpc_link_found();
     }
-    inited = true;
-    reqs_ll_head = NULL;
-    userSemaphore = xSemaphoreCreateMutex();
-    return HTTPC_ERR_OK;
 }
 
-static void httpc_dispose(httpc_req_t *req) {
-#ifdef HTTPC_DEBUG
-    Serial.printf("httpc_dispose %p\r\n", req);
-#endif
-    if (NULL != req) {
-        if (NULL != req->httpBuf) {
-            free(req->httpBuf);
-        }
-        if (NULL != req->lb) {
-            linebuffer_term(req->lb);
-            free(req->lb);
-        }
-        if (NULL != req->postBuf) {
-            free(req->postBuf);
+// req's timer has fired, do what's due and set it for what's next
+static void httpc_req_deadline(httpc_req_t *req, TickType_t now) {
+    const char *why;
+    TickType_t at;
+    httpc_due_t due = httpc_req_due(req, &at, &why);
+
+    if (due == HTTPC_DUE_PING && httpc_ticks_due(at, now)) {
+        lock_ws();
+        httpc_ws_queue(req, HTTPC_WS_PING, NULL, 0);
+        unlock_ws();
+        req->wsPingSent = true;     // if there was no room, whatever's queued is waiting to go anyway
+    } else if (due == HTTPC_DUE_FAIL && httpc_ticks_due(at, now)) {
+        lock_stats();
+        httpcStats.timeouts++;
+        if (0 == strcmp(why, "stalled")) {
+            httpcStats.stalls++;
         }
-        if (NULL != req->userdata) {
-            free(req->userdata);
+        if (req->state == HTTPC_REQ_STATE_BACKOFF) {
+            req->state = HTTPC_REQ_STATE_RUNNABLE;  // waiting on a rate limit, it's failed now rather than later
+            req->retryWaiting = false;
         }
-        free(req);
+        unlock_stats();
+        httpc_req_fail(req, why);
+    }
+    if (HTTPC_DUE_NONE != httpc_req_due(req, &at, &why)) {
+        httpc_timer_set(req, at);
     }
 }
 
-httpc_err_t httpc_close(httpc_req_t *req) {
-#ifdef HTTPC_DEBUG
-    Serial.printf("httpc_close (setting HTTPC_REQ_STATE_CLOSEABLE) %p\r\n", req);
-#endif
-//    lock_ll();
+// Fire what's due in a slot. Its list is taken off the wheel first, with its head on the stack, so a deadline that
+// ends or re-times another request, this one's callbacks included, unlinks it from there instead. What isn't due yet
+// goes back on the wheel.
+static void httpc_timers_fire(unsigned slot, TickType_t now) {
+    httpc_req_t *pending = wheel[slot], *req;
 
-    if (NULL != req) {
-        if (NULL != reqs_ll_head) {
-            httpc_req_t *rp = reqs_ll_head;
-            while(rp != NULL) {
-                // only update if req appears in ll, so it's safe to call httpc_close() after connection has been destroyed
-                if (rp == req) {
-                    if (req->state == HTTPC_REQ_STATE_RUNNABLE) {
-                        req->state = HTTPC_REQ_STATE_CLOSEABLE;
-                    }
-                    break;
-                } else {
-                    rp = rp->next;
-                }
-            }
+    if (NULL == pending) {
+        return;
+    }
+    wheel[slot] = NULL;
+    pending->timerPrev = &pending;
+    while (NULL != (req = pending)) {
+        httpc_timer_cancel(req);
+        if (httpc_ticks_due(req->timerAt, now)) {
+            httpc_req_deadline(req, now);
+        } else {
+            httpc_timer_set(req, req->timerAt);
         }
     }
-//    unlock_ll();
-    return HTTPC_ERR_OK;
 }
 
-static esp_err_t http_event_handler(esp_http_client_event_t *evt) {
-    httpc_req_t *req = (httpc_req_t *)evt->user_data;
-
-    esp_task_wdt_reset();
+// Turn the wheel up to now, firing the timers that are due. It's moved on before anything fires so timers set
+// meanwhile land where they should. wheelDue is then the soonest of what's in the current slot and the start of the
+// next slot with anything in, which may be early (the timers there are a turn or more away, or cancelled) but never
+// late, and costs a look at each slot rather than each timer.
+static void httpc_timers_run(TickType_t now) {
+    TickType_t steps;
+    unsigned first, count;
 
-    switch(evt->event_id) {
-        default:
-        break;
-        case HTTP_EVENT_ERROR:
-            Serial.printf("HTTP_EVENT_ERROR req=%p\r\n", req);
-            req->state = HTTPC_REQ_STATE_CLOSEABLE;
-            break;
-        case HTTP_EVENT_ON_CONNECTED:
-#ifdef HTTPC_DEBUG
-            Serial.printf("HTTP_EVENT_ON_CONNECTED\r\n");
-#endif
-            break;
-        case HTTP_EVENT_HEADER_SENT:
-#ifdef HTTPC_DEBUG
-            Serial.printf("HTTP_EVENT_HEADER_SENT\r\n");
-#endif
-            break;
-        case HTTP_EVENT_ON_HEADER:
-#ifdef HTTPC_DEBUG
-            Serial.printf("HTTP_EVENT_ON_HEADER, key=%s, value=%s\r\n", evt->header_key, evt->header_value);
-#endif
-            break;
-        case HTTP_EVENT_ON_DATA:
-#ifdef HTTPC_DEBUG
-            Serial.printf("HTTP_EVENT_ON_DATA, len=%d\r\n", evt->data_len);
-#endif
-            if (req->state != HTTPC_REQ_STATE_RUNNABLE) {
-                esp_http_client_close(req->client);
-                break;
-            }
+    if (0 == wheelTimers || !httpc_ticks_due(wheelDue, now)) {
+        return;
+    }
+    steps = (TickType_t)(now - wheelAt) / HTTPC_WHEEL_TICKS;
+    first = wheelSlot;
+    count = steps >= HTTPC_WHEEL_SLOTS ? HTTPC_WHEEL_SLOTS : steps + 1;   // gone all the way round, anything may be due
+    wheelAt += steps * HTTPC_WHEEL_TICKS;
+    wheelSlot = (wheelSlot + steps) % HTTPC_WHEEL_SLOTS;
+    for (unsigned i=0;i<count;i++) {
+        httpc_timers_fire((first + i) % HTTPC_WHEEL_SLOTS, now);
+    }
 
-            if (req->httpBufMaxLen == 0) {
-                // pass buffer straight to cb
-                req->dataCb(HTTPC_ERR_OK, req, esp_http_client_get_status_code(req->client), (const char *)evt->data, evt->data_len);
-            } else {
-                if (req->lb != NULL) {  // linebuffered
-                    if (0 != linebuffer_write(req->lb, (const char *)evt->data, evt->data_len)) {
-                        req->dataCb(HTTPC_ERR_FAIL, req, esp_http_client_get_status_code(req->client), NULL, 0);
-                    }
-                } else { // accumulate for big final send
-                    if ((req->httpBufMaxLen-1) - req->httpBufLen >= evt->data_len) {
-                        memcpy(req->httpBuf + req->httpBufLen, evt->data, evt->data_len);
-                        req->httpBufLen += evt->data_len;
-                    } else {
-                        Serial.printf("** httpBuf too small (%d)\r\n", req->httpBufMaxLen);
-                        req->dataCb(HTTPC_ERR_FAIL, req, esp_http_client_get_status_code(req->client), NULL, 0);
-                    }
-                }
-            }
-            break;
-        case HTTP_EVENT_ON_FINISH:
-#ifdef HTTPC_DEBUG
-            Serial.printf("** HTTP_EVENT_ON_FINISH\r\n");
-#endif
-            if (req->httpBufMaxLen == 0 || req->lb != NULL) {
-                req->dataCb(HTTPC_ERR_OK, req, esp_http_client_get_status_code(req->client), NULL, 0);
-            } else {
-                // null terminate buffer
-                req->httpBuf[req->httpBufLen] = '\0';
-                req->dataCb(HTTPC_ERR_OK, req, esp_http_client_get_status_code(req->client), req->httpBuf, req->httpBufLen);
-            }
-            if (req->state == HTTPC_REQ_STATE_RUNNABLE) {    // once by user closed, don't reopen
-                // if notAutoresuming or didn't get "200 OK"
-                if (!req->autoResume || esp_http_client_get_status_code(req->client) != 200) {  // don't keep retrying if we get a 401!
-                    req->state = HTTPC_REQ_STATE_CLOSEABLE;
-                }
-            }
+    wheelDue = wheelAt + HTTPC_WHEEL_TICKS * HTTPC_WHEEL_SLOTS;
+    for (unsigned i=1;i<HTTPC_WHEEL_SLOTS;i++) {
+        if (NULL != wheel[(wheelSlot + i) % HTTPC_WHEEL_SLOTS]) {
+            wheelDue = wheelAt + i * HTTPC_WHEEL_TICKS;
             break;
-        case HTTP_EVENT_DISCONNECTED:
-#ifdef HTTPC_DEBUG
-            Serial.printf("HTTP_EVENT_DISCONNECTED\r\n");
-#endif
-            req->state = HTTPC_REQ_STATE_KILLABLE;
+        }
+    }
+    for (httpc_req_t *req = wheel[wheelSlot];req != NULL;req = req->timerNext) {
+        if (!httpc_ticks_due(wheelDue, req->timerAt)) {
+            wheelDue = req->timerAt;
+        }
+    }
+}
 
-            int mbedtls_err = 0;
-            esp_err_t err = esp_tls_get_and_clear_last_error((esp_tls_error_handle_t)evt->data, &mbedtls_err, NULL);
-            if (err != 0) {
-                Serial.printf("Last esp error code: 0x%x\r\n", err);
-                Serial.printf("Last mbedtls failure: 0x%x\r\n", mbedtls_err);
-            }
-            break;
+// shorten *waitTicks to the next timer
+static void httpc_timers_watch(TickType_t now, TickType_t *waitTicks) {
+    if (0 == wheelTimers) {
+        return;
+    }
+    if (httpc_ticks_due(wheelDue, now)) {
+        *waitTicks = 0;
+    } else if (wheelDue - now < *waitTicks) {
+        *waitTicks = wheelDue - now;
     }
-    return ESP_OK;
 }
 
 void httpc_loop_internal(void) {
-    uint32_t err;
     httpc_req_t *req;
+    fd_set readfds, writefds;
+    struct timeval tv;
+    TickType_t now, waitTicks;
+    bool polling = false;
+    bool busy = false;
+    int maxfd;
 
     if (!inited) {
         Serial.println("Err httpc_loop called before httpc_init!\r\n");
     }
 
-    lock_ll();
+    httpc_admit();
+    httpc_commands();
+    httpc_link();
+    httpc_timers_run(xTaskGetTickCount());
 
 #ifdef HTTPC_DEBUG_VERBOSE
     // dump ll
@@ -264,23 +2212,22 @@ void httpc_loop_internal(void) {
     }
 #endif
 
-    // make a pass to close and cleanup 
+    // make a pass to close and cleanup
     req = reqs_ll_head;
     while(req != NULL) {
         switch(req->state) {
             case HTTPC_REQ_STATE_RUNNABLE:
+            case HTTPC_REQ_STATE_HELD:
+            case HTTPC_REQ_STATE_BACKOFF:
             break;
             case HTTPC_REQ_STATE_CLOSEABLE:
 #ifdef HTTPC_DEBUG
-                Serial.printf("req %p HTTPC_REQ_STATE_CLOSEABLE -> esp_http_client_close\r\n", req);
+                Serial.printf("req %p HTTPC_REQ_STATE_CLOSEABLE -> close transport\r\n", req);
 #endif
-                esp_http_client_close(req->client);
-            break;
-            case HTTPC_REQ_STATE_KILLABLE:
-#ifdef HTTPC_DEBUG
-                Serial.printf("req %p HTTPC_REQ_STATE_KILLABLE -> esp_http_client_cleanup\r\n", req);
+                httpc_transport_close(req);
+#if HTTPC_RATELIMIT_HOSTS > 0
+                httpc_ratelimit_release(req);
 #endif
-                esp_http_client_cleanup(req->client);
                 req->state = HTTPC_REQ_STATE_DEAD;
             break;
             case HTTPC_REQ_STATE_DEAD:
@@ -289,58 +2236,141 @@ void httpc_loop_internal(void) {
         req = req->next;
     }
 
-    // make a pass to remove first dead/stale connection
+    // make a pass to remove dead connections, those still pinned wait for httpc_unpin() to wake it
+    __atomic_store_n(&pinnedDead, false, __ATOMIC_SEQ_CST);
     req = reqs_ll_head;
     while(req != NULL) {
+        httpc_req_t *next = req->next;
         if (req->state == HTTPC_REQ_STATE_DEAD) {
+            __atomic_store_n(&pinnedDead, true, __ATOMIC_SEQ_CST);
+            if (httpc_handle_free(req)) {
 #ifdef HTTPC_DEBUG
-            Serial.printf("req %p HTTPC_REQ_STATE_DEAD -> ll_remove/dispose\r\n", req);
+                Serial.printf("req %p HTTPC_REQ_STATE_DEAD -> ll_remove/dispose\r\n", req);
 #endif
-            httpc_ll_remove(req);
-            httpc_dispose(req);
-            break;
-        } else {
-            req = req->next;
+                httpc_timer_cancel(req);
+                httpc_ll_remove(req);
+                httpc_dispose(req);
+            }
         }
+        req = next;
     }
 
-    // make a pass to process all running connections
+    // make a pass to progress all running connections. Requests made from callbacks wait for the next pass,
+    // and only the close pass removes, so walking on is safe.
     req = reqs_ll_head;
     while(req != NULL) {
-        switch(req->state) {
-            case HTTPC_REQ_STATE_RUNNABLE:
-                esp_err_t err;
-                unlock_ll();    // esp_http_client_perform() may block for a long time, preventing new connections being added
-                err = esp_http_client_perform(req->client);
-                lock_ll();
-                if (err != ESP_ERR_HTTP_EAGAIN) {
-#ifdef HTTPC_DEBUG
-                    Serial.printf("*** esp_http_client_perform err %d\r\n", (int)err);
-#endif
-                }
-            break;
-            case HTTPC_REQ_STATE_CLOSEABLE:
-            case HTTPC_REQ_STATE_KILLABLE:
-            case HTTPC_REQ_STATE_DEAD:
-            break;
+        if (req->state == HTTPC_REQ_STATE_RUNNABLE) {
+            busy |= httpc_req_step(req);
+            lock_stats();
+            httpc_stats_fold(req);
+            unlock_stats();
+            httpc_timer_update(req);
+        }
+        req = req->next;
+    }
+
+    // wait for any connection to become ready, a timeout, or a wake from another task
+    FD_ZERO(&readfds);
+    FD_ZERO(&writefds);
+    FD_SET(wakeFd, &readfds);
+    maxfd = wakeFd;
+    waitTicks = busy ? 0 : portMAX_DELAY;   // go round again straight away if a request was cut short
+    now = xTaskGetTickCount();
+    req = reqs_ll_head;
+    while(req != NULL) {
+        int fd;
+        if (req->state == HTTPC_REQ_STATE_HELD) {
+            // nothing to wait for until httpc_resume()
+        } else if (req->state == HTTPC_REQ_STATE_BACKOFF) {
+            if (req->autoResume && !httpc_link_up()) {
+                // nothing to wait for until the WiFi is back
+            } else if (httpc_ticks_due(req->retryAt, now)) {
+                lock_stats();
+                req->state = HTTPC_REQ_STATE_RUNNABLE;
+                req->retryWaiting = false;
+                unlock_stats();
+                req->lastActivity = now;    // the connect timeout runs from now
+                httpc_timer_update(req);
+                waitTicks = 0;
+            } else if (req->retryAt - now < waitTicks) {
+                waitTicks = req->retryAt - now;
+            }
+        } else if (req->state != HTTPC_REQ_STATE_RUNNABLE) {
+            waitTicks = 0;  // closed from a callback, clean up straight away
+        } else if (req->tls == NULL || ESP_OK != esp_tls_get_conn_sockfd(req->tls, &fd) || fd < 0) {
+            polling = true;
+        } else {
+            switch(req->ioState) {
+                case HTTPC_IO_CONNECTING:
+                    polling = true;
+                    FD_SET(fd, &readfds);
+                    break;
+                case HTTPC_IO_SENDING:
+                    FD_SET(fd, &writefds);
+                    break;
+                case HTTPC_IO_RECV_HEADERS:
+                case HTTPC_IO_RECV_BODY:
+                    FD_SET(fd, &readfds);
+                    if (req->ws) {
+                        lock_ws();
+                        if (req->wsTxLen > 0) {
+                            FD_SET(fd, &writefds);
+                        }
+                        unlock_ws();
+                    }
+                    break;
+            }
+            if (fd > maxfd) {
+                maxfd = fd;
+            }
         }
         req = req->next;
     }
-    unlock_ll();
+    httpc_pool_watch(&readfds, &maxfd, now, &waitTicks, &polling);
+    httpc_timers_watch(now, &waitTicks);
+
+    if (polling && waitTicks > pdMS_TO_TICKS(HTTPC_CONNECT_POLL_MS)) {
+        waitTicks = pdMS_TO_TICKS(HTTPC_CONNECT_POLL_MS);
+    }
+    if (waitTicks != portMAX_DELAY) {
+        tv.tv_sec = (waitTicks * portTICK_PERIOD_MS) / 1000;
+        tv.tv_usec = ((waitTicks * portTICK_PERIOD_MS) % 1000) * 1000;
+    }
+    if (select(maxfd + 1, &readfds, &writefds, NULL, waitTicks == portMAX_DELAY ? NULL : &tv) > 0) {
+        if (FD_ISSET(wakeFd, &readfds)) {
+            uint64_t count;
+            if (read(wakeFd, &count, sizeof(count)) != sizeof(count)) {
+                Serial.printf("httpc wake read failed\r\n");
+            }
+        }
+        httpc_pool_check(&readfds);
+    }
 }
 
-static int lineCb(linebuffer_t *lb, const char *line, void *userdata) {
+static int lineCb(linebuffer_t *lb, const char *line, size_t len, void *userdata) {
     httpc_req_t *req = (httpc_req_t *)userdata;
+    if (NULL == line) {     // lines lost, kept ones included
+        req->dataCb(HTTPC_ERR_FAIL, req, req->statusCode, NULL, 0);
+        return 0;
+    }
 #ifdef HTTPC_DEBUG
     Serial.printf("line='%s'\r\n", line);
 #endif
-    req->dataCb(HTTPC_ERR_OK, req, esp_http_client_get_status_code(req->client), line, strlen(line));
+    if (HTTPC_ERR_KEEP == req->dataCb(HTTPC_ERR_OK, req, req->statusCode, line, len)) {
+        return LINEBUFFER_KEEP;
+    }
     return 0;
 }
 
-static httpc_req_t *httpc_request(const char *host, const char *path, const char *auth, size_t maxLen, bool linebuffered, httpc_data_cb_t dataCb, void *userdata, size_t userdataLen, esp_http_client_method_t method, const char *post_data, bool isEndlessStream) {
+char *httpc_kept_lines(httpc_req_t *req) {
+    return NULL != req->lb ? linebuffer_kept(req->lb) : NULL;
+}
+
+static httpc_handle_t httpc_request(const char *host, const char *path, const char *auth, size_t maxLen, bool linebuffered, httpc_data_cb_t dataCb, void *userdata, size_t userdataLen, const char *method, const char *post_data, bool isEndlessStream, bool ws) {
     httpc_req_t *req = NULL;
-    uint32_t err;
+    const char *colon;
+    size_t hostLen;
+    int len;
 
 #ifdef HTTPC_DEBUG
     Serial.printf("httpc_request host=%s path=%s auth=%s\r\n", host==NULL?"":host, path==NULL?"":path, auth==NULL?"":auth);
@@ -348,102 +2378,248 @@ static httpc_req_t *httpc_request(const char *host, const char *path, const char
 
     if (host == NULL || path == NULL || dataCb == NULL) {
         Serial.println("httpc_request bad args");
-        return NULL;
+        return HTTPC_HANDLE_NONE;
+    }
+    colon = strchr(host, ':');
+    hostLen = colon != NULL ? (size_t)(colon - host) : strlen(host);
+    if (hostLen == 0 || hostLen >= HTTPC_MAX_HOST_LEN) {
+        Serial.println("httpc_request bad host");
+        return HTTPC_HANDLE_NONE;
     }
-    if (NULL == (req = (httpc_req_t *)malloc(sizeof(httpc_req_t)))) {
+    if (NULL == (req = httpc_req_alloc())) {
         Serial.println("httpc_request out of mem");
-        return NULL;
+        return HTTPC_HANDLE_NONE;
     }
     memset(req, 0x00, sizeof(httpc_req_t));
+    memcpy(req->host, host, hostLen);
+    req->host[hostLen] = '\0';
+    req->port = colon != NULL ? atoi(colon + 1) : HTTPC_DEFAULT_PORT;
     req->httpBufMaxLen = maxLen;
     req->dataCb = dataCb;
+    req->madeAt = xTaskGetTickCount();
+    httpc_deadlines_default(&req->deadlines);
 
     if (isEndlessStream) {
         req->autoResume = true;
     }
+    req->paced = (NULL != post_data);
+    req->ws = ws;
+    if (ws && NULL == (req->wsTx = (char *)httpc_alloc(HTTPC_WS_TX_SIZE))) {
+        Serial.println("httpc_request out of mem ws");
+        httpc_dispose(req);
+        return HTTPC_HANDLE_NONE;
+    }
 
     req->userdataLen = userdataLen;
     if (userdataLen > 0) {  // clone userdata into req
-        if (NULL == (req->userdata = malloc(userdataLen))) {
+        if (NULL == (req->userdata = httpc_alloc(userdataLen))) {
             Serial.println("httpc_request out of mem userdata");
             httpc_dispose(req);
-            return NULL;
+            return HTTPC_HANDLE_NONE;
         }
 #ifdef HTTPC_DEBUG
-    Serial.printf("httpc_request: cloning userdata %d\r\n", userdataLen);
+    Serial.printf("httpc_request: cloning userdata %d\r\n", (int)userdataLen);
 #endif
         memcpy(req->userdata, userdata, userdataLen);
     }
 
     if (maxLen > 0) {
         if (linebuffered) {
-            if (NULL == (req->lb = (linebuffer_t *)malloc(sizeof(linebuffer_t)))) {
-                Serial.println("httpc_request out of mem lb");
-                httpc_dispose(req);
-                return NULL;
-            }
-            if (0 != linebuffer_init(req->lb, maxLen, lineCb)) {
+            char *linebuf = (char *)httpc_alloc(maxLen);
+            if (0 != linebuffer_init_buf(&req->lbStore, linebuf, maxLen, lineCb)) {
                 Serial.println("Linebuffer init failed!");
+                if (NULL != linebuf) {
+                    httpc_free(linebuf);
+                }
                 httpc_dispose(req);
-                return NULL;
+                return HTTPC_HANDLE_NONE;
             }
+            req->lb = &req->lbStore;
             linebuffer_set_userdata(req->lb, req);
         } else {
-            if (NULL == (req->httpBuf = (char *)malloc(req->httpBufMaxLen))) {
+            if (NULL == (req->httpBuf = (char *)httpc_alloc(req->httpBufMaxLen))) {
                 Serial.printf("httpc_request out of mem (buf %d)\r\n", (int)req->httpBufMaxLen);
                 httpc_dispose(req);
-                return NULL;
+                return HTTPC_HANDLE_NONE;
             }
         }
     }
 
+    // build the whole request up front, it's resent as is if the stream resumes (with a new key for a websocket)
+    const char *fmt = "%s %s HTTP/1.1\r\nHost: %s\r\nUser-Agent: ESP32 HTTP Client/1.0\r\n%s%s%s%s";
+    const char *upgrade = ws ? "Upgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Version: 13\r\n" HTTPC_WS_KEY_HEADER "xxxxxxxxxxxxxxxxxxxxxxxx\r\n" : "";
+    len = snprintf(NULL, 0, fmt, method, path, host, auth != NULL ? "Authorization: " : "", auth != NULL ? auth : "", auth != NULL ? "\r\n" : "", upgrade);
     if (NULL != post_data) {
-        if (NULL == (req->postBuf = strdup(post_data))) {
-            Serial.printf("httpc_request out of mem postdata\r\n");
-            httpc_dispose(req);
-            return NULL;
-        }
+        len += snprintf(NULL, 0, "Content-Type: application/x-www-form-urlencoded\r\nContent-Length: %d\r\n\r\n%s", (int)strlen(post_data), post_data);
+    } else {
+        len += 2;
+    }
+    if (NULL == (req->txBuf = (char *)httpc_alloc(len + 1))) {
+        Serial.printf("httpc_request out of mem request\r\n");
+        httpc_dispose(req);
+        return HTTPC_HANDLE_NONE;
+    }
+    req->txLen = snprintf(req->txBuf, len + 1, fmt, method, path, host, auth != NULL ? "Authorization: " : "", auth != NULL ? auth : "", auth != NULL ? "\r\n" : "", upgrade);
+    if (ws) {
+        req->wsKeyOff = (strstr(req->txBuf, HTTPC_WS_KEY_HEADER) - req->txBuf) + strlen(HTTPC_WS_KEY_HEADER);
+    }
+    if (NULL != post_data) {
+#ifdef HTTPC_DEBUG
+        Serial.printf("POST path=%s data=%s\r\n", path, post_data);
+#endif
+        req->txLen += snprintf(req->txBuf + req->txLen, len + 1 - req->txLen, "Content-Type: application/x-www-form-urlencoded\r\nContent-Length: %d\r\n\r\n%s", (int)strlen(post_data), post_data);
+    } else {
+        req->txLen += snprintf(req->txBuf + req->txLen, len + 1 - req->txLen, "\r\n");
+    }
+
+    httpc_req_start(req);
+    req->state = HTTPC_REQ_STATE_RUNNABLE;
+    if (HTTPC_HANDLE_NONE == (req->handle = httpc_handle_alloc(req))) {
+        Serial.printf("httpc_request no free handle, all %d in use\r\n", HTTPC_MAX_HANDLES);
+        lock_stats();
+        httpcStats.refused++;
+        unlock_stats();
+        httpc_dispose(req);
+        return HTTPC_HANDLE_NONE;
     }
+    lock_stats();
+    httpcStats.requests++;
+    unlock_stats();
 
-    req->config.transport_type = HTTP_TRANSPORT_OVER_SSL;
-    req->config.host = host;
-    req->config.path = path;
-    req->config.event_handler = http_event_handler;
-    req->config.crt_bundle_attach = esp_crt_bundle_attach;
-    req->config.is_async = true;
-    req->config.user_data = (void *)req;
+    // over to the httpc task, without waiting for it, req may be gone once it's pushed
+    httpc_handle_t h = req->handle;
+    httpc_req_t *top = __atomic_load_n(&submitted, __ATOMIC_RELAXED);
+    do {
+        req->submitNext = top;
+    } while (!__atomic_compare_exchange_n(&submitted, &top, req, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    httpc_wake();
+
+    return h;
+}
 
-    req->client = esp_http_client_init(&req->config);
+httpc_handle_t httpc_get(const char *host, const char *path, const char *auth, size_t maxLen, bool linebuffered, httpc_data_cb_t dataCb, void *userdata, size_t userdataLen, bool isEndlessStream) {
+    return httpc_request(host, path, auth, maxLen, linebuffered, dataCb, userdata, userdataLen, "GET", NULL, isEndlessStream, false);
+}
 
-    esp_http_client_set_timeout_ms(req->client, HTTP_TIMEOUT_MS);
-    esp_http_client_set_method(req->client, method);
+httpc_handle_t httpc_post(const char *host, const char *path, const char *auth, const char *postData, size_t maxLen, bool linebuffered, httpc_data_cb_t dataCb, void *userdata, size_t userdataLen) {
+    return httpc_request(host, path, auth, maxLen, linebuffered, dataCb, userdata, userdataLen, "POST", postData, false, false);
+}
 
-    if (auth != NULL) {
-        esp_http_client_set_header(req->client, "Authorization", auth);
+httpc_handle_t httpc_ws(const char *host, const char *path, const char *auth, size_t maxLen, httpc_data_cb_t dataCb, void *userdata, size_t userdataLen) {
+    if (maxLen < 2) {
+        Serial.println("httpc_ws bad maxLen");
+        return HTTPC_HANDLE_NONE;
     }
+    return httpc_request(host, path, auth, maxLen, false, dataCb, userdata, userdataLen, "GET", NULL, true, true);
+}
 
-    if (NULL != req->postBuf) {
-        esp_http_client_set_header(req->client, "Content-Type", "application/x-www-form-urlencoded");
-#ifdef HTTPC_DEBUG
-        Serial.printf("POST path=%s data=%s\r\n", path, req->postBuf);
-#endif
-        esp_http_client_set_post_field(req->client, req->postBuf, strlen(req->postBuf));
+httpc_err_t httpc_resume(httpc_handle_t h) {
+    if (httpc_on_task()) {
+        httpc_req_t *req = httpc_lookup(h);
+        if (NULL == req || !httpc_req_resume(req)) {
+            return HTTPC_ERR_FAIL;
+        }
+        httpc_wake();
+        return HTTPC_ERR_OK;
+    }
+    // the httpc task ignores it unless the stream is held by then
+    if (!httpc_is_open(h) || !httpc_handle_command(h, HTTPC_H_RESUME)) {
+        return HTTPC_ERR_FAIL;
     }
+    return HTTPC_ERR_OK;
+}
 
-    req->state = HTTPC_REQ_STATE_RUNNABLE;
-    lock_ll();
-    httpc_ll_push(req);
-    unlock_ll();
+void httpc_deadlines_default(httpc_deadlines_t *deadlines) {
+    memset(deadlines, 0x00, sizeof(httpc_deadlines_t));
+    deadlines->connectMs = HTTPC_CONNECT_TIMEOUT_MS;
+    deadlines->firstByteMs = HTTPC_FIRST_BYTE_TIMEOUT_MS;
+    deadlines->idleMs = HTTPC_IDLE_TIMEOUT_MS;
+    deadlines->totalMs = HTTPC_TOTAL_TIMEOUT_MS;
+    deadlines->heartbeatMs = HTTPC_HEARTBEAT_MS;
+    deadlines->stallHeartbeats = HTTPC_STALL_HEARTBEATS;
+}
 
-    return req;
+httpc_err_t httpc_set_deadlines(httpc_handle_t h, const httpc_deadlines_t *deadlines) {
+    httpc_req_t *req;
+
+    if (httpc_on_task()) {
+        if (NULL == (req = httpc_lookup(h))) {
+            return HTTPC_ERR_FAIL;
+        }
+        req->deadlines = *deadlines;
+        httpc_timer_update(req);
+        return HTTPC_ERR_OK;
+    }
+    if (NULL == (req = httpc_handle_acquire(h))) {
+        return HTTPC_ERR_FAIL;
+    }
+    lock_stats();
+    req->deadlinesNext = *deadlines;
+    unlock_stats();
+    httpc_unpin(req);
+    return httpc_handle_command(h, HTTPC_H_DEADLINES) ? HTTPC_ERR_OK : HTTPC_ERR_FAIL;
+}
+
+bool httpc_is_open(httpc_handle_t h) {
+    uint32_t word;
+
+    if ((h & HTTPC_H_INDEX) >= HTTPC_MAX_HANDLES) {
+        return false;
+    }
+    word = __atomic_load_n(&handles[h & HTTPC_H_INDEX].word, __ATOMIC_ACQUIRE);
+    return (word & HTTPC_H_GEN) == (h & HTTPC_H_GEN) && 0 == (word & HTTPC_H_CLOSE);
 }
 
-httpc_req_t *httpc_get(const char *host, const char *path, const char *auth, size_t maxLen, bool linebuffered, httpc_data_cb_t dataCb, void *userdata, size_t userdataLen, bool isEndlessStream) {
-    return httpc_request(host, path, auth, maxLen, linebuffered, dataCb, userdata, userdataLen, HTTP_METHOD_GET, NULL, isEndlessStream);
+httpc_err_t httpc_get_reconnect_stats(httpc_handle_t h, httpc_reconnect_stats_t *stats) {
+    httpc_req_t *req;
+    TickType_t now = xTaskGetTickCount();
+
+    if (NULL == (req = httpc_handle_acquire(h))) {
+        return HTTPC_ERR_FAIL;
+    }
+    lock_stats();
+    stats->reconnects = req->reconnects;
+    stats->failures = req->failures;
+    stats->retries = req->retries;
+    stats->backoffMs = req->backoffMs;
+    stats->nextRetryMs = 0;
+    if (req->retryWaiting && !httpc_ticks_due(req->retryAt, now)) {
+        stats->nextRetryMs = (req->retryAt - now) * portTICK_PERIOD_MS;
+    }
+    stats->lastStatus = req->lastStatus;
+    unlock_stats();
+    httpc_unpin(req);
+    return HTTPC_ERR_OK;
 }
 
-httpc_req_t *httpc_post(const char *host, const char *path, const char *auth, const char *postData, size_t maxLen, bool linebuffered, httpc_data_cb_t dataCb, void *userdata, size_t userdataLen) {
-    return httpc_request(host, path, auth, maxLen, linebuffered, dataCb, userdata, userdataLen, HTTP_METHOD_POST, postData, false);
+httpc_err_t httpc_get_req_stats(httpc_handle_t h, httpc_req_stats_t *stats) {
+    httpc_req_t *req;
+
+    if (NULL == (req = httpc_handle_acquire(h))) {
+        return HTTPC_ERR_FAIL;
+    }
+    lock_stats();
+    *stats = req->stats;
+    unlock_stats();
+    httpc_unpin(req);
+    return HTTPC_ERR_OK;
 }
 
+httpc_err_t httpc_ws_send(httpc_handle_t h, const char *text, size_t len) {
+    httpc_req_t *req;
+    bool queued;
+
+    if (!httpc_is_open(h) || NULL == (req = httpc_handle_acquire(h))) {
+        return HTTPC_ERR_FAIL;
+    }
+    lock_ws();
+    queued = req->ws && httpc_ws_queue(req, HTTPC_WS_TEXT, text, len);
+    unlock_ws();
+    httpc_unpin(req);
+    if (!queued) {
+        return HTTPC_ERR_FAIL;
+    }
+    httpc_wake();
+    return HTTPC_ERR_OK;
+}
 
@@ -1,54 +1,386 @@
 #ifndef HTTPC_H
 #define HTTPC_H 1
 
+#include "freertos/FreeRTOS.h"
 #include "linebuffer.h"
-#include "esp_http_client.h"
 #include "esp_tls.h"
 #if CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
 #include "esp_crt_bundle.h"
 #endif
 
 #define HTTP_TIMEOUT_MS 60000
+#define HTTPC_DEFAULT_PORT 443
+#define HTTPC_MAX_HOST_LEN 128
+#define HTTPC_MAX_HEADER_LINE 256   // longer response header lines are truncated
+
+// idle keep-alive connections kept for reuse by the next request to the same host:port, 0 disables
+#ifndef HTTPC_POOL_SIZE
+#define HTTPC_POOL_SIZE 2
+#endif
+// a pooled connection unused for this long is closed
+#ifndef HTTPC_POOL_IDLE_MS
+#define HTTPC_POOL_IDLE_MS 30000
+#endif
+// hosts whose TLS session is remembered for resumption on the next connect,
+// needs CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS in the ESP-IDF config
+#ifndef HTTPC_TLS_SESSION_CACHE_SIZE
+#define HTTPC_TLS_SESSION_CACHE_SIZE 2
+#endif
+// room for websocket frames queued by httpc_ws_send() (and pongs) waiting to go out, per websocket
+#ifndef HTTPC_WS_TX_SIZE
+#define HTTPC_WS_TX_SIZE 1024
+#endif
+// an endless request that fails, or whose connection ends soon after it was made, reconnects after a jittered
+// delay that doubles with each further attempt from HTTPC_BACKOFF_MIN_MS up to HTTPC_BACKOFF_MAX_MS
+#ifndef HTTPC_BACKOFF_MIN_MS
+#define HTTPC_BACKOFF_MIN_MS 1000
+#endif
+#ifndef HTTPC_BACKOFF_MAX_MS
+#define HTTPC_BACKOFF_MAX_MS 300000
+#endif
+// a connection that lasted this long resets the backoff, the server ending it is reconnected straight away
+#ifndef HTTPC_BACKOFF_STABLE_MS
+#define HTTPC_BACKOFF_STABLE_MS 30000
+#endif
+// hosts whose X-RateLimit- budget is remembered, POSTs to them are started spread over what's left of it
+// rather than all at once, 0 disables
+#ifndef HTTPC_RATELIMIT_HOSTS
+#define HTTPC_RATELIMIT_HOSTS 2
+#endif
+// Requests are made in this many fixed slots, and their buffers (cloned userdata, the response buffer of
+// maxLen, the request text and a websocket's send queue) taken from blocks reserved once by httpc_init(),
+// so making and finishing requests never touches the heap. A request that finds no free slot, or no free
+// block big enough for one of its buffers, fails. 0 allocates each request from the heap as it's made.
+#ifndef HTTPC_REQ_SLOTS
+#define HTTPC_REQ_SLOTS 0
+#endif
+// {size, count} of each class of block for HTTPC_REQ_SLOTS, smallest first. A buffer takes the smallest free
+// block it fits in. The defaults cover a stream, a websocket, a backfill (which asks for its next page before
+// the last is freed) and a couple of toots at once, about 112KB.
+#ifndef HTTPC_BLOCK_CLASSES
+#define HTTPC_BLOCK_CLASSES {256, 16}, {1024, 12}, {4096, 4}, {16384, 2}, {24576, 2}
+#endif
+// Default deadlines of each request, see httpc_deadlines_t, 0 for none
+#ifndef HTTPC_CONNECT_TIMEOUT_MS
+#define HTTPC_CONNECT_TIMEOUT_MS 20000
+#endif
+#ifndef HTTPC_FIRST_BYTE_TIMEOUT_MS
+#define HTTPC_FIRST_BYTE_TIMEOUT_MS 30000
+#endif
+#ifndef HTTPC_IDLE_TIMEOUT_MS
+#define HTTPC_IDLE_TIMEOUT_MS HTTP_TIMEOUT_MS
+#endif
+#ifndef HTTPC_TOTAL_TIMEOUT_MS
+#define HTTPC_TOTAL_TIMEOUT_MS 0
+#endif
+// Mastodon sends a ":thump" comment down a stream every 15 s, a stream that misses HTTPC_STALL_HEARTBEATS of
+// them in a row has stalled and is reconnected. 0 for either leaves streams to the idle timeout.
+#ifndef HTTPC_HEARTBEAT_MS
+#define HTTPC_HEARTBEAT_MS 15000
+#endif
+#ifndef HTTPC_STALL_HEARTBEATS
+#define HTTPC_STALL_HEARTBEATS 2
+#endif
+// deadlines are kept in a timer wheel of this many slots, each this long, a deadline fires up to a slot late
+#ifndef HTTPC_WHEEL_SLOTS
+#define HTTPC_WHEEL_SLOTS 64
+#endif
+#ifndef HTTPC_WHEEL_TICK_MS
+#define HTTPC_WHEEL_TICK_MS 100
+#endif
+// Follow the WiFi through the default event loop. Losing it tears down requests in flight straight away (one-off
+// requests fail, streams wait for it to come back) rather than leaving them to their deadlines, and getting an IP
+// address reconnects the streams and the pooled connections it took at once. 0 leaves them to their deadlines.
+#ifndef HTTPC_LINK_EVENTS
+#define HTTPC_LINK_EVENTS 1
+#endif
+// requests open at once, each needs a handle until it's closed and disposed of. At most 65535.
+#ifndef HTTPC_MAX_HANDLES
+#define HTTPC_MAX_HANDLES 64
+#endif
+// Buffers of at least this many bytes (a stream's line buffer, response buffers, or with HTTPC_REQ_SLOTS the
+// block classes this big) are put in PSRAM, leaving internal RAM to mbedTLS and the small structures touched
+// on every read. Without PSRAM, or once it's full, they fall back to internal RAM. 0 keeps them all internal.
+#ifndef HTTPC_PSRAM_MIN_LEN
+#define HTTPC_PSRAM_MIN_LEN 4096
+#endif
+// defaults for the httpc task, which does all socket reads and writes, see httpc_set_task_config()
+#ifndef HTTPC_TASK_PRIORITY
+#define HTTPC_TASK_PRIORITY tskIDLE_PRIORITY
+#endif
+#ifndef HTTPC_TASK_STACK_SIZE
+#define HTTPC_TASK_STACK_SIZE 4096
+#endif
+#ifndef HTTPC_TASK_CORE
+#define HTTPC_TASK_CORE tskNO_AFFINITY
+#endif
 
 typedef enum {
     HTTPC_ERR_OK = 0,
-    HTTPC_ERR_FAIL = 1
+    HTTPC_ERR_FAIL = 1,
+    HTTPC_ERR_KEEP = 2, // from a linebuffered dataCb, keep the line in the buffer, see httpc_kept_lines()
+    HTTPC_ERR_OPEN = 3, // to a websocket's dataCb each time it (re)connects, before any messages
+    HTTPC_ERR_HOLD = 4  // from dataCb at the end of an endless stream's response, don't reconnect until httpc_resume()
 } httpc_err_t;
 
 typedef struct httpc_req_s httpc_req_t;
 
+// A request as held by the task that made it. The low 16 bits pick its slot in the handle table and the rest
+// count the slot's reuses, so a handle kept after its request has gone no longer matches and is refused
+// (until the slot has been reused 65536 times).
+typedef uint32_t httpc_handle_t;
+#define HTTPC_HANDLE_NONE 0
+
+typedef struct {
+    UBaseType_t priority;
+    uint32_t stackSize;     // bytes
+    BaseType_t core;        // core the task is pinned to, tskNO_AFFINITY for either
+} httpc_task_config_t;
+
+typedef struct {
+    unsigned long fullHandshakes;
+    unsigned long resumedHandshakes;
+} httpc_tls_stats_t;
+
+// phases of a request timed by httpc_get_stats()
+typedef enum {
+    HTTPC_PHASE_DNS,            // resolving the host and setting up the socket
+    HTTPC_PHASE_CONNECT,        // TCP connect
+    HTTPC_PHASE_TLS,            // TLS handshake
+    HTTPC_PHASE_FIRST_BYTE,     // from the request going out to the first byte of the response
+    HTTPC_PHASE_COMPLETE,       // from starting to the end of the response, not timed for endless requests
+    HTTPC_PHASES
+} httpc_phase_t;
+
+// latency histogram buckets, bucket i counts phases taking under 4^i ms, the last any longer
+#define HTTPC_HIST_BUCKETS 8
+
+typedef struct {
+    unsigned long requests;     // made by httpc_get(), httpc_post() and httpc_ws()
+    unsigned long refused;      // of those, for want of a handle, see HTTPC_MAX_HANDLES
+    unsigned long responses;    // complete
+    unsigned long failures;     // transport errors and timeouts
+    unsigned long timeouts;     // of those, past a deadline, see httpc_deadlines_t
+    unsigned long stalls;       // of those, streams that missed their heartbeats
+    unsigned long reconnects;   // of endless requests
+    unsigned long linkLosses;   // times the WiFi went, see HTTPC_LINK_EVENTS
+    unsigned long preconnects;  // pooled connections made again as it came back
+    unsigned long long bytesIn;
+    unsigned long long bytesOut;
+    unsigned long allocs;       // request structures and buffers, from the heap or HTTPC_REQ_SLOTS
+    unsigned long frees;
+    size_t bufHighWater;        // most of any request's response or line buffer in use at once
+    size_t heapFree;            // internal RAM now, and the least there has been
+    size_t heapMinFree;
+    size_t psramFree;
+    unsigned long hist[HTTPC_PHASES][HTTPC_HIST_BUCKETS];
+} httpc_stats_t;
+
+typedef struct {
+    uint32_t phaseUs[HTTPC_PHASES];     // of the latest connection, 0 for phases it skipped (e.g. a pooled connection's)
+    unsigned long long bytesIn;         // over all its connections
+    unsigned long long bytesOut;
+    size_t bufHighWater;
+} httpc_req_stats_t;
+
+typedef struct {
+    int slots;                  // HTTPC_REQ_SLOTS, the rest are 0 without it
+    int slotsInUse;
+    int slotsPeak;
+    size_t blockBytes;          // reserved for HTTPC_BLOCK_CLASSES
+    int blocksInUse;
+    int blocksPeak;
+    unsigned long exhausted;    // requests refused for want of a slot or a block
+} httpc_slot_stats_t;
+
+typedef struct {
+    unsigned long reconnects;   // times the request has been restarted
+    unsigned long failures;     // of those, after a transport error, a 429 or a 5xx
+    unsigned retries;           // attempts since the last stable connection, the backoff grows with these
+    uint32_t backoffMs;         // delay chosen before the latest reconnect, 0 if it was straight away
+    uint32_t nextRetryMs;       // until the pending reconnect, 0 if connected or connecting
+    int lastStatus;             // of the response before the latest reconnect, -1 if there was none
+} httpc_reconnect_stats_t;
+
+// A request past a deadline fails (an endless one reconnects, after a backoff), each 0 for none
+typedef struct {
+    uint32_t connectMs;         // from starting a connection attempt to it being made, TLS handshake included
+    uint32_t firstByteMs;       // from the request going out to the first byte of the response
+    uint32_t idleMs;            // with nothing read or written on the connection
+    uint32_t totalMs;           // from being made to the end of the response, rate limit waits included. Not for
+                                // endless requests.
+    uint32_t heartbeatMs;       // an endless request's body is expected to carry something at least this often
+    unsigned stallHeartbeats;   // heartbeats missed in a row before it has stalled
+} httpc_deadlines_t;
+
+// For linebuffered requests data is a line in the request's own buffer, and for buffered requests the whole
+// response. Either may be modified in place by the callback (e.g. parsed destructively), it's discarded afterwards.
 typedef httpc_err_t (*httpc_data_cb_t)(httpc_err_t err, httpc_req_t *req, int status_code, const char *data, size_t len);
 
 typedef enum {
     HTTPC_REQ_STATE_RUNNABLE,
+    HTTPC_REQ_STATE_HELD,       // endless stream waiting for httpc_resume() before it reconnects
+    HTTPC_REQ_STATE_BACKOFF,    // waiting for retryAt before it (re)connects, backing off or paced by a rate limit
     HTTPC_REQ_STATE_CLOSEABLE,
-    HTTPC_REQ_STATE_KILLABLE,
     HTTPC_REQ_STATE_DEAD
 } httpc_req_state_t;
 
+// progress of a RUNNABLE request on the wire
+typedef enum {
+    HTTPC_IO_CONNECTING,
+    HTTPC_IO_SENDING,
+    HTTPC_IO_RECV_HEADERS,
+    HTTPC_IO_RECV_BODY
+} httpc_io_state_t;
+
+typedef enum {
+    HTTPC_BODY_LENGTH,
+    HTTPC_BODY_UNTIL_CLOSE,
+    HTTPC_BODY_CHUNK_SIZE,
+    HTTPC_BODY_CHUNK_EXT,
+    HTTPC_BODY_CHUNK_DATA,
+    HTTPC_BODY_CHUNK_CRLF,
+    HTTPC_BODY_TRAILER,
+    HTTPC_BODY_WS_HEADER,
+    HTTPC_BODY_WS_PAYLOAD
+} httpc_body_state_t;
+
 struct httpc_req_s {
     httpc_req_state_t state;
-    esp_http_client_config_t config;
-    esp_http_client_handle_t client;
+    httpc_io_state_t ioState;
+    esp_tls_t *tls;
+    char host[HTTPC_MAX_HOST_LEN];  // without any ":port" suffix
+    int port;
+    char *txBuf;    // complete request, kept for resending if autoResume
+    size_t txLen;
+    size_t txOff;
+    TickType_t lastActivity;
+    TickType_t madeAt;
+    httpc_deadlines_t deadlines;
+    httpc_deadlines_t deadlinesNext;    // from httpc_set_deadlines() on another task, guarded by the stats lock
+    bool timerSet;      // in the timer wheel, to fire at timerAt, only the httpc task touches these
+    TickType_t timerAt;
+    struct httpc_req_s **timerPrev;     // whatever points to this one in its slot
+    struct httpc_req_s *timerNext;
+    int statusCode;
+    httpc_body_state_t bodyState;
+    size_t bodyRemaining;
+    bool chunked;
+    bool haveContentLength;
+    bool gotStatusLine;
+    bool trailerLineEmpty;
+    bool keepAlive;     // server will keep the connection open after this response
+    bool reused;        // connection came from the pool, it may have been closed under us
+    bool sessionOffered;    // a cached TLS session was offered for resumption on connect
+    char hdrLine[HTTPC_MAX_HEADER_LINE];
+    size_t hdrLineLen;
     size_t httpBufMaxLen;
     size_t httpBufLen;
     char *httpBuf;
-    char *postBuf;
     httpc_data_cb_t dataCb;
-    struct httpc_req_s *prev;
+    httpc_handle_t handle;
+    struct httpc_req_s *submitNext; // made, waiting for the httpc task to take it on
+    struct httpc_req_s *prev;   // the httpc task's list of requests, only it touches these
     struct httpc_req_s *next;
-    linebuffer_t *lb;
+    httpc_req_stats_t stats;    // guarded by the stats lock
+    uint32_t startUs;   // when the current connection attempt began
+    uint32_t phaseUs;   // when the phase being timed began
+    int tlsState;       // connection state seen after the last connect step, for timing
+    size_t rxCount;     // moved since the stats were last brought up to date, only touched by the httpc task
+    size_t txCount;
+    size_t bufUsed;
+    linebuffer_t *lb;   // &lbStore for linebuffered requests, otherwise NULL
+    linebuffer_t lbStore;
     void *userdata;
     size_t userdataLen;
-    bool autoResume;    // hack to workaround "E (33430) TRANSPORT_BASE: esp_tls_conn_read error, errno=No more processes", HTTPS dropping connection in is_async mode
+    bool autoResume;    // endless stream, reconnect when the server ends it
+    TickType_t connectedAt;     // when the status line arrived
+    TickType_t retryAt;         // when a request in backoff reconnects
+    bool retryWaiting;          // HELD or BACKOFF, the rest of the reconnect stats are guarded by the stats lock
+    uint32_t retryAfterMs;      // from a Retry-After header
+    uint32_t backoffMs;
+    unsigned retries;
+    unsigned long reconnects;
+    unsigned long failures;
+    int lastStatus;
+    bool paced;         // a POST, started no sooner than the host's rate limit allows
+    bool rlInflight;    // counted in the host's rate limit as awaiting its response
+    long rlLimit;       // X-RateLimit- headers of the response, -1 if absent
+    long rlRemaining;
+    long rlResetIn;     // seconds until the limit resets, from a numeric reset or the Date header
+    long long rlReset;  // an ISO 8601 reset as seconds since the epoch
+    long long date;
+    bool ws;            // websocket, see httpc_ws()
+    bool wsUpgraded;    // "Upgrade: websocket" seen
+    bool wsAccepted;    // a Sec-WebSocket-Accept matching our key seen
+    bool wsOpen;        // upgraded, frames follow
+    size_t wsKeyOff;    // where the Sec-WebSocket-Key value sits in txBuf, it's fresh for each connection
+    char wsAccept[29];  // the Sec-WebSocket-Accept expected for that key
+    unsigned char wsHdr[14];    // header of the frame being read
+    size_t wsHdrLen;
+    unsigned char wsOpcode;     // of the frame being read
+    bool wsFin;
+    bool wsInMessage;   // a fragmented message is being assembled in httpBuf
+    bool wsDropping;    // the message being assembled didn't fit, skip to its end
+    char wsCtrl[125];   // payload of the control frame being read
+    size_t wsCtrlLen;
+    bool wsPingSent;    // a ping is out because the websocket went quiet
+    char *wsTx;         // frames waiting to go out, guarded by the websocket lock
+    size_t wsTxLen;
 };
 
+// the HTTPC_TASK_ defaults
+void httpc_task_config_default(httpc_task_config_t *cfg);
+// priority, stack and core of the httpc task, used by httpc_init() if the task isn't running yet
+void httpc_set_task_config(const httpc_task_config_t *cfg);
 httpc_err_t httpc_init(void);
 void httpc_loop(void);
-httpc_req_t *httpc_get(const char *host, const char *path, const char *auth, size_t maxLen, bool linebuffered, httpc_data_cb_t dataCb, void *userdata, size_t userdataLen, bool isEndlessStream);
-httpc_req_t *httpc_post(const char *host, const char *path, const char *auth, const char *postData, size_t maxLen, bool linebuffered, httpc_data_cb_t dataCb, void *userdata, size_t userdataLen);
-httpc_err_t httpc_close(httpc_req_t *req);
+// Requests are made on the calling task and handed to the httpc task without waiting for it, HTTPC_HANDLE_NONE if
+// they can't be made. host may carry a ":port" suffix, otherwise HTTPC_DEFAULT_PORT is used.
+httpc_handle_t httpc_get(const char *host, const char *path, const char *auth, size_t maxLen, bool linebuffered, httpc_data_cb_t dataCb, void *userdata, size_t userdataLen, bool isEndlessStream);
+httpc_handle_t httpc_post(const char *host, const char *path, const char *auth, const char *postData, size_t maxLen, bool linebuffered, httpc_data_cb_t dataCb, void *userdata, size_t userdataLen);
+// Websocket to path, reconnected whenever it closes until httpc_close(). Each complete text or binary message
+// is passed to dataCb (status 101, NUL terminated, may be modified), messages longer than maxLen-1 are dropped
+// with an HTTPC_ERR_FAIL. dataCb gets HTTPC_ERR_OPEN once the upgrade completes, the place to (re)send
+// subscriptions. A refused upgrade ends with dataCb(HTTPC_ERR_OK, req, status, NULL, 0), as for other requests.
+httpc_handle_t httpc_ws(const char *host, const char *path, const char *auth, size_t maxLen, httpc_data_cb_t dataCb, void *userdata, size_t userdataLen);
+// queue a text message on an open websocket, may be called from any task,
+// fails if the websocket isn't open or HTTPC_WS_TX_SIZE is used up
+httpc_err_t httpc_ws_send(httpc_handle_t h, const char *text, size_t len);
+// may be called from any task, and after the request has finished. The httpc task closes it on its next pass
+// (straight away when called from a callback), no callbacks are made for it after that.
+httpc_err_t httpc_close(httpc_handle_t h);
+// handle of a request, e.g. in its dataCb
+httpc_handle_t httpc_handle(httpc_req_t *req);
+// the request with handle h, NULL if it has been disposed of. Only on the httpc task, e.g. from a callback.
+httpc_req_t *httpc_lookup(httpc_handle_t h);
+// Keep a request's userdata and buffers from being freed once it's closed, until as many httpc_unpin()s. For
+// handing its data to another task from dataCb, on the httpc task. httpc_unpin() may be called from any task.
+void httpc_pin(httpc_req_t *req);
+void httpc_unpin(httpc_req_t *req);
+// reconnect a stream held by its dataCb returning HTTPC_ERR_HOLD, may be called from any task,
+// it waits out any backoff still pending
+httpc_err_t httpc_resume(httpc_handle_t h);
+// the HTTPC_ deadline defaults
+void httpc_deadlines_default(httpc_deadlines_t *deadlines);
+// deadlines of a request in place of the defaults, may be called from any task. They run from the same
+// starting points whenever they're set, so setting them straight after making the request is soon enough.
+httpc_err_t httpc_set_deadlines(httpc_handle_t h, const httpc_deadlines_t *deadlines);
+// Whether an endless request whose response had this status is reconnected, after a backoff honouring any
+// Retry-After. 429 and 5xx are, other statuses besides the expected 200 (101 for websockets) close it for good.
+bool httpc_status_retryable(int status_code);
+// reconnect counts and backoff of an endless request, may be called from any task
+httpc_err_t httpc_get_reconnect_stats(httpc_handle_t h, httpc_reconnect_stats_t *stats);
+// true if the request hasn't been closed. From a callback, another open request's userdata stays valid until it returns.
+bool httpc_is_open(httpc_handle_t h);
+void httpc_get_tls_stats(httpc_tls_stats_t *stats);
+void httpc_get_slot_stats(httpc_slot_stats_t *stats);
+// totals and latency histograms over all requests so far, may be called from any task
+void httpc_get_stats(httpc_stats_t *stats);
+// timings of req's latest connection and its byte counts, may be called from any task
+httpc_err_t httpc_get_req_stats(httpc_handle_t h, httpc_req_stats_t *stats);
+// for linebuffered requests, the lines kept by dataCb returning HTTPC_ERR_KEEP. Only valid within dataCb,
+// the lines may have moved since they were delivered but are in the same order and as the callback left them
+char *httpc_kept_lines(httpc_req_t *req);
 
 #endif
-
-
@@ -0,0 +1,455 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jsonscan.h"
+
+typedef enum {
+    JSONSCAN_OK,
+    JSONSCAN_ERROR,
+    JSONSCAN_DONE       // every field found, stop scanning
+} jsonscan_rc_t;
+
+// where the current position sits relative to the wanted paths
+typedef enum {
+    JSONSCAN_PATH_NONE,     // no field below here, skip it
+    JSONSCAN_PATH_PREFIX,   // on the way to a field
+    JSONSCAN_PATH_MATCH     // at a field
+} jsonscan_path_t;
+
+typedef struct {
+    const char *p;
+    const char *end;
+    bool insitu;        // values are left in the document, see jsonscan_extract_insitu()
+    jsonscan_field_t *fields;
+    size_t nfields;
+    size_t remaining;   // fields not yet found
+    const char *keys[JSONSCAN_MAX_DEPTH];   // object keys leading to the current position, pointing into the document
+    size_t keyLens[JSONSCAN_MAX_DEPTH];
+    char indexKeys[JSONSCAN_MAX_DEPTH][12];  // array indexes as text, for keys to point at
+    int depth;
+} jsonscan_t;
+
+static jsonscan_rc_t scan_value(jsonscan_t *s, jsonscan_path_t rel, jsonscan_field_t *field);
+
+static void skip_ws(jsonscan_t *s) {
+    while (s->p < s->end && (*s->p == ' ' || *s->p == '\t' || *s->p == '\n' || *s->p == '\r')) {
+        s->p++;
+    }
+}
+
+// how the key path compares to a field's dotted path
+static jsonscan_path_t path_compare(jsonscan_t *s, const char *path) {
+    for (int i=0;i<s->depth;i++) {
+        if (0 != strncmp(path, s->keys[i], s->keyLens[i])) {
+            return JSONSCAN_PATH_NONE;
+        }
+        path += s->keyLens[i];
+        if (i == s->depth - 1) {
+            return *path == '\0' ? JSONSCAN_PATH_MATCH : (*path == '.' ? JSONSCAN_PATH_PREFIX : JSONSCAN_PATH_NONE);
+        }
+        if (*path++ != '.') {
+            return JSONSCAN_PATH_NONE;
+        }
+    }
+    return JSONSCAN_PATH_PREFIX;
+}
+
+static jsonscan_path_t path_lookup(jsonscan_t *s, jsonscan_field_t **field) {
+    jsonscan_path_t best = JSONSCAN_PATH_NONE;
+    *field = NULL;
+    for (size_t i=0;i<s->nfields;i++) {
+        if (s->fields[i].found) {
+            continue;
+        }
+        switch(path_compare(s, s->fields[i].path)) {
+            case JSONSCAN_PATH_MATCH:
+                *field = &s->fields[i];
+                return JSONSCAN_PATH_MATCH;
+            case JSONSCAN_PATH_PREFIX:
+                best = JSONSCAN_PATH_PREFIX;
+                break;
+            case JSONSCAN_PATH_NONE:
+                break;
+        }
+    }
+    return best;
+}
+
+// s->p is on the opening quote, leaves it after the closing one
+static jsonscan_rc_t skip_string(jsonscan_t *s) {
+    const char *q = s->p + 1;
+    while (NULL != (q = (const char *)memchr(q, '"', s->end - q))) {
+        const char *b = q;
+        while (b > s->p + 1 && b[-1] == '\\') {
+            b--;
+        }
+        if (((q - b) & 1) == 0) {   // not escaped
+            s->p = q + 1;
+            return JSONSCAN_OK;
+        }
+        q++;
+    }
+    return JSONSCAN_ERROR;
+}
+
+// s->p is on the opening bracket, leaves it after the matching close
+static jsonscan_rc_t skip_container(jsonscan_t *s) {
+    int depth = 0;
+    while (s->p < s->end) {
+        switch(*s->p) {
+            case '"':
+                if (JSONSCAN_OK != skip_string(s)) {
+                    return JSONSCAN_ERROR;
+                }
+                continue;
+            case '{':
+            case '[':
+                depth++;
+                break;
+            case '}':
+            case ']':
+                if (--depth == 0) {
+                    s->p++;
+                    return JSONSCAN_OK;
+                }
+                break;
+        }
+        s->p++;
+    }
+    return JSONSCAN_ERROR;
+}
+
+// append UTF-8 to the field, once it's full the rest of the value is dropped
+static void field_emit(jsonscan_field_t *field, bool *full, const char *data, size_t n) {
+    if (*full) {
+        return;
+    }
+    if (field->len + n >= field->outLen) {
+        n = field->outLen - 1 - field->len;
+        while (n > 0 && (data[n] & 0xC0) == 0x80) {  // don't split a character
+            n--;
+        }
+        *full = true;
+    }
+    memmove(field->out + field->len, data, n);    // in situ, the unescaped value is never ahead of the escaped text
+    field->len += n;
+}
+
+static int hex4(const char *p, unsigned long *v) {
+    *v = 0;
+    for (int i=0;i<4;i++) {
+        char c = p[i];
+        *v <<= 4;
+        if (c >= '0' && c <= '9') {
+            *v |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            *v |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            *v |= c - 'A' + 10;
+        } else {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// s->p is on the opening quote, unescapes the string into field
+static jsonscan_rc_t scan_string(jsonscan_t *s, jsonscan_field_t *field) {
+    bool full = false;
+    const char *p = s->p + 1;
+
+    if (s->insitu) {
+        field->out = (char *)p;
+        field->outLen = (size_t)-1;
+    }
+    field->len = 0;
+    while (p < s->end) {
+        const char *run = p;
+        while (p < s->end && *p != '"' && *p != '\\') {
+            p++;
+        }
+        field_emit(field, &full, run, p - run);
+        if (p >= s->end) {
+            break;
+        }
+        if (*p == '"') {
+            if (!s->insitu) {
+                field->out[field->len] = '\0';
+            }
+            field->found = true;
+            s->p = p + 1;
+            return JSONSCAN_OK;
+        }
+        // escape sequence
+        if (++p >= s->end) {
+            break;
+        }
+        char c = *p++;
+        switch(c) {
+            case '"': case '\\': case '/':
+                field_emit(field, &full, &c, 1);
+                break;
+            case 'b': field_emit(field, &full, "\b", 1); break;
+            case 'f': field_emit(field, &full, "\f", 1); break;
+            case 'n': field_emit(field, &full, "\n", 1); break;
+            case 'r': field_emit(field, &full, "\r", 1); break;
+            case 't': field_emit(field, &full, "\t", 1); break;
+            case 'u': {
+                unsigned long cp, lo;
+                char utf8[4];
+                size_t n;
+                if (s->end - p < 4 || 0 != hex4(p, &cp)) {
+                    return JSONSCAN_ERROR;
+                }
+                p += 4;
+                if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                    return JSONSCAN_ERROR;  // lone low surrogate
+                }
+                if (cp >= 0xD800 && cp <= 0xDBFF) {
+                    if (s->end - p < 6 || p[0] != '\\' || p[1] != 'u' || 0 != hex4(p + 2, &lo) || lo < 0xDC00 || lo > 0xDFFF) {
+                        return JSONSCAN_ERROR;
+                    }
+                    p += 6;
+                    cp = 0x10000 + (((cp & 0x3FF) << 10) | (lo & 0x3FF));
+                }
+                if (cp < 0x80) {
+                    utf8[0] = (char)cp;
+                    n = 1;
+                } else if (cp < 0x800) {
+                    utf8[0] = (char)(0xC0 | (cp >> 6));
+                    utf8[1] = (char)(0x80 | (cp & 0x3F));
+                    n = 2;
+                } else if (cp < 0x10000) {
+                    utf8[0] = (char)(0xE0 | (cp >> 12));
+                    utf8[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+                    utf8[2] = (char)(0x80 | (cp & 0x3F));
+                    n = 3;
+                } else {
+                    utf8[0] = (char)(0xF0 | (cp >> 18));
+                    utf8[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+                    utf8[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+                    utf8[3] = (char)(0x80 | (cp & 0x3F));
+                    n = 4;
+                }
+                field_emit(field, &full, utf8, n);
+                break;
+            }
+            default:
+                return JSONSCAN_ERROR;
+        }
+    }
+    return JSONSCAN_ERROR;
+}
+
+// number, true, false or null
+static jsonscan_rc_t scan_literal(jsonscan_t *s, jsonscan_field_t *field) {
+    const char *start = s->p;
+    char c = *s->p;
+
+    if (c == '-' || (c >= '0' && c <= '9')) {
+        while (s->p < s->end && ((*s->p >= '0' && *s->p <= '9') || *s->p == '-' || *s->p == '+' || *s->p == '.' || *s->p == 'e' || *s->p == 'E')) {
+            s->p++;
+        }
+    } else {
+        static const char *words[] = {"true", "false", "null"};
+        size_t i;
+        for (i=0;i<3;i++) {
+            size_t n = strlen(words[i]);
+            if ((size_t)(s->end - s->p) >= n && 0 == strncmp(s->p, words[i], n)) {
+                s->p += n;
+                break;
+            }
+        }
+        if (i == 3) {
+            return JSONSCAN_ERROR;
+        }
+    }
+    if (NULL != field) {
+        bool full = false;
+        if (s->insitu) {
+            // terminating it here would overwrite the delimiter which is still to be read
+            field->out = (char *)start;
+            field->outLen = (size_t)-1;
+            field->len = s->p - start;
+        } else {
+            field->len = 0;
+            field_emit(field, &full, start, s->p - start);
+            field->out[field->len] = '\0';
+        }
+        field->found = true;
+    }
+    return JSONSCAN_OK;
+}
+
+// s->p is on the opening brace of an object which is on the way to a field
+static jsonscan_rc_t scan_object(jsonscan_t *s) {
+    s->p++;
+    skip_ws(s);
+    if (s->p < s->end && *s->p == '}') {
+        s->p++;
+        return JSONSCAN_OK;
+    }
+    while (s->p < s->end) {
+        const char *key;
+        size_t keyLen;
+        jsonscan_field_t *field = NULL;
+        jsonscan_path_t rel = JSONSCAN_PATH_NONE;
+        jsonscan_rc_t rc;
+
+        if (*s->p != '"') {
+            return JSONSCAN_ERROR;
+        }
+        key = s->p + 1;
+        if (JSONSCAN_OK != skip_string(s)) {
+            return JSONSCAN_ERROR;
+        }
+        keyLen = (s->p - 1) - key;    // raw, keys are compared without unescaping
+        skip_ws(s);
+        if (s->p >= s->end || *s->p++ != ':') {
+            return JSONSCAN_ERROR;
+        }
+        if (s->depth < JSONSCAN_MAX_DEPTH) {
+            s->keys[s->depth] = key;
+            s->keyLens[s->depth] = keyLen;
+            s->depth++;
+            rel = path_lookup(s, &field);
+            rc = scan_value(s, rel, field);
+            s->depth--;
+        } else {
+            rc = scan_value(s, JSONSCAN_PATH_NONE, NULL);
+        }
+        if (rc != JSONSCAN_OK) {
+            return rc;
+        }
+        if (NULL != field && field->found && --s->remaining == 0) {
+            return JSONSCAN_DONE;
+        }
+        skip_ws(s);
+        if (s->p >= s->end) {
+            break;
+        }
+        if (*s->p == '}') {
+            s->p++;
+            return JSONSCAN_OK;
+        }
+        if (*s->p++ != ',') {
+            return JSONSCAN_ERROR;
+        }
+        skip_ws(s);
+    }
+    return JSONSCAN_ERROR;
+}
+
+// s->p is on the opening bracket of an array which is on the way to a field, its elements are keyed by index
+static jsonscan_rc_t scan_array(jsonscan_t *s) {
+    unsigned long index = 0;
+
+    s->p++;
+    skip_ws(s);
+    if (s->p < s->end && *s->p == ']') {
+        s->p++;
+        return JSONSCAN_OK;
+    }
+    while (s->p < s->end) {
+        jsonscan_field_t *field = NULL;
+        jsonscan_path_t rel = JSONSCAN_PATH_NONE;
+        jsonscan_rc_t rc;
+
+        if (s->depth < JSONSCAN_MAX_DEPTH) {
+            s->keys[s->depth] = s->indexKeys[s->depth];
+            s->keyLens[s->depth] = snprintf(s->indexKeys[s->depth], sizeof(s->indexKeys[s->depth]), "%lu", index);
+            s->depth++;
+            rel = path_lookup(s, &field);
+            rc = scan_value(s, rel, field);
+            s->depth--;
+        } else {
+            rc = scan_value(s, JSONSCAN_PATH_NONE, NULL);
+        }
+        if (rc != JSONSCAN_OK) {
+            return rc;
+        }
+        if (NULL != field && field->found && --s->remaining == 0) {
+            return JSONSCAN_DONE;
+        }
+        index++;
+        skip_ws(s);
+        if (s->p >= s->end) {
+            break;
+        }
+        if (*s->p == ']') {
+            s->p++;
+            return JSONSCAN_OK;
+        }
+        if (*s->p++ != ',') {
+            return JSONSCAN_ERROR;
+        }
+    }
+    return JSONSCAN_ERROR;
+}
+
+static jsonscan_rc_t scan_value(jsonscan_t *s, jsonscan_path_t rel, jsonscan_field_t *field) {
+    skip_ws(s);
+    if (s->p >= s->end) {
+        return JSONSCAN_ERROR;
+    }
+    switch(*s->p) {
+        case '{':
+            return rel == JSONSCAN_PATH_PREFIX ? scan_object(s) : skip_container(s);
+        case '[':
+            return rel == JSONSCAN_PATH_PREFIX ? scan_array(s) : skip_container(s);
+        case '"':
+            return rel == JSONSCAN_PATH_MATCH ? scan_string(s, field) : skip_string(s);
+        default:
+            return scan_literal(s, rel == JSONSCAN_PATH_MATCH ? field : NULL);
+    }
+}
+
+static int extract(const char *json, size_t len, jsonscan_field_t *fields, size_t nfields, bool insitu) {
+    jsonscan_t s;
+    jsonscan_rc_t rc;
+
+    for (size_t i=0;i<nfields;i++) {
+        fields[i].found = false;
+        fields[i].len = 0;
+        if (!insitu && fields[i].outLen > 0) {
+            fields[i].out[0] = '\0';
+        }
+    }
+    s.insitu = insitu;
+    s.p = json;
+    s.end = json + len;
+    s.fields = fields;
+    s.nfields = nfields;
+    s.remaining = nfields;
+    s.depth = 0;
+
+    if (nfields == 0) {
+        return 0;
+    }
+    rc = scan_value(&s, JSONSCAN_PATH_PREFIX, NULL);
+    if (rc == JSONSCAN_OK) {
+        skip_ws(&s);
+        if (s.p != s.end && *s.p != '\0') {
+            rc = JSONSCAN_ERROR;    // trailing garbage
+        }
+    }
+    return rc == JSONSCAN_ERROR ? 1 : 0;
+}
+
+int jsonscan_extract(const char *json, size_t len, jsonscan_field_t *fields, size_t nfields) {
+    return extract(json, len, fields, nfields, false);
+}
+
+int jsonscan_extract_insitu(char *json, size_t len, jsonscan_field_t *fields, size_t nfields) {
+    if (0 != extract(json, len, fields, nfields, true)) {
+        return 1;
+    }
+    // the scan is over, so the closing quotes and delimiters after the values can go
+    for (size_t i=0;i<nfields;i++) {
+        if (fields[i].found) {
+            fields[i].out[fields[i].len] = '\0';
+        }
+    }
+    return 0;
+}
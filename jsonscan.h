@@ -0,0 +1,30 @@
+#ifndef JSONSCAN_H
+#define JSONSCAN_H 1
+
+// Single pass JSON field extractor. Pulls the values at a few known paths
+// out of a document without building a tree and without allocating, the
+// rest of the document is skipped over.
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#define JSONSCAN_MAX_DEPTH 16   // deeper nesting is skipped, never matched
+
+typedef struct {
+    const char *path;   // object keys or array indexes separated by '.', e.g. "account.username", "stream.1"
+    char *out;          // the value, strings unescaped to UTF-8, numbers/true/false/null as written, always NUL terminated
+    size_t outLen;      // size of out (at least 1), a longer value is truncated on a character boundary
+    bool found;
+    size_t len;         // bytes written to out, excluding the NUL
+} jsonscan_field_t;
+
+// Scan the first len bytes of json, filling in any fields whose path holds a scalar value. Stops as soon
+// as every field is found, so only the part of the document read so far is checked.
+// Returns 0 on success, non-zero if the document is malformed.
+int jsonscan_extract(const char *json, size_t len, jsonscan_field_t *fields, size_t nfields);
+// As jsonscan_extract, but destructive. Values are unescaped and NUL terminated in place, and each found
+// field's out is pointed at its value inside json, so nothing is copied. out and outLen are not used on entry.
+// json is garbage afterwards, apart from the values.
+int jsonscan_extract_insitu(char *json, size_t len, jsonscan_field_t *fields, size_t nfields);
+
+#endif
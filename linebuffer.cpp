@@ -11,7 +11,7 @@
 int linebuffer_init(linebuffer_t *lb, size_t buf_len, linebuffer_per_line_func per_line_cb)
 {
     lb->per_line_cb = per_line_cb;
-    if (NULL == (lb->linebuf = (char *)malloc(buf_len+1)))
+    if (buf_len < 2 || NULL == (lb->linebuf = (char *)malloc(buf_len)))
         goto fail;
     lb->userdata = NULL;
     lb->size = buf_len;
@@ -21,10 +21,24 @@ fail:
     return 1;
 }
 
+int linebuffer_init_buf(linebuffer_t *lb, char *buf, size_t buf_len, linebuffer_per_line_func per_line_cb)
+{
+    lb->per_line_cb = per_line_cb;
+    lb->linebuf = buf;
+    if (buf_len < 2 || NULL == buf)
+        return 1;
+    lb->userdata = NULL;
+    lb->size = buf_len;
+    linebuffer_reset(lb);
+    return 0;
+}
+
 void linebuffer_reset(linebuffer_t *lb)
 {
-    lb->linebuf_index = 0;
-    lb->linebuf[0] = 0;
+    lb->mark = 0;
+    lb->head = 0;
+    lb->tail = 0;
+    lb->discarding = false;
 }
 
 void linebuffer_term(linebuffer_t *lb)
@@ -33,45 +47,145 @@ void linebuffer_term(linebuffer_t *lb)
         free(lb->linebuf);
 }
 
-static int linebuffer_write_char(linebuffer_t *lb, char c)
+// words at a time, a byte in a word of 0x01s is a byte in every lane
+typedef unsigned long lb_word_t;
+#define LB_ONES (~(lb_word_t)0 / 255)
+#define LB_HIGHS (LB_ONES * 0x80)
+
+// does any byte of w fall outside printable ASCII (0x20-0x7e)?
+static inline bool lb_word_unprintable(lb_word_t w)
+{
+    lb_word_t below = (w - LB_ONES * 0x20) & ~w;
+    lb_word_t above = (w + LB_ONES * (0x7f - 0x7e)) | w;
+    return ((below | above) & LB_HIGHS) != 0;
+}
+
+static inline bool lb_printable(char c)
+{
+    return c >= 0x20 && c < 0x7f;   // isprint() in the C locale
+}
+
+// drop any unprintable characters from a line in place, returns its new length
+static size_t linebuffer_filter(char *line, size_t len)
+{
+    char *p = line;
+    char *end = line + len;
+    char *out;
+
+    // usually there are none, so find the first a word at a time
+    while ((size_t)(end - p) >= sizeof(lb_word_t))
+    {
+        lb_word_t w;
+        memcpy(&w, p, sizeof(w));
+        if (lb_word_unprintable(w))
+            break;
+        p += sizeof(w);
+    }
+    while (p < end && lb_printable(*p))
+        p++;
+    for (out = p; p < end; p++)
+    {
+        if (lb_printable(*p))
+            *out++ = *p;
+    }
+    return out - line;
+}
+
+char *linebuffer_get_space(linebuffer_t *lb, size_t *len)
 {
-    int rc = 1;
-    if (c == '\n')
+    if (lb->mark == lb->tail)
     {
-        if (lb->linebuf_index < lb->size)
+        lb->mark = 0;
+        lb->head = 0;
+        lb->tail = 0;
+    }
+    else if (lb->mark > 0 && lb->size - lb->tail < lb->size / 2)
+    {
+        // running out of room after the partial line, move it (and any kept lines) back to the start
+        memmove(lb->linebuf, lb->linebuf + lb->mark, lb->tail - lb->mark);
+        lb->head -= lb->mark;
+        lb->tail -= lb->mark;
+        lb->mark = 0;
+    }
+    else if (lb->tail == lb->size)
+    {
+        // a whole buffer with no newline, drop it and whatever follows up to the next one
+        lb->discarding = true;
+        lb->mark = 0;
+        lb->head = 0;
+        lb->tail = 0;
+        lb->per_line_cb(lb, NULL, 0, lb->userdata);
+    }
+    *len = lb->size - lb->tail;
+    return lb->linebuf + lb->tail;
+}
+
+int linebuffer_commit(linebuffer_t *lb, size_t len)
+{
+    char *scan = lb->linebuf + lb->tail;
+    char *end = scan + len;
+    char *nl;
+    int ret = lb->discarding ? 1 : 0;
+
+    while (NULL != (nl = (char *)memchr(scan, '\n', end - scan)))
+    {
+        char *line = lb->linebuf + lb->head;
+        bool keep = false;
+        if (lb->discarding)
         {
-            if (lb->linebuf_index && lb->linebuf[lb->linebuf_index-1] == '\r')
-                lb->linebuf[lb->linebuf_index-1] = 0;
-            lb->per_line_cb(lb, lb->linebuf, lb->userdata);
-            linebuffer_reset(lb);
-            rc = 0;
+            lb->discarding = false;
         }
         else
         {
-            linebuffer_reset(lb);
+            size_t line_len = linebuffer_filter(line, nl - line);
+            line[line_len] = 0;
+            keep = LINEBUFFER_KEEP == lb->per_line_cb(lb, line, line_len, lb->userdata);
         }
+        scan = nl + 1;
+        lb->head = scan - lb->linebuf;
+        if (!keep)
+            lb->mark = lb->head;
     }
-    else
-    if (lb->linebuf_index < lb->size)
+    lb->tail = end - lb->linebuf;
+    if (lb->discarding)
     {
-        if (isprint(c))
-        {
-            lb->linebuf[lb->linebuf_index++] = c;
-            lb->linebuf[lb->linebuf_index] = 0;
-        }
-        rc = 0;
+        lb->mark = lb->tail;
+        lb->head = lb->tail;
     }
-    return rc;
+    return ret;
+}
+
+char *linebuffer_kept(linebuffer_t *lb)
+{
+    return lb->linebuf + lb->mark;
 }
 
 int linebuffer_write(linebuffer_t *lb, const char *buf, size_t len)
 {
-    while(len--)
+    int ret = 0;
+
+    while (len > 0)
     {
-        if (0 != linebuffer_write_char(lb, *buf++))
-            return 1;
+        size_t n;
+        if (lb->tail < lb->size && buf == lb->linebuf + lb->tail)
+        {
+            n = lb->size - lb->tail;    // already in place
+        }
+        else
+        {
+            // may lie further on in the buffer, behind the tail, so move rather than copy
+            char *space = linebuffer_get_space(lb, &n);
+            if (n > len)
+                n = len;
+            memmove(space, buf, n);
+        }
+        if (n > len)
+            n = len;
+        ret |= linebuffer_commit(lb, n);
+        buf += n;
+        len -= n;
     }
-    return 0;
+    return ret;
 }
 
 void linebuffer_set_userdata(linebuffer_t *lb, void *userdata)
@@ -1,25 +1,54 @@
 #ifndef LINEBUFFER_H
 #define LINEBUFFER_H 1
 
+#include <stddef.h>
+#include <stdbool.h>
+
 struct linebuffer_s;
 
-typedef int (*linebuffer_per_line_func)(struct linebuffer_s *lb, const char *buf, void *userdata);
+// buf is a complete line of len printable characters, NUL terminated where its newline was. It points into
+// the linebuffer's own storage and may be modified in place, it's discarded once the callback returns unless
+// LINEBUFFER_KEEP is returned. buf is NULL if lines were dropped, a line too long or too much kept.
+typedef int (*linebuffer_per_line_func)(struct linebuffer_s *lb, const char *buf, size_t len, void *userdata);
+
+// returned by per_line_cb to keep the line (and any kept before it) in the buffer, until a later line's
+// callback returns 0. The kept lines start at linebuffer_kept() and move when the buffer is compacted.
+#define LINEBUFFER_KEEP 1
 
+// Lines are framed in place: data is read (or copied) into the free space after the current partial line,
+// and each complete line is handed out as a slice of the buffer. The partial line is only moved back to
+// the start once it has crept past halfway. This compacts rather than wrapping round as a ring would: lines,
+// and the kept lines of an event, are parsed as JSON and stripped of HTML in place, so they have to be
+// contiguous, and a line straddling the end would need copying out anyway. The move is of one partial line at
+// most once per half buffer.
 struct linebuffer_s {
     char *linebuf;
     size_t size;
-    size_t linebuf_index;
+    size_t mark;        // start of any kept lines, otherwise head
+    size_t head;        // start of the partial line
+    size_t tail;        // end of the data, free space follows
+    bool discarding;    // dropping the rest of a line too long for the buffer
     void *userdata;
     linebuffer_per_line_func per_line_cb;
 };
 typedef struct linebuffer_s linebuffer_t;
 
+// lines may be up to buf_len-1 bytes long, plus their newline
 int linebuffer_init(linebuffer_t *lb, size_t buf_len, linebuffer_per_line_func per_line_cb);
+// as linebuffer_init() but framing lines in the caller's buf, which stays the caller's to free, no linebuffer_term()
+int linebuffer_init_buf(linebuffer_t *lb, char *buf, size_t buf_len, linebuffer_per_line_func per_line_cb);
 void linebuffer_reset(linebuffer_t *lb);
 void linebuffer_term(linebuffer_t *lb);
+// copy in len bytes, calling per_line_cb for each complete line, returns non-zero if a line was too long
+// and had to be dropped. If buf is where linebuffer_get_space() pointed, the bytes aren't copied.
 int linebuffer_write(linebuffer_t *lb, const char *buf, size_t len);
+// free space for the caller to read into directly, at least 1 byte, followed by linebuffer_commit()
+char *linebuffer_get_space(linebuffer_t *lb, size_t *len);
+// len bytes have been placed at linebuffer_get_space(), frame them as linebuffer_write() does
+int linebuffer_commit(linebuffer_t *lb, size_t len);
+// start of the kept lines, valid until the next linebuffer_get_space() or linebuffer_write()
+char *linebuffer_kept(linebuffer_t *lb);
 void linebuffer_set_userdata(linebuffer_t *lb, void *userdata);
 void *linebuffer_get_userdata(linebuffer_t *lb);
 #endif
 
-
@@ -2,10 +2,11 @@
 #include <Arduino.h>
 #include "ctype.h"
 #include "cJSON.h"
+#include "jsonscan.h"
 #include "lyuba.h"
 #include "linebuffer.h"
+#include "sse.h"
 #include "Preferences.h"
-#include "esp_http_client.h"
 #include "esp_tls.h"
 #if CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
 #include "esp_crt_bundle.h"
@@ -15,11 +16,18 @@
 
 #define MASTODON_CLIENT_NAME "lyuba"
 #define MASTODON_CLIENT_URL "http://github.com/ringtailsoftware/lyuba"
+#define LYUBA_JSON_ARENA_SIZE 3072  // auth responses are parsed into this, a few hundred bytes of JSON
+#define LYUBA_STATUS_ID_LEN 24      // snowflake ids are 18 or 19 digits
+#define LYUBA_STREAM_GAPS 4         // reconnects whose statuses may still be being fetched
 
 //#define LYUBA_DEBUG 1
 
 static Preferences preferences_lyuba;
 
+// auth responses are parsed into a reused block instead of the heap, only used from callbacks on the httpc task
+static unsigned char jsonArenaBlock[LYUBA_JSON_ARENA_SIZE];
+static cJSON_Arena jsonArena = { jsonArenaBlock, sizeof(jsonArenaBlock), 0, 0 };
+
 // struct for userdata containing multiple elements
 typedef struct {
     lyuba_auth_cb_t authCb;
@@ -31,19 +39,533 @@ typedef struct {
     lyuba_t *lyuba;
 } lyuba_toot_cb_t_with_lyuba_t;
 
+// statuses posted while a stream reconnected, newer than after and older than the live stream's first
+typedef struct {
+    char after[LYUBA_STATUS_ID_LEN];    // newest status delivered before reconnecting
+    char before[LYUBA_STATUS_ID_LEN];   // first live status after, "" until it arrives
+    char tailMax[LYUBA_STATUS_ID_LEN];  // newest delivered by the tail before that, the live stream may repeat them
+} lyuba_stream_gap_t;
+
+// where a status came from
+typedef enum {
+    LYUBA_STATUS_LIVE,
+    LYUBA_STATUS_BACKFILL,  // the timeline, after the stream ended
+    LYUBA_STATUS_TAIL       // the timeline, after the stream reconnected
+} lyuba_status_src_t;
+
 typedef struct {
     lyuba_stream_cb_t streamCb;
+    lyuba_event_cb_t eventCb;
+    unsigned events;    // LYUBA_EVENT_ types wanted
+    sse_parser_t sse;
+    char timeline[128];     // REST timeline holding the stream's statuses, "" if there isn't one
+    char authToken[128];
+    char lastId[LYUBA_STATUS_ID_LEN];   // newest status delivered
+    unsigned ends;      // times the stream has ended
+    lyuba_stream_gap_t gaps[LYUBA_STREAM_GAPS];     // for the last few reconnects, whose tails may still be out, by ends
+    bool tailPending;   // reconnecting, fetch the statuses posted meanwhile once it's up
+    int decoding;       // pipelined, events queued for the decode task and not decoded yet
     lyuba_t *lyuba;
 } lyuba_stream_cb_t_with_lyuba_t;
 
+// a page of a stream's timeline, fetched after it ended
+typedef struct {
+    httpc_handle_t stream;
+    char cursor[LYUBA_STATUS_ID_LEN];   // page starts after this id
+    bool tail;      // the statuses posted while the stream reconnected (its gap), it's running again
+    unsigned ends;  // the stream's ends when fetched
+    int limit;      // page size
+    bool done;
+} lyuba_backfill_t;
+
+// one of the streams multiplexed over a websocket, as named in its messages' "stream" field
+typedef struct {
+    char name[24];      // e.g. "hashtag:local"
+    char paramKey[8];   // "tag" or "list", "" if none
+    char param[64];
+} lyuba_ws_stream_t;
+
+typedef struct {
+    lyuba_multi_stream_cb_t streamCb;
+    lyuba_multi_event_cb_t eventCb;
+    unsigned events;    // LYUBA_EVENT_ types wanted
+    int nstreams;
+    lyuba_ws_stream_t streams[LYUBA_MAX_STREAMS];
+    lyuba_t *lyuba;
+} lyuba_multi_cb_t_with_lyuba_t;
+
+static const struct {
+    const char *name;
+    unsigned type;
+} streamEventTypes[] = {
+    {"update", LYUBA_EVENT_UPDATE},
+    {"status.update", LYUBA_EVENT_STATUS_UPDATE},
+    {"delete", LYUBA_EVENT_DELETE},
+    {"notification", LYUBA_EVENT_NOTIFICATION},
+};
+
+// the timelines matching streams, see https://docs.joinmastodon.org/methods/timelines/
+static const struct {
+    const char *stream;
+    const char *timeline;
+    const char *param;      // stream parameter appended to the timeline path, NULL if none
+    const char *query;
+} streamTimelines[] = {
+    {"public", "/api/v1/timelines/public", NULL, NULL},
+    {"public/local", "/api/v1/timelines/public", NULL, "local=true"},
+    {"public/remote", "/api/v1/timelines/public", NULL, "remote=true"},
+    {"hashtag", "/api/v1/timelines/tag/", "tag", NULL},
+    {"hashtag/local", "/api/v1/timelines/tag/", "tag", "local=true"},
+    {"list", "/api/v1/timelines/list/", "list", NULL},
+    {"user", "/api/v1/timelines/home", NULL, NULL},
+};
+
+// a callback for lyuba_loop() to make, queued with its strings after it. Pipelined, the decode task's queue
+// also carries stream events to decode, which make callbacks of their own.
+typedef enum {
+    LYUBA_CALL_AUTH,
+    LYUBA_CALL_TOOT,
+    LYUBA_CALL_STREAM,
+    LYUBA_CALL_EVENT,
+    LYUBA_CALL_MULTI_STREAM,
+    LYUBA_CALL_MULTI_EVENT,
+    LYUBA_CALL_DECODE_SSE,      // an SSE event, the event type and data
+    LYUBA_CALL_DECODE_WS        // a websocket message, as data
+} lyuba_call_type_t;
+
+#define LYUBA_CALL_NULL 0xffffffffU     // string length of a NULL
+
+typedef struct {
+    lyuba_call_type_t type;
+    bool ok;
+    int stream;
+    union {
+        lyuba_auth_cb_t auth;
+        lyuba_toot_cb_t toot;
+        lyuba_stream_cb_t stream;
+        lyuba_event_cb_t event;
+        lyuba_multi_stream_cb_t multiStream;
+        lyuba_multi_event_cb_t multiEvent;
+        httpc_req_t *req;       // the stream to decode for, pinned until it's done
+    } cb;
+    uint32_t len[2];    // the strings' lengths, each is followed by a NUL
+} lyuba_call_t;
+
+static int callqInit(lyuba_callq_t *q, size_t size, bool wake) {
+    memset(q, 0x00, sizeof(lyuba_callq_t));
+    if (0 != spscq_init(&q->ring, size) || NULL == (q->room = xSemaphoreCreateBinary()) ||
+        (wake && NULL == (q->work = xSemaphoreCreateBinary()))) {
+        return 1;
+    }
+    return 0;
+}
+
+static void callqTerm(lyuba_callq_t *q) {
+    spscq_term(&q->ring);
+    if (NULL != q->room) {
+        vSemaphoreDelete(q->room);
+    }
+    if (NULL != q->work) {
+        vSemaphoreDelete(q->work);
+    }
+    memset(q, 0x00, sizeof(lyuba_callq_t));
+}
+
+// what callqReserve() does with a record that mustn't be dropped, alongside LYUBA_CALLBACK_WAIT and _DROP
+#define LYUBA_CALLBACK_KEEP 2
+
+// producer, room for a record of len bytes leaving reserve bytes free, NULL if there isn't any yet
+static char *callqTry(lyuba_callq_t *q, size_t len, size_t reserve) {
+    return spscq_used(&q->ring) + len + reserve <= q->ring.size ? (char *)spscq_reserve(&q->ring, len) : NULL;
+}
+
+// producer, room for a record of len bytes, NULL if it's to be dropped. Only LYUBA_CALLBACK_KEEP records may use
+// the last LYUBA_CALLBACK_RESERVE bytes.
+static char *callqReserve(lyuba_callq_t *q, size_t len, int overflow) {
+    size_t reserve = LYUBA_CALLBACK_RESERVE < q->ring.size / 4 ? LYUBA_CALLBACK_RESERVE : q->ring.size / 4;
+    unsigned long waitStart = 0;
+    bool waited = false;
+    char *rec;
+
+    if (overflow == LYUBA_CALLBACK_KEEP) {
+        reserve = 0;
+    }
+    while (NULL == (rec = callqTry(q, len, reserve))) {
+        unsigned long waitedMs = waited ? millis() - waitStart : 0;
+        // nothing queued means it's too big to ever fit
+        if (spscq_used(&q->ring) == 0 || (overflow != LYUBA_CALLBACK_KEEP &&
+            (overflow == LYUBA_CALLBACK_DROP || q->dropping || waitedMs >= LYUBA_CALLBACK_WAIT_MS))) {
+            __atomic_store_n(&q->waiting, false, __ATOMIC_SEQ_CST);
+            if (!q->dropping) {
+                Serial.printf("callback queue full, dropping %d byte callback\r\n", (int)len);
+            }
+            q->dropping = spscq_used(&q->ring) > 0;
+            q->stats.dropped++;
+            return NULL;
+        }
+        if (!waited) {
+            waited = true;
+            waitStart = millis();
+            q->stats.waits++;
+        }
+        // each time, as the consumer clears it when it gives room, which may not have been enough
+        __atomic_store_n(&q->waiting, true, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (NULL != (rec = callqTry(q, len, reserve))) {
+            break;      // the consumer made room before it saw waiting
+        }
+        xSemaphoreTake(q->room, pdMS_TO_TICKS(overflow == LYUBA_CALLBACK_KEEP ? LYUBA_CALLBACK_WAIT_MS : LYUBA_CALLBACK_WAIT_MS - waitedMs));
+    }
+    __atomic_store_n(&q->waiting, false, __ATOMIC_SEQ_CST);
+    return rec;
+}
+
+// producer, the reserved record is filled in
+static void callqPush(lyuba_callq_t *q, size_t len) {
+    spscq_push(&q->ring, len);
+    q->dropping = false;
+    q->stats.queued++;
+    if (spscq_used(&q->ring) > q->stats.highWater) {
+        q->stats.highWater = spscq_used(&q->ring);
+    }
+    if (NULL != q->work) {
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_exchange_n(&q->idle, false, __ATOMIC_SEQ_CST)) {
+            xSemaphoreGive(q->work);
+        }
+    }
+}
+
+// consumer, done with the record from spscq_peek(), returns the bytes given back
+static size_t callqPop(lyuba_callq_t *q) {
+    size_t freed = spscq_pop(&q->ring);
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_exchange_n(&q->waiting, false, __ATOMIC_SEQ_CST)) {
+        xSemaphoreGive(q->room);
+    }
+    return freed;
+}
+
+// consumer, the next record, waiting for one until *stop
+static lyuba_call_t *callqWait(lyuba_callq_t *q, size_t *len, bool *stop) {
+    lyuba_call_t *call;
+
+    while (NULL == (call = (lyuba_call_t *)spscq_peek(&q->ring, len))) {
+        if (__atomic_load_n(stop, __ATOMIC_SEQ_CST)) {
+            return NULL;
+        }
+        __atomic_store_n(&q->idle, true, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (NULL != (call = (lyuba_call_t *)spscq_peek(&q->ring, len))) {
+            __atomic_store_n(&q->idle, false, __ATOMIC_SEQ_CST);
+            break;      // it came before idle was seen
+        }
+        xSemaphoreTake(q->work, portMAX_DELAY);
+    }
+    return call;
+}
+
+static void callRun(const lyuba_call_t *call, const char *a, const char *b) {
+    switch (call->type) {
+        case LYUBA_CALL_AUTH:
+            call->cb.auth(call->ok, a);
+            break;
+        case LYUBA_CALL_TOOT:
+            call->cb.toot(call->ok);
+            break;
+        case LYUBA_CALL_STREAM:
+            call->cb.stream(call->ok, a, b);
+            break;
+        case LYUBA_CALL_EVENT:
+            call->cb.event(call->ok, a, b, call->len[1] != LYUBA_CALL_NULL ? call->len[1] : 0);
+            break;
+        case LYUBA_CALL_MULTI_STREAM:
+            call->cb.multiStream(call->ok, call->stream, a, b);
+            break;
+        case LYUBA_CALL_MULTI_EVENT:
+            call->cb.multiEvent(call->ok, call->stream, a, b, call->len[1] != LYUBA_CALL_NULL ? call->len[1] : 0);
+            break;
+        case LYUBA_CALL_DECODE_SSE:
+        case LYUBA_CALL_DECODE_WS:
+            break;
+    }
+}
+
+// copy a call and its strings into q, false if it was dropped
+static bool callPush(lyuba_callq_t *q, int overflow, lyuba_call_t *call, const char *a, const char *b, size_t bLen) {
+    size_t aLen = a != NULL ? strlen(a) : 0;
+    size_t len = sizeof(lyuba_call_t) + aLen + 1 + bLen + 1;
+    char *rec;
+
+    if (NULL == (rec = callqReserve(q, len, overflow))) {
+        return false;
+    }
+    call->len[0] = a != NULL ? (uint32_t)aLen : LYUBA_CALL_NULL;
+    call->len[1] = b != NULL ? (uint32_t)bLen : LYUBA_CALL_NULL;
+    memcpy(rec, call, sizeof(lyuba_call_t));
+    rec += sizeof(lyuba_call_t);
+    if (a != NULL) {
+        memcpy(rec, a, aLen);
+    }
+    rec[aLen] = '\0';
+    rec += aLen + 1;
+    if (b != NULL) {
+        memcpy(rec, b, bLen);
+    }
+    rec[bLen] = '\0';
+    callqPush(q, len);
+    return true;
+}
+
+// the strings queued after a call
+static void callStrings(lyuba_call_t *call, char **a, char **b) {
+    *a = (char *)(call + 1);
+    *b = *a + (call->len[0] != LYUBA_CALL_NULL ? call->len[0] : 0) + 1;
+    if (call->len[0] == LYUBA_CALL_NULL) {
+        *a = NULL;
+    }
+    if (call->len[1] == LYUBA_CALL_NULL) {
+        *b = NULL;
+    }
+}
+
+// queue a callback for lyuba_loop(), or make it now if there's no queue. Pipelined, those from the httpc task
+// go by way of the decode task, in order with the stream events before them. Results something may be waiting on,
+// a toot's, an auth's or a stream being refused, are never dropped.
+static void callQueue(lyuba_t *lyuba, lyuba_call_t *call, const char *a, const char *b, size_t bLen) {
+    int overflow = lyuba->callsOverflow;
+
+    if (call->type == LYUBA_CALL_TOOT || call->type == LYUBA_CALL_AUTH || !call->ok) {
+        overflow = LYUBA_CALLBACK_KEEP;
+    }
+    if (lyuba->decodes.ring.size > 0 && xTaskGetCurrentTaskHandle() != lyuba->decodeTask) {
+        callPush(&lyuba->decodes, overflow, call, a, b, bLen);
+    } else if (lyuba->calls.ring.size > 0) {
+        callPush(&lyuba->calls, overflow, call, a, b, bLen);
+    } else {
+        callRun(call, a, b);
+    }
+}
+
+// make the callbacks queued when this started, later ones wait for the next lyuba_loop()
+static void callsDrain(lyuba_t *lyuba) {
+    size_t budget = spscq_used(&lyuba->calls.ring);
+    size_t len, freed;
+    lyuba_call_t *call;
+    char *a, *b;
+
+    while (budget > 0 && NULL != (call = (lyuba_call_t *)spscq_peek(&lyuba->calls.ring, &len))) {
+        callStrings(call, &a, &b);
+        callRun(call, a, b);
+        freed = callqPop(&lyuba->calls);
+        budget -= freed < budget ? freed : budget;
+    }
+}
+
+static void callAuth(lyuba_t *lyuba, lyuba_auth_cb_t cb, bool ok, const char *authToken) {
+    lyuba_call_t call;
+
+    memset(&call, 0x00, sizeof(call));
+    call.type = LYUBA_CALL_AUTH;
+    call.ok = ok;
+    call.cb.auth = cb;
+    callQueue(lyuba, &call, authToken, NULL, 0);
+}
+
+static void callToot(lyuba_t *lyuba, lyuba_toot_cb_t cb, bool ok) {
+    lyuba_call_t call;
+
+    memset(&call, 0x00, sizeof(call));
+    call.type = LYUBA_CALL_TOOT;
+    call.ok = ok;
+    call.cb.toot = cb;
+    callQueue(lyuba, &call, NULL, NULL, 0);
+}
+
+static void callStream(lyuba_t *lyuba, lyuba_stream_cb_t cb, bool ok, const char *username, const char *content) {
+    lyuba_call_t call;
+
+    memset(&call, 0x00, sizeof(call));
+    call.type = LYUBA_CALL_STREAM;
+    call.ok = ok;
+    call.cb.stream = cb;
+    callQueue(lyuba, &call, username, content, content != NULL ? strlen(content) : 0);
+}
+
+static void callEvent(lyuba_t *lyuba, lyuba_event_cb_t cb, bool ok, const char *event, const char *data, size_t len) {
+    lyuba_call_t call;
+
+    memset(&call, 0x00, sizeof(call));
+    call.type = LYUBA_CALL_EVENT;
+    call.ok = ok;
+    call.cb.event = cb;
+    callQueue(lyuba, &call, event, data, len);
+}
+
+static void callMultiStream(lyuba_t *lyuba, lyuba_multi_stream_cb_t cb, bool ok, int stream, const char *username, const char *content) {
+    lyuba_call_t call;
+
+    memset(&call, 0x00, sizeof(call));
+    call.type = LYUBA_CALL_MULTI_STREAM;
+    call.ok = ok;
+    call.stream = stream;
+    call.cb.multiStream = cb;
+    callQueue(lyuba, &call, username, content, content != NULL ? strlen(content) : 0);
+}
+
+static void callMultiEvent(lyuba_t *lyuba, lyuba_multi_event_cb_t cb, bool ok, int stream, const char *event, const char *data, size_t len) {
+    lyuba_call_t call;
+
+    memset(&call, 0x00, sizeof(call));
+    call.type = LYUBA_CALL_MULTI_EVENT;
+    call.ok = ok;
+    call.stream = stream;
+    call.cb.multiEvent = cb;
+    callQueue(lyuba, &call, event, data, len);
+}
+
+static void streamEvent(lyuba_stream_cb_t_with_lyuba_t *userdata, const char *event, char *data, size_t len);
+static void multiMessage(lyuba_multi_cb_t_with_lyuba_t *userdata, char *data, size_t len);
+
+// a stream event has been decoded, or dropped, let go of its stream and wake decodeFlush() if it was the last
+static void decodeDone(lyuba_t *lyuba, lyuba_call_t *call) {
+    if (call->type == LYUBA_CALL_DECODE_SSE &&
+        0 == __atomic_sub_fetch(&((lyuba_stream_cb_t_with_lyuba_t *)call->cb.req->userdata)->decoding, 1, __ATOMIC_SEQ_CST) &&
+        __atomic_exchange_n(&lyuba->decodeWaiting, false, __ATOMIC_SEQ_CST)) {
+        xSemaphoreGive(lyuba->decodeDone);
+    }
+    httpc_unpin(call->cb.req);
+}
+
+// on the httpc task, hand a stream event to the decode task, false if not pipelined or it's too big to queue. One
+// that finds the queue full is dropped, or waits for room first, as callsOverflow says.
+static bool decodeQueue(lyuba_t *lyuba, lyuba_call_type_t type, httpc_req_t *req, const char *event, const char *data, size_t len) {
+    lyuba_call_t call;
+
+    if (lyuba->decodes.ring.size == 0) {
+        return false;
+    }
+    if (sizeof(lyuba_call_t) + (event != NULL ? strlen(event) : 0) + len + 2 > lyuba->decodes.ring.size / 2) {
+        lyuba->decodes.stats.dropped++;
+        return false;
+    }
+    memset(&call, 0x00, sizeof(call));
+    call.type = type;
+    call.cb.req = req;
+    httpc_pin(req);
+    if (type == LYUBA_CALL_DECODE_SSE) {
+        __atomic_fetch_add(&((lyuba_stream_cb_t_with_lyuba_t *)req->userdata)->decoding, 1, __ATOMIC_SEQ_CST);
+    }
+    if (!callPush(&lyuba->decodes, lyuba->callsOverflow, &call, event, data, len)) {
+        decodeDone(lyuba, &call);
+    }
+    return true;
+}
+
+// on the httpc task, wait for the decode task to finish with the stream's events, before touching the state it
+// works on. Other streams' events and callbacks on their way through don't hold it up.
+static void decodeFlush(lyuba_stream_cb_t_with_lyuba_t *userdata) {
+    lyuba_t *lyuba = userdata->lyuba;
+
+    while (__atomic_load_n(&userdata->decoding, __ATOMIC_SEQ_CST) > 0) {
+        __atomic_store_n(&lyuba->decodeWaiting, true, __ATOMIC_SEQ_CST);
+        if (0 == __atomic_load_n(&userdata->decoding, __ATOMIC_SEQ_CST)) {
+            break;      // done before waiting was seen
+        }
+        xSemaphoreTake(lyuba->decodeDone, portMAX_DELAY);
+    }
+    __atomic_store_n(&lyuba->decodeWaiting, false, __ATOMIC_SEQ_CST);
+}
+
+static void decodeTaskFunction(void *param) {
+    lyuba_t *lyuba = (lyuba_t *)param;
+    lyuba_call_t *call;
+    size_t len;
+    char *a, *b;
+
+    while (NULL != (call = callqWait(&lyuba->decodes, &len, &lyuba->decodeStop))) {
+        callStrings(call, &a, &b);
+        switch (call->type) {
+            case LYUBA_CALL_DECODE_SSE:
+                streamEvent((lyuba_stream_cb_t_with_lyuba_t *)call->cb.req->userdata, a, b, call->len[1]);
+                decodeDone(lyuba, call);
+                break;
+            case LYUBA_CALL_DECODE_WS:
+                multiMessage((lyuba_multi_cb_t_with_lyuba_t *)call->cb.req->userdata, b, call->len[1]);
+                decodeDone(lyuba, call);
+                break;
+            default:
+                callQueue(lyuba, call, a, b, call->len[1] != LYUBA_CALL_NULL ? call->len[1] : 0);
+                break;
+        }
+        callqPop(&lyuba->decodes);
+    }
+    // lyuba_term(), let go of any streams still waiting
+    while (NULL != (call = (lyuba_call_t *)spscq_peek(&lyuba->decodes.ring, &len))) {
+        if (call->type == LYUBA_CALL_DECODE_SSE || call->type == LYUBA_CALL_DECODE_WS) {
+            decodeDone(lyuba, call);
+        }
+        callqPop(&lyuba->decodes);
+    }
+    __atomic_store_n(&lyuba->decodeStop, false, __ATOMIC_SEQ_CST);
+    vTaskDelete(NULL);
+}
+
+void lyuba_callback_stats(lyuba_t *lyuba, lyuba_callback_stats_t *stats) {
+    memcpy(stats, &lyuba->calls.stats, sizeof(lyuba_callback_stats_t));
+    stats->size = lyuba->calls.ring.size;
+    stats->used = lyuba->calls.ring.size > 0 ? spscq_used(&lyuba->calls.ring) : 0;
+}
+
+void lyuba_decode_stats(lyuba_t *lyuba, lyuba_callback_stats_t *stats) {
+    memcpy(stats, &lyuba->decodes.stats, sizeof(lyuba_callback_stats_t));
+    stats->size = lyuba->decodes.ring.size;
+    stats->used = lyuba->decodes.ring.size > 0 ? spscq_used(&lyuba->decodes.ring) : 0;
+}
 
 void lyuba_term(lyuba_t *lyuba) {
     if (NULL != lyuba) {
+        lyuba_queue_save(lyuba);    // keyed by the host
+        free((void *)lyuba->host);
+        free((void *)lyuba->username);
+        free((void *)lyuba->password);
+        free((void *)lyuba->client_id);
+        free((void *)lyuba->client_secret);
+        free(lyuba->queue);
+        if (NULL != lyuba->decodeTask) {
+            __atomic_store_n(&lyuba->decodeStop, true, __ATOMIC_SEQ_CST);
+            xSemaphoreGive(lyuba->decodes.work);
+            while (__atomic_load_n(&lyuba->decodeStop, __ATOMIC_SEQ_CST)) {
+                delay(1);
+            }
+        }
+        callqTerm(&lyuba->decodes);
+        callqTerm(&lyuba->calls);
+        if (NULL != lyuba->decodeDone) {
+            vSemaphoreDelete(lyuba->decodeDone);
+        }
         free(lyuba);
     }
 }
 
+void lyuba_config_default(lyuba_config_t *cfg) {
+    memset(cfg, 0x00, sizeof(lyuba_config_t));
+    httpc_task_config_default(&cfg->net);
+    cfg->pipelined = false;
+    cfg->decode.priority = LYUBA_DECODE_TASK_PRIORITY;
+    cfg->decode.stackSize = LYUBA_DECODE_TASK_STACK_SIZE;
+    cfg->decode.core = LYUBA_DECODE_TASK_CORE;
+    cfg->decodeQueueSize = LYUBA_DECODE_QUEUE_SIZE;
+    httpc_deadlines_default(&cfg->streams);
+    httpc_deadlines_default(&cfg->toots);
+}
+
 lyuba_t *lyuba_init(const char *host, const char *username, const char *password) {
+    return lyuba_init_config(host, username, password, NULL);
+}
+
+lyuba_t *lyuba_init_config(const char *host, const char *username, const char *password, const lyuba_config_t *cfg) {
     lyuba_t *lyuba = NULL;
 
     preferences_lyuba.begin("lyuba", false);
@@ -52,6 +574,9 @@ lyuba_t *lyuba_init(const char *host, const char *username, const char *password
     Serial.printf("lyuba_init host=%s\r\n", host);
 #endif
 
+    if (NULL != cfg) {
+        httpc_set_task_config(&cfg->net);
+    }
     if (HTTPC_ERR_OK != httpc_init()) {
         Serial.printf("lyuba_init httpc_init\r\n");
         return NULL;
@@ -62,6 +587,19 @@ lyuba_t *lyuba_init(const char *host, const char *username, const char *password
         return NULL;
     }
     memset(lyuba, 0x00, sizeof(lyuba_t));
+    lyuba->callsOverflow = LYUBA_CALLBACK_OVERFLOW;
+    if (NULL != cfg) {
+        lyuba->streamDeadlines = cfg->streams;
+        lyuba->tootDeadlines = cfg->toots;
+    } else {
+        httpc_deadlines_default(&lyuba->streamDeadlines);
+        httpc_deadlines_default(&lyuba->tootDeadlines);
+    }
+    if (LYUBA_CALLBACK_QUEUE_SIZE > 0 && 0 != callqInit(&lyuba->calls, LYUBA_CALLBACK_QUEUE_SIZE, false)) {
+        Serial.printf("lyuba_init out of mem callback queue\r\n");
+        lyuba_term(lyuba);
+        return NULL;
+    }
 
     if (NULL == (lyuba->host = (const char *)strdup(host))) {
         Serial.printf("lyuba_init out of mem host\r\n");
@@ -85,6 +623,20 @@ lyuba_t *lyuba_init(const char *host, const char *username, const char *password
         }
     }
 
+    if (NULL != cfg && cfg->pipelined) {
+        if (0 != callqInit(&lyuba->decodes, cfg->decodeQueueSize, true) || NULL == (lyuba->decodeDone = xSemaphoreCreateBinary())) {
+            Serial.printf("lyuba_init out of mem decode queue\r\n");
+            lyuba_term(lyuba);
+            return NULL;
+        }
+        if (pdPASS != xTaskCreatePinnedToCore(decodeTaskFunction, "lyuba decode", cfg->decode.stackSize, lyuba, cfg->decode.priority, &lyuba->decodeTask, cfg->decode.core)) {
+            Serial.printf("lyuba_init decode task\r\n");
+            lyuba->decodeTask = NULL;
+            lyuba_term(lyuba);
+            return NULL;
+        }
+    }
+
     return lyuba;
 }
 
@@ -97,38 +649,39 @@ static httpc_err_t authTokenPostCb(httpc_err_t err, httpc_req_t *req, int status
     Serial.printf("data='%s'\r\n", data);
 #endif
 
-    if (NULL == (json = cJSON_Parse((const char *)data))) {
+    if (NULL == (json = cJSON_ParseWithArena((const char *)data, &jsonArena))) {
+        cJSON_ArenaReset(&jsonArena);
         Serial.printf("authTokenPostCb: Bad JSON\r\n");
         if (NULL != userdata->authCb) {
-            userdata->authCb(false, NULL);
+            callAuth(userdata->lyuba, userdata->authCb, false, NULL);
         }
-        httpc_close(req);
+        httpc_close(httpc_handle(req));
         return HTTPC_ERR_FAIL;
     } else {
         cJSON *json_access_token;
         if (NULL == (json_access_token = cJSON_GetObjectItem(json, "access_token"))) {
             Serial.printf("authTokenPostCb: missing access_token\r\n");
             if (NULL != userdata->authCb) {
-                userdata->authCb(false, NULL);
+                callAuth(userdata->lyuba, userdata->authCb, false, NULL);
             }
-            cJSON_Delete(json);
-            httpc_close(req);
+            cJSON_ArenaReset(&jsonArena);
+            httpc_close(httpc_handle(req));
             return HTTPC_ERR_FAIL;
         }
         if (!cJSON_IsString(json_access_token)) {
             Serial.printf("authTokenPostCb: bad types in json\r\n");
             if (NULL != userdata->authCb) {
-                userdata->authCb(false, NULL);
+                callAuth(userdata->lyuba, userdata->authCb, false, NULL);
             }
-            cJSON_Delete(json);
-            httpc_close(req);
+            cJSON_ArenaReset(&jsonArena);
+            httpc_close(httpc_handle(req));
             return HTTPC_ERR_FAIL;
         }
 #ifdef LYUBA_DEBUG
         Serial.printf("access_token='%s'\r\n", json_access_token->valuestring);
 #endif
         snprintf(userdata->lyuba->negotiated_bearer_access_token, sizeof(userdata->lyuba->negotiated_bearer_access_token), "Bearer %s", json_access_token->valuestring);
-        cJSON_Delete(json);
+        cJSON_ArenaReset(&jsonArena);
 
         // write new auth data to flash
         char key[512];
@@ -147,15 +700,18 @@ static httpc_err_t authTokenPostCb(httpc_err_t err, httpc_req_t *req, int status
 #ifdef LYUBA_DEBUG
             Serial.printf("calling authCb true '%s'\r\n", userdata->lyuba->negotiated_bearer_access_token);
 #endif
-            userdata->authCb(true, userdata->lyuba->negotiated_bearer_access_token);
+            callAuth(userdata->lyuba, userdata->authCb, true, userdata->lyuba->negotiated_bearer_access_token);
         }
     }
 
     return HTTPC_ERR_OK;
 }
 
+static void queueDrain(lyuba_t *lyuba);
+
 void lyuba_loop(lyuba_t *lyuba) {
     esp_task_wdt_reset();
+    callsDrain(lyuba);
     if (lyuba->authGetToken) {
         lyuba->authGetToken = false;
 
@@ -166,7 +722,7 @@ void lyuba_loop(lyuba_t *lyuba) {
         userdata.authCb = lyuba->authCb;
         userdata.lyuba = lyuba;
 
-        if (NULL == httpc_post(lyuba->host, "/oauth/token", NULL, postBuf, 4096, false, authTokenPostCb, (void *)&userdata, sizeof(lyuba_auth_cb_t_with_lyuba_t))) {
+        if (HTTPC_HANDLE_NONE == httpc_post(lyuba->host, "/oauth/token", NULL, postBuf, 4096, false, authTokenPostCb, (void *)&userdata, sizeof(lyuba_auth_cb_t_with_lyuba_t))) {
             Serial.printf("post err\r\n");
             if (NULL != lyuba->authCb) {
                 lyuba->authCb(false, NULL);
@@ -175,6 +731,7 @@ void lyuba_loop(lyuba_t *lyuba) {
             Serial.printf("post ok\r\n");
         }
     }
+    queueDrain(lyuba);
 
     httpc_loop();
 }
@@ -199,10 +756,10 @@ static httpc_err_t tootPostCb(httpc_err_t err, httpc_req_t *req, int status_code
     lyuba_toot_cb_t_with_lyuba_t *userdata = (lyuba_toot_cb_t_with_lyuba_t *)req->userdata;
 
     if (status_code == 200) {
-        userdata->tootCb(true);
+        callToot(userdata->lyuba, userdata->tootCb, true);
     } else {
         Serial.printf("tootPostCb: status_code=%d\r\n", status_code);
-        userdata->tootCb(false);
+        callToot(userdata->lyuba, userdata->tootCb, false);
     }
     return HTTPC_ERR_OK;
 }
@@ -211,6 +768,7 @@ void lyuba_toot(lyuba_t *lyuba, const char *user_bearer_access_token, const char
     size_t msgLen;
     char *postBuf;
     char *prefix = "status=";
+    httpc_handle_t h;
 
     lyuba_toot_cb_t_with_lyuba_t userdata;
     userdata.tootCb = _tootCb;
@@ -223,17 +781,209 @@ void lyuba_toot(lyuba_t *lyuba, const char *user_bearer_access_token, const char
     }
     
     snprintf(postBuf, msgLen + strlen(prefix) + 1, "%s%s", prefix, msg);
-    if (NULL == httpc_post(lyuba->host, "/api/v1/statuses", user_bearer_access_token, postBuf, 4096, false, tootPostCb, (void *)&userdata, sizeof(lyuba_toot_cb_t_with_lyuba_t))) {
+    if (HTTPC_HANDLE_NONE == (h = httpc_post(lyuba->host, "/api/v1/statuses", user_bearer_access_token, postBuf, 4096, false, tootPostCb, (void *)&userdata, sizeof(lyuba_toot_cb_t_with_lyuba_t)))) {
         Serial.printf("post err\r\n");
         _tootCb(false);
     } else {
+        httpc_set_deadlines(h, &lyuba->tootDeadlines);
         Serial.printf("post ok\r\n");
     }
 
     free(postBuf);
 }
 
-// remove HTML tags from a string
+// the queue's key in Preferences, per host
+static void queueKey(lyuba_t *lyuba, char *key, size_t len) {
+    uint32_t keyCRC = (~crc32_le((uint32_t)~(0xffffffff), (const uint8_t*)lyuba->host, strlen(lyuba->host)))^0xffffffff;
+    snprintf(key, len, "q%08X", keyCRC);
+}
+
+static void queueSave(lyuba_t *lyuba) {
+    char key[16];
+
+    if (!lyuba->queueDirty) {
+        return;
+    }
+    lyuba->queueDirty = false;
+    queueKey(lyuba, key, sizeof(key));
+    if (lyuba->queueLen == 0) {
+        if (lyuba->queueSaved) {
+            preferences_lyuba.remove(key);
+        }
+        lyuba->queueSaved = false;
+    } else if (lyuba->queueLen != preferences_lyuba.putBytes(key, lyuba->queue, lyuba->queueLen)) {
+        Serial.printf("toot queue not saved\r\n");
+    } else {
+        lyuba->queueSaved = true;
+    }
+}
+
+// the queue has changed, it's written by queueDrain() once the change has waited LYUBA_QUEUE_SAVE_MS
+static void queueChanged(lyuba_t *lyuba) {
+    if (!lyuba->queuePersist) {
+        return;
+    }
+    if (!lyuba->queueDirty) {
+        lyuba->queueDirty = true;
+        lyuba->queueDirtySince = millis();
+    }
+    if (LYUBA_QUEUE_SAVE_MS == 0) {
+        queueSave(lyuba);
+    }
+}
+
+// runs on the httpc task, lyuba_loop() picks the result up
+static httpc_err_t queuePostCb(httpc_err_t err, httpc_req_t *req, int status_code, const char *data, size_t len) {
+    lyuba_t *lyuba = *(lyuba_t **)req->userdata;
+
+    if (err == HTTPC_ERR_FAIL) {
+        lyuba->queueResult = -1;
+    } else if (NULL == data) {  // the end of the response, its body isn't needed
+        lyuba->queueResult = status_code > 0 ? status_code : -1;
+    }
+    return HTTPC_ERR_OK;
+}
+
+// post the oldest queued toot when it's due, and deal with the outcome of the last post
+static void queueDrain(lyuba_t *lyuba) {
+    unsigned long now = millis();
+    httpc_handle_t h;
+    size_t headLen;
+    char *postBuf;
+
+    if (NULL == lyuba->queue) {
+        return;
+    }
+    // once it's empty the saved copy is only toots already posted, drop it straight away
+    if (lyuba->queueDirty && (lyuba->queueLen == 0 || now - lyuba->queueDirtySince >= LYUBA_QUEUE_SAVE_MS)) {
+        queueSave(lyuba);
+    }
+    if (lyuba->queueSending) {
+        int status = lyuba->queueResult;
+        if (status == 0) {
+            return;
+        }
+        lyuba->queueSending = false;
+        if (status == 200 || (status >= 400 && status < 500 && status != 401 && status != 403 && status != 408 && status != 429)) {
+            // posted, or refused as it stands (e.g. 422, too long), either way it's done with
+            if (status != 200) {
+                Serial.printf("queued toot refused, status=%d\r\n", status);
+            }
+            headLen = strlen(lyuba->queue) + 1;
+            memmove(lyuba->queue, lyuba->queue + headLen, lyuba->queueLen - headLen);
+            lyuba->queueLen -= headLen;
+            queueChanged(lyuba);
+            lyuba->queueRetryMs = 0;
+            lyuba->queueNextAt = now + lyuba->queueIntervalMs;
+            if (NULL != lyuba->queueCb) {
+                lyuba->queueCb(status == 200);
+            }
+        } else {
+            // offline, server trouble, rate limited or the token needs renewing, try again later
+            if (lyuba->queueRetryMs == 0) {
+                lyuba->queueRetryMs = lyuba->queueIntervalMs > 1000 ? lyuba->queueIntervalMs : 1000;
+            } else if (lyuba->queueRetryMs < LYUBA_QUEUE_RETRY_MAX_MS / 2) {
+                lyuba->queueRetryMs *= 2;
+            } else {
+                lyuba->queueRetryMs = LYUBA_QUEUE_RETRY_MAX_MS;
+            }
+            Serial.printf("queued toot failed, status=%d, retry in %lu ms\r\n", status, lyuba->queueRetryMs);
+            lyuba->queueNextAt = now + lyuba->queueRetryMs;
+        }
+    }
+    if (lyuba->queueLen == 0 || (long)(now - lyuba->queueNextAt) < 0) {
+        return;
+    }
+    headLen = strlen(lyuba->queue) + 1;
+    if (headLen == lyuba->queueLen && lyuba->queueRetryMs == 0 && now - lyuba->queueTailSince < lyuba->queueCoalesceMs) {
+        return;     // still gathering toots into it
+    }
+    if (NULL == (postBuf = (char *)malloc(headLen + 7))) {
+        return;
+    }
+    snprintf(postBuf, headLen + 7, "status=%s", lyuba->queue);
+    lyuba->queueResult = 0;
+    lyuba->queueSending = true;
+    if (HTTPC_HANDLE_NONE == (h = httpc_post(lyuba->host, "/api/v1/statuses", lyuba->queueAuth[0] != '\0' ? lyuba->queueAuth : NULL, postBuf, 0, false, queuePostCb, (void *)&lyuba, sizeof(lyuba)))) {
+        lyuba->queueResult = -1;
+    } else {
+        httpc_set_deadlines(h, &lyuba->tootDeadlines);
+    }
+    free(postBuf);
+}
+
+void lyuba_queue_start(lyuba_t *lyuba, const char *authToken, unsigned long intervalMs, unsigned long coalesceMs, bool persist, lyuba_toot_cb_t cb) {
+    char key[16];
+    size_t len;
+
+    if (NULL == lyuba->queue && NULL == (lyuba->queue = (char *)malloc(LYUBA_QUEUE_SIZE))) {
+        Serial.printf("toot queue out of mem\r\n");
+        return;
+    }
+    lyuba->queueAuth[0] = '\0';
+    if (NULL != authToken && strlen(authToken) < sizeof(lyuba->queueAuth)) {
+        strcpy(lyuba->queueAuth, authToken);
+    }
+    lyuba->queueIntervalMs = intervalMs;
+    lyuba->queueCoalesceMs = coalesceMs;
+    lyuba->queuePersist = persist;
+    lyuba->queueCb = cb;
+    lyuba->queueRetryMs = 0;    // a new token, say, so try straight away
+    lyuba->queueNextAt = millis();
+    if (persist && lyuba->queueLen == 0) {
+        queueKey(lyuba, key, sizeof(key));
+        len = preferences_lyuba.getBytesLength(key);
+        if (len > 0 && len <= LYUBA_QUEUE_SIZE && len == preferences_lyuba.getBytes(key, lyuba->queue, len) && lyuba->queue[len - 1] == '\0') {
+            lyuba->queueLen = len;
+            lyuba->queueTailSince = millis() - coalesceMs;  // saved toots are ready to go
+            lyuba->queueSaved = true;
+        }
+    }
+}
+
+bool lyuba_queue_toot(lyuba_t *lyuba, const char *msg) {
+    unsigned long now = millis();
+    size_t msgLen = strlen(msg);
+
+    if (NULL == lyuba->queue || msgLen == 0 || msgLen > LYUBA_TOOT_MAX_LEN) {
+        return false;
+    }
+    // add it to the newest toot if that's still gathering, or while offline to any that isn't being sent
+    if (lyuba->queueCoalesceMs > 0 && lyuba->queueLen > 0 && (lyuba->queueRetryMs > 0 || now - lyuba->queueTailSince < lyuba->queueCoalesceMs)) {
+        size_t tail = lyuba->queueLen - 1;
+        while (tail > 0 && lyuba->queue[tail - 1] != '\0') {
+            tail--;
+        }
+        if (!(tail == 0 && lyuba->queueSending) && (lyuba->queueLen - 1 - tail) + 1 + msgLen <= LYUBA_TOOT_MAX_LEN &&
+            lyuba->queueLen + msgLen + 1 <= LYUBA_QUEUE_SIZE) {
+            lyuba->queue[lyuba->queueLen - 1] = '\n';
+            memcpy(lyuba->queue + lyuba->queueLen, msg, msgLen + 1);
+            lyuba->queueLen += msgLen + 1;
+            queueChanged(lyuba);
+            return true;
+        }
+    }
+    if (lyuba->queueLen + msgLen + 1 > LYUBA_QUEUE_SIZE) {
+        return false;
+    }
+    memcpy(lyuba->queue + lyuba->queueLen, msg, msgLen + 1);
+    lyuba->queueLen += msgLen + 1;
+    lyuba->queueTailSince = now;
+    queueChanged(lyuba);
+    return true;
+}
+
+size_t lyuba_queue_pending(lyuba_t *lyuba) {
+    return lyuba->queueLen;
+}
+
+void lyuba_queue_save(lyuba_t *lyuba) {
+    if (NULL != lyuba->queue) {
+        queueSave(lyuba);
+    }
+}
+
+// remove HTML tags from a string, in and out may be the same buffer
 static bool stripHTML(const char *in, char *out, size_t outlen) {
     bool inTag = false;
     char c;
@@ -260,72 +1010,505 @@ static bool stripHTML(const char *in, char *out, size_t outlen) {
     return true;
 }
 
-static httpc_err_t streamLineCb(httpc_err_t err, httpc_req_t *req, int status_code, const char *line, size_t len) {
-    lyuba_stream_cb_t_with_lyuba_t *userdata = (lyuba_stream_cb_t_with_lyuba_t *)req->userdata;
+static unsigned streamEventType(const char *event) {
+    for (size_t i=0;i<sizeof(streamEventTypes)/sizeof(streamEventTypes[0]);i++) {
+        if (0 == strcmp(event, streamEventTypes[i].name)) {
+            return streamEventTypes[i].type;
+        }
+    }
+    return LYUBA_EVENT_OTHER;
+}
 
-    if (err == HTTPC_ERR_OK) {
-        if (NULL != line) {
-#ifdef LYUBA_DEBUG
-//            Serial.printf("streamLineCb '%s'\r\n", line);
-#endif
-            cJSON *json;
-            if (0==strncmp(line, "data:", 5)) {
-                if (NULL != (json = cJSON_Parse(line + 5))) {
-                    cJSON *json_content, *json_account, *json_account_username;
-                    if (NULL != (json_content = cJSON_GetObjectItem(json, "content"))) {
-                        if (NULL != (json_account = cJSON_GetObjectItem(json, "account"))) {
-                            if (NULL != (json_account_username = cJSON_GetObjectItem(json_account, "username"))) {
+// pull the id, author and text out of a status, returns false if it's not one
+static bool streamStatus(char *data, size_t len, const char **id, const char **username, const char **content) {
+    // only content and account.username are wanted, so pull them out in one pass rather than building a cJSON tree,
+    // the data is ours to modify so they're unescaped where they lie and handed on without copying
+    jsonscan_field_t fields[] = {
+        {"content"},
+        {"account.username"},
+        {"id"},
+    };
+    if (0 != jsonscan_extract_insitu(data, len, fields, sizeof(fields)/sizeof(fields[0]))) {
+        Serial.printf("json parse failure, %d bytes\r\n", (int)len);
+        return false;
+    }
+    if (!fields[0].found || !fields[1].found) {
+        return false;
+    }
 #ifdef LYUBA_DEBUG
-//                                Serial.printf("username='%s' content='%s'\r\n", json_account_username->valuestring, json_content->valuestring);
+//    Serial.printf("username='%s' content='%s'\r\n", fields[1].out, fields[0].out);
 #endif
-                                if (userdata->streamCb != NULL) {
-                                    // strip html from content
-                                    char *stripBuf;
-                                    size_t stripBufLen = strlen(json_content->valuestring)+1;
-                                    if (NULL == (stripBuf = (char*)malloc(stripBufLen))) {
-                                        Serial.printf("Out of mem HTML strip");
-                                    } else {
-                                        stripHTML(json_content->valuestring, stripBuf, stripBufLen);
-                                        userdata->streamCb(true, json_account_username->valuestring, stripBuf);
-                                        free(stripBuf);
-                                    }
-                                }
-                            }
-                        }
-                    }
-                    cJSON_Delete(json);
-                } else {
-                    Serial.printf("json parse failure '%s'\r\n", line+5);
-                }
+    // strip html from content, in place
+    stripHTML(fields[0].out, fields[0].out, fields[0].len + 1);
+    *username = fields[1].out;
+    *content = fields[0].out;
+    *id = fields[2].found ? fields[2].out : "";
+    return true;
+}
+
+// ids are snowflakes, decimal (or base62 on some servers) and increasing, so longer is newer
+static int statusIdCmp(const char *a, const char *b) {
+    size_t la = strlen(a), lb = strlen(b);
+    if (la != lb) {
+        return la < lb ? -1 : 1;
+    }
+    return strcmp(a, b);
+}
+
+static void copyId(char *dst, const char *id) {
+    if (strlen(id) < LYUBA_STATUS_ID_LEN) {
+        strcpy(dst, id);
+    }
+}
+
+// Statuses are delivered once, whether they come live or from a timeline around a reconnect. Live ones are
+// always new (ids follow creation time, a late federated status can be older than the last) apart from any the
+// tail has already passed on. A backfill fetches those after lastId, and a tail those in its gap, or after it
+// until the live stream's first.
+static void streamDeliver(lyuba_stream_cb_t_with_lyuba_t *userdata, const char *id, const char *username, const char *content, lyuba_status_src_t src, lyuba_stream_gap_t *gap) {
+    lyuba_stream_gap_t *current = &userdata->gaps[userdata->ends % LYUBA_STREAM_GAPS];
+    bool fresh = true;
+
+    switch (src) {
+        case LYUBA_STATUS_LIVE:
+            if (current->after[0] != '\0' && current->before[0] == '\0') {
+                copyId(current->before, id);
             }
+            fresh = id[0] == '\0' || current->tailMax[0] == '\0' || statusIdCmp(id, current->after) <= 0 || statusIdCmp(id, current->tailMax) > 0;
+            break;
+        case LYUBA_STATUS_BACKFILL:
+            fresh = statusIdCmp(id, userdata->lastId) > 0;
+            break;
+        case LYUBA_STATUS_TAIL:
+            fresh = gap != NULL && statusIdCmp(id, gap->after) > 0 &&
+                (gap->before[0] != '\0' ? statusIdCmp(id, gap->before) < 0 : gap == current);
+            if (fresh && gap->before[0] == '\0' && statusIdCmp(id, gap->tailMax) > 0) {
+                copyId(gap->tailMax, id);
+            }
+            break;
+    }
+    if (!fresh) {
+        return;
+    }
+    if (statusIdCmp(id, userdata->lastId) > 0) {
+        copyId(userdata->lastId, id);
+    }
+    callStream(userdata->lyuba, userdata->streamCb, true, username, content);
+}
 
+// the gap a tail fetched after the stream's ends-th end is for, NULL if it's no longer tracked
+static lyuba_stream_gap_t *streamGap(lyuba_stream_cb_t_with_lyuba_t *userdata, unsigned ends) {
+    return userdata->ends - ends < LYUBA_STREAM_GAPS ? &userdata->gaps[ends % LYUBA_STREAM_GAPS] : NULL;
+}
+
+// the REST timeline for a stream named as for lyuba_stream, e.g. "hashtag?tag=cheerlights" to "/api/v1/timelines/tag/cheerlights"
+static bool streamTimeline(const char *tag, char *out, size_t outLen) {
+    const char *q = strchr(tag, '?');
+    size_t nameLen = q != NULL ? (size_t)(q - tag) : strlen(tag);
+
+    for (size_t i=0;i<sizeof(streamTimelines)/sizeof(streamTimelines[0]);i++) {
+        const char *value = "";
+        size_t valueLen = 0;
+        int len;
+        if (strlen(streamTimelines[i].stream) != nameLen || 0 != strncmp(tag, streamTimelines[i].stream, nameLen)) {
+            continue;
+        }
+        if (streamTimelines[i].param != NULL) {
+            size_t keyLen = strlen(streamTimelines[i].param);
+            if (q == NULL || 0 != strncmp(q + 1, streamTimelines[i].param, keyLen) || q[1 + keyLen] != '=') {
+                return false;
+            }
+            value = q + 2 + keyLen;
+            valueLen = strcspn(value, "&");
+        }
+        len = snprintf(out, outLen, "%s%.*s%s%s", streamTimelines[i].timeline, (int)valueLen, value,
+            streamTimelines[i].query != NULL ? "?" : "", streamTimelines[i].query != NULL ? streamTimelines[i].query : "");
+        return len > 0 && (size_t)len < outLen;
+    }
+    return false;
+}
+
+static httpc_err_t streamLineCb(httpc_err_t err, httpc_req_t *req, int status_code, const char *line, size_t len);
+
+static void streamEvent(lyuba_stream_cb_t_with_lyuba_t *userdata, const char *event, char *data, size_t len) {
+    unsigned type = streamEventType(event);
+    const char *id, *username, *content;
+
+    if (0 == (type & userdata->events)) {
+        return;     // not subscribed, don't even parse it
+    }
+    if (type == LYUBA_EVENT_UPDATE || type == LYUBA_EVENT_STATUS_UPDATE) {
+        if (userdata->streamCb != NULL && streamStatus(data, len, &id, &username, &content)) {
+            if (type == LYUBA_EVENT_UPDATE) {
+                streamDeliver(userdata, id, username, content, LYUBA_STATUS_LIVE, NULL);
+            } else {
+                callStream(userdata->lyuba, userdata->streamCb, true, username, content);    // an edit of an older status
+            }
+        }
+    } else if (userdata->eventCb != NULL) {
+        callEvent(userdata->lyuba, userdata->eventCb, true, event, data, len);
+    }
+}
+
+static httpc_err_t streamBackfillCb(httpc_err_t err, httpc_req_t *req, int status_code, const char *data, size_t len);
+
+// fetch the page of the stream's timeline after cursor
+static bool streamBackfill(httpc_req_t *stream, const char *cursor, bool tail, unsigned ends, int limit) {
+    lyuba_stream_cb_t_with_lyuba_t *userdata = (lyuba_stream_cb_t_with_lyuba_t *)stream->userdata;
+    lyuba_backfill_t backfill;
+    char path[256];
+
+    memset(&backfill, 0x00, sizeof(backfill));
+    backfill.stream = httpc_handle(stream);
+    copyId(backfill.cursor, cursor);
+    backfill.tail = tail;
+    backfill.ends = ends;
+    backfill.limit = limit;
+    // min_id pages forward from cursor, so only one page of the gap is ever held
+    snprintf(path, sizeof(path), "%s%cmin_id=%s&limit=%d", userdata->timeline, NULL != strchr(userdata->timeline, '?') ? '&' : '?', cursor, limit);
+    if (HTTPC_HANDLE_NONE == httpc_get(userdata->lyuba->host, path, userdata->authToken[0] != '\0' ? userdata->authToken : NULL, LYUBA_BACKFILL_BUF, false, streamBackfillCb, (void *)&backfill, sizeof(backfill), false)) {
+        Serial.printf("stream backfill get err\r\n");
+        return false;
+    }
+    return true;
+}
+
+// pass on a page of statuses, which comes newest first. Returns the number in the page, or -1 if it's unreadable.
+static int streamBackfillPage(lyuba_stream_cb_t_with_lyuba_t *userdata, lyuba_backfill_t *backfill, char *json, size_t len) {
+    char paths[LYUBA_BACKFILL_PAGE][3][24];
+    jsonscan_field_t fields[LYUBA_BACKFILL_PAGE * 3];
+    int i, n = 0;
+
+    memset(fields, 0x00, sizeof(fields));
+    for (i=0;i<LYUBA_BACKFILL_PAGE;i++) {
+        snprintf(paths[i][0], sizeof(paths[i][0]), "%d.id", i);
+        snprintf(paths[i][1], sizeof(paths[i][1]), "%d.account.username", i);
+        snprintf(paths[i][2], sizeof(paths[i][2]), "%d.content", i);
+        for (int j=0;j<3;j++) {
+            fields[i * 3 + j].path = paths[i][j];
+        }
+    }
+    if (0 != jsonscan_extract_insitu(json, len, fields, sizeof(fields)/sizeof(fields[0]))) {
+        Serial.printf("backfill json parse failure, %d bytes\r\n", (int)len);
+        return -1;
+    }
+    for (i=LYUBA_BACKFILL_PAGE-1;i>=0;i--) {
+        jsonscan_field_t *f = &fields[i * 3];
+        if (!f[0].found) {
+            continue;
+        }
+        n++;
+        if (f[1].found && f[2].found) {
+            stripHTML(f[2].out, f[2].out, f[2].len + 1);
+            if (backfill->tail) {
+                streamDeliver(userdata, f[0].out, f[1].out, f[2].out, LYUBA_STATUS_TAIL, streamGap(userdata, backfill->ends));
+            } else {
+                streamDeliver(userdata, f[0].out, f[1].out, f[2].out, LYUBA_STATUS_BACKFILL, NULL);
+            }
         }
     }
+    if (fields[0].found) {
+        copyId(backfill->cursor, fields[0].out);
+    }
+    return n;
+}
+
+static httpc_err_t streamBackfillCb(httpc_err_t err, httpc_req_t *req, int status_code, const char *data, size_t len) {
+    lyuba_backfill_t *backfill = (lyuba_backfill_t *)req->userdata;
+    lyuba_stream_cb_t_with_lyuba_t *userdata;
+    httpc_req_t *stream;
+    lyuba_stream_gap_t *gap;
+    bool more;
+    int n = -1;
+
+    // once only, a page too big for the buffer fails and then finishes. The stream may have been closed meanwhile.
+    if (backfill->done || !httpc_is_open(backfill->stream) || NULL == (stream = httpc_lookup(backfill->stream))) {
+        return HTTPC_ERR_OK;
+    }
+    backfill->done = true;
+    userdata = (lyuba_stream_cb_t_with_lyuba_t *)stream->userdata;
+    decodeFlush(userdata);   // delivered statuses are the decode task's until it's done with them
+    gap = backfill->tail ? streamGap(userdata, backfill->ends) : NULL;
+    if (err == HTTPC_ERR_FAIL && status_code == 200 && backfill->limit > 1 && (!backfill->tail || gap != NULL) &&
+        streamBackfill(stream, backfill->cursor, backfill->tail, backfill->ends, backfill->limit / 2)) {
+        return HTTPC_ERR_OK;    // didn't fit, try fewer
+    }
+    if (err == HTTPC_ERR_OK && status_code == 200 && data != NULL) {
+        n = streamBackfillPage(userdata, backfill, (char *)data, len);
+    }
+    more = n == backfill->limit;
+    if (backfill->tail) {
+        // a tail only reaches as far as the live stream's first status. If none came before the stream ended
+        // again, everything after is the next backfill's.
+        more = more && gap != NULL && (gap->before[0] != '\0' ? statusIdCmp(backfill->cursor, gap->before) < 0 : backfill->ends == userdata->ends);
+    }
+    if (more && streamBackfill(stream, backfill->cursor, backfill->tail, backfill->ends, backfill->limit)) {
+        return HTTPC_ERR_OK;
+    }
+    if (n < 0) {
+        Serial.printf("stream backfill failed, status=%d\r\n", status_code);
+    }
+    if (!backfill->tail) {
+        // caught up, reconnect. Statuses posted while it does are fetched once it's back.
+        gap = &userdata->gaps[userdata->ends % LYUBA_STREAM_GAPS];
+        strcpy(gap->after, userdata->lastId);
+        userdata->tailPending = true;
+        httpc_resume(backfill->stream);
+    }
     return HTTPC_ERR_OK;
 }
 
+static httpc_err_t streamLineCb(httpc_err_t err, httpc_req_t *req, int status_code, const char *line, size_t len) {
+    lyuba_stream_cb_t_with_lyuba_t *userdata = (lyuba_stream_cb_t_with_lyuba_t *)req->userdata;
+
+    if (err != HTTPC_ERR_OK || NULL == line) {
+        // lines lost, the response ended or the connection failed (a resumed stream starts afresh)
+        sse_reset(&userdata->sse);
+        decodeFlush(userdata);
+        if (err == HTTPC_ERR_OK && status_code != 200 && !httpc_status_retryable(status_code)) {
+            Serial.printf("stream refused, status=%d\r\n", status_code);   // e.g. 401, it won't be retried
+            if (userdata->streamCb != NULL) {
+                callStream(userdata->lyuba, userdata->streamCb, false, NULL, NULL);
+            }
+            if (userdata->eventCb != NULL) {
+                callEvent(userdata->lyuba, userdata->eventCb, false, NULL, NULL, 0);
+            }
+            return HTTPC_ERR_OK;
+        }
+        if (err == HTTPC_ERR_OK && status_code == 200 && userdata->lastId[0] != '\0' && userdata->timeline[0] != '\0' &&
+            userdata->streamCb != NULL && 0 != (userdata->events & LYUBA_EVENT_UPDATE)) {
+            // it's about to reconnect, first catch up on what was missed
+            userdata->ends++;
+            memset(&userdata->gaps[userdata->ends % LYUBA_STREAM_GAPS], 0x00, sizeof(lyuba_stream_gap_t));
+            userdata->tailPending = false;
+            if (streamBackfill(req, userdata->lastId, false, userdata->ends, LYUBA_BACKFILL_PAGE)) {
+                return HTTPC_ERR_HOLD;
+            }
+        }
+        if (err == HTTPC_ERR_FAIL && !userdata->tailPending && userdata->lastId[0] != '\0' && userdata->timeline[0] != '\0' &&
+            userdata->streamCb != NULL && 0 != (userdata->events & LYUBA_EVENT_UPDATE)) {
+            // stalled, WiFi lost or some other transport error, and it's retried after its backoff (or lines were lost
+            // and it carries on). Either way what was missed is fetched as a tail once the next line arrives.
+            lyuba_stream_gap_t *gap = &userdata->gaps[++userdata->ends % LYUBA_STREAM_GAPS];
+            memset(gap, 0x00, sizeof(lyuba_stream_gap_t));
+            strcpy(gap->after, userdata->lastId);
+            userdata->tailPending = true;
+        }
+        return HTTPC_ERR_OK;
+    }
+    if (userdata->tailPending) {
+        // reconnected after a backfill or a failure, now fetch anything posted in between
+        lyuba_stream_gap_t *gap = &userdata->gaps[userdata->ends % LYUBA_STREAM_GAPS];
+        decodeFlush(userdata);
+        userdata->tailPending = false;
+        if (!streamBackfill(req, gap->after, true, userdata->ends, LYUBA_BACKFILL_PAGE)) {
+            memset(gap, 0x00, sizeof(lyuba_stream_gap_t));
+        }
+    }
+#ifdef LYUBA_DEBUG
+//    Serial.printf("streamLineCb '%s'\r\n", line);
+#endif
+    if (SSE_LINE_EVENT == sse_parse_line(&userdata->sse, httpc_kept_lines(req), (char *)line, len) &&
+        0 != (streamEventType(sse_event_type(&userdata->sse)) & userdata->events) &&
+        !decodeQueue(userdata->lyuba, LYUBA_CALL_DECODE_SSE, req, sse_event_type(&userdata->sse), userdata->sse.data, userdata->sse.dataLen)) {
+        decodeFlush(userdata);
+        streamEvent(userdata, sse_event_type(&userdata->sse), userdata->sse.data, userdata->sse.dataLen);
+    }
+    // an event's data lines are left in the linebuffer until the blank line that ends it
+    return sse_holding(&userdata->sse) ? HTTPC_ERR_KEEP : HTTPC_ERR_OK;
+}
+
 void lyuba_close(lyuba_t *lyuba, lyuba_conn_t conn) {
-    httpc_req_t *req = conn;    // this works as same type, will break if/when lyuba_conn_t becomes a struct
-    httpc_close(req);
+    httpc_close(conn);
+}
+
+httpc_err_t lyuba_stream_stats(lyuba_t *lyuba, lyuba_conn_t conn, httpc_reconnect_stats_t *stats) {
+    return httpc_get_reconnect_stats(conn, stats);
 }
 
 lyuba_conn_t lyuba_stream(lyuba_t *lyuba, const char *authToken, const char *tag, lyuba_stream_cb_t cb) {
+    return lyuba_stream_events(lyuba, authToken, tag, LYUBA_EVENT_UPDATE, cb, NULL);
+}
+
+lyuba_conn_t lyuba_stream_events(lyuba_t *lyuba, const char *authToken, const char *tag, unsigned events, lyuba_stream_cb_t streamCb, lyuba_event_cb_t eventCb) {
     char path[512];
     lyuba_stream_cb_t_with_lyuba_t userdata;
-    httpc_req_t *req;
+    httpc_handle_t h;
 
+    memset(&userdata, 0x00, sizeof(userdata));
     userdata.lyuba = lyuba;
-    userdata.streamCb = cb;
+    userdata.streamCb = streamCb;
+    userdata.eventCb = eventCb;
+    userdata.events = events;
+    sse_init(&userdata.sse);
+    if (!streamTimeline(tag, userdata.timeline, sizeof(userdata.timeline))) {
+        userdata.timeline[0] = '\0';     // no backfill
+    }
+    if (authToken != NULL && strlen(authToken) < sizeof(userdata.authToken)) {
+        strcpy(userdata.authToken, authToken);
+    } else if (authToken != NULL) {
+        userdata.timeline[0] = '\0';
+    }
 
     snprintf(path, sizeof(path), "/api/v1/streaming/%s", tag);
 
-    if (NULL == (req = httpc_get(lyuba->host, path, authToken, 16384, true, streamLineCb, (void *)&userdata, sizeof(lyuba_stream_cb_t_with_lyuba_t), true))) {
+    if (HTTPC_HANDLE_NONE == (h = httpc_get(lyuba->host, path, authToken, 16384, true, streamLineCb, (void *)&userdata, sizeof(lyuba_stream_cb_t_with_lyuba_t), true))) {
         Serial.printf("stream get err\r\n");
-        cb(false, NULL, NULL);
+        if (streamCb != NULL) {
+            streamCb(false, NULL, NULL);
+        }
+        if (eventCb != NULL) {
+            eventCb(false, NULL, NULL, 0);
+        }
     } else {
         Serial.printf("stream get ok\r\n");
+        httpc_set_deadlines(h, &lyuba->streamDeadlines);
+    }
+    return h;
+}
+
+// send the subscriptions, again each time the websocket reconnects
+static void multiSubscribe(httpc_req_t *req, lyuba_multi_cb_t_with_lyuba_t *userdata) {
+    char msg[160];
+    for (int i=0;i<userdata->nstreams;i++) {
+        lyuba_ws_stream_t *st = &userdata->streams[i];
+        int len;
+        if (st->paramKey[0] != '\0') {
+            len = snprintf(msg, sizeof(msg), "{\"type\":\"subscribe\",\"stream\":\"%s\",\"%s\":\"%s\"}", st->name, st->paramKey, st->param);
+        } else {
+            len = snprintf(msg, sizeof(msg), "{\"type\":\"subscribe\",\"stream\":\"%s\"}", st->name);
+        }
+        if (HTTPC_ERR_OK != httpc_ws_send(httpc_handle(req), msg, len)) {
+            Serial.printf("subscribe %s failed\r\n", st->name);
+        }
+    }
+}
+
+// a message that isn't an open or an end, routed to the stream it's for
+static void multiMessage(lyuba_multi_cb_t_with_lyuba_t *userdata, char *data, size_t len) {
+    const char *id, *username, *content;
+    unsigned type;
+    int i;
+
+    // {"stream":["hashtag","cheerlights"],"event":"update","payload":"{...status JSON as a string...}"}
+    jsonscan_field_t fields[] = {
+        {"stream.0"},
+        {"stream.1"},
+        {"event"},
+        {"payload"},
+    };
+    if (0 != jsonscan_extract_insitu(data, len, fields, sizeof(fields)/sizeof(fields[0])) || !fields[0].found || !fields[2].found) {
+#ifdef LYUBA_DEBUG
+        Serial.printf("multiMsgCb ignoring '%s'\r\n", data);
+#endif
+        return;
+    }
+    type = streamEventType(fields[2].out);
+    if (0 == (type & userdata->events)) {
+        return;     // not subscribed, the payload isn't parsed
+    }
+    for (i=0;i<userdata->nstreams;i++) {
+        lyuba_ws_stream_t *st = &userdata->streams[i];
+        if (0 == strcmp(st->name, fields[0].out) &&
+            (st->paramKey[0] == '\0' ? !fields[1].found : (fields[1].found && 0 == strcasecmp(st->param, fields[1].out)))) {
+            break;
+        }
+    }
+    if (i == userdata->nstreams) {
+        return;
+    }
+    if (type == LYUBA_EVENT_UPDATE || type == LYUBA_EVENT_STATUS_UPDATE) {
+        if (userdata->streamCb != NULL && fields[3].found && streamStatus(fields[3].out, fields[3].len, &id, &username, &content)) {
+            callMultiStream(userdata->lyuba, userdata->streamCb, true, i, username, content);
+        }
+    } else if (userdata->eventCb != NULL) {
+        callMultiEvent(userdata->lyuba, userdata->eventCb, true, i, fields[2].out, fields[3].found ? fields[3].out : "", fields[3].len);
+    }
+}
+
+static httpc_err_t multiMsgCb(httpc_err_t err, httpc_req_t *req, int status_code, const char *data, size_t len) {
+    lyuba_multi_cb_t_with_lyuba_t *userdata = (lyuba_multi_cb_t_with_lyuba_t *)req->userdata;
+
+    if (err == HTTPC_ERR_OPEN) {
+        multiSubscribe(req, userdata);
+        return HTTPC_ERR_OK;
+    }
+    if (err != HTTPC_ERR_OK || NULL == data) {
+        if (err == HTTPC_ERR_OK && status_code != 101 && !httpc_status_retryable(status_code)) {    // refused, it won't be retried
+            Serial.printf("stream refused, status=%d\r\n", status_code);
+            if (userdata->streamCb != NULL) {
+                callMultiStream(userdata->lyuba, userdata->streamCb, false, -1, NULL, NULL);
+            }
+            if (userdata->eventCb != NULL) {
+                callMultiEvent(userdata->lyuba, userdata->eventCb, false, -1, NULL, NULL, 0);
+            }
+        }
+        return HTTPC_ERR_OK;
+    }
+    if (!decodeQueue(userdata->lyuba, LYUBA_CALL_DECODE_WS, req, NULL, data, len)) {
+        multiMessage(userdata, (char *)data, len);
+    }
+    return HTTPC_ERR_OK;
+}
+
+// "hashtag/local?tag=cheerlights" as used in streaming API paths, to its websocket stream name and parameter
+static bool multiParseStream(const char *spec, lyuba_ws_stream_t *st) {
+    const char *q = strchr(spec, '?');
+    size_t nameLen = q != NULL ? (size_t)(q - spec) : strlen(spec);
+    const char *eq;
+
+    memset(st, 0x00, sizeof(lyuba_ws_stream_t));
+    if (nameLen == 0 || nameLen >= sizeof(st->name)) {
+        return false;
+    }
+    for (size_t i=0;i<nameLen;i++) {
+        st->name[i] = spec[i] == '/' ? ':' : spec[i];
+    }
+    if (q != NULL) {
+        q++;
+        if (NULL == (eq = strchr(q, '=')) || (size_t)(eq - q) >= sizeof(st->paramKey) || strlen(eq + 1) >= sizeof(st->param)) {
+            return false;
+        }
+        memcpy(st->paramKey, q, eq - q);
+        strcpy(st->param, eq + 1);
+    }
+    // they go into JSON unescaped
+    return NULL == strpbrk(st->name, "\"\\") && NULL == strpbrk(st->paramKey, "\"\\") && NULL == strpbrk(st->param, "\"\\");
+}
+
+lyuba_conn_t lyuba_stream_multi(lyuba_t *lyuba, const char *authToken, const char *const *streams, int nstreams, unsigned events, lyuba_multi_stream_cb_t streamCb, lyuba_multi_event_cb_t eventCb) {
+    lyuba_multi_cb_t_with_lyuba_t userdata;
+    httpc_handle_t h = HTTPC_HANDLE_NONE;
+    int i;
+
+    memset(&userdata, 0x00, sizeof(userdata));
+    userdata.lyuba = lyuba;
+    userdata.streamCb = streamCb;
+    userdata.eventCb = eventCb;
+    userdata.events = events;
+    userdata.nstreams = nstreams;
+    for (i=0;i<nstreams && i<LYUBA_MAX_STREAMS;i++) {
+        if (!multiParseStream(streams[i], &userdata.streams[i])) {
+            break;
+        }
+    }
+    if (nstreams < 1 || i != nstreams) {
+        Serial.printf("stream multi bad streams\r\n");
+    } else if (HTTPC_HANDLE_NONE == (h = httpc_ws(lyuba->host, "/api/v1/streaming", authToken, 16384, multiMsgCb, (void *)&userdata, sizeof(lyuba_multi_cb_t_with_lyuba_t)))) {
+        Serial.printf("stream multi err\r\n");
+    } else {
+        Serial.printf("stream multi ok\r\n");
+        httpc_set_deadlines(h, &lyuba->streamDeadlines);
+    }
+    if (HTTPC_HANDLE_NONE == h) {
+        if (streamCb != NULL) {
+            streamCb(false, -1, NULL, NULL);
+        }
+        if (eventCb != NULL) {
+            eventCb(false, -1, NULL, NULL, 0);
+        }
     }
-    return req;
+    return h;
 }
 
 static httpc_err_t authAppPostCb(httpc_err_t err, httpc_req_t *req, int status_code, const char *data, size_t len) {
@@ -335,10 +1518,11 @@ static httpc_err_t authAppPostCb(httpc_err_t err, httpc_req_t *req, int status_c
     Serial.printf("authAppPostCb! status=%d err=%d len=%d\r\n", status_code, (int)err, (int)len);
     Serial.printf("data='%s'\r\n", data);
 
-    if (NULL == (json = cJSON_Parse(data))) {
+    if (NULL == (json = cJSON_ParseWithArena(data, &jsonArena))) {
+        cJSON_ArenaReset(&jsonArena);
         Serial.printf("authAppPostCb: Bad JSON\r\n");
         if (NULL != userdata->authCb) {
-            userdata->authCb(false, NULL);
+            callAuth(userdata->lyuba, userdata->authCb, false, NULL);
         }
         return HTTPC_ERR_FAIL;
     } else {
@@ -346,25 +1530,25 @@ static httpc_err_t authAppPostCb(httpc_err_t err, httpc_req_t *req, int status_c
         if (NULL == (json_client_id = cJSON_GetObjectItem(json, "client_id"))) {
             Serial.printf("authAppPostCb: missing client_id\r\n");
             if (NULL != userdata->authCb) {
-                userdata->authCb(false, NULL);
+                callAuth(userdata->lyuba, userdata->authCb, false, NULL);
             }
-            cJSON_Delete(json);
+            cJSON_ArenaReset(&jsonArena);
             return HTTPC_ERR_FAIL;
         }
         if (NULL == (json_client_secret = cJSON_GetObjectItem(json, "client_secret"))) {
             Serial.printf("authAppPostCb: missing client_secret\r\n");
             if (NULL != userdata->authCb) {
-                userdata->authCb(false, NULL);
+                callAuth(userdata->lyuba, userdata->authCb, false, NULL);
             }
-            cJSON_Delete(json);
+            cJSON_ArenaReset(&jsonArena);
             return HTTPC_ERR_FAIL;
         }
         if (!cJSON_IsString(json_client_id) || !cJSON_IsString(json_client_secret)) {
             Serial.printf("authAppPostCb: bad types in json\r\n");
             if (NULL != userdata->authCb) {
-                userdata->authCb(false, NULL);
+                callAuth(userdata->lyuba, userdata->authCb, false, NULL);
             }
-            cJSON_Delete(json);
+            cJSON_ArenaReset(&jsonArena);
             return HTTPC_ERR_FAIL;
         }
 #ifdef LYUBA_DEBUG
@@ -373,12 +1557,12 @@ static httpc_err_t authAppPostCb(httpc_err_t err, httpc_req_t *req, int status_c
 
         if (NULL == (userdata->lyuba->client_id = strdup(json_client_id->valuestring))) {
             Serial.printf("Out of mem for client id\r\n");
-            cJSON_Delete(json);
+            cJSON_ArenaReset(&jsonArena);
             return HTTPC_ERR_FAIL;
         }
         if (NULL == (userdata->lyuba->client_secret = strdup(json_client_secret->valuestring))) {
             Serial.printf("Out of mem for client id\r\n");
-            cJSON_Delete(json);
+            cJSON_ArenaReset(&jsonArena);
             return HTTPC_ERR_FAIL;
         }
 
@@ -386,7 +1570,7 @@ static httpc_err_t authAppPostCb(httpc_err_t err, httpc_req_t *req, int status_c
         userdata->lyuba->authGetToken = true;
         userdata->lyuba->authCb = userdata->authCb;
 
-        cJSON_Delete(json);
+        cJSON_ArenaReset(&jsonArena);
     }
 
     return HTTPC_ERR_OK;
@@ -400,7 +1584,7 @@ void lyuba_authenticate(lyuba_t *lyuba, lyuba_auth_cb_t _authCb) {
     userdata.lyuba = lyuba;
 
     snprintf(postBuf, sizeof(postBuf), "client_name=%s&redirect_uris=urn:ietf:wg:oauth:2.0:oob&scopes=write read follow&website=%s", MASTODON_CLIENT_NAME, MASTODON_CLIENT_URL);
-    if (NULL == httpc_post(lyuba->host, "/api/v1/apps", NULL, postBuf, 4096, false, authAppPostCb, (void *)&userdata, sizeof(lyuba_auth_cb_t_with_lyuba_t))) {
+    if (HTTPC_HANDLE_NONE == httpc_post(lyuba->host, "/api/v1/apps", NULL, postBuf, 4096, false, authAppPostCb, (void *)&userdata, sizeof(lyuba_auth_cb_t_with_lyuba_t))) {
         Serial.printf("post err\r\n");
         _authCb(false, NULL);
     } else {
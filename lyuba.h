@@ -3,10 +3,130 @@
 
 #include <stdbool.h>
 #include "httpc.h"
+#include "spscq.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
 
 typedef void (*lyuba_auth_cb_t)(bool ok, const char *authToken);
 typedef void (*lyuba_toot_cb_t)(bool ok);
 typedef void (*lyuba_stream_cb_t)(bool ok, const char *username, const char *content);
+// event is the stream event type, e.g. "delete", data its payload as sent (JSON, or a status id for deletes)
+typedef void (*lyuba_event_cb_t)(bool ok, const char *event, const char *data, size_t len);
+
+// as above, for lyuba_stream_multi(), stream is the index of the stream the event arrived on
+typedef void (*lyuba_multi_stream_cb_t)(bool ok, int stream, const char *username, const char *content);
+typedef void (*lyuba_multi_event_cb_t)(bool ok, int stream, const char *event, const char *data, size_t len);
+
+#define LYUBA_MAX_STREAMS 8     // per lyuba_stream_multi() connection
+
+// statuses posted while a stream reconnects are fetched from its timeline a page at a time, see lyuba_stream_events()
+#ifndef LYUBA_BACKFILL_PAGE
+#define LYUBA_BACKFILL_PAGE 4
+#endif
+// room for a page of statuses, a page that doesn't fit ends the backfill early
+#ifndef LYUBA_BACKFILL_BUF
+#define LYUBA_BACKFILL_BUF 24576
+#endif
+
+// bytes of toots waiting in the lyuba_queue_toot() queue
+#ifndef LYUBA_QUEUE_SIZE
+#define LYUBA_QUEUE_SIZE 2048
+#endif
+// longest status queued toots are coalesced into, Mastodon's default limit is 500 characters
+#ifndef LYUBA_TOOT_MAX_LEN
+#define LYUBA_TOOT_MAX_LEN 500
+#endif
+// longest wait before a queued toot that failed is tried again, the wait doubles from the queue's interval
+#ifndef LYUBA_QUEUE_RETRY_MAX_MS
+#define LYUBA_QUEUE_RETRY_MAX_MS 300000
+#endif
+// With persist, the queue is written to flash once a change to it has waited this long, so toots posted straight
+// away never are and waiting ones at most once per LYUBA_QUEUE_SAVE_MS. Each write is up to LYUBA_QUEUE_SIZE bytes
+// of NVS, whose sectors last about 100000 erases: offline, one every minute erases each sector of a 20 KB NVS
+// partition some 150 times a day. Toots queued or posted in the last LYUBA_QUEUE_SAVE_MS before a power cut are lost
+// or posted again after it. 0 writes on every change.
+#ifndef LYUBA_QUEUE_SAVE_MS
+#define LYUBA_QUEUE_SAVE_MS 60000
+#endif
+
+// Callbacks made from the httpc task (stream events, toot and auth results) are queued for lyuba_loop() to make on
+// the caller's task, so a slow callback doesn't hold up the network. Bytes of callbacks waiting, each 32 bytes or so
+// plus its strings (a status's username and content, an event's data), rounded down to a power of 2. A callback
+// larger than half of it may be dropped. 0 makes them on the httpc task as they happen, without lyuba_loop().
+#ifndef LYUBA_CALLBACK_QUEUE_SIZE
+#define LYUBA_CALLBACK_QUEUE_SIZE 8192
+#endif
+// What the httpc task does when the callback queue is full, see lyuba_t callsOverflow. Pipelined, the same goes for
+// the decode queue. Dropping keeps the network going whatever the callbacks do, but a burst that outruns lyuba_loop()
+// loses statuses. Waiting loses none unless lyuba_loop() falls behind for LYUBA_CALLBACK_WAIT_MS, but every
+// connection stalls meanwhile, heartbeats and websocket pings included.
+#define LYUBA_CALLBACK_WAIT 0   // wait for lyuba_loop() to make room, up to LYUBA_CALLBACK_WAIT_MS, then drop it
+#define LYUBA_CALLBACK_DROP 1   // drop it
+#ifndef LYUBA_CALLBACK_OVERFLOW
+#define LYUBA_CALLBACK_OVERFLOW LYUBA_CALLBACK_DROP
+#endif
+#ifndef LYUBA_CALLBACK_WAIT_MS
+#define LYUBA_CALLBACK_WAIT_MS 1000
+#endif
+// Toot and auth results and a stream's refusal are never dropped, whatever callsOverflow says, as something may be
+// waiting on them. They may use these last bytes of the queue, which statuses and events leave free (a quarter of
+// the queue at most), and wait for lyuba_loop() for as long as it takes once that's gone too.
+#ifndef LYUBA_CALLBACK_RESERVE
+#define LYUBA_CALLBACK_RESERVE 512
+#endif
+
+typedef struct {
+    size_t size;                // bytes in the queue, 0 if callbacks are made on the httpc task
+    size_t used;
+    size_t highWater;
+    unsigned long queued;
+    unsigned long dropped;      // full, or too big
+    unsigned long waits;        // callbacks the httpc task had to wait for room for
+} lyuba_callback_stats_t;
+
+// records from one task for another, callbacks for lyuba_loop() or stream events for the decode task
+typedef struct {
+    spscq_t ring;
+    SemaphoreHandle_t room;         // given by the consumer once there's room, if the producer is waiting for it
+    SemaphoreHandle_t work;         // given by the producer if the consumer is waiting for a record, NULL if it polls
+    bool waiting;                   // the producer is waiting for room
+    bool idle;                      // the consumer is waiting for a record
+    bool dropping;                  // dropped the last one, don't wait for room again until one fits
+    lyuba_callback_stats_t stats;   // written by the producer
+} lyuba_callq_t;
+
+// Pipelined, the httpc task reads sockets, frames lines and parses SSE, and hands each stream event to a decode
+// task for the JSON extraction and HTML stripping. On an ESP32, pin the httpc task to the WiFi core (0) and the
+// decode task to the other. Streams' callbacks are made in order whichever task they came from.
+#ifndef LYUBA_DECODE_TASK_PRIORITY
+#define LYUBA_DECODE_TASK_PRIORITY tskIDLE_PRIORITY
+#endif
+#ifndef LYUBA_DECODE_TASK_STACK_SIZE
+#define LYUBA_DECODE_TASK_STACK_SIZE 4096
+#endif
+#ifndef LYUBA_DECODE_TASK_CORE
+#define LYUBA_DECODE_TASK_CORE tskNO_AFFINITY
+#endif
+// bytes of stream events waiting to be decoded, an event over half of it is decoded on the httpc task
+#ifndef LYUBA_DECODE_QUEUE_SIZE
+#define LYUBA_DECODE_QUEUE_SIZE 32768
+#endif
+
+typedef struct {
+    httpc_task_config_t net;        // the httpc task, used if it isn't running yet
+    bool pipelined;
+    httpc_task_config_t decode;     // the decode task
+    size_t decodeQueueSize;
+    httpc_deadlines_t streams;      // of streams, e.g. heartbeatMs and stallHeartbeats for how soon a silent one reconnects
+    httpc_deadlines_t toots;        // of lyuba_toot() and queued toots, e.g. totalMs to give up on a post
+} lyuba_config_t;
+
+// stream event types, see https://docs.joinmastodon.org/methods/streaming/#events
+#define LYUBA_EVENT_UPDATE          0x01    // a new status, to the stream callback
+#define LYUBA_EVENT_STATUS_UPDATE   0x02    // an edited status, to the stream callback
+#define LYUBA_EVENT_DELETE          0x04    // the rest to the event callback
+#define LYUBA_EVENT_NOTIFICATION    0x08
+#define LYUBA_EVENT_OTHER           0x80    // any type not listed above
 
 typedef struct {
     const char *host;
@@ -18,18 +138,82 @@ typedef struct {
 // FIXME move authCb into lyuba_conn_t (wrapper for httpc_req, may need an extra userdata in it for this?)
     lyuba_auth_cb_t authCb; // needs storing here for 2-phase auth
     char negotiated_bearer_access_token[256];
+    // toot queue, only touched from lyuba_loop() and the calling task
+    char *queue;            // queued toots NUL terminated back to back, oldest first, NULL until lyuba_queue_start()
+    size_t queueLen;
+    char queueAuth[256];
+    lyuba_toot_cb_t queueCb;
+    unsigned long queueIntervalMs;
+    unsigned long queueCoalesceMs;
+    bool queuePersist;
+    bool queueDirty;                // changed since it was last written to flash
+    unsigned long queueDirtySince;  // millis() of the first change since
+    bool queueSaved;                // flash holds a copy
+    unsigned long queueTailSince;   // millis() when the newest queued toot was started, it takes more until queueCoalesceMs
+    unsigned long queueNextAt;      // millis() before which nothing is posted
+    unsigned long queueRetryMs;     // wait after the last failure, 0 after a success
+    bool queueSending;              // the oldest toot is being posted
+    volatile int queueResult;       // its status once the post is over, -1 if it failed, set on the httpc task
+    // callback queue, pushed to on the httpc task (the decode task if pipelined) and drained by lyuba_loop()
+    lyuba_callq_t calls;
+    int callsOverflow;              // LYUBA_CALLBACK_WAIT or LYUBA_CALLBACK_DROP, may be changed after lyuba_init()
+    // pipelined, stream events from the httpc task for the decode task, ring size 0 if not
+    lyuba_callq_t decodes;
+    TaskHandle_t decodeTask;
+    bool decodeStop;                // set by lyuba_term(), cleared by the decode task as it finishes
+    SemaphoreHandle_t decodeDone;   // given by the decode task once a stream the httpc task waits on is decoded
+    bool decodeWaiting;             // the httpc task is waiting for a stream's events to be decoded
+    httpc_deadlines_t streamDeadlines;
+    httpc_deadlines_t tootDeadlines;
 } lyuba_t;
 
-typedef httpc_req_t * lyuba_conn_t;
+// a stream, HTTPC_HANDLE_NONE if it couldn't be made. Safe to close after it has ended.
+typedef httpc_handle_t lyuba_conn_t;
 
 lyuba_t *lyuba_init(const char *host, const char *username, const char *password);
+// not pipelined, tasks from the HTTPC_TASK_ and LYUBA_DECODE_TASK_ defaults, deadlines from the HTTPC_ ones
+void lyuba_config_default(lyuba_config_t *cfg);
+// as lyuba_init(), with the tasks and deadlines as in cfg
+lyuba_t *lyuba_init_config(const char *host, const char *username, const char *password, const lyuba_config_t *cfg);
 void lyuba_term(lyuba_t *lyuba);
+// call regularly from the task that wants the callbacks, it makes those queued since the last call
 void lyuba_loop(lyuba_t *lyuba);
 void lyuba_authenticate(lyuba_t *lyuba, lyuba_auth_cb_t cb);
 const char *lyuba_getAuthToken(lyuba_t *lyuba);
 void lyuba_toot(lyuba_t *lyuba, const char *authToken, const char *msg, lyuba_toot_cb_t cb);
+// Queue toots to be posted one at a time from lyuba_loop(), at least intervalMs apart. A toot that can't be posted
+// (no network, server errors, rate limited) stays queued and is tried again after a growing wait, so toots made
+// while offline go out once the connection is back. A post that failed after it was sent may be posted twice.
+// With coalesceMs > 0 a toot is held that long so toots queued meanwhile are added to it, one per line, up to
+// LYUBA_TOOT_MAX_LEN. With persist the queue is kept in flash (Preferences), written as LYUBA_QUEUE_SAVE_MS says,
+// and picked up again here after a restart.
+// cb (may be NULL) is called from lyuba_loop() for each status posted, or refused by the server and dropped.
+void lyuba_queue_start(lyuba_t *lyuba, const char *authToken, unsigned long intervalMs, unsigned long coalesceMs, bool persist, lyuba_toot_cb_t cb);
+// msg is sent as for lyuba_toot(), false if the queue hasn't been started or hasn't room for it
+bool lyuba_queue_toot(lyuba_t *lyuba, const char *msg);
+// bytes of toots still queued, 0 once everything has been posted
+size_t lyuba_queue_pending(lyuba_t *lyuba);
+// with persist, write changes to the queue to flash now rather than after LYUBA_QUEUE_SAVE_MS, e.g. before a deep
+// sleep or a restart. lyuba_term() does too.
+void lyuba_queue_save(lyuba_t *lyuba);
 lyuba_conn_t lyuba_stream(lyuba_t *lyuba, const char *authToken, const char *tag, lyuba_stream_cb_t cb);
+// as lyuba_stream, but for the LYUBA_EVENT_ types in events. Events of other types are skipped without being parsed.
+// When the stream ends and reconnects, new statuses posted meanwhile are fetched from the matching timeline and passed
+// to streamCb first, oldest first, so each new status is delivered once (public, hashtag, list and user streams).
+lyuba_conn_t lyuba_stream_events(lyuba_t *lyuba, const char *authToken, const char *tag, unsigned events, lyuba_stream_cb_t streamCb, lyuba_event_cb_t eventCb);
+// several streams over a single websocket connection, each named as for lyuba_stream's tag (e.g. "public",
+// "hashtag?tag=cheerlights", "list?list=42"). Events are dispatched by the stream they arrived on, as for lyuba_stream_events.
+lyuba_conn_t lyuba_stream_multi(lyuba_t *lyuba, const char *authToken, const char *const *streams, int nstreams, unsigned events, lyuba_multi_stream_cb_t streamCb, lyuba_multi_event_cb_t eventCb);
+// callbacks already queued for the connection are still made by the next lyuba_loop()
 void lyuba_close(lyuba_t *lyuba, lyuba_conn_t conn);
+// reconnect counts and backoff of a stream. Streams reconnect after transport errors, 429s and 5xxs with a growing
+// backoff, a refusal such as a 401 ends them with a callback with ok false.
+httpc_err_t lyuba_stream_stats(lyuba_t *lyuba, lyuba_conn_t conn, httpc_reconnect_stats_t *stats);
+// how full the callback queue has been and what it has dropped
+void lyuba_callback_stats(lyuba_t *lyuba, lyuba_callback_stats_t *stats);
+// the same for the decode queue, size 0 if not pipelined. Waits are the httpc task waiting for the decode task,
+// dropped are events too big for the queue, decoded on the httpc task instead, and those dropped as callsOverflow says.
+void lyuba_decode_stats(lyuba_t *lyuba, lyuba_callback_stats_t *stats);
 
 #endif
 
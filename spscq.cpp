@@ -0,0 +1,91 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "spscq.h"
+
+// each record starts with its length, a record of SPSCQ_WRAP says the rest of the ring is unused
+#define SPSCQ_HDR 8
+#define SPSCQ_WRAP 0xffffffffU
+#define SPSCQ_ALIGN(n) (((n) + 7) & ~(size_t)7)
+
+int spscq_init(spscq_t *q, size_t size) {
+    memset(q, 0x00, sizeof(spscq_t));
+    if (size < 2 * SPSCQ_HDR || size > 0x80000000U) {
+        return 1;
+    }
+    q->size = 1;
+    while (q->size * 2 <= size) {
+        q->size *= 2;
+    }
+    if (NULL == (q->buf = (char *)malloc(q->size))) {
+        q->size = 0;
+        return 1;
+    }
+    return 0;
+}
+
+void spscq_term(spscq_t *q) {
+    free(q->buf);
+    memset(q, 0x00, sizeof(spscq_t));
+}
+
+void *spscq_reserve(spscq_t *q, size_t len) {
+    size_t rec = SPSCQ_ALIGN(SPSCQ_HDR + len);
+    uint32_t used = q->head - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+    uint32_t pos = q->head & (q->size - 1);
+    uint32_t end = q->size - pos;
+
+    if (rec > q->size) {
+        return NULL;
+    }
+    if (rec <= end) {
+        q->reserved = pos;
+        q->skip = 0;
+    } else {
+        q->reserved = 0;    // start again at the beginning
+        q->skip = end;
+    }
+    if (q->skip + rec > q->size - used) {
+        return NULL;
+    }
+    return q->buf + q->reserved + SPSCQ_HDR;
+}
+
+void spscq_push(spscq_t *q, size_t len) {
+    if (q->skip > 0) {
+        *(uint32_t *)(q->buf + (q->head & (q->size - 1))) = SPSCQ_WRAP;
+    }
+    *(uint32_t *)(q->buf + q->reserved) = (uint32_t)len;
+    // the record is written before the consumer can see it
+    __atomic_store_n(&q->head, q->head + q->skip + (uint32_t)SPSCQ_ALIGN(SPSCQ_HDR + len), __ATOMIC_RELEASE);
+}
+
+void *spscq_peek(spscq_t *q, size_t *len) {
+    uint32_t tail = q->tail;
+    uint32_t pos, rec;
+
+    if (tail == __atomic_load_n(&q->head, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    pos = tail & (q->size - 1);
+    if (SPSCQ_WRAP == (rec = *(uint32_t *)(q->buf + pos))) {
+        tail += q->size - pos;  // the record follows at the beginning, pushed along with the wrap
+        pos = 0;
+        rec = *(uint32_t *)q->buf;
+    }
+    q->next = tail + (uint32_t)SPSCQ_ALIGN(SPSCQ_HDR + rec);
+    *len = rec;
+    return q->buf + pos + SPSCQ_HDR;
+}
+
+size_t spscq_pop(spscq_t *q) {
+    uint32_t freed = q->next - q->tail;
+
+    // done reading before the producer can reuse it
+    __atomic_store_n(&q->tail, q->next, __ATOMIC_RELEASE);
+    return freed;
+}
+
+size_t spscq_used(spscq_t *q) {
+    return __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,36 @@
+#ifndef SPSCQ_H
+#define SPSCQ_H 1
+
+// Single producer, single consumer queue of variable length records, in a fixed ring of bytes and without locks.
+// One task pushes and one other pops, each only moving its own end of the ring. A record is contiguous, so one that
+// won't fit before the end of the ring starts again at the beginning, and one over half the ring may never fit.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+    char *buf;
+    uint32_t size;      // a power of 2
+    uint32_t head;      // bytes ever pushed, written by the producer, wraps
+    uint32_t tail;      // bytes ever popped, written by the consumer
+    uint32_t reserved;  // producer only, offset of the record being filled in
+    uint32_t skip;      // producer only, bytes left unused at the end of the ring before it
+    uint32_t next;      // consumer only, tail after the record being read
+} spscq_t;
+
+// size is rounded down to a power of 2, returns non-zero if out of memory
+int spscq_init(spscq_t *q, size_t size);
+void spscq_term(spscq_t *q);
+// producer, room for a record of len bytes (8 byte aligned), NULL if there isn't any yet. Fill it in, then spscq_push().
+void *spscq_reserve(spscq_t *q, size_t len);
+// producer, the reserved record, len at most as reserved, is ready to be popped
+void spscq_push(spscq_t *q, size_t len);
+// consumer, the oldest record and its length, NULL if there's none. It stays put until spscq_pop().
+void *spscq_peek(spscq_t *q, size_t *len);
+// consumer, done with the record from spscq_peek(), returns the bytes of the ring it gave back
+size_t spscq_pop(spscq_t *q);
+// bytes of the ring in use, from either side
+size_t spscq_used(spscq_t *q);
+
+#endif
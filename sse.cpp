@@ -0,0 +1,104 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "sse.h"
+
+void sse_init(sse_parser_t *sse) {
+    memset(sse, 0x00, sizeof(sse_parser_t));
+    sse->retryMs = -1;
+}
+
+void sse_reset(sse_parser_t *sse) {
+    sse->event[0] = '\0';
+    sse->data = NULL;
+    sse->dataLen = 0;
+    sse->dataOff = 0;
+    sse->haveData = false;
+    sse->dispatched = false;
+}
+
+bool sse_holding(const sse_parser_t *sse) {
+    return sse->haveData;
+}
+
+const char *sse_event_type(const sse_parser_t *sse) {
+    return sse->event[0] != '\0' ? sse->event : "message";
+}
+
+static bool field_is(const char *name, size_t nameLen, const char *field) {
+    return nameLen == strlen(field) && 0 == memcmp(name, field, nameLen);
+}
+
+sse_line_t sse_parse_line(sse_parser_t *sse, char *kept, char *line, size_t len) {
+    const char *colon;
+    size_t nameLen;
+    char *value;
+    size_t valueLen;
+
+    if (sse->dispatched) {
+        sse_reset(sse);
+    }
+
+    if (len == 0) {     // blank line, dispatch
+        if (!sse->haveData) {
+            sse->event[0] = '\0';
+            return SSE_LINE_NONE;
+        }
+        sse->data = kept + sse->dataOff;
+        sse->data[sse->dataLen] = '\0';
+        sse->haveData = false;
+        sse->dispatched = true;
+        return SSE_LINE_EVENT;
+    }
+    if (line[0] == ':') {
+        return SSE_LINE_COMMENT;
+    }
+
+    // "name: value", the space after the colon is optional, no colon is a name with an empty value
+    if (NULL != (colon = (const char *)memchr(line, ':', len))) {
+        nameLen = colon - line;
+        value = line + nameLen + 1;
+        if (value < line + len && *value == ' ') {
+            value++;
+        }
+        valueLen = (line + len) - value;
+    } else {
+        nameLen = len;
+        value = line + len;
+        valueLen = 0;
+    }
+
+    if (field_is(line, nameLen, "data")) {
+        if (!sse->haveData) {
+            // the first data line is left where it is, this line becomes the start of the kept ones
+            sse->haveData = true;
+            sse->dataOff = value - kept;
+            sse->dataLen = valueLen;
+        } else {
+            // later ones are moved down to follow it, the bytes between are spare
+            char *end = kept + sse->dataOff + sse->dataLen;
+            *end++ = '\n';
+            memmove(end, value, valueLen);
+            sse->dataLen += 1 + valueLen;
+        }
+    } else if (field_is(line, nameLen, "event")) {
+        size_t n = valueLen < sizeof(sse->event) - 1 ? valueLen : sizeof(sse->event) - 1;
+        memcpy(sse->event, value, n);
+        sse->event[n] = '\0';
+    } else if (field_is(line, nameLen, "id")) {
+        if (valueLen < sizeof(sse->lastId)) {
+            memcpy(sse->lastId, value, valueLen);
+            sse->lastId[valueLen] = '\0';
+        }
+    } else if (field_is(line, nameLen, "retry")) {
+        long ms = 0;
+        size_t i;
+        for (i = 0; i < valueLen && value[i] >= '0' && value[i] <= '9'; i++) {
+            ms = ms * 10 + (value[i] - '0');
+        }
+        if (i == valueLen && valueLen > 0) {
+            sse->retryMs = ms;
+        }
+    }
+    return SSE_LINE_NONE;
+}
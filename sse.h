@@ -0,0 +1,42 @@
+#ifndef SSE_H
+#define SSE_H 1
+
+// Server-Sent Events parser, fed one line at a time (without its newline). Data lines are joined in the
+// caller's line storage rather than copied out, so the caller keeps lines from the first data line of an
+// event until the blank line that dispatches it, see sse_holding().
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#define SSE_MAX_EVENT_LEN 32    // longer event types are truncated
+#define SSE_MAX_ID_LEN 64       // longer ids are ignored
+
+typedef enum {
+    SSE_LINE_NONE,      // a field or nothing, no action needed
+    SSE_LINE_EVENT,     // an event was dispatched, see event, data and dataLen
+    SSE_LINE_COMMENT    // a comment (e.g. a heartbeat), the text follows the ':'
+} sse_line_t;
+
+typedef struct {
+    char event[SSE_MAX_EVENT_LEN];  // type of the event being read, or dispatched, "" until an event field
+    char lastId[SSE_MAX_ID_LEN];    // last event id received, "" if none
+    long retryMs;                   // reconnection time asked for by the server, -1 if none
+    char *data;         // a dispatched event's data lines joined with '\n', NUL terminated, may be modified
+    size_t dataLen;
+    size_t dataOff;     // offset of the data so far from the kept lines
+    bool haveData;      // a data field has been seen since the last dispatch
+    bool dispatched;    // the last line dispatched an event, clear it on the next
+} sse_parser_t;
+
+void sse_init(sse_parser_t *sse);
+// forget any partly read event, e.g. when lines were lost or the connection restarted. lastId and retryMs are kept.
+void sse_reset(sse_parser_t *sse);
+// parse a line, kept points at the first line held since sse_holding() last went true (it may have moved since,
+// but must be in order and unaltered) and line points at this one, which may be modified
+sse_line_t sse_parse_line(sse_parser_t *sse, char *kept, char *line, size_t len);
+// must the caller keep this line, and those kept before it, for a later one?
+bool sse_holding(const sse_parser_t *sse);
+// the type of a dispatched event, "message" if none was given
+const char *sse_event_type(const sse_parser_t *sse);
+
+#endif